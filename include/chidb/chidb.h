@@ -69,6 +69,12 @@ int chidb_open(const char *file, chidb **db);
  * - stmt: Out parameter. Returns a pointer to a chidb_stmt. The chidb_stmt
  *         type is an opaque type representing a prepared SQL statement.
  *
+ * SELECT and INSERT statements that differ only in their integer and
+ * string literals share one compiled program, kept by the connection
+ * until the schema changes. The literals of such a statement are not
+ * parameters: they are not counted by chidb_bind_parameter_count and
+ * cannot be bound again.
+ *
  * Return
  * - CHIDB_OK: Operation successful
  * - CHIDB_EINVALIDSQL: Invalid SQL
@@ -98,10 +104,87 @@ int chidb_prepare(chidb *db, const char *sql, chidb_stmt **stmt);
  * Return
  * - CHIDB_ROW: Statement returned a row.
  * - CHIDB_DONE: Statement has finished executing.
+ * - CHIDB_EMISMATCH: A value bound to a parameter does not have the
+ *                    type of the column it is used with
  */
 int chidb_step(chidb_stmt *stmt);
 
 
+/* Resets a prepared SQL statement
+ *
+ * Rewinds the statement so that chidb_step will run it again from the
+ * beginning, without parsing and generating code for the SQL statement
+ * again. The values bound to its parameters are kept, so only the ones
+ * that change have to be bound again.
+ *
+ * Parameters
+ * - stmt: Prepared SQL statement
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_reset(chidb_stmt *stmt);
+
+
+/* Returns the number of parameters in a SQL statement
+ *
+ * A SQL statement can have parameters in place of literal values:
+ * "?" is a new parameter each time it appears, while ":name" is the
+ * same parameter each time it appears. Parameters are numbered from 1,
+ * in the order in which they first appear in the statement. A parameter
+ * that has no value bound to it is NULL.
+ *
+ * Parameters
+ * - stmt: Prepared SQL statement
+ *
+ * Return
+ * - Number of parameters (the largest parameter number)
+ */
+int chidb_bind_parameter_count(chidb_stmt *stmt);
+
+
+/* Returns the number of a named parameter
+ *
+ * Parameters
+ * - stmt: Prepared SQL statement
+ * - name: Name of the parameter, including the colon (e.g., ":id")
+ *
+ * Return
+ * - Parameter number, or 0 if there is no such parameter
+ */
+int chidb_bind_parameter_index(chidb_stmt *stmt, const char *name);
+
+
+/* Binds an integer value to a parameter
+ *
+ * Parameters
+ * - stmt: Prepared SQL statement
+ * - param: Parameter (parameters are numbered from 1)
+ * - value: Integer value
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: There is no such parameter
+ */
+int chidb_bind_int(chidb_stmt *stmt, int param, int value);
+
+
+/* Binds a string value to a parameter
+ *
+ * Parameters
+ * - stmt: Prepared SQL statement
+ * - param: Parameter (parameters are numbered from 1)
+ * - value: Null-terminated string. The string is copied, so the API
+ *          client can free it as soon as this function returns.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: There is no such parameter
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_bind_text(chidb_stmt *stmt, int param, const char *value);
+
+
 /* Finalizes a SQL statement, freeing all resources associated with it.
  *
  * Parameters
@@ -180,6 +263,75 @@ int chidb_column_int(chidb_stmt *stmt, int col);
 const char *chidb_column_text(chidb_stmt *stmt, int col);
 
 
+/* Begins a transaction
+ *
+ * By default, each statement is committed as soon as it finishes
+ * running. After this function is called, the changes made by
+ * statements are kept in memory (and in the write-ahead log) until
+ * chidb_commit is called, and are then made durable together, with a
+ * single sync. Running a BEGIN statement has the same effect.
+ *
+ * Parameters
+ * - db: chidb database
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: A transaction has already begun
+ */
+int chidb_begin(chidb *db);
+
+
+/* Commits a transaction
+ *
+ * Running a COMMIT statement has the same effect. If the transaction
+ * cannot be committed, it remains open, and can be rolled back.
+ *
+ * Parameters
+ * - db: chidb database
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: No transaction has begun
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_commit(chidb *db);
+
+
+/* Rolls back a transaction
+ *
+ * Every change made since the transaction began is discarded.
+ * Running a ROLLBACK statement has the same effect.
+ *
+ * Parameters
+ * - db: chidb database
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: No transaction has begun
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_rollback(chidb *db);
+
+
+/* Sets the memory used to sort the rows of an ORDER BY
+ *
+ * Rows in excess of this number of bytes are sorted in runs that are
+ * written to a temporary file, and merged when the rows are returned.
+ * Only statements prepared after this function is called use the new
+ * value.
+ *
+ * Parameters
+ * - db: chidb database
+ * - bytes: Bytes of rows kept in memory by each sort (0 for the default)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_set_sort_memory(chidb *db, uint32_t bytes);
+
+
 /* Closes a chidb database
  *
  * Parameters
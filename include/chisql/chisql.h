@@ -18,6 +18,9 @@
 #define STMT_SELECT (1)
 #define STMT_INSERT (2)
 #define STMT_DELETE (3)
+#define STMT_BEGIN (4)
+#define STMT_COMMIT (5)
+#define STMT_ROLLBACK (6)
 
 typedef struct chisql_statement
 {
@@ -30,6 +33,10 @@ typedef struct chisql_statement
         Insert_t *insert;
         Delete_t *delete;
     } stmt;
+    /* Parameters (? and :name). params[i] is the name of parameter i+1,
+     * or NULL if it is a ? */
+    int nparams;
+    char **params;
 } chisql_statement_t;
 
 int chisql_parser(const char *sql, chisql_statement_t **stmt);
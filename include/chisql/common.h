@@ -29,7 +29,8 @@ enum data_type {
    TYPE_INT,
    TYPE_DOUBLE,
    TYPE_CHAR,
-   TYPE_TEXT
+   TYPE_TEXT,
+   TYPE_PARAM  /* A parameter (? or :name), whose value is bound later */
 };
 
 typedef struct StrList_t {
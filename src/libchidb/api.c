@@ -60,62 +60,86 @@ int chidb_stmt_optimize(chidb *db,
 // --------- My Code Begin ---------
 
 // Step 1
-// 读取Schema表
-int load_schema(chidb *db, npage_t nroot)
+// 读取Schema表中key大于db->schema.last_key的行
+// 用游标逐行遍历, 而不是递归地读取每个结点; 行中的sql在用到时才解析
+static int load_schema(chidb *db)
 {
-	Btree *bt = db->bt;
+	chidb_dbm_cursor_t c;
+	int rc;
 
-	// 读取nroot页
-	BTreeNode *btn;
-	chidb_Btree_getNodeByPage(bt, nroot, &btn);
+	if ((rc = chidb_Btree_getSchemaCookie(db->bt, &db->schema_cookie)) != CHIDB_OK)
+		return rc;
 
-	// 遍历当前页面的所有cells
-	int i;
-	for (i = 0; i < btn->n_cells; ++i)
+	if ((rc = chidb_dbm_cursor_init(db->bt, &c, 1, 5)) != CHIDB_OK)
+		return rc;
+
+	// 之前读取过的行不再读取
+	if (db->schema.last_key == 0)
+		rc = chidb_dbm_cursor_rewind(db->bt, &c);
+	else
+		rc = chidb_dbm_cursor_seek(db->bt, &c, db->schema.last_key, SEEKGT);
+
+	while (rc == CHIDB_OK)
 	{
-		BTreeCell *cell = malloc(sizeof(BTreeCell));
-		chidb_Btree_getCell(btn, i, cell);
+		DBRecordView *dbrv = chidb_dbm_cursor_record(&c);
+		const char *s;
+		int len;
 
-		// 如果是页表内部结点
-		if (btn->type == PGTYPE_TABLE_INTERNAL)
+		// 为schema中的一行申请空间
+		chidb_schema_item_t *item = malloc(sizeof(chidb_schema_item_t));
+		if (item == NULL)
 		{
-			load_schema(db, cell->fields.tableInternal.child_page);
+			rc = CHIDB_ENOMEM;
+			break;
 		}
-		// 如果是页表叶子结点
-		else if (btn->type == PGTYPE_TABLE_LEAF)
-		{
-			DBRecord *dbr;
-			chidb_DBRecord_unpack(&dbr, cell->fields.tableLeaf.data);
-			// 为schema中的一行申请空间
-			chidb_schema_item_t *item = malloc(sizeof(chidb_schema_item_t));
-			// 将Record中的字段写入schema
-			chidb_DBRecord_getString(dbr, 0, &item->type);
-			chidb_DBRecord_getString(dbr, 1, &item->name);
-			chidb_DBRecord_getString(dbr, 2, &item->assoc);
-			chidb_DBRecord_getInt32 (dbr, 3, &item->root_page);
-			char *sql;
-			chidb_DBRecord_getString(dbr, 4, &sql);
-			// 解析sql语句写入schema->stmt
-			chisql_parser(sql, &item->stmt);
-			// 将该行加入到db中的schema里
-			list_append(&db->schema, item);
-			// 释放空间
-			free(sql);
-			chidb_DBRecord_destroy(dbr);
-		}
-
-		free(cell);
+		// 将Record中的字段写入schema
+		chidb_DBRecord_viewGetString(dbrv, 0, &s, &len);
+		item->type = strndup(s, len);
+		chidb_DBRecord_viewGetString(dbrv, 1, &s, &len);
+		item->name = strndup(s, len);
+		chidb_DBRecord_viewGetString(dbrv, 2, &s, &len);
+		item->assoc = strndup(s, len);
+		chidb_DBRecord_viewGetInt32(dbrv, 3, &item->root_page);
+		chidb_DBRecord_viewGetString(dbrv, 4, &s, &len);
+		item->sql = strndup(s, len);
+		item->stmt = NULL;
+		// 将该行加入到db中的schema里, 同时加入表的索引
+		if ((rc = chidb_schema_add(&db->schema, item)) != CHIDB_OK)
+			break;
+		db->schema.last_key = c.current_cell.key;
+
+		rc = chidb_dbm_cursor_fwd(db->bt, &c);
 	}
 
-	// 如果不是叶子结点, 则还需要加载right page
-	if (btn->type != PGTYPE_TABLE_LEAF)
+	chidb_dbm_cursor_destroy(db->bt, &c);
+
+	// 读到了最后一行
+	return rc == CHIDB_CURSORCANTMOVE ? CHIDB_OK : rc;
+}
+
+// 文件头中的schema cookie改变之后读取新加入的行; 回滚之后重新读取整个schema
+static int refresh_schema(chidb *db)
+{
+	uint32_t cookie;
+	int rc;
+
+	if ((rc = chidb_Btree_getSchemaCookie(db->bt, &cookie)) != CHIDB_OK)
+		return rc;
+	if (!db->need_refresh && cookie == db->schema_cookie)
+		return CHIDB_OK;
+
+	// 缓存的语句中有表的根页码和列, 可能不再有效
+	chidb_stmt_cache_clear(&db->stmt_cache);
+
+	if (db->need_refresh)
 	{
-		load_schema(db, btn->right_page);
+		chidb_schema_destroy(&db->schema);
+		if ((rc = chidb_schema_init(&db->schema)) != CHIDB_OK)
+			return rc;
+		db->need_refresh = 0;
 	}
 
-	// 释放内存
-	chidb_Btree_freeMemNode(bt, btn);
-	return CHIDB_OK;
+	return load_schema(db);
 }
 
 int chidb_open(const char *file, chidb **db)
@@ -126,31 +150,77 @@ int chidb_open(const char *file, chidb **db)
     chidb_Btree_open(file, *db, &(*db)->bt);
 
 	// 初始化schema
-	list_init(&(*db)->schema);
+	chidb_schema_init(&(*db)->schema);
 	// 初始化need_refresh
 	(*db)->need_refresh = 0;
+	(*db)->schema_cookie = 0;
+	// 默认每条语句自动提交
+	(*db)->in_transaction = 0;
+	// 排序时使用默认的内存预算
+	(*db)->sort_memory = 0;
+	// 初始化缓存的语句
+	chidb_stmt_cache_init(&(*db)->stmt_cache);
 	// 读取schema
-	load_schema(*db, 1);
+	load_schema(*db);
 
     return CHIDB_OK;
 }
 
+int chidb_begin(chidb *db)
+{
+	// 不支持嵌套事务
+	if (db->in_transaction)
+		return CHIDB_EMISUSE;
+
+	db->in_transaction = 1;
+	return CHIDB_OK;
+}
+
+int chidb_commit(chidb *db)
+{
+	if (!db->in_transaction)
+		return CHIDB_EMISUSE;
+
+	// 提交失败时事务保持打开, 仍可回滚
+	int rc = chidb_Btree_commit(db->bt);
+	if (rc == CHIDB_OK)
+		db->in_transaction = 0;
+
+	return rc;
+}
+
+int chidb_rollback(chidb *db)
+{
+	if (!db->in_transaction)
+		return CHIDB_EMISUSE;
+
+	db->in_transaction = 0;
+	// 回滚可能撤销了CREATE TABLE, 需要重新load schema
+	db->need_refresh = 1;
+
+	return chidb_Btree_rollback(db->bt);
+}
+
+int chidb_set_sort_memory(chidb *db, uint32_t bytes)
+{
+	db->sort_memory = bytes;
+	// 已经编译的语句使用原来的预算, 需要重新生成
+	chidb_stmt_cache_clear(&db->stmt_cache);
+
+	return CHIDB_OK;
+}
+
 int chidb_close(chidb *db)
 {
+	// 未提交的事务被丢弃
+	if (db->in_transaction)
+		chidb_rollback(db);
+
+	chidb_stmt_cache_clear(&db->stmt_cache);
+
     chidb_Btree_close(db->bt);
 
-	// 不断获取list中的第一个值并释放其中的指针指向的空间
-	while (!list_empty(&db->schema))
-	{
-		chidb_schema_item_t *item = (chidb_schema_item_t *)list_fetch(&db->schema);
-		chisql_statement_free(item->stmt);
-		free(item->type);
-		free(item->name);
-		free(item->assoc);
-		free(item);
-	}
-	// 释放list的空间
-	list_destroy(&db->schema);
+	chidb_schema_destroy(&db->schema);
 
     free(db);
     return CHIDB_OK;
@@ -158,7 +228,8 @@ int chidb_close(chidb *db)
 
 // --------- My Code End ---------
 
-int chidb_prepare(chidb *db, const char *sql, chidb_stmt **stmt)
+// 解析sql并生成代码
+static int chidb_prepare_sql(chidb *db, const char *sql, chidb_stmt **stmt)
 {
     int rc;
     chisql_statement_t *sql_stmt, *sql_stmt_opt;
@@ -193,11 +264,101 @@ int chidb_prepare(chidb *db, const char *sql, chidb_stmt **stmt)
 
     free(sql_stmt_opt);
 
+    // 操作数只在这里检查一次, 执行时不再检查
+    if(rc == CHIDB_OK)
+        rc = chidb_stmt_verify(*stmt);
+
     (*stmt)->explain = sql_stmt->explain;
 
     return rc;
 }
 
+// 将从sql中取出的字面值绑定到参数上, 字面值的类型与读取它的指令不符时返回0
+static int chidb_bind_literals(chidb_stmt *stmt, chidb_stmt_literal_t *lits, int nlits)
+{
+    bool *used = calloc(nlits, sizeof(bool));
+    int ok = 1;
+
+    for(int i = 0; i < stmt->endOp && ok; i++)
+    {
+        chidb_dbm_op_t *op = &stmt->ops[i];
+        if((op->opcode == Op_Integer || op->opcode == Op_String) && op->p3 > 0 && op->p3 <= nlits)
+        {
+            used[op->p3 - 1] = true;
+            if(lits[op->p3 - 1].is_int != (op->opcode == Op_Integer))
+                ok = 0;
+        }
+    }
+
+    for(int i = 0; i < nlits && ok; i++)
+    {
+        if(!used[i])
+            ok = 0;
+        else if(lits[i].is_int)
+            chidb_bind_int(stmt, i + 1, lits[i].i);
+        else
+            chidb_bind_text(stmt, i + 1, lits[i].s);
+    }
+
+    free(used);
+    return ok;
+}
+
+int chidb_prepare(chidb *db, const char *sql, chidb_stmt **stmt)
+{
+    chidb_stmt *cached;
+    chidb_stmt_literal_t *lits;
+    char *key;
+    int nlits, rc;
+
+    // 结构改变之后, 先读取新的结构
+    if((rc = refresh_schema(db)) != CHIDB_OK)
+        return rc;
+
+    if(!chidb_stmt_cache_key(sql, &key, &lits, &nlits))
+        return chidb_prepare_sql(db, sql, stmt);
+
+    // 同样形式的语句只解析和生成代码一次
+    cached = chidb_stmt_cache_get(&db->stmt_cache, key);
+    if(cached == NULL)
+    {
+        rc = chidb_prepare_sql(db, key, &cached);
+        if(rc == CHIDB_OK && chidb_stmt_cache_put(&db->stmt_cache, key, cached) != CHIDB_OK)
+        {
+            chidb_stmt_free(cached);
+            free(cached);
+            rc = CHIDB_ENOMEM;
+        }
+        if(rc != CHIDB_OK)
+            cached = NULL;
+    }
+
+    rc = CHIDB_EINVALIDSQL;
+    if(cached != NULL && chidb_stmt_clone(cached, stmt) == CHIDB_OK)
+    {
+        rc = CHIDB_OK;
+        // 类型不符时, 按原来的sql重新准备, 以得到同样的错误
+        if(!chidb_bind_literals(*stmt, lits, nlits))
+        {
+            chidb_stmt_free(*stmt);
+            free(*stmt);
+            rc = CHIDB_EINVALIDSQL;
+        }
+        else
+            // 字面值变成的参数不是用户写的参数, 不能再被绑定
+            (*stmt)->nUserParams -= nlits;
+    }
+
+    free(key);
+    chidb_stmt_cache_free_literals(lits, nlits);
+
+    // 无法使用缓存时(如字面值的类型与列不符), 按原来的sql准备语句
+    if(rc != CHIDB_OK)
+        return chidb_prepare_sql(db, sql, stmt);
+
+    return CHIDB_OK;
+}
+
 int chidb_step(chidb_stmt *stmt)
 {
 	if(stmt->explain)
@@ -214,6 +375,64 @@ int chidb_step(chidb_stmt *stmt)
 		return chidb_stmt_exec(stmt);
 }
 
+int chidb_reset(chidb_stmt *stmt)
+{
+    return chidb_stmt_reset(stmt);
+}
+
+int chidb_bind_parameter_count(chidb_stmt *stmt)
+{
+    return stmt->nUserParams;
+}
+
+int chidb_bind_parameter_index(chidb_stmt *stmt, const char *name)
+{
+    for(int i = 0; i < stmt->nUserParams; i++)
+        if(stmt->paramNames[i] != NULL && !strcmp(stmt->paramNames[i], name))
+            return i + 1;
+
+    return 0;
+}
+
+// 将参数原来绑定的值释放, 返回参数对应的寄存器
+static chidb_dbm_register_t *chidb_bind_param(chidb_stmt *stmt, int param)
+{
+    if(param < 1 || param > stmt->nUserParams)
+        return NULL;
+
+    chidb_dbm_register_t *p = &stmt->params[param - 1];
+    if(p->type == REG_STRING)
+        free(p->value.s);
+    p->type = REG_UNSPECIFIED;
+
+    return p;
+}
+
+int chidb_bind_int(chidb_stmt *stmt, int param, int value)
+{
+    chidb_dbm_register_t *p = chidb_bind_param(stmt, param);
+    if(p == NULL)
+        return CHIDB_EMISUSE;
+
+    p->type = REG_INT32;
+    p->value.i = value;
+
+    return CHIDB_OK;
+}
+
+int chidb_bind_text(chidb_stmt *stmt, int param, const char *value)
+{
+    chidb_dbm_register_t *p = chidb_bind_param(stmt, param);
+    if(p == NULL)
+        return CHIDB_EMISUSE;
+
+    if((p->value.s = strdup(value)) == NULL)
+        return CHIDB_ENOMEM;
+    p->type = REG_STRING;
+
+    return CHIDB_OK;
+}
+
 int chidb_finalize(chidb_stmt *stmt)
 {
     return chidb_stmt_free(stmt);
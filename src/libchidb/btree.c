@@ -112,12 +112,19 @@ int chidb_Btree_open(const char *filename, chidb *db, BTree **bt)
     (*bt)->db = db;
     db->bt = *bt;
 
+    // 还没有记录任何B树最右边的叶子结点
+    memset((*bt)->append, 0, sizeof((*bt)->append));
+    (*bt)->append_next = 0;
+
     struct stat file_stat;
     // 读取文件的信息
-    fstat(fileno(pager->f), &file_stat);
+    fstat(pager->fd, &file_stat);
+
+    // 文件头规定了前一百个字节
+    uint8_t buf[100];
 
-    // 若文件为空
-    if (file_stat.st_size == 0)
+    // 若文件为空, 且预写日志中也没有页1
+    if (file_stat.st_size == 0 && chidb_Pager_readHeader(pager, buf) == CHIDB_NOHEADER)
     {
         // 1) 通过默认页大小初始化文件头
         chidb_Pager_setPageSize(pager, DEFAULT_PAGE_SIZE);
@@ -130,13 +137,16 @@ int chidb_Btree_open(const char *filename, chidb *db, BTree **bt)
             // 创建页结点失败则返回对应的错误码
             return status;
         }
+
+        // 3) 立即提交页1, 之后的回滚不会撤销它
+        if ((status = chidb_Pager_flush(pager)) != CHIDB_OK)
+        {
+            return status;
+        }
     }
     // 若文件非空
     else
     {
-        // 文件头规定了前一百个字节
-        uint8_t buf[100];
-
         // 尝试读取文件头
         if ((status = chidb_Pager_readHeader(pager, buf)) != CHIDB_OK)
         {
@@ -197,6 +207,108 @@ int chidb_Btree_close(BTree *bt)
 }
 
 
+/* Commit the changes made to a B-Tree file
+ *
+ * Every page modified since the last commit is made durable at once
+ * (see chidb_Pager_flush).
+ *
+ * Parameters
+ * - bt: B-Tree file
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_commit(BTree *bt)
+{
+    return chidb_Pager_flush(bt->pager);
+}
+
+
+/* Undo the changes made to a B-Tree file since the last commit
+ *
+ * Parameters
+ * - bt: B-Tree file
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_rollback(BTree *bt)
+{
+    // 回滚后记录的最右叶子结点可能已不存在
+    memset(bt->append, 0, sizeof(bt->append));
+    bt->append_next = 0;
+
+    return chidb_Pager_rollback(bt->pager);
+}
+
+
+/* Read the schema cookie
+ *
+ * The schema cookie is a counter in the file header that is incremented
+ * whenever a table or an index is created. A connection that remembers
+ * the cookie of the schema it has read can tell whether that schema is
+ * still current without reading the schema table again.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - cookie: Out parameter. Used to return the schema cookie
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_getSchemaCookie(BTree *bt, uint32_t *cookie)
+{
+    MemPage *header;
+
+    int status = chidb_Pager_readPage(bt->pager, 1, &header);
+    if (status != CHIDB_OK)
+        return status;
+
+    *cookie = get4byte(header->data + HEADER_SCHEMA_COOKIE_OFFSET);
+
+    chidb_Pager_releaseMemPage(bt->pager, header);
+    return CHIDB_OK;
+}
+
+
+/* Increment the schema cookie
+ *
+ * Like any other change to page 1, the new value becomes durable when
+ * the B-Tree file is committed, and is undone by a rollback.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_incrSchemaCookie(BTree *bt)
+{
+    MemPage *header;
+
+    int status = chidb_Pager_readPage(bt->pager, 1, &header);
+    if (status != CHIDB_OK)
+        return status;
+
+    put4byte(header->data + HEADER_SCHEMA_COOKIE_OFFSET,
+             get4byte(header->data + HEADER_SCHEMA_COOKIE_OFFSET) + 1);
+    status = chidb_Pager_writePage(bt->pager, header);
+
+    chidb_Pager_releaseMemPage(bt->pager, header);
+    return status;
+}
+
+
+static void chidb_Btree_loadNode(BTree *bt, BTreeNode *node, MemPage *page);
+
 /* Loads a B-Tree node from disk
  *
  * Reads a B-Tree node from a page in the disk. All the information regarding
@@ -232,15 +344,26 @@ int chidb_Btree_getNodeByPage(BTree *bt, npage_t npage, BTreeNode **btn)
     if (status != CHIDB_OK)
     {
         // 读取失败返回错误码
+        free(*btn);
         return status;
     }
 
+    chidb_Btree_loadNode(bt, *btn, (*btn)->page);
+
+    return CHIDB_OK;
+}
+
+
+// 根据已读入内存的页初始化结点中的成员, 不分配内存
+static void chidb_Btree_loadNode(BTree *bt, BTreeNode *node, MemPage *page)
+{
+    node->page = page;
+
     // 如果读取的是第一页, 则需要加上文件头(100字节)的偏移量
     // 否则不添加偏移量
-    uint8_t *data = (*btn)->page->data + ((npage == 1) ? 100 : 0);
+    uint8_t *data = page->data + ((page->npage == 1) ? 100 : 0);
 
     // 按照格式初始化结点中的成员
-    BTreeNode *node = *btn;
     // 第一个字节为Page type
     node->type = *data;
     // 字节1-2为表示可用空间开始的字节偏移量Free offset
@@ -258,11 +381,65 @@ int chidb_Btree_getNodeByPage(BTree *bt, npage_t npage, BTreeNode **btn)
         data +
         (((node->type == PGTYPE_TABLE_INTERNAL) || (node->type == PGTYPE_INDEX_INTERNAL))
         ? 12 : 8);
+    // 表叶子结点可能在页尾保存了前后兄弟叶结点的页号
+    node->linked = (node->type == PGTYPE_TABLE_LEAF) && (data[PGHEADER_ZERO_OFFSET] & PGFLAG_LEAF_LINKS);
+    if (node->linked)
+    {
+        uint8_t *links = page->data + bt->pager->page_size - LEAFPG_LINKS_SIZE;
+        node->prev_leaf = get4byte(links);
+        node->next_leaf = get4byte(links + 4);
+    }
+    else
+    {
+        node->prev_leaf = node->next_leaf = 0;
+    }
+}
+
+
+/* Loads a B-Tree node from disk into a given BTreeNode
+ *
+ * Like chidb_Btree_getNodeByPage, but the BTreeNode is provided by the
+ * caller (e.g., embedded in another struct, or on the stack) instead of
+ * being allocated. The node's page stays pinned in the pager until
+ * chidb_Btree_unpinNode is called.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - npage: Page of node to load
+ * - btn: BTreeNode to initialize
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EPAGENO: The provided page number is not valid
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_pinNode(BTree *bt, npage_t npage, BTreeNode *btn)
+{
+    MemPage *page;
+
+    int status = chidb_Pager_readPage(bt->pager, npage, &page); CHECK;
+    chidb_Btree_loadNode(bt, btn, page);
 
     return CHIDB_OK;
 }
 
 
+/* Releases a B-Tree node loaded with chidb_Btree_pinNode
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - btn: BTreeNode to release (the struct itself is not freed)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_Btree_unpinNode(BTree *bt, BTreeNode *btn)
+{
+    return chidb_Pager_releaseMemPage(bt->pager, btn->page);
+}
+
+
 /* Frees the memory allocated to an in-memory B-Tree node
  *
  * Frees the memory allocated to an in-memory B-Tree node, and
@@ -296,6 +473,8 @@ int chidb_Btree_freeMemNode(BTree *bt, BTreeNode *btn)
 /* Create a new B-Tree node
  *
  * Allocates a new page in the file and initializes it as a B-Tree node.
+ * Pages in the free-page list (see chidb_Btree_freePage) are reused
+ * before the file is extended.
  *
  * Parameters
  * - bt: B-Tree file
@@ -311,8 +490,45 @@ int chidb_Btree_freeMemNode(BTree *bt, BTreeNode *btn)
  */
 int chidb_Btree_newNode(BTree *bt, npage_t *npage, uint8_t type)
 {
-    // 尝试分配新页
-    int status = chidb_Pager_allocatePage(bt->pager, npage);
+    MemPage *header, *page;
+    int status;
+
+    // 新建数据库时还没有第一页, 也就没有空闲页链表
+    if (bt->pager->n_pages > 0)
+    {
+        status = chidb_Pager_readPage(bt->pager, 1, &header); CHECK;
+        *npage = get4byte(header->data + HEADER_FREELIST_OFFSET);
+    }
+    else
+    {
+        header = NULL;
+        *npage = 0;
+    }
+
+    if (*npage != 0)
+    {
+        // 从空闲页链表的表头取出一页, 表头改为它的下一页
+        status = chidb_Pager_readPage(bt->pager, *npage, &page);
+        if (status == CHIDB_OK)
+        {
+            put4byte(header->data + HEADER_FREELIST_OFFSET, get4byte(page->data));
+            put4byte(header->data + HEADER_FREECOUNT_OFFSET,
+                     get4byte(header->data + HEADER_FREECOUNT_OFFSET) - 1);
+            chidb_Pager_releaseMemPage(bt->pager, page);
+            status = chidb_Pager_writePage(bt->pager, header);
+        }
+    }
+    else
+    {
+        // 没有空闲页则尝试分配新页
+        status = chidb_Pager_allocatePage(bt->pager, npage);
+    }
+
+    if (header)
+    {
+        chidb_Pager_releaseMemPage(bt->pager, header);
+    }
+
     if (status == CHIDB_OK)
     {
         // 分配成功则初始化空结点
@@ -324,6 +540,67 @@ int chidb_Btree_newNode(BTree *bt, npage_t *npage, uint8_t type)
 }
 
 
+/* Free a page
+ *
+ * Adds a page that is no longer used by any B-Tree to the free-page list
+ * kept in the file header, so that chidb_Btree_newNode can reuse it.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - npage: Page to free (must not be page 1)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EPAGENO: The provided page number is not valid
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_freePage(BTree *bt, npage_t npage)
+{
+    MemPage *header, *page;
+
+    if (npage <= 1 || npage > bt->pager->n_pages)
+    {
+        return CHIDB_EPAGENO;
+    }
+
+    int status = chidb_Pager_readPage(bt->pager, 1, &header); CHECK;
+    status = chidb_Pager_readPage(bt->pager, npage, &page);
+    if (status != CHIDB_OK)
+    {
+        chidb_Pager_releaseMemPage(bt->pager, header);
+        return status;
+    }
+
+    // 空闲页的前四个字节指向链表中的下一页, 其余内容不再有意义
+    memset(page->data, 0, bt->pager->page_size);
+    memcpy(page->data, header->data + HEADER_FREELIST_OFFSET, 4);
+    status = chidb_Pager_writePage(bt->pager, page);
+
+    // 记录的最右叶子结点或根结点被释放后, 这条记录不再有效
+    for (int i = 0; i < BTREE_APPEND_HINTS; i++)
+    {
+        if (bt->append[i].nroot == npage || bt->append[i].nleaf == npage)
+        {
+            bt->append[i].nroot = 0;
+        }
+    }
+
+    // 把释放的页放到链表的表头
+    if (status == CHIDB_OK)
+    {
+        put4byte(header->data + HEADER_FREELIST_OFFSET, npage);
+        put4byte(header->data + HEADER_FREECOUNT_OFFSET,
+                 get4byte(header->data + HEADER_FREECOUNT_OFFSET) + 1);
+        status = chidb_Pager_writePage(bt->pager, header);
+    }
+
+    chidb_Pager_releaseMemPage(bt->pager, page);
+    chidb_Pager_releaseMemPage(bt->pager, header);
+
+    return status;
+}
+
+
 /* Initialize a B-Tree node
  *
  * Initializes a database page to contain an empty B-Tree node. The
@@ -355,8 +632,9 @@ int chidb_Btree_initEmptyNode(BTree *bt, npage_t npage, uint8_t type)
 
     uint8_t *pos = page->data;
 
-    // 如果是第一页, 需要写入文件头
-    if (npage == 1)
+    // 如果是第一页且还没有文件头, 需要写入文件头
+    // (重新初始化根结点时要保留原有的文件头, 如空闲页链表)
+    if (npage == 1 && memcmp(pos, "SQLite format 3", 16))
     {
         sprintf((char *)pos, "SQLite format 3");
         pos += 16;
@@ -377,7 +655,7 @@ int chidb_Btree_initEmptyNode(BTree *bt, npage_t npage, uint8_t type)
         memcpy(pos, header_between_32_39, 8);
         pos += 8;
 
-        // 初始化版本为0
+        // 初始化schema cookie为0
         put4byte(pos, 0);
         pos += 4;
 
@@ -399,7 +677,15 @@ int chidb_Btree_initEmptyNode(BTree *bt, npage_t npage, uint8_t type)
 
         // 写入字节64-67的常量
         put4byte(pos, 0);
+        pos += 4;
+
+        // 空闲页链表为空
+        put4byte(pos, 0);
+        put4byte(pos + 4, 0);
+    }
 
+    if (npage == 1)
+    {
         pos = page->data + 100;
     }
 
@@ -479,6 +765,14 @@ int chidb_Btree_writeNode(BTree *bt, BTreeNode *btn)
     {
         put4byte(pos + 8, btn->right_page);
     }
+    // 带有兄弟链接的叶结点, 设置标志位并把链接写到页尾
+    pos[PGHEADER_ZERO_OFFSET] = btn->linked ? PGFLAG_LEAF_LINKS : 0;
+    if (btn->linked)
+    {
+        uint8_t *links = btn->page->data + bt->pager->page_size - LEAFPG_LINKS_SIZE;
+        put4byte(links, btn->prev_leaf);
+        put4byte(links + 4, btn->next_leaf);
+    }
 
     // 返回写入页的结果
     return chidb_Pager_writePage(bt->pager, btn->page);
@@ -563,6 +857,86 @@ int chidb_Btree_getCell(BTreeNode *btn, ncell_t ncell, BTreeCell *cell)
 }
 
 
+// 只解码第ncell个cell的键, 不构造完整的BTreeCell
+static inline chidb_key_t chidb_Btree_cellKey(BTreeNode *btn, ncell_t ncell)
+{
+    uint8_t *data = btn->page->data + get2byte(btn->celloffset_array + ncell * 2);
+
+    switch (btn->type)
+    {
+    case PGTYPE_TABLE_INTERNAL:
+    case PGTYPE_TABLE_LEAF:
+        // 表结点的键为字节4-7的varint32
+        data += TABLELEAFCELL_KEY_OFFSET;
+        return ((chidb_key_t) (data[0] & 0x7F) << 21)
+             | ((chidb_key_t) (data[1] & 0x7F) << 14)
+             | ((chidb_key_t) (data[2] & 0x7F) << 7)
+             | ((chidb_key_t) (data[3] & 0x7F));
+
+    case PGTYPE_INDEX_INTERNAL:
+        return get4byte(data + INDEXINTCELL_KEYIDX_OFFSET);
+
+    default:
+        return get4byte(data + INDEXLEAFCELL_KEYIDX_OFFSET);
+    }
+}
+
+// 索引的键是INTEGER列的值, 按有符号整数排序; 表的键(rowid)按无符号整数排序
+static inline bool chidb_Btree_keyLess(uint8_t type, chidb_key_t a, chidb_key_t b)
+{
+    if (type == PGTYPE_INDEX_INTERNAL || type == PGTYPE_INDEX_LEAF)
+    {
+        return (int32_t) a < (int32_t) b;
+    }
+
+    return a < b;
+}
+
+
+/* Search for a key in a B-Tree node
+ *
+ * Performs a binary search on the cell offset array of a node (the cells
+ * are sorted by key), decoding only the keys of the cells it probes.
+ * The keys of index nodes are compared as signed integers, since they are
+ * the values of an INTEGER column.
+ *
+ * Parameters
+ * - btn: BTreeNode to search in
+ * - key: Key to search for
+ * - ncell: Out parameter. Position of the first cell with a key greater
+ *          than or equal to key, or btn->n_cells if there is no such cell
+ *          (i.e., the key belongs in the right page of an internal node).
+ *
+ * Return
+ * - CHIDB_OK: The cell at position *ncell has the given key
+ * - CHIDB_ENOTFOUND: No cell in the node has the given key
+ */
+int chidb_Btree_searchNode(BTreeNode *btn, chidb_key_t key, ncell_t *ncell)
+{
+    ncell_t low = 0, high = btn->n_cells;
+
+    // 在[low, high)中查找第一个键大于或等于key的cell
+    while (low < high)
+    {
+        ncell_t mid = low + (high - low) / 2;
+
+        if (chidb_Btree_keyLess(btn->type, chidb_Btree_cellKey(btn, mid), key))
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    *ncell = low;
+
+    return (low < btn->n_cells && chidb_Btree_cellKey(btn, low) == key)
+           ? CHIDB_OK : CHIDB_ENOTFOUND;
+}
+
+
 /* Insert a new cell into a B-Tree node
  *
  * Inserts a new cell into a B-Tree node at a specified position ncell.
@@ -671,107 +1045,201 @@ int chidb_Btree_insertCell(BTreeNode *btn, ncell_t ncell, BTreeCell *cell)
     return CHIDB_OK;
 }
 
-/* Find an entry in a table B-Tree
+// cell在页中占用的字节数(不包括偏移数组中的2字节)
+static uint16_t chidb_Btree_cellSize(uint8_t type, BTreeCell *cell)
+{
+    switch (type)
+    {
+    case PGTYPE_TABLE_LEAF:
+        return TABLELEAFCELL_SIZE_WITHOUTDATA + cell->fields.tableLeaf.data_size;
+    case PGTYPE_TABLE_INTERNAL:
+        return TABLEINTCELL_SIZE;
+    case PGTYPE_INDEX_INTERNAL:
+        return INDEXINTCELL_SIZE;
+    default:
+        return INDEXLEAFCELL_SIZE;
+    }
+}
+
+/* Remove a cell from a B-Tree node
  *
- * Finds the data associated for a given key in a table B-Tree
+ * Removes the cell at position ncell from a B-Tree node. The cells
+ * stored below the removed cell are moved up so that the cell area
+ * stays contiguous, and the cell offset array is updated accordingly.
  *
  * Parameters
- * - bt: B-Tree file
- * - nroot: Page number of the root node of the B-Tree we want search in
- * - key: Entry key
- * - data: Out-parameter where a copy of the data must be stored
- * - size: Out-parameter where the number of bytes of data must be stored
+ * - btn: BTreeNode to remove cell from
+ * - ncell: Cell number
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: No entry with the given key way found
- * - CHIDB_ENOMEM: Could not allocate memory
- * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ * - CHIDB_ECELLNO: The provided cell number is invalid
  */
-int chidb_Btree_find(BTree *bt, npage_t nroot, chidb_key_t key, uint8_t **data, uint16_t *size)
+int chidb_Btree_removeCell(BTreeNode *btn, ncell_t ncell)
 {
+    uint8_t *data = btn->page->data;
     BTreeCell cell;
-    BTreeNode *btn;
 
-    int status;
-    // 尝试根据页码读取结点
-    if ((status = chidb_Btree_getNodeByPage(bt, nroot, &btn)) != CHIDB_OK)
+    if (ncell < 0 || ncell >= btn->n_cells)
     {
-        // 读取失败返回错误码
-        return status;
+        return CHIDB_ECELLNO;
     }
 
-    int i;
-    // 遍历页中所有的Cell
-    for (i = 0; i < btn->n_cells; ++i)
+    uint16_t offset = get2byte(btn->celloffset_array + ncell * 2);
+    chidb_Btree_getCell(btn, ncell, &cell);
+    uint16_t size = chidb_Btree_cellSize(btn->type, &cell);
+
+    // 将存储在被删除cell之前(低地址)的cells整体后移, 填补空出来的空间
+    memmove(data + btn->cells_offset + size, data + btn->cells_offset, offset - btn->cells_offset);
+    for (ncell_t i = 0; i < btn->n_cells; i++)
     {
-        // 根据Cell的索引获取Cell
-        chidb_Btree_getCell(btn, i, &cell);
-        // 若键匹配且Cell类型为Table Leaf
-        if ((cell.key == key) && (btn->type == PGTYPE_TABLE_LEAF))
+        uint16_t o = get2byte(btn->celloffset_array + i * 2);
+        if (o < offset)
         {
-            // 将结点存储的数据大小存储到size指向的空间
-            *size = cell.fields.tableLeaf.data_size;
-            // 为传出的data分配内存
-            (*data) = malloc(sizeof(uint8_t) * (*size));
-            // 若分配内存失败
-            if (!(*data))
-            {
-                // 释放内存结点(btn), 返回错误码
-                chidb_Btree_freeMemNode(bt, btn);
-                return CHIDB_ENOMEM;
-            }
-            // 复制Cell中的数据到*data指向的内存空间
-            memcpy(*data, cell.fields.tableLeaf.data, *size);
-            // 尝试释放btn结点所占的内存
-            if ((status = chidb_Btree_freeMemNode(bt, btn)) != CHIDB_OK)
+            put2byte(btn->celloffset_array + i * 2, o + size);
+        }
+    }
+
+    // 将ncell后的偏移向前移一位
+    memmove(btn->celloffset_array + ncell * 2, btn->celloffset_array + ncell * 2 + 2, (btn->n_cells - ncell - 1) * 2);
+    btn->n_cells--;
+    btn->free_offset -= 2;
+    btn->cells_offset += size;
+
+    return CHIDB_OK;
+}
+
+/* Find an entry in a table B-Tree
+ *
+ * Finds the data associated for a given key in a table B-Tree
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree we want search in
+ * - key: Entry key
+ * - data: Out-parameter where a copy of the data must be stored
+ * - size: Out-parameter where the number of bytes of data must be stored
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: No entry with the given key way found
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_find(BTree *bt, npage_t nroot, chidb_key_t key, uint8_t **data, uint16_t *size)
+{
+    MemPage *page;
+    uint8_t *ref;
+
+    // 先找到数据在叶子页中的位置, 再复制一份
+    int status = chidb_Btree_findRef(bt, nroot, key, &ref, size, &page); CHECK;
+
+    // 为传出的data分配内存
+    (*data) = malloc(sizeof(uint8_t) * (*size));
+    // 若分配内存失败
+    if (!(*data))
+    {
+        chidb_Btree_releaseRef(bt, page);
+        return CHIDB_ENOMEM;
+    }
+    // 复制Cell中的数据到*data指向的内存空间
+    memcpy(*data, ref, *size);
+
+    return chidb_Btree_releaseRef(bt, page);
+}
+
+
+/* Find an entry in a table B-Tree, without copying it
+ *
+ * Like chidb_Btree_find, but instead of returning a copy of the data,
+ * returns a pointer to the data in the (pinned) leaf page that contains
+ * it. The tree is walked iteratively, and only one page is pinned at any
+ * time. No memory is allocated.
+ *
+ * The pointer is only valid until chidb_Btree_releaseRef is called on
+ * the returned page, and must not be used to modify the data.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree we want search in
+ * - key: Entry key
+ * - data: Out-parameter where a pointer to the data will be stored
+ * - size: Out-parameter where the number of bytes of data must be stored
+ * - page: Out-parameter where the pinned leaf page will be stored
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: No entry with the given key way found
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_findRef(BTree *bt, npage_t nroot, chidb_key_t key, uint8_t **data, uint16_t *size, MemPage **page)
+{
+    BTreeNode btn;
+    BTreeCell cell;
+    ncell_t i;
+    npage_t npage = nroot;
+    int status;
+
+    // 自根结点逐层向下查找, 进入子页之前释放当前页
+    for (;;)
+    {
+        status = chidb_Pager_readPage(bt->pager, npage, page); CHECK;
+        chidb_Btree_loadNode(bt, &btn, *page);
+
+        // 二分查找第一个键大于或等于key的cell
+        int found = chidb_Btree_searchNode(&btn, key, &i);
+
+        // 若为表叶子结点, 只有键完全匹配才算找到
+        if (btn.type == PGTYPE_TABLE_LEAF)
+        {
+            if (found != CHIDB_OK)
             {
-                // 失败则返回错误码
-                return status;
+                break;
             }
+
+            chidb_Btree_getCell(&btn, i, &cell);
+            *data = cell.fields.tableLeaf.data;
+            *size = cell.fields.tableLeaf.data_size;
             return CHIDB_OK;
         }
-        // 若Cell中的键大于或等于给定key, 因为页中cell是有序的, 所以第一个大于或等于给定key的结点一定是包含所找Cell的页码的Cell
-        else if (cell.key >= key)
+
+        // 索引B树中没有表的数据
+        if (btn.type != PGTYPE_TABLE_INTERNAL)
         {
-            // 保存btn的类型
-            uint8_t temp_type = btn->type;
-            // 尝试释放btn, 失败则返回错误码
-            if ((status = chidb_Btree_freeMemNode(bt, btn)) != CHIDB_OK)
-            {
-                return status;
-            }
-            // 若类型非表叶子结点则在子页中查找
-            if (temp_type != PGTYPE_TABLE_LEAF)
-            {
-                return chidb_Btree_find(bt, cell.fields.tableInternal.child_page, key, data, size);
-            }
-            // 否则返回未找到
-            else
-            {
-                return CHIDB_ENOTFOUND;
-            }
+            break;
         }
-    }
 
-    // 若遍历页中的cells没有找到满足条件, 并且页非叶结点, 则在btn指向的右边页中继续查找
-    if (btn->type != PGTYPE_TABLE_LEAF)
-    {
-        i = btn->right_page;
-        // 尝试释放btn, 失败则返回错误码
-        if ((status = chidb_Btree_freeMemNode(bt, btn)) != CHIDB_OK)
+        // 第一个键大于或等于key的cell指向的子页包含key, 若没有这样的cell则在right page中
+        npage = btn.right_page;
+        if (i < btn.n_cells)
         {
-            return status;
+            chidb_Btree_getCell(&btn, i, &cell);
+            npage = cell.fields.tableInternal.child_page;
         }
-        // 在right page中继续查找
-        return chidb_Btree_find(bt, i, key, data, size);
+
+        status = chidb_Pager_releaseMemPage(bt->pager, *page); CHECK;
     }
 
-    // 上述操作均未找到返回未找到
+    chidb_Pager_releaseMemPage(bt->pager, *page);
     return CHIDB_ENOTFOUND;
 }
 
 
+/* Release an entry returned by chidb_Btree_findRef
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - page: Leaf page returned by chidb_Btree_findRef
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_Btree_releaseRef(BTree *bt, MemPage *page)
+{
+    return chidb_Pager_releaseMemPage(bt->pager, page);
+}
+
+
 
 /* Insert an entry into a table B-Tree
  *
@@ -862,9 +1330,9 @@ int hasRoomForCell(BTreeNode *btn, BTreeCell *btc)
         break;
     }
 
-    // 如果当前结点剩余的可用空间大于单元格的数据大小
+    // 如果当前结点剩余的可用空间能放下单元格和它在偏移数组中的2字节
     // 返回1, 否则返回0
-    if (space >= size)
+    if (space >= size + 2)
     {
         return 1;
     }
@@ -874,6 +1342,93 @@ int hasRoomForCell(BTreeNode *btn, BTreeCell *btc)
     }
 }
 
+static int chidb_Btree_insertTree(BTree *bt, npage_t nroot, BTreeCell *btc);
+static int chidb_Btree_insertNode(BTree *bt, npage_t npage, BTreeCell *btc, bool *full);
+static int chidb_Btree_splitAt(BTree *bt, npage_t npage_parent, npage_t npage_child, ncell_t parent_ncell, BTreeCell *btc, bool append, npage_t *npage_child2);
+
+// 查找nroot对应的最右叶子结点记录, 返回其下标, 没有则返回-1
+static int chidb_Btree_appendHint(BTree *bt, npage_t nroot)
+{
+    for (int i = 0; i < BTREE_APPEND_HINTS; i++)
+    {
+        if (bt->append[i].nroot == nroot)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// 沿right page找到nroot最右边的叶子结点, 记录它和B树中最大的键
+static int chidb_Btree_setAppendHint(BTree *bt, npage_t nroot, int hint)
+{
+    BTreeNode *btn;
+    npage_t npage = nroot;
+    int status;
+
+    for (;;)
+    {
+        status = chidb_Btree_getNodeByPage(bt, npage, &btn); CHECK;
+        if (btn->type != PGTYPE_TABLE_INTERNAL && btn->type != PGTYPE_INDEX_INTERNAL)
+        {
+            break;
+        }
+        npage = btn->right_page;
+        chidb_Btree_freeMemNode(bt, btn);
+    }
+
+    // 没有记录时替换最早的一条
+    if (hint < 0)
+    {
+        hint = bt->append_next;
+        bt->append_next = (bt->append_next + 1) % BTREE_APPEND_HINTS;
+    }
+
+    if (btn->n_cells > 0)
+    {
+        bt->append[hint].nroot = nroot;
+        bt->append[hint].nleaf = npage;
+        bt->append[hint].key = chidb_Btree_cellKey(btn, btn->n_cells - 1);
+    }
+    else
+    {
+        bt->append[hint].nroot = 0;
+    }
+
+    return chidb_Btree_freeMemNode(bt, btn);
+}
+
+// 把比B树中所有键都大的btc直接追加到记录的最右叶子结点中,
+// 记录已失效或叶子结点已满时返回CHIDB_ENOTFOUND
+static int chidb_Btree_append(BTree *bt, int hint, BTreeCell *btc)
+{
+    BTreeNode *btn;
+    int status = chidb_Btree_getNodeByPage(bt, bt->append[hint].nleaf, &btn); CHECK;
+
+    // 叶子结点的最后一个键仍是记录的最大键时, 它仍是这棵树最右边的叶子结点
+    if ((btn->type == PGTYPE_TABLE_LEAF || btn->type == PGTYPE_INDEX_LEAF)
+        && btn->type == btc->type
+        && btn->n_cells > 0
+        && chidb_Btree_cellKey(btn, btn->n_cells - 1) == bt->append[hint].key
+        && hasRoomForCell(btn, btc))
+    {
+        status = chidb_Btree_insertCell(btn, btn->n_cells, btc);
+        if (status == CHIDB_OK)
+        {
+            status = chidb_Btree_writeNode(bt, btn);
+            bt->append[hint].key = btc->key;
+        }
+    }
+    else
+    {
+        status = CHIDB_ENOTFOUND;
+    }
+
+    chidb_Btree_freeMemNode(bt, btn);
+    return status;
+}
+
 /* Insert a BTreeCell into a B-Tree
  *
  * The chidb_Btree_insert and chidb_Btree_insertNonFull functions
@@ -884,6 +1439,13 @@ int hasRoomForCell(BTreeNode *btn, BTreeCell *btc)
  * splitting any other node). If so, chidb_Btree_split is called
  * before calling chidb_Btree_insertNonFull.
  *
+ * The rightmost leaf of the last few B-Trees inserted into is remembered
+ * in the BTree. A key larger than every other key in the tree (such as
+ * an increasing rowid) is appended directly to that leaf, as long as it
+ * has room for it. When it does not, the leaf is split so that all the
+ * existing cells stay in the left node, which leaves the leaves of
+ * sequentially loaded trees full instead of half full.
+ *
  * Parameters
  * - bt: B-Tree file
  * - nroot: Page number of the root node of the B-Tree we want to insert
@@ -897,19 +1459,58 @@ int hasRoomForCell(BTreeNode *btn, BTreeCell *btc)
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
 int chidb_Btree_insert(BTree *bt, npage_t nroot, BTreeCell *btc)
+{
+    int status, hint = chidb_Btree_appendHint(bt, nroot);
+
+    // 键比树中所有的键都大时, 尝试直接追加到最右边的叶子结点
+    if (hint >= 0 && chidb_Btree_keyLess(btc->type, bt->append[hint].key, btc->key))
+    {
+        status = chidb_Btree_append(bt, hint, btc);
+        if (status != CHIDB_ENOTFOUND)
+        {
+            return status;
+        }
+    }
+
+    status = chidb_Btree_insertTree(bt, nroot, btc); CHECK;
+
+    // 插入了新的最大键(或还没有记录)时, 重新记录最右边的叶子结点
+    if (hint < 0 || chidb_Btree_keyLess(btc->type, bt->append[hint].key, btc->key))
+    {
+        status = chidb_Btree_setAppendHint(bt, nroot, hint);
+    }
+
+    return status;
+}
+
+// 从根结点nroot开始插入btc, 根结点已满时先切分根结点
+static int chidb_Btree_insertTree(BTree *bt, npage_t nroot, BTreeCell *btc)
 {
     // 插入Cell到指定页
+    bool full;
 
     // 尝试读取结点, 错误返回错误码
     BTreeNode *root;
     int status = chidb_Btree_getNodeByPage(bt, nroot, &root); CHECK;
 
-    // 如果有空间, 直接调用insertNonFull
+    // 如果有空间, 直接在根结点中插入
     if (hasRoomForCell(root, btc))
     {
-        return chidb_Btree_insertNonFull(bt, nroot, btc);
+        status = chidb_Btree_freeMemNode(bt, root); CHECK;
+        status = chidb_Btree_insertNode(bt, nroot, btc, &full); CHECK;
+        // 下层的结点切分后根结点放不下提升的cell时, 切分根结点后重新插入
+        if (!full)
+        {
+            return CHIDB_OK;
+        }
+        status = chidb_Btree_getNodeByPage(bt, nroot, &root); CHECK;
     }
 
+    // 根结点为叶子结点且btc的键比其中所有的键都大时, 按追加的方式切分
+    bool append = (root->type == PGTYPE_TABLE_LEAF || root->type == PGTYPE_INDEX_LEAF)
+               && root->n_cells > 0
+               && chidb_Btree_keyLess(root->type, chidb_Btree_cellKey(root, root->n_cells - 1), btc->key);
+
     BTreeNode *new_child;
     npage_t new_child_num;
     // 准备一个新结点, 包含原父结点的内容
@@ -974,9 +1575,9 @@ int chidb_Btree_insert(BTree *bt, npage_t nroot, BTreeCell *btc)
 
     // 切分原来的根节点, 并将产生的cell添加到新的根节点中
     npage_t lower_num;
-    status = chidb_Btree_split(bt, nroot, new_child_num, 0, &lower_num); CHECK;
+    status = chidb_Btree_splitAt(bt, nroot, new_child_num, 0, btc, append, &lower_num); CHECK;
 
-    return chidb_Btree_insertNonFull(bt, nroot, btc);
+    return chidb_Btree_insertTree(bt, nroot, btc);
 }
 
 /* Insert a BTreeCell into a non-full B-Tree node
@@ -1004,118 +1605,144 @@ int chidb_Btree_insert(BTree *bt, npage_t nroot, BTreeCell *btc)
  */
 int chidb_Btree_insertNonFull(BTree *bt, npage_t npage, BTreeCell *btc)
 {
-    BTreeNode *btn;
-    int status = chidb_Btree_getNodeByPage(bt, npage, &btn); CHECK;
+    bool full;
+    int status = chidb_Btree_insertNode(bt, npage, btc, &full); CHECK;
 
-    BTreeNode *child_btn;
-    npage_t child_num;
+    // npage没有父结点(即为根结点)时, 放不下提升的cell只能切分根结点
+    return full ? chidb_Btree_insertTree(bt, npage, btc) : CHIDB_OK;
+}
 
-    // 遍历每一个cell
-    int i;
-    for (i = 0; i < btn->n_cells; ++i)
+// 在以npage为根的子树中插入btc. 需要切分的子结点提升的cell在npage中放不下时(只在记录
+// 很大时发生), 不做任何修改并将*full设为true, 由父结点先切分npage再重新插入, 这样切分
+// 逐层向上传递到根结点, 所有叶子结点的深度保持相同
+static int chidb_Btree_insertNode(BTree *bt, npage_t npage, BTreeCell *btc, bool *full)
+{
+    BTreeNode *btn, *child_btn;
+    npage_t child_page, child_num;
+    int status;
+
+    *full = false;
+    for (;;)
     {
-        // 获取当前Cell
-        BTreeCell cell;
-        status = chidb_Btree_getCell(btn, i, &cell); CHECK;
+        status = chidb_Btree_getNodeByPage(bt, npage, &btn); CHECK;
+
+        // 当前结点是否还能放下切分子结点时提升上来的cell
+        int room = hasRoomForCell(btn, btc);
 
-        // 如果当前Cell的key与要插入的Cell的key相同, 且非页表内部结点, 则返回重定义错误
-        if ((cell.key == btc->key)
+        // 二分查找第一个键大于或等于要插入的key的cell
+        ncell_t i;
+        int found = chidb_Btree_searchNode(btn, btc->key, &i);
+
+        // 如果存在相同key的Cell, 且非页表内部结点, 则返回重定义错误
+        if ((found == CHIDB_OK)
             && (btn->type != PGTYPE_TABLE_INTERNAL))
         {
             status = chidb_Btree_freeMemNode(bt, btn); CHECK;
             return CHIDB_EDUPLICATE;
         }
 
-        // 如果要插入的结点key小于等于当前Cell的key, 则可插入在当前位置或当前cell指向的child page中
-        if (btc->key <= cell.key)
+        // 如果是叶子结点, 则可以直接插入在第i个位置(所有cell的key都小于要插入的key时插入在最后)
+        if ((btn->type == PGTYPE_INDEX_LEAF) || (btn->type == PGTYPE_TABLE_LEAF))
+        {
+            status = chidb_Btree_insertCell(btn, i, btc);
+            // 写入文件后释放
+            chidb_Btree_writeNode(bt, btn);
+            chidb_Btree_freeMemNode(bt, btn);
+            return status;
+        }
+
+        // 要插入的结点key小于等于第i个Cell的key时插入到当前cell指向的子结点中,
+        // 否则插入到right page指向的子结点中
+        if (i < btn->n_cells)
+        {
+            BTreeCell cell;
+            status = chidb_Btree_getCell(btn, i, &cell); CHECK;
+            child_page = btn->type == PGTYPE_TABLE_INTERNAL ? cell.fields.tableInternal.child_page
+                                                            : cell.fields.indexInternal.child_page;
+        }
+        else
+        {
+            child_page = btn->right_page;
+        }
+        bool last = i == btn->n_cells;
+        status = chidb_Btree_freeMemNode(bt, btn); CHECK;
+
+        // 读取子结点
+        status = chidb_Btree_getNodeByPage(bt, child_page, &child_btn); CHECK;
+
+        // 如果子结点没有足够的空间插入
+        if (!hasRoomForCell(child_btn, btc))
         {
-            switch(btn->type)
+            // right page指向的子结点为叶子结点且btc的键比其中所有的键都大时(如按顺序插入), 按追加的方式切分
+            bool append = last
+                       && (child_btn->type == PGTYPE_TABLE_LEAF || child_btn->type == PGTYPE_INDEX_LEAF)
+                       && child_btn->n_cells > 0
+                       && chidb_Btree_keyLess(child_btn->type, chidb_Btree_cellKey(child_btn, child_btn->n_cells - 1), btc->key);
+            status = chidb_Btree_freeMemNode(bt, child_btn); CHECK;
+            // 当前结点放不下提升的cell时, 交给父结点切分当前结点
+            if (!room)
             {
-            case PGTYPE_TABLE_INTERNAL:
-                status = chidb_Btree_freeMemNode(bt, btn); CHECK;
-                // 获取当前Cell指向的子结点
-                status = chidb_Btree_getNodeByPage(bt, cell.fields.tableInternal.child_page, &child_btn);
-                CHECK;
-
-                // 如果当前cell指向的子页没有足够的空间
-                if (!hasRoomForCell(child_btn, btc))
-                {
-                    // 释放child_btn
-                    status = chidb_Btree_freeMemNode(bt,child_btn); CHECK;
-                    // 切分当前cell指向的子结点, 并将产生的cell插入到这里
-                    status = chidb_Btree_split(bt, npage, cell.fields.tableInternal.child_page, i, &child_num);
-                    CHECK;
-                    // 在切分之后调用insert, 因为当前结点可能没有足够的空间
-                    return chidb_Btree_insert(bt, npage, btc);
-                }
-                // 如果有足够的空间, 在当前cell指向的子结点上调用本函数
-                return chidb_Btree_insertNonFull(bt, cell.fields.tableInternal.child_page, btc);
-
-            case PGTYPE_INDEX_INTERNAL:
-                status = chidb_Btree_freeMemNode(bt, btn); CHECK;
-                // 获取当前Cell指向的子结点
-                status = chidb_Btree_getNodeByPage(bt, cell.fields.indexInternal.child_page, &child_btn);
-                CHECK;
-
-                // 如果当前cell指向的子页没有足够的空间
-                if (!hasRoomForCell(child_btn, btc))
-                {
-                    // 释放child_btn
-                    status = chidb_Btree_freeMemNode(bt,child_btn); CHECK;
-                    // 切分当前cell指向的子结点, 并将产生的cell插入到这里
-                    status = chidb_Btree_split(bt, npage, cell.fields.indexInternal.child_page, i, &child_num);
-                    CHECK;
-                    // 在切分之后调用insert, 因为当前结点可能没有足够的空间
-                    return chidb_Btree_insert(bt, npage, btc);
-                }
-                // 如果有足够的空间, 在当前cell指向的子结点上调用本函数
-                return chidb_Btree_insertNonFull(bt, cell.fields.indexInternal.child_page, btc);
-
-            // 如果是叶子结点, 则可以直接插入
-            case PGTYPE_TABLE_LEAF:
-            case PGTYPE_INDEX_LEAF:
-                status = chidb_Btree_insertCell(btn, i, btc);
-                // 写入文件后释放
-                chidb_Btree_writeNode(bt, btn);
-                chidb_Btree_freeMemNode(bt, btn);
-                return status;
+                *full = true;
+                return CHIDB_OK;
             }
+            // 切分子结点, 并将产生的cell插入到第i个位置
+            status = chidb_Btree_splitAt(bt, npage, child_page, i, btc, append, &child_num); CHECK;
+            // 切分之后重新在当前结点中查找, 进入切分出的两个结点之一
+            continue;
+        }
+
+        // 如果有足够的空间, 在子结点上插入
+        status = chidb_Btree_freeMemNode(bt, child_btn); CHECK;
+        bool child_full;
+        status = chidb_Btree_insertNode(bt, child_page, btc, &child_full); CHECK;
+        if (!child_full)
+        {
+            return CHIDB_OK;
+        }
+
+        // 子结点(内部结点)放不下它的子结点提升的cell, 切分子结点后重新查找
+        if (!room)
+        {
+            *full = true;
+            return CHIDB_OK;
         }
+        status = chidb_Btree_split(bt, npage, child_page, i, &child_num); CHECK;
     }
+}
 
-    // 若循环没有找到可以插入的地方, 则应插入在最后或者插入在right page指向的页中
-    // 若当前结点为叶子结点, 则直接插入在最后
-    if ((btn->type == PGTYPE_INDEX_LEAF) || (btn->type == PGTYPE_TABLE_LEAF))
+// 表叶子结点btn中[from, to)的cells加上兄弟链接能否放进一页
+static bool chidb_Btree_fitsWithLinks(BTree *bt, BTreeNode *btn, ncell_t from, ncell_t to)
+{
+    uint32_t size = LEAFPG_CELLSOFFSET_OFFSET + LEAFPG_LINKS_SIZE;
+    BTreeCell cell;
+
+    for (ncell_t i = from; i < to; i++)
     {
-        status = chidb_Btree_insertCell(btn, i, btc);
-        chidb_Btree_writeNode(bt, btn);
-        chidb_Btree_freeMemNode(bt, btn);
-        return status;
+        chidb_Btree_getCell(btn, i, &cell);
+        size += 2 + TABLELEAFCELL_SIZE_WITHOUTDATA + cell.fields.tableLeaf.data_size;
     }
-    else
-    {
-        // 保存right page的值
-        npage_t right_page = btn->right_page;
-        // 释放btn
-        chidb_Btree_freeMemNode(bt, btn);
 
-        // 读取right page指向的页结点
-        status = chidb_Btree_getNodeByPage(bt, right_page, &child_btn); CHECK;
+    return size <= bt->pager->page_size;
+}
 
-        // 如果right page没有足够的空间插入结点
-        if (!hasRoomForCell(child_btn, btc))
-        {
-            status = chidb_Btree_freeMemNode(bt,child_btn); CHECK;
-            // 切分right page指向的子结点, 并将产生的cell插入到最后
-            status = chidb_Btree_split(bt, npage, right_page, i, &child_num); CHECK;
-            // 在切分之后调用insert, 因为当前结点可能没有足够的空间
-            return chidb_Btree_insert(bt, npage, btc);
-        }
-        // 如果有足够的空间, 在当前cell指向的子结点上调用本函数
-        return chidb_Btree_insertNonFull(bt, right_page, btc);
+// 修改叶结点npage指向前一个(next为false)或后一个(next为true)叶结点的链接
+static int chidb_Btree_setLeafLink(BTree *bt, npage_t npage, bool next, npage_t link)
+{
+    BTreeNode *btn;
+    int status = chidb_Btree_getNodeByPage(bt, npage, &btn); CHECK;
+
+    if (btn->linked)
+    {
+        if (next)
+            btn->next_leaf = link;
+        else
+            btn->prev_leaf = link;
+        status = chidb_Btree_writeNode(bt, btn);
     }
-}
 
+    chidb_Btree_freeMemNode(bt, btn);
+    return status;
+}
 
 /* Split a B-Tree node
  *
@@ -1126,6 +1753,8 @@ int chidb_Btree_insertNonFull(BTree *bt, npage_t npage, BTreeCell *btc)
  *   cell is a table leaf cell, the median cell is moved too)
  * - Add a cell to the parent (which, by definition, will be an
  *   internal page) with the median key and the page number of M.
+ * - If N is a table leaf, link M and N to each other and to
+ *   N's former neighbours (see PGFLAG_LEAF_LINKS).
  *
  * Parameters
  * - bt: B-Tree file
@@ -1141,17 +1770,57 @@ int chidb_Btree_insertNonFull(BTree *bt, npage_t npage, BTreeCell *btc)
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
 int chidb_Btree_split(BTree *bt, npage_t npage_parent, npage_t npage_child, ncell_t parent_ncell, npage_t *npage_child2)
+{
+    return chidb_Btree_splitAt(bt, npage_parent, npage_child, parent_ncell, NULL, false, npage_child2);
+}
+
+// 切分结点. append为true时(只用于叶子结点)不在中间切分, 而是把所有已有的cells
+// 留在左边的结点中(索引叶子结点的最后一个cell提升到父结点中), 右边的结点为空,
+// 用于按顺序追加的键. btc为切分之后要插入的cell(可以为NULL), 切分表叶子结点时
+// 保证btc所在的一半比原结点小
+static int chidb_Btree_splitAt(BTree *bt, npage_t npage_parent, npage_t npage_child, ncell_t parent_ncell, BTreeCell *btc, bool append, npage_t *npage_child2)
 {
     // 读取要切分的结点的父结点
     BTreeNode *parent;
     int status = chidb_Btree_getNodeByPage(bt, npage_parent, &parent); CHECK;
 
     // 读取要切分的结点
-    BTreeNode *child;
-    status = chidb_Btree_getNodeByPage(bt, npage_child, &child); CHECK;
+    BTreeNode *child_btn;
+    status = chidb_Btree_getNodeByPage(bt, npage_child, &child_btn); CHECK;
 
-    // 中间索引为n_cells / 2
-    int median_index = child->n_cells / 2;
+    // 缓冲池中同一页只有一份内存, 之后在npage_child上重建的right会覆盖child的cells,
+    // 因此先复制一份child的页数据, 切分时从副本中读取cells
+    uint8_t *child_data = malloc(bt->pager->page_size);
+    if (!child_data)
+    {
+        chidb_Btree_freeMemNode(bt, child_btn);
+        chidb_Btree_freeMemNode(bt, parent);
+        return CHIDB_ENOMEM;
+    }
+    memcpy(child_data, child_btn->page->data, bt->pager->page_size);
+    MemPage child_page = *child_btn->page;
+    child_page.data = child_data;
+    BTreeNode child_copy = *child_btn;
+    child_copy.page = &child_page;
+    child_copy.celloffset_array = child_data + (child_btn->celloffset_array - child_btn->page->data);
+    BTreeNode *child = &child_copy;
+    status = chidb_Btree_freeMemNode(bt, child_btn); CHECK;
+
+    // 中间索引为n_cells / 2, 追加时为最后一个cell
+    int median_index = append ? child->n_cells - 1 : child->n_cells / 2;
+
+    // 表叶子结点的中间cell留在左边, 只有一两个cell时键不大于它的btc所在的左边不会变小,
+    // 记录很大时切分之后仍然放不下. 这时中间cell前移一个, 只有一个cell时左边为空,
+    // 用btc的键作为提升到父结点的键
+    if (btc != NULL && !append && child->type == PGTYPE_TABLE_LEAF && median_index == child->n_cells - 1)
+    {
+        ncell_t pos;
+        chidb_Btree_searchNode(child, btc->key, &pos);
+        if (pos <= median_index)
+        {
+            median_index--;
+        }
+    }
 
     // 新建一个结点用于存储切分的左半部分cells
     npage_t left_num;
@@ -1163,7 +1832,14 @@ int chidb_Btree_split(BTree *bt, npage_t npage_parent, npage_t npage_child, ncel
 
     // 将要切分的结点的中间Cell提升到父结点中
     BTreeCell mcell, to_insert_cell;
-    status = chidb_Btree_getCell(child, median_index, &mcell); CHECK;
+    if (median_index >= 0)
+    {
+        status = chidb_Btree_getCell(child, median_index, &mcell); CHECK;
+    }
+    else
+    {
+        mcell = *btc;
+    }
     to_insert_cell.type = parent->type;
     to_insert_cell.key = mcell.key;
     switch(parent->type)
@@ -1190,6 +1866,16 @@ int chidb_Btree_split(BTree *bt, npage_t npage_parent, npage_t npage_child, ncel
     // 插入到父结点中
     status = chidb_Btree_insertCell(parent, parent_ncell, &to_insert_cell); CHECK;
 
+    // 切分表叶子结点时, 在两半的页尾预留兄弟链接的空间
+    // (只有记录很大, 某一半放不下链接时才不建立链接)
+    bool link = (child->type == PGTYPE_TABLE_LEAF)
+             && chidb_Btree_fitsWithLinks(bt, child, 0, median_index + 1)
+             && chidb_Btree_fitsWithLinks(bt, child, median_index + 1, child->n_cells);
+    if (link)
+    {
+        left->cells_offset -= LEAFPG_LINKS_SIZE;
+    }
+
     BTreeCell cell;
     // 将左半边的cells插入到左边的页中
     int i;
@@ -1200,15 +1886,20 @@ int chidb_Btree_split(BTree *bt, npage_t npage_parent, npage_t npage_child, ncel
     }
 
     // 如果需要中间cell的话则插入到左页中
-    status = chidb_Btree_getCell(child, i, &cell); CHECK;
-    // 如果为叶结点, 则直接插入到左页中
+    // 如果为叶结点, 则直接插入到左页中(左边为空时没有中间cell)
     if (child->type == PGTYPE_TABLE_LEAF)
     {
-        status = chidb_Btree_insertCell(left, i++, &cell); CHECK;
+        if (median_index >= 0)
+        {
+            status = chidb_Btree_getCell(child, i, &cell); CHECK;
+            status = chidb_Btree_insertCell(left, i++, &cell); CHECK;
+        }
     }
-    // 如果中间cell不是索引叶子结点, 则需要将左结点的right page指向中间cell的前一个child page
-    else if (cell.type != PGTYPE_INDEX_LEAF)
+    // 否则中间cell已经提升到父结点中, 右页中不再保留它
+    else
     {
+        status = chidb_Btree_getCell(child, i, &cell); CHECK;
+        // 如果中间cell不是索引叶子结点, 则需要将左结点的right page指向中间cell的前一个child page
         switch(cell.type)
         {
         case PGTYPE_TABLE_INTERNAL:
@@ -1218,12 +1909,17 @@ int chidb_Btree_split(BTree *bt, npage_t npage_parent, npage_t npage_child, ncel
             left->right_page = cell.fields.indexInternal.child_page;
             break;
         }
+        i++;
     }
 
     BTreeNode *right;
     // 在npage_child的位置新建一个空结点使right指向
     status = chidb_Btree_initEmptyNode(bt, npage_child, child->type); CHECK;
     status = chidb_Btree_getNodeByPage(bt, npage_child, &right); CHECK;
+    if (link)
+    {
+        right->cells_offset -= LEAFPG_LINKS_SIZE;
+    }
 
     // 将中间之后的cells插入到right中
     int j;
@@ -1234,8 +1930,35 @@ int chidb_Btree_split(BTree *bt, npage_t npage_parent, npage_t npage_child, ncel
     }
     right->right_page = child->right_page;
 
-    // 释放child
-    status = chidb_Btree_freeMemNode(bt, child);
+    // 维护叶结点链表: prev <-> left <-> right(原child的页) <-> next
+    // right仍在原来的页上, 所以next指向它的链接不用修改
+    if (link)
+    {
+        left->linked = right->linked = true;
+        left->prev_leaf = child->prev_leaf;
+        left->next_leaf = npage_child;
+        right->prev_leaf = left_num;
+        right->next_leaf = child->next_leaf;
+        if (child->prev_leaf)
+        {
+            status = chidb_Btree_setLeafLink(bt, child->prev_leaf, true, left_num); CHECK;
+        }
+    }
+    else if (child->linked)
+    {
+        // 无法建立链接时, 把邻居指向这里的链接置为未知
+        if (child->prev_leaf)
+        {
+            status = chidb_Btree_setLeafLink(bt, child->prev_leaf, true, 0); CHECK;
+        }
+        if (child->next_leaf)
+        {
+            status = chidb_Btree_setLeafLink(bt, child->next_leaf, false, 0); CHECK;
+        }
+    }
+
+    // 释放child的副本
+    free(child_data);
 
     // 将修改后的页写入文件
     status = chidb_Btree_writeNode(bt, parent); CHECK;
@@ -1253,4 +1976,742 @@ int chidb_Btree_split(BTree *bt, npage_t npage_parent, npage_t npage_child, ncel
     return CHIDB_OK;
 }
 
+// 结点的页头(包括单元格偏移数组之前的部分)的大小
+#define NODE_HEADER_SIZE(type) \
+    ((((type) == PGTYPE_TABLE_INTERNAL) || ((type) == PGTYPE_INDEX_INTERNAL)) \
+     ? INTPG_CELLSOFFSET_OFFSET : LEAFPG_CELLSOFFSET_OFFSET)
+
+// 结点中cells及其偏移数组已经使用的字节数
+static uint32_t chidb_Btree_usedSpace(BTree *bt, BTreeNode *btn)
+{
+    uint32_t end = bt->pager->page_size - (btn->linked ? LEAFPG_LINKS_SIZE : 0);
+
+    return end - btn->cells_offset + 2 * btn->n_cells;
+}
+
+// 结点中可用于存放cells及其偏移数组的字节数
+static uint32_t chidb_Btree_capacity(BTree *bt, BTreeNode *btn)
+{
+    uint32_t end = bt->pager->page_size - (btn->linked ? LEAFPG_LINKS_SIZE : 0);
+
+    return end - (btn->celloffset_array - btn->page->data);
+}
+
+// 使用不到一半空间的结点需要与兄弟结点合并或重新分配
+static bool chidb_Btree_isUnderfull(BTree *bt, BTreeNode *btn)
+{
+    return btn->n_cells == 0
+        || 2 * chidb_Btree_usedSpace(bt, btn) < chidb_Btree_capacity(bt, btn);
+}
+
+// 将结点npage读到page->data中新分配的一份副本里, 之后重建该页时仍可从副本中读取cells
+static int chidb_Btree_copyNode(BTree *bt, npage_t npage, BTreeNode *btn, MemPage *page)
+{
+    BTreeNode *orig;
+    int status = chidb_Btree_getNodeByPage(bt, npage, &orig); CHECK;
+
+    if (!(page->data = malloc(bt->pager->page_size)))
+    {
+        chidb_Btree_freeMemNode(bt, orig);
+        return CHIDB_ENOMEM;
+    }
+    memcpy(page->data, orig->page->data, bt->pager->page_size);
+    page->npage = npage;
+
+    *btn = *orig;
+    btn->page = page;
+    btn->celloffset_array = page->data + (orig->celloffset_array - orig->page->data);
+
+    return chidb_Btree_freeMemNode(bt, orig);
+}
+
+// 用给定的cells重建npage上的结点
+static int chidb_Btree_rebuildNode(BTree *bt, npage_t npage, uint8_t type,
+                                   BTreeCell *cells, ncell_t ncells, npage_t right_page,
+                                   bool linked, npage_t prev_leaf, npage_t next_leaf)
+{
+    BTreeNode *btn;
+
+    int status = chidb_Btree_initEmptyNode(bt, npage, type); CHECK;
+    status = chidb_Btree_getNodeByPage(bt, npage, &btn); CHECK;
+
+    if (linked)
+    {
+        btn->cells_offset -= LEAFPG_LINKS_SIZE;
+    }
+    for (ncell_t i = 0; i < ncells && status == CHIDB_OK; i++)
+    {
+        status = chidb_Btree_insertCell(btn, i, &cells[i]);
+    }
+    btn->right_page = right_page;
+    btn->linked = linked;
+    btn->prev_leaf = prev_leaf;
+    btn->next_leaf = next_leaf;
+
+    if (status == CHIDB_OK)
+    {
+        status = chidb_Btree_writeNode(bt, btn);
+    }
+    chidb_Btree_freeMemNode(bt, btn);
+
+    return status;
+}
+
+// 修改父结点中第ncell个cell的键(内部索引结点还要修改KeyPk)
+static void chidb_Btree_setSeparator(BTreeNode *parent, ncell_t ncell, BTreeCell *cell)
+{
+    uint8_t *data = parent->page->data + get2byte(parent->celloffset_array + ncell * 2);
+
+    if (parent->type == PGTYPE_TABLE_INTERNAL)
+    {
+        putVarint32(data + TABLEINTCELL_KEY_OFFSET, cell->key);
+    }
+    else
+    {
+        put4byte(data + INDEXINTCELL_KEYIDX_OFFSET, cell->key);
+        // 索引叶子与内部cell的keyPk都位于union的起始位置
+        put4byte(data + INDEXINTCELL_KEYPK_OFFSET, cell->fields.indexLeaf.keyPk);
+    }
+}
+
+/* Rebalance an underfull child of a B-Tree node
+ *
+ * Takes the underfull child at position nchild of an internal node
+ * (nchild == n_cells being its right page) together with an adjacent
+ * sibling. If the cells of both (plus the separating cell in the parent,
+ * except for table leaves) fit in a single node, the siblings are merged
+ * into the right sibling's page, the separating cell is removed from the
+ * parent and the left sibling's page is freed. Otherwise, the cells are
+ * redistributed evenly between both siblings and the separating cell in
+ * the parent is updated in place (its size never changes).
+ *
+ * Sibling links of table leaves are kept consistent (see PGFLAG_LEAF_LINKS).
+ * The parent is modified in memory only; the caller must write it.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - parent: Parent node
+ * - nchild: Position of the underfull child in the parent
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+static int chidb_Btree_rebalance(BTree *bt, BTreeNode *parent, ncell_t nchild)
+{
+    BTreeCell sep_cell, *cells;
+    BTreeNode left, right;
+    MemPage left_page, right_page;
+    int status;
+
+    // 只剩right page的结点没有可以合并的兄弟
+    if (parent->n_cells == 0)
+    {
+        return CHIDB_OK;
+    }
+
+    // 兄弟结点为left和right, 父结点中的第sep个cell分隔它们
+    ncell_t sep = (nchild < parent->n_cells) ? nchild : parent->n_cells - 1;
+    status = chidb_Btree_getCell(parent, sep, &sep_cell); CHECK;
+    npage_t left_num = (parent->type == PGTYPE_TABLE_INTERNAL)
+                     ? sep_cell.fields.tableInternal.child_page
+                     : sep_cell.fields.indexInternal.child_page;
+    npage_t right_num = parent->right_page;
+    if (sep + 1 < parent->n_cells)
+    {
+        BTreeCell cell;
+        status = chidb_Btree_getCell(parent, sep + 1, &cell); CHECK;
+        right_num = (parent->type == PGTYPE_TABLE_INTERNAL)
+                  ? cell.fields.tableInternal.child_page
+                  : cell.fields.indexInternal.child_page;
+    }
+
+    status = chidb_Btree_copyNode(bt, left_num, &left, &left_page); CHECK;
+    status = chidb_Btree_copyNode(bt, right_num, &right, &right_page);
+    if (status != CHIDB_OK)
+    {
+        free(left_page.data);
+        return status;
+    }
+
+    uint8_t type = left.type;
+    bool table_leaf = (type == PGTYPE_TABLE_LEAF);
+    ncell_t n = 0;
+    uint32_t total = 0;
+
+    if (!(cells = malloc((left.n_cells + right.n_cells + 1) * sizeof(BTreeCell))))
+    {
+        free(left_page.data);
+        free(right_page.data);
+        return CHIDB_ENOMEM;
+    }
+
+    // 按顺序收集两个兄弟的cells; 除表叶子结点外, 父结点中的分隔cell也要放到两者之间
+    for (ncell_t i = 0; i < left.n_cells; i++)
+    {
+        chidb_Btree_getCell(&left, i, &cells[n++]);
+    }
+    if (!table_leaf)
+    {
+        BTreeCell *c = &cells[n++];
+        c->type = type;
+        c->key = sep_cell.key;
+        switch (type)
+        {
+        case PGTYPE_TABLE_INTERNAL:
+            c->fields.tableInternal.child_page = left.right_page;
+            break;
+        case PGTYPE_INDEX_INTERNAL:
+            c->fields.indexInternal.keyPk = sep_cell.fields.indexInternal.keyPk;
+            c->fields.indexInternal.child_page = left.right_page;
+            break;
+        case PGTYPE_INDEX_LEAF:
+            c->fields.indexLeaf.keyPk = sep_cell.fields.indexInternal.keyPk;
+            break;
+        }
+    }
+    for (ncell_t i = 0; i < right.n_cells; i++)
+    {
+        chidb_Btree_getCell(&right, i, &cells[n++]);
+    }
+    for (ncell_t i = 0; i < n; i++)
+    {
+        total += chidb_Btree_cellSize(type, &cells[i]) + 2;
+    }
+
+    uint32_t capacity = bt->pager->page_size - NODE_HEADER_SIZE(type);
+    npage_t prev_leaf = left.linked ? left.prev_leaf : 0;
+    npage_t next_leaf = right.linked ? right.next_leaf : 0;
+
+    if (total <= capacity)
+    {
+        // 合并到right的页中, 删除父结点中指向left的cell, 释放left的页
+        bool link = table_leaf && total + LEAFPG_LINKS_SIZE <= capacity;
+
+        status = chidb_Btree_rebuildNode(bt, right_num, type, cells, n, right.right_page,
+                                         link, prev_leaf, next_leaf);
+        if (status == CHIDB_OK && table_leaf)
+        {
+            // prev原来指向left, 现在指向合并后的结点; next已经指向right的页
+            if (prev_leaf)
+                status = chidb_Btree_setLeafLink(bt, prev_leaf, true, link ? right_num : 0);
+            if (status == CHIDB_OK && next_leaf && !link)
+                status = chidb_Btree_setLeafLink(bt, next_leaf, false, 0);
+        }
+        if (status == CHIDB_OK)
+            status = chidb_Btree_removeCell(parent, sep);
+        if (status == CHIDB_OK)
+            status = chidb_Btree_freePage(bt, left_num);
+    }
+    else
+    {
+        // 重新分配: left得到前m个cells, right得到剩下的(非表叶子结点的第m个cell提升到父结点中)
+        ncell_t m = 0;
+        uint32_t prefix = 0, rest;
+
+        while (m < n - 1 && 2 * (prefix + chidb_Btree_cellSize(type, &cells[m]) + 2) <= total)
+        {
+            prefix += chidb_Btree_cellSize(type, &cells[m++]) + 2;
+        }
+
+        // 保证两边都放得下且都不为空
+        ncell_t lo = 1, hi = table_leaf ? n - 1 : n - 2;
+        for (;;)
+        {
+            rest = total - prefix - (table_leaf ? 0 : chidb_Btree_cellSize(type, &cells[m]) + 2);
+            if (m < hi && rest > capacity)
+                prefix += chidb_Btree_cellSize(type, &cells[m++]) + 2;
+            else if (m > lo && prefix > capacity)
+                prefix -= chidb_Btree_cellSize(type, &cells[--m]) + 2;
+            else
+                break;
+        }
+
+        if (m < lo || m > hi || prefix > capacity || rest > capacity)
+        {
+            // 无法重新分配(只在记录很大时发生), 保持原样, 树仍然是合法的
+            status = CHIDB_OK;
+        }
+        else if (table_leaf)
+        {
+            bool link = prefix + LEAFPG_LINKS_SIZE <= capacity
+                     && rest + LEAFPG_LINKS_SIZE <= capacity;
+
+            status = chidb_Btree_rebuildNode(bt, left_num, type, cells, m, 0,
+                                             link, prev_leaf, right_num);
+            if (status == CHIDB_OK)
+                status = chidb_Btree_rebuildNode(bt, right_num, type, cells + m, n - m, 0,
+                                                 link, left_num, next_leaf);
+            // 无法建立链接时, 把邻居指向这里的链接置为未知
+            if (status == CHIDB_OK && !link && prev_leaf)
+                status = chidb_Btree_setLeafLink(bt, prev_leaf, true, 0);
+            if (status == CHIDB_OK && !link && next_leaf)
+                status = chidb_Btree_setLeafLink(bt, next_leaf, false, 0);
+            if (status == CHIDB_OK)
+                chidb_Btree_setSeparator(parent, sep, &cells[m - 1]);
+        }
+        else
+        {
+            npage_t mid_child = (type == PGTYPE_TABLE_INTERNAL)
+                              ? cells[m].fields.tableInternal.child_page
+                              : cells[m].fields.indexInternal.child_page;
+
+            status = chidb_Btree_rebuildNode(bt, left_num, type, cells, m, mid_child, false, 0, 0);
+            if (status == CHIDB_OK)
+                status = chidb_Btree_rebuildNode(bt, right_num, type, cells + m + 1, n - m - 1,
+                                                 right.right_page, false, 0, 0);
+            if (status == CHIDB_OK)
+                chidb_Btree_setSeparator(parent, sep, &cells[m]);
+        }
+    }
+
+    free(cells);
+    free(left_page.data);
+    free(right_page.data);
+
+    return status;
+}
+
+// 在索引B树npage中找到最大的一条记录(最右边的叶子结点的最后一个cell)
+static int chidb_Btree_lastCell(BTree *bt, npage_t npage, BTreeCell *cell)
+{
+    BTreeNode *btn;
+    int status;
+
+    for (;;)
+    {
+        status = chidb_Btree_getNodeByPage(bt, npage, &btn); CHECK;
+        if (btn->type != PGTYPE_INDEX_INTERNAL)
+        {
+            break;
+        }
+        npage = btn->right_page;
+        chidb_Btree_freeMemNode(bt, btn);
+    }
+
+    status = (btn->n_cells > 0) ? chidb_Btree_getCell(btn, btn->n_cells - 1, cell) : CHIDB_ECELLNO;
+    chidb_Btree_freeMemNode(bt, btn);
+
+    return status;
+}
+
+// 从以npage为根的子树中删除key, 并通过underfull返回该结点是否需要重新平衡
+static int chidb_Btree_deleteFrom(BTree *bt, npage_t npage, chidb_key_t key, bool *underfull)
+{
+    BTreeNode *btn;
+    BTreeCell cell;
+    ncell_t i;
+    bool child_underfull = false;
+
+    int status = chidb_Btree_getNodeByPage(bt, npage, &btn); CHECK;
+    int found = chidb_Btree_searchNode(btn, key, &i);
+
+    // 叶子结点中直接删除cell
+    if (btn->type == PGTYPE_TABLE_LEAF || btn->type == PGTYPE_INDEX_LEAF)
+    {
+        if (found != CHIDB_OK)
+        {
+            chidb_Btree_freeMemNode(bt, btn);
+            return CHIDB_ENOTFOUND;
+        }
+
+        status = chidb_Btree_removeCell(btn, i);
+        if (status == CHIDB_OK)
+            status = chidb_Btree_writeNode(bt, btn);
+        *underfull = chidb_Btree_isUnderfull(bt, btn);
+        chidb_Btree_freeMemNode(bt, btn);
+        return status;
+    }
+
+    // 内部结点中找到key所在的子结点
+    npage_t child = btn->right_page;
+    if (i < btn->n_cells)
+    {
+        chidb_Btree_getCell(btn, i, &cell);
+        child = (btn->type == PGTYPE_TABLE_INTERNAL)
+              ? cell.fields.tableInternal.child_page
+              : cell.fields.indexInternal.child_page;
+    }
+
+    if (found == CHIDB_OK && btn->type == PGTYPE_INDEX_INTERNAL)
+    {
+        // 内部索引结点中的cell本身就是一条记录, 先从左子树中删除最大的记录,
+        // 再用它替换这个cell
+        BTreeCell pred;
+        status = chidb_Btree_lastCell(bt, child, &pred);
+        if (status == CHIDB_OK)
+            status = chidb_Btree_deleteFrom(bt, child, pred.key, &child_underfull);
+        if (status == CHIDB_OK)
+            chidb_Btree_setSeparator(btn, i, &pred);
+    }
+    else
+    {
+        status = chidb_Btree_deleteFrom(bt, child, key, &child_underfull);
+    }
+
+    if (status == CHIDB_OK && child_underfull)
+        status = chidb_Btree_rebalance(bt, btn, i);
+    if (status == CHIDB_OK)
+        status = chidb_Btree_writeNode(bt, btn);
+
+    *underfull = chidb_Btree_isUnderfull(bt, btn);
+    chidb_Btree_freeMemNode(bt, btn);
+
+    return status;
+}
+
+/* Delete an entry from a B-Tree
+ *
+ * Removes the entry with the given key from a table or index B-Tree.
+ * The cell is removed from its leaf and, on the way back up, any node
+ * left less than half full is merged with or borrows cells from an
+ * adjacent sibling (see chidb_Btree_rebalance). Pages that are no
+ * longer used are added to the free-page list. If the root ends up
+ * as an internal node with no cells, the tree shrinks by one level:
+ * the contents of its only child are moved into the root page (the
+ * root page number never changes).
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree
+ * - key: Key of the entry to delete
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: No entry with the given key was found
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_delete(BTree *bt, npage_t nroot, chidb_key_t key)
+{
+    BTreeNode *root, child;
+    MemPage child_page;
+    bool underfull;
+
+    int status = chidb_Btree_deleteFrom(bt, nroot, key, &underfull); CHECK;
+
+    for (;;)
+    {
+        status = chidb_Btree_getNodeByPage(bt, nroot, &root); CHECK;
+        bool collapse = root->n_cells == 0
+                     && (root->type == PGTYPE_TABLE_INTERNAL || root->type == PGTYPE_INDEX_INTERNAL);
+        npage_t child_num = root->right_page;
+        uint32_t capacity = bt->pager->page_size - (nroot == 1 ? 100 : 0);
+        chidb_Btree_freeMemNode(bt, root);
+
+        if (!collapse)
+        {
+            return CHIDB_OK;
+        }
+
+        status = chidb_Btree_copyNode(bt, child_num, &child, &child_page); CHECK;
+
+        // 第一页的文件头占了100字节, 子结点的内容不一定放得下; 放不下时保留只有right page的根结点
+        BTreeCell *cells = malloc((child.n_cells + 1) * sizeof(BTreeCell));
+        uint32_t used = NODE_HEADER_SIZE(child.type);
+        for (ncell_t i = 0; cells && i < child.n_cells; i++)
+        {
+            chidb_Btree_getCell(&child, i, &cells[i]);
+            used += chidb_Btree_cellSize(child.type, &cells[i]) + 2;
+        }
+
+        if (!cells)
+            status = CHIDB_ENOMEM;
+        else if (used <= capacity)
+        {
+            // 根结点没有兄弟, 不需要兄弟链接
+            status = chidb_Btree_rebuildNode(bt, nroot, child.type, cells, child.n_cells,
+                                             child.right_page, false, 0, 0);
+            if (status == CHIDB_OK)
+                status = chidb_Btree_freePage(bt, child_num);
+        }
+
+        free(cells);
+        free(child_page.data);
+        if (status != CHIDB_OK || used > capacity)
+        {
+            return status;
+        }
+    }
+}
+
+// 为构建器的第level层分配并固定一个新的空结点
+static int chidb_Btree_bulkNode(BTreeBuilder *bb, uint32_t level, uint8_t type)
+{
+    BTreeNode *btn = &bb->level[level];
+    npage_t npage;
+
+    int status = chidb_Btree_newNode(bb->bt, &npage, type); CHECK;
+    status = chidb_Btree_pinNode(bb->bt, npage, btn); CHECK;
+
+    // 构建的表叶子结点总是带有兄弟链接
+    if (type == PGTYPE_TABLE_LEAF)
+    {
+        btn->cells_offset -= LEAFPG_LINKS_SIZE;
+        btn->linked = true;
+    }
+
+    return CHIDB_OK;
+}
+
+// 写入并释放第level层正在填充的结点
+static int chidb_Btree_bulkWrite(BTreeBuilder *bb, uint32_t level)
+{
+    int status = chidb_Btree_writeNode(bb->bt, &bb->level[level]);
+    chidb_Btree_unpinNode(bb->bt, &bb->level[level]);
+
+    return status;
+}
+
+// btc放入btn后, btn使用的空间是否仍不超过填充比例
+static bool chidb_Btree_bulkFits(BTreeBuilder *bb, BTreeNode *btn, BTreeCell *btc)
+{
+    if (!hasRoomForCell(btn, btc))
+    {
+        return false;
+    }
+
+    // 空结点至少要放一个cell
+    uint32_t used = chidb_Btree_usedSpace(bb->bt, btn) + chidb_Btree_cellSize(btn->type, btc) + 2;
+    return btn->n_cells == 0
+        || used * 100 <= chidb_Btree_capacity(bb->bt, btn) * bb->fill;
+}
+
+// 把指向一个已完成的子结点的cell加入第level层(level >= 1). 该层已满时,
+// 子结点成为它的right page, 它自己则作为已完成的结点加入上一层
+static int chidb_Btree_bulkPush(BTreeBuilder *bb, uint32_t level, BTreeCell *btc)
+{
+    BTreeNode *btn = &bb->level[level];
+    int status;
+
+    // 新的一层
+    if (level == bb->depth)
+    {
+        if (level == BTREE_MAX_DEPTH)
+        {
+            return CHIDB_ENOMEM;
+        }
+        status = chidb_Btree_bulkNode(bb, level, btc->type); CHECK;
+        bb->depth++;
+    }
+
+    if (chidb_Btree_bulkFits(bb, btn, btc))
+    {
+        return chidb_Btree_insertCell(btn, btn->n_cells, btc);
+    }
+
+    BTreeCell up = *btc;
+    btn->right_page = (btc->type == PGTYPE_TABLE_INTERNAL)
+                    ? btc->fields.tableInternal.child_page
+                    : btc->fields.indexInternal.child_page;
+    if (up.type == PGTYPE_TABLE_INTERNAL)
+        up.fields.tableInternal.child_page = btn->page->npage;
+    else
+        up.fields.indexInternal.child_page = btn->page->npage;
+
+    status = chidb_Btree_bulkWrite(bb, level); CHECK;
+    status = chidb_Btree_bulkNode(bb, level, btc->type); CHECK;
+
+    return chidb_Btree_bulkPush(bb, level + 1, &up);
+}
+
+/* Start building a B-Tree from sorted entries
+ *
+ * Initializes a BTreeBuilder that creates a new B-Tree from entries
+ * given (with chidb_Btree_bulkAppend) in increasing key order. Unlike
+ * inserting the entries one by one, no node is ever searched or split:
+ * leaves are filled up to the given fill factor and written once, and
+ * the internal levels are built bottom-up as the leaves are completed.
+ * Table leaves are linked to their siblings.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - bb: BTreeBuilder to initialize
+ * - type: Type of the leaves (PGTYPE_TABLE_LEAF or PGTYPE_INDEX_LEAF)
+ * - fill: Percentage (1-100) of each node to fill. Filling nodes
+ *         completely makes scans cheaper, while leaving some room
+ *         makes later insertions cheaper.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Invalid type or fill factor
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_bulkInit(BTree *bt, BTreeBuilder *bb, uint8_t type, uint8_t fill)
+{
+    if ((type != PGTYPE_TABLE_LEAF && type != PGTYPE_INDEX_LEAF) || fill == 0 || fill > 100)
+    {
+        return CHIDB_EMISUSE;
+    }
+
+    bb->bt = bt;
+    bb->type = type;
+    bb->fill = fill;
+    bb->depth = 1;
+    bb->empty = true;
+    bb->last_key = 0;
+
+    return chidb_Btree_bulkNode(bb, 0, type);
+}
+
+/* Append an entry to a B-Tree being built
+ *
+ * Parameters
+ * - bb: BTreeBuilder
+ * - btc: Entry to append (a table leaf or index leaf cell, according to
+ *        the type given to chidb_Btree_bulkInit). Its key must be larger
+ *        than the key of every entry appended before.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EDUPLICATE: The key is equal to the previous key
+ * - CHIDB_EMISUSE: The key is smaller than the previous key, or the
+ *                  cell has the wrong type
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_bulkAppend(BTreeBuilder *bb, BTreeCell *btc)
+{
+    BTreeNode *leaf = &bb->level[0];
+    BTreeCell sep;
+    int status;
+
+    if (btc->type != bb->type)
+    {
+        return CHIDB_EMISUSE;
+    }
+    if (!bb->empty && !chidb_Btree_keyLess(bb->type, bb->last_key, btc->key))
+    {
+        return (btc->key == bb->last_key) ? CHIDB_EDUPLICATE : CHIDB_EMISUSE;
+    }
+
+    if (!chidb_Btree_bulkFits(bb, leaf, btc))
+    {
+        npage_t nleaf = leaf->page->npage;
+
+        if (bb->type == PGTYPE_TABLE_LEAF)
+        {
+            // 表B树中, 父结点中的键为左边子结点中最大的键
+            npage_t next;
+            sep.type = PGTYPE_TABLE_INTERNAL;
+            sep.key = bb->last_key;
+            sep.fields.tableInternal.child_page = nleaf;
+
+            // 先分配下一个叶子结点, 以便在写入之前链接两者
+            status = chidb_Btree_newNode(bb->bt, &next, PGTYPE_TABLE_LEAF); CHECK;
+            leaf->next_leaf = next;
+            status = chidb_Btree_bulkWrite(bb, 0); CHECK;
+            status = chidb_Btree_pinNode(bb->bt, next, leaf); CHECK;
+            leaf->cells_offset -= LEAFPG_LINKS_SIZE;
+            leaf->linked = true;
+            leaf->prev_leaf = nleaf;
+
+            status = chidb_Btree_bulkPush(bb, 1, &sep); CHECK;
+        }
+        else
+        {
+            // 索引B树中, btc本身成为父结点中的cell, 不再放入叶子结点
+            sep.type = PGTYPE_INDEX_INTERNAL;
+            sep.key = btc->key;
+            sep.fields.indexInternal.keyPk = btc->fields.indexLeaf.keyPk;
+            sep.fields.indexInternal.child_page = nleaf;
+
+            status = chidb_Btree_bulkWrite(bb, 0); CHECK;
+            status = chidb_Btree_bulkNode(bb, 0, PGTYPE_INDEX_LEAF); CHECK;
+            status = chidb_Btree_bulkPush(bb, 1, &sep); CHECK;
+
+            bb->empty = false;
+            bb->last_key = btc->key;
+            return CHIDB_OK;
+        }
+    }
+
+    status = chidb_Btree_insertCell(leaf, leaf->n_cells, btc); CHECK;
+    bb->empty = false;
+    bb->last_key = btc->key;
+
+    return CHIDB_OK;
+}
+
+/* Finish building a B-Tree
+ *
+ * Completes the node being filled at each level (each one becomes the
+ * right page of the node above it) and releases them. The last nodes
+ * of each level may be nearly empty; they are merged with or borrow
+ * cells from their left siblings (see chidb_Btree_rebalance), so that
+ * the resulting tree is no different from one built by insertions.
+ * The builder must be finished even if chidb_Btree_bulkAppend failed.
+ *
+ * Parameters
+ * - bb: BTreeBuilder
+ * - nroot: Out parameter. Page number of the root of the new B-Tree.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_bulkFinish(BTreeBuilder *bb, npage_t *nroot)
+{
+    BTree *bt = bb->bt;
+    BTreeNode *btn;
+    int status = CHIDB_OK;
+
+    // 自下而上完成每一层, 下一层的结点成为上一层的right page
+    npage_t child = bb->level[0].page->npage;
+    if (chidb_Btree_bulkWrite(bb, 0) != CHIDB_OK)
+        status = CHIDB_EIO;
+    for (uint32_t i = 1; i < bb->depth; i++)
+    {
+        bb->level[i].right_page = child;
+        child = bb->level[i].page->npage;
+        if (chidb_Btree_bulkWrite(bb, i) != CHIDB_OK)
+            status = CHIDB_EIO;
+    }
+    bb->depth = 0;
+    CHECK;
+
+    *nroot = child;
+
+    // 沿最右边的路径向下, 重新平衡每一层最后的结点
+    npage_t npage = *nroot;
+    for (;;)
+    {
+        status = chidb_Btree_getNodeByPage(bt, npage, &btn); CHECK;
+        if (btn->type != PGTYPE_TABLE_INTERNAL && btn->type != PGTYPE_INDEX_INTERNAL)
+        {
+            break;
+        }
+
+        BTreeNode *right;
+        status = chidb_Btree_getNodeByPage(bt, btn->right_page, &right);
+        if (status == CHIDB_OK)
+        {
+            bool underfull = chidb_Btree_isUnderfull(bt, right);
+            chidb_Btree_freeMemNode(bt, right);
+            if (underfull)
+                status = chidb_Btree_rebalance(bt, btn, btn->n_cells);
+        }
+        if (status == CHIDB_OK)
+            status = chidb_Btree_writeNode(bt, btn);
+
+        // 合并或重新分配后right page仍在原来的页上
+        npage = btn->right_page;
+        bool collapse = (btn->n_cells == 0 && btn->page->npage == *nroot);
+        chidb_Btree_freeMemNode(bt, btn);
+        CHECK;
+
+        // 根结点的两个子结点合并后, 唯一的子结点成为根结点
+        if (collapse)
+        {
+            status = chidb_Btree_freePage(bt, *nroot); CHECK;
+            *nroot = npage;
+        }
+    }
+
+    return chidb_Btree_freeMemNode(bt, btn);
+}
+
 // --------- My Code End ---------
@@ -43,6 +43,16 @@
 #include "chidbInt.h"
 #include "pager.h"
 
+/* File header offsets. Bytes 68-75 are unused by the chidb file format;
+ * we keep the free-page list there. Free pages are chained through their
+ * first four bytes (page number of the next free page, 0 at the end). */
+
+#define HEADER_FREELIST_OFFSET (68)
+#define HEADER_FREECOUNT_OFFSET (72)
+
+/* Schema cookie: incremented every time the schema table changes */
+#define HEADER_SCHEMA_COOKIE_OFFSET (40)
+
 /* Page header offsets and sizes */
 
 #define PGTYPE_TABLE_INTERNAL (0x05)
@@ -57,6 +67,14 @@
 #define PGHEADER_ZERO_OFFSET (7)
 #define PGHEADER_RIGHTPG_OFFSET (8)
 
+/* Table leaves may be linked to their neighbouring leaves. The links are
+ * stored in the last LEAFPG_LINKS_SIZE bytes of the page (previous leaf,
+ * then next leaf) and are only present if the PGFLAG_LEAF_LINKS bit is set
+ * in the (otherwise zero) byte at PGHEADER_ZERO_OFFSET. A zero link means
+ * there is no neighbour or it is not known. */
+#define PGFLAG_LEAF_LINKS (0x01)
+#define LEAFPG_LINKS_SIZE (8)
+
 #define LEAFPG_CELLSOFFSET_OFFSET (8)
 #define INTPG_CELLSOFFSET_OFFSET (12)
 
@@ -87,6 +105,10 @@
 typedef struct BTreeCell BTreeCell;
 typedef struct BTreeNode BTreeNode;
 
+/* Number of B-Trees for which the rightmost leaf is remembered (see
+ * chidb_Btree_insert) */
+#define BTREE_APPEND_HINTS (4)
+
 /* The BTree struct represent a "B-Tree file". It contains a pointer to the
  * chidb database it is a part of, and a pointer to a Pager, which it will
  * use to access pages on the file */
@@ -94,6 +116,18 @@ typedef struct BTree
 {
     chidb *db;
     Pager *pager;
+
+    /* Rightmost leaf of the B-Trees most recently inserted into, so that
+     * keys larger than any other key in the tree (e.g., increasing rowids)
+     * can be appended without descending from the root. nroot == 0 means
+     * the entry is unused. */
+    struct
+    {
+        npage_t nroot;
+        npage_t nleaf;
+        chidb_key_t key;   /* Largest key in the tree */
+    } append[BTREE_APPEND_HINTS];
+    uint8_t append_next;
 } Btree;
 
 /* The BTreeNode struct is an in-memory representation of a B-Tree node. Thus,
@@ -116,6 +150,9 @@ struct BTreeNode
     ncell_t n_cells;           /* Number of cells */
     uint16_t cells_offset;     /* Byte offset of start of cells in page */
     npage_t right_page;        /* Right page (internal nodes only) */
+    bool linked;               /* Has sibling links (table leaves only) */
+    npage_t prev_leaf;         /* Previous leaf, if linked */
+    npage_t next_leaf;         /* Next leaf, if linked */
     uint8_t *celloffset_array; /* Pointer to start of cell offset array in the in-memory page */
 };
 
@@ -148,21 +185,50 @@ struct BTreeCell
     } fields;
 };
 
+/* Maximum height of a B-Tree built with chidb_Btree_bulkInit */
+#define BTREE_MAX_DEPTH (32)
+
+/* A BTreeBuilder builds a new B-Tree bottom-up from entries appended in
+ * increasing key order (see chidb_Btree_bulkInit). It keeps the node being
+ * filled at each level pinned in the pager; every node is written once,
+ * when it is full. */
+typedef struct BTreeBuilder
+{
+    BTree *bt;
+    uint8_t type;                       /* Leaf type (PGTYPE_TABLE_LEAF or PGTYPE_INDEX_LEAF) */
+    uint8_t fill;                       /* Percentage of each page to fill */
+    uint32_t depth;                     /* Number of levels built so far */
+    BTreeNode level[BTREE_MAX_DEPTH];   /* Node being filled at each level (0 is the leaf level) */
+    bool empty;                         /* No entry has been appended yet */
+    chidb_key_t last_key;               /* Key of the last entry appended */
+} BTreeBuilder;
+
 
 int chidb_Btree_open(const char *filename, chidb *db, BTree **bt);
 int chidb_Btree_close(BTree *bt);
+int chidb_Btree_commit(BTree *bt);
+int chidb_Btree_rollback(BTree *bt);
+int chidb_Btree_getSchemaCookie(BTree *bt, uint32_t *cookie);
+int chidb_Btree_incrSchemaCookie(BTree *bt);
 
 int chidb_Btree_getNodeByPage(BTree *bt, npage_t npage, BTreeNode **node);
 int chidb_Btree_freeMemNode(BTree *bt, BTreeNode *btn);
+int chidb_Btree_pinNode(BTree *bt, npage_t npage, BTreeNode *btn);
+int chidb_Btree_unpinNode(BTree *bt, BTreeNode *btn);
 
 int chidb_Btree_newNode(BTree *bt, npage_t *npage, uint8_t type);
+int chidb_Btree_freePage(BTree *bt, npage_t npage);
 int chidb_Btree_initEmptyNode(BTree *bt, npage_t npage, uint8_t type);
 int chidb_Btree_writeNode(BTree *bt, BTreeNode *node);
 
 int chidb_Btree_getCell(BTreeNode *btn, ncell_t ncell, BTreeCell *cell);
 int chidb_Btree_insertCell(BTreeNode *btn, ncell_t ncell, BTreeCell *cell);
+int chidb_Btree_removeCell(BTreeNode *btn, ncell_t ncell);
+int chidb_Btree_searchNode(BTreeNode *btn, chidb_key_t key, ncell_t *ncell);
 
 int chidb_Btree_find(BTree *bt, npage_t nroot, chidb_key_t key, uint8_t **data, uint16_t *size);
+int chidb_Btree_findRef(BTree *bt, npage_t nroot, chidb_key_t key, uint8_t **data, uint16_t *size, MemPage **page);
+int chidb_Btree_releaseRef(BTree *bt, MemPage *page);
 
 int chidb_Btree_insertInTable(BTree *bt, npage_t nroot, chidb_key_t key, uint8_t *data, uint16_t size);
 int chidb_Btree_insertInIndex(BTree *bt, npage_t nroot, chidb_key_t keyIdx, chidb_key_t keyPk);
@@ -170,5 +236,11 @@ int chidb_Btree_insert(BTree *bt, npage_t nroot, BTreeCell *btc);
 int chidb_Btree_insertNonFull(BTree *bt, npage_t npage, BTreeCell *btc);
 int chidb_Btree_split(BTree *bt, npage_t npage_parent, npage_t npage_child, ncell_t parent_cell, npage_t *npage_child2);
 
+int chidb_Btree_delete(BTree *bt, npage_t nroot, chidb_key_t key);
+
+int chidb_Btree_bulkInit(BTree *bt, BTreeBuilder *bb, uint8_t type, uint8_t fill);
+int chidb_Btree_bulkAppend(BTreeBuilder *bb, BTreeCell *btc);
+int chidb_Btree_bulkFinish(BTreeBuilder *bb, npage_t *nroot);
+
 
 #endif /*BTREE_H_*/
@@ -50,6 +50,8 @@
 #include <string.h>
 #include <chidb/chidb.h>
 #include "../simclist/simclist.h"
+#include "schema.h"
+#include "stmt-cache.h"
 
 // Private codes (shouldn't be used by API users)
 #define CHIDB_NOHEADER (1)
@@ -66,6 +68,7 @@
 #define CHIDB_ENOREG (37) //Error accessing register
 
 #define DEFAULT_PAGE_SIZE (1024)
+#define DEFAULT_CACHE_SIZE (256) // pages kept in the pager's buffer pool
 
 #define MAX_STR_LEN (256)
 
@@ -77,18 +80,6 @@ typedef uint32_t chidb_key_t;
 typedef struct BTree BTree;
 
 // --------- My Code Begin ---------
-// 定义Schema结构
-typedef struct
-{
-    char *type;
-    char *name;
-    char *assoc;
-    int root_page;
-    chisql_statement_t *stmt;
-} chidb_schema_item_t;
-
-typedef list_t chidb_schema_t;
-
 /* A chidb database is initially only a BTree.
  * This presuposes that only the btree.c module has been implemented.
  * If other parts of the chidb Architecture are implemented, the
@@ -98,7 +89,11 @@ struct chidb
 {
     BTree   *bt;
     chidb_schema_t schema;
-    int need_refresh; // 创建新表之后会置为1
+    uint32_t schema_cookie; // 读取schema时文件头中的schema cookie, 不同时读取新加入的行
+    int need_refresh; // 回滚之后会置为1, 重新读取整个schema
+    int in_transaction; // 执行BEGIN之后置为1, COMMIT/ROLLBACK之后置为0
+    chidb_stmt_cache_t stmt_cache; // 编译好的语句, schema改变时清空
+    uint32_t sort_memory; // ORDER BY排序时在内存中保留的字节数, 0时使用默认值
 };
 // --------- My Code End ---------
 
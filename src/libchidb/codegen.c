@@ -61,19 +61,47 @@ chidb_dbm_op_t *chidb_make_op(
     return op;
 }
 
-// Step 4
-// 只包含创建表的代码生成
-int chidb_create_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t *ops)
+// 生成将值写入寄存器reg的指令, type为值所对应的列的类型
+// 值为参数时, 根据列的类型生成读取参数的Integer或String指令
+void chidb_value_codegen(list_t *ops, Literal_t *value, enum data_type type, int reg)
 {
-    Create_t *create = sql_stmt->stmt.create;
-    char *text = sql_stmt->text;
-
-    // 如果要创建的表名已存在则返回错误
-    if (chidb_check_table_exist(stmt->db->schema, create->table->name))
+    switch (value->t == TYPE_PARAM ? type : value->t)
     {
-        return CHIDB_EINVALIDSQL;
+    case TYPE_INT:
+        list_append(ops, chidb_make_op(
+            Op_Integer,
+            value->t == TYPE_PARAM ? 0 : value->val.ival,
+            reg,
+            value->t == TYPE_PARAM ? value->val.ival : 0, // 参数的编号, 0表示不是参数
+            NULL)); // not used
+        break;
+    case TYPE_TEXT:
+        if (value->t == TYPE_PARAM)
+            list_append(ops, chidb_make_op(
+                Op_String,
+                0, // 长度在执行时才知道
+                reg,
+                value->val.ival, // 参数的编号
+                NULL));
+        else
+            list_append(ops, chidb_make_op(
+                Op_String,
+                strlen(value->val.strval),
+                reg,
+                0, // not used
+                value->val.strval));
+        break;
+
+    // 并没有Op_Double 和 Op_Char
+    default:
+        break;
     }
+}
 
+// 生成在schema中加入一行的代码, 新的B树的根页码需要已经存储在寄存器4上
+void chidb_schema_insert_codegen(chidb_stmt *stmt, list_t *ops,
+    char *type, char *name, char *assoc, char *text)
+{
     // 在寄存器0上存储整数1
     list_append(ops, chidb_make_op(
         Op_Integer,
@@ -88,35 +116,30 @@ int chidb_create_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
         5, // 列数为5, 因为是schema, 共有5列
         NULL)); // not used
 
-    list_append(ops, chidb_make_op(
-        Op_CreateTable,
-        4, // 新建一个表, 其B树所在页码存储在寄存器4上, 因为其值需要在记录中的第5列
-        0, 0, NULL)); // not used
-
     // 按Schema记录的顺序存储值
     // 存储类型
     list_append(ops, chidb_make_op(
         Op_String,
-        5, // 字符串长度为5
+        strlen(type),
         1, // 存储在寄存器1上
         0, // not used
-        "table")); // 类型为table
+        type)); // 类型为table或index
 
     // 存储名称
     list_append(ops, chidb_make_op(
         Op_String,
-        strlen(create->table->name),
+        strlen(name),
         2,
         0, // not used
-        create->table->name));
+        name));
 
-    // 存储关联表名称, 因是创建table所以即是table的名称
+    // 存储关联表名称, 创建table时即是table的名称
     list_append(ops, chidb_make_op(
         Op_String,
-        strlen(create->table->name),
+        strlen(assoc),
         3,
         0, // not used
-        create->table->name));
+        assoc));
 
     // 存储sql语句
     list_append(ops, chidb_make_op(
@@ -136,7 +159,7 @@ int chidb_create_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
 
     list_append(ops, chidb_make_op(
         Op_Integer,
-        list_size(&stmt->db->schema) + 1, // 其key即为在schema中的位置
+        list_size(&stmt->db->schema.items) + 1, // 其key即为在schema中的位置
         7, // 将key存储在寄存器7中
         0, NULL)); // not used
 
@@ -151,6 +174,141 @@ int chidb_create_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
         Op_Close,
         0, // 关闭游标0指向的B树
         0, 0, NULL)); // not used
+}
+
+// 创建索引: 遍历一次表, 把每行的 (列值, 主键) 加入sorter 0,
+// 由IdxBulkBuild排序后自下而上建立索引, 而不是逐行插入
+int chidb_create_index_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t *ops)
+{
+    Index_t *index = sql_stmt->stmt.create->index;
+    char *table_name = index->table_name;
+
+    // 表或列不存在, 或索引名已存在时返回错误
+    if (!chidb_check_table_exist(&stmt->db->schema, table_name)
+        || !chidb_check_column_exist(&stmt->db->schema, table_name, index->column_name)
+        || chidb_check_index_exist(&stmt->db->schema, index->name))
+    {
+        return CHIDB_EINVALIDSQL;
+    }
+
+    // 索引的key为整数, 所以只能在整数列上建立索引
+    if (chidb_get_type_of_column(&stmt->db->schema, table_name, index->column_name) != TYPE_INT)
+    {
+        return CHIDB_EINVALIDSQL;
+    }
+
+    int column_num = chidb_get_order_of_column(&stmt->db->schema, table_name, index->column_name);
+    chidb_schema_table_t *table = chidb_schema_find_table(&stmt->db->schema, table_name);
+
+    // 与ORDER BY相同, 排序的内存预算由chidb_set_sort_memory设置
+    list_append(ops, chidb_make_op(
+        Op_SorterOpen,
+        0,
+        0, // 升序
+        stmt->db->sort_memory, // 为0时使用DBM_SORTER_MEMORY
+        NULL)); // not used
+
+    list_append(ops, chidb_make_op(
+        Op_Integer,
+        table->item->root_page,
+        8, // 将表的root page存储在寄存器8上
+        0, NULL)); // not used
+
+    list_append(ops, chidb_make_op(
+        Op_OpenRead,
+        1, // 与游标1关联
+        8,
+        table->ncols, // 表内的列数
+        NULL)); // not used
+
+    chidb_dbm_op_t *rewind = chidb_make_op(
+        Op_Rewind,
+        1, // 表为空时
+        0, // 占位, 跳转到建立索引的地方
+        0, NULL); // not used
+    list_append(ops, rewind);
+
+    int loop = list_size(ops);
+
+    // 取出列值存储在寄存器9上, 主键存储在寄存器10上
+    if (column_num == 0)
+    {
+        list_append(ops, chidb_make_op(
+            Op_Key,
+            1, // 读取游标1关联的表的Key
+            9,
+            0, NULL)); // not used
+    }
+    else
+    {
+        list_append(ops, chidb_make_op(
+            Op_Column,
+            1, // 读取游标1关联的表的列
+            column_num,
+            9,
+            NULL)); // not used
+    }
+
+    list_append(ops, chidb_make_op(
+        Op_Key,
+        1, // 读取游标1关联的表的Key
+        10,
+        0, NULL)); // not used
+
+    list_append(ops, chidb_make_op(
+        Op_IdxBulkAdd,
+        9, // 列值
+        10, // 主键
+        0, // 加入sorter 0
+        NULL)); // not used
+
+    list_append(ops, chidb_make_op(
+        Op_Next,
+        1, // 对游标1关联的表进行下一条记录的读取
+        loop,
+        0, NULL)); // not used
+
+    rewind->p2 = list_size(ops);
+
+    list_append(ops, chidb_make_op(
+        Op_Close,
+        1, // 关闭游标1关联的表
+        0, 0, NULL)); // not used
+
+    list_append(ops, chidb_make_op(
+        Op_IdxBulkBuild,
+        4, // 新建的索引的B树所在页码存储在寄存器4上, 因为其值需要在记录中的第5列
+        0, // 从sorter 0中读取
+        0, NULL)); // not used
+
+    chidb_schema_insert_codegen(stmt, ops, "index", index->name, table_name, sql_stmt->text);
+
+    return CHIDB_OK;
+}
+
+// Step 4
+// 创建表和索引的代码生成
+int chidb_create_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t *ops)
+{
+    Create_t *create = sql_stmt->stmt.create;
+
+    if (create->t == CREATE_INDEX)
+    {
+        return chidb_create_index_codegen(stmt, sql_stmt, ops);
+    }
+
+    // 如果要创建的表名已存在则返回错误
+    if (chidb_check_table_exist(&stmt->db->schema, create->table->name))
+    {
+        return CHIDB_EINVALIDSQL;
+    }
+
+    list_append(ops, chidb_make_op(
+        Op_CreateTable,
+        4, // 新建一个表, 其B树所在页码存储在寄存器4上, 因为其值需要在记录中的第5列
+        0, 0, NULL)); // not used
+
+    chidb_schema_insert_codegen(stmt, ops, "table", create->table->name, create->table->name, sql_stmt->text);
 
     return CHIDB_OK;
 }
@@ -202,153 +360,1964 @@ Project([altcode],
         )
 */
 
-// 获取列在表中所有列的位置, 从0开始
-int order_of_column(list_t *columns, char *name);
+// 生成把当前行的第column_num列读取到寄存器reg上的指令
+// index_only为1时不读取表, 主键和索引的列值已经在pk_reg和pk_reg + 1中
+void chidb_column_codegen(list_t *ops, int column_num, int index_only, int pk_reg, int reg)
+{
+    if (index_only)
+    {
+        list_append(ops, chidb_make_op(
+            Op_Copy,
+            column_num == 0 ? pk_reg : pk_reg + 1,
+            reg,
+            0, NULL)); // not used
+    }
+    else if (column_num == 0)
+    {
+        list_append(ops, chidb_make_op(
+            Op_Key,
+            0, // 读取游标0关联的表的Key
+            reg,
+            0, NULL)); // not used
+    }
+    else
+    {
+        list_append(ops, chidb_make_op(
+            Op_Column,
+            0, // 读取游标0关联的表的列
+            column_num,
+            reg,
+            NULL)); // not used
+    }
+}
 
-// 如果next_to置为-1, 则无需next指令
-// *after_next置为1表示cmp_op跳转到next之后
-// *prev置为1表示需要prev指令而非next
-int chidb_cond_codegen(chidb_stmt *stmt,
-    SRA_Select_t *select, chidb_dbm_op_t **cmp_op,
-    list_t *ops, int *reg,
-    int *next_to, int *after_next, int *prev)
+// where条件中可以用来限定查找范围的比较, 都在同一列上
+// 有等于时只使用等于, 否则可以同时有一个下界和一个上界
+typedef struct chidb_cond_bounds
 {
-    // 错误检查
-    // 3. 检查要比较的值和对应的列的类型相同
-    Condition_t *cond = select->cond;
-    char *table_name = select->sra->table.ref->table_name;
-    char *cond_column_name = cond->cond.comp.expr1->expr.term.ref->columnName;
-    enum data_type column_type = chidb_get_type_of_column(stmt->db->schema, table_name, cond_column_name);
-    Literal_t *value = cond->cond.comp.expr2->expr.term.val;
-    if (column_type != value->t)
+    Condition_t *eq;    // =
+    Condition_t *lower; // > 或 >=
+    Condition_t *upper; // < 或 <=
+} chidb_cond_bounds_t;
+
+// 一次连接最多的表数
+#define JOIN_MAX_TABLES (16)
+
+// 连接中的一个表, 第一个表逐行遍历, 之后的每个表先放入同编号的hash表, 再按key探查
+typedef struct chidb_join_table
+{
+    char *name;             // 语句中引用该表的名字, 有别名时为别名
+    char *table_name;
+    int ncols;
+    Column_t **columns;     // 按顺序排列的列
+    int *merged;            // 该列是否已由USING或自然连接与之前的表的同名列合并
+    int key;                // 作为hash表的key的列, 没有时为-1, 此时所有行的key都为0(笛卡尔积)
+    int probe_table;        // 探查时与key比较的(之前的)表的列
+    int probe_column;
+    int *fields;            // 每一列在hash表的记录中的位置, 不需要的列为-1
+    int nfields;
+    list_t build_conds;     // 只与该表有关, 在放入hash表之前判断的条件
+    list_t probe_conds;     // 与该表及之前的表有关, 探查到该表时判断的条件
+    int lookup;             // 为1时不放入hash表, 探查时通过主键或索引(index不为NULL)直接查找
+    chidb_schema_index_t *index;
+} chidb_join_table_t;
+
+typedef struct chidb_join
+{
+    chidb_join_table_t tables[JOIN_MAX_TABLES];
+    int ntables;
+    list_t conds;           // 用AND连接的所有条件
+    list_t made;            // 由USING和自然连接生成的条件
+    int merge;              // 用merge join时为1, 此时所有的表都从游标读取列
+} chidb_join_t;
+
+// 生成条件中读取列的指令时, 列所在的表及读取的方式
+typedef struct chidb_cond_ctx
+{
+    chidb_stmt *stmt;
+    char *table_name;       // 只有一个表时的表名
+    int index_only;         // 只有一个表且只读取索引时为1, 主键和索引的列值在pk_reg和pk_reg + 1中
+    int pk_reg;
+    chidb_join_t *join;     // 连接多个表时不为NULL
+    int building;           // 正在把第几个表放入hash表, 此时从它的游标读取列; 探查时为-1
+} chidb_cond_ctx_t;
+
+// 是否为比较
+int chidb_cond_is_comp(Condition_t *cond)
+{
+    switch (cond->t)
     {
-        return CHIDB_EINVALIDSQL;
+    case RA_COND_EQ:
+    case RA_COND_LT:
+    case RA_COND_GT:
+    case RA_COND_LEQ:
+    case RA_COND_GEQ:
+        return 1;
+    default:
+        return 0;
     }
+}
+
+// 比较的两边
+#define COND_EXPR1(c) (&(c)->cond.comp.expr1->expr.term)
+#define COND_EXPR2(c) (&(c)->cond.comp.expr2->expr.term)
+// 列与值之间的比较中的列名和值
+#define COND_COLUMN(c) (COND_EXPR1(c)->ref->columnName)
+#define COND_VALUE(c) (COND_EXPR2(c)->val)
+
+// 是否为列与值之间的比较, 只有这样的比较可以限定查找范围
+int chidb_cond_is_column_value(Condition_t *cond)
+{
+    return chidb_cond_is_comp(cond)
+           && COND_EXPR1(cond)->t == TERM_COLREF
+           && COND_EXPR2(cond)->t == TERM_LITERAL;
+}
 
-    // 代码生成
+// 找到列所在的表(单表时为0)和在表中的位置及类型, 列不存在或有歧义时返回错误
+int chidb_cond_resolve(chidb_cond_ctx_t *ctx, ColumnReference_t *ref,
+    int *table, int *column, int *type)
+{
+    if (ctx->join == NULL)
+    {
+        chidb_schema_column_t *c = chidb_schema_find_column(&ctx->stmt->db->schema,
+                                                             ctx->table_name, ref->columnName);
+        if (c == NULL || (ref->tableName != NULL && strcmp(ref->tableName, ctx->table_name)))
+        {
+            return CHIDB_EINVALIDSQL;
+        }
+        *table = 0;
+        *column = c->ordinal;
+        *type = c->column->type;
+        return CHIDB_OK;
+    }
 
-    switch (value->t)
+    // 没有指定表时, 只能有一个表有这个列(由USING或自然连接合并的列属于第一个表)
+    chidb_join_t *join = ctx->join;
+    *table = -1;
+    int t, i;
+    for (t = 0; t < join->ntables; t++)
+    {
+        chidb_join_table_t *jt = &join->tables[t];
+        if (ref->tableName != NULL ? strcmp(ref->tableName, jt->name) : 0)
+        {
+            continue;
+        }
+        for (i = 0; i < jt->ncols; i++)
+        {
+            if (strcmp(jt->columns[i]->name, ref->columnName)
+                || (ref->tableName == NULL && jt->merged[i]))
+            {
+                continue;
+            }
+            if (*table != -1)
+            {
+                return CHIDB_EINVALIDSQL;
+            }
+            *table = t;
+            *column = i;
+            *type = jt->columns[i]->type;
+        }
+    }
+
+    return *table == -1 ? CHIDB_EINVALIDSQL : CHIDB_OK;
+}
+
+// 生成把第table个表当前行的第column列读取到寄存器reg上的指令
+void chidb_cond_column_codegen(chidb_cond_ctx_t *ctx, list_t *ops, int table, int column, int reg)
+{
+    if (ctx->join == NULL)
+    {
+        chidb_column_codegen(ops, column, ctx->index_only, ctx->pk_reg, reg);
+    }
+    // 第一个表, 正在放入hash表的表和直接查找的表从游标读取, 游标与表的编号相同
+    else if (table == 0 || table == ctx->building || ctx->join->merge
+             || ctx->join->tables[table].lookup)
+    {
+        if (column == 0)
+        {
+            list_append(ops, chidb_make_op(
+                Op_Key,
+                table, // 读取游标关联的表的Key
+                reg,
+                0, NULL)); // not used
+        }
+        else
+        {
+            list_append(ops, chidb_make_op(
+                Op_Column,
+                table, // 读取游标关联的表的列
+                column,
+                reg,
+                NULL)); // not used
+        }
+    }
+    // 其余的表从hash表当前的记录中读取
+    else
     {
-    case TYPE_INT:
-        list_append(ops, chidb_make_op(
-            Op_Integer,
-            value->val.ival,
-            (*reg)++, // 存储在寄存器1上
-            0, NULL)); // not used
-        break;
-    case TYPE_TEXT:
         list_append(ops, chidb_make_op(
-            Op_String,
-            strlen(value->val.strval),
-            (*reg)++, // 存储在寄存器1上
-            0, // not used
-            value->val.strval));
+            Op_HashColumn,
+            table, // 读取同编号的hash表当前的记录
+            ctx->join->tables[table].fields[column],
+            reg,
+            NULL)); // not used
+    }
+}
+
+// 错误检查
+// 1. 只支持AND, OR, NOT和列与列或列与值之间的比较
+// 2. 比较的列需要存在
+// 3. 检查要比较的两边的类型相同
+int chidb_cond_check(chidb_cond_ctx_t *ctx, Condition_t *cond)
+{
+    switch (cond->t)
+    {
+    case RA_COND_AND:
+    case RA_COND_OR:
+        if (chidb_cond_check(ctx, cond->cond.binary.cond1))
+        {
+            return CHIDB_EINVALIDSQL;
+        }
+        return chidb_cond_check(ctx, cond->cond.binary.cond2);
+    case RA_COND_NOT:
+        return chidb_cond_check(ctx, cond->cond.unary.cond);
+    default:
         break;
+    }
 
-    // 并没有Op_Double 和 Op_Char
+    if (!chidb_cond_is_comp(cond)
+        || cond->cond.comp.expr1->t != EXPR_TERM
+        || cond->cond.comp.expr2->t != EXPR_TERM)
+    {
+        return CHIDB_EINVALIDSQL;
+    }
+
+    ExprTerm *terms[2] = { COND_EXPR1(cond), COND_EXPR2(cond) };
+    int types[2];
+    int i, table, column;
+    for (i = 0; i < 2; i++)
+    {
+        if (terms[i]->t == TERM_LITERAL)
+        {
+            types[i] = terms[i]->val->t;
+        }
+        else if (terms[i]->t != TERM_COLREF
+                 || chidb_cond_resolve(ctx, terms[i]->ref, &table, &column, &types[i]))
+        {
+            return CHIDB_EINVALIDSQL;
+        }
+    }
+
+    // 至少有一边是列, 参数的类型与另一边相同
+    if ((terms[0]->t != TERM_COLREF && terms[1]->t != TERM_COLREF)
+        || (types[0] != types[1] && types[0] != TYPE_PARAM && types[1] != TYPE_PARAM))
+    {
+        return CHIDB_EINVALIDSQL;
+    }
+
+    return CHIDB_OK;
+}
+
+// 把最外层用AND连接的条件拆开, 依次加入conjuncts
+void chidb_cond_conjuncts(Condition_t *cond, list_t *conjuncts)
+{
+    if (cond->t == RA_COND_AND)
+    {
+        chidb_cond_conjuncts(cond->cond.binary.cond1, conjuncts);
+        chidb_cond_conjuncts(cond->cond.binary.cond2, conjuncts);
+    }
+    else
+    {
+        list_append(conjuncts, cond);
+    }
+}
+
+// 把条件中出现的列加入refs
+void chidb_cond_refs(Condition_t *cond, list_t *refs)
+{
+    switch (cond->t)
+    {
+    case RA_COND_AND:
+    case RA_COND_OR:
+        chidb_cond_refs(cond->cond.binary.cond1, refs);
+        chidb_cond_refs(cond->cond.binary.cond2, refs);
+        break;
+    case RA_COND_NOT:
+        chidb_cond_refs(cond->cond.unary.cond, refs);
+        break;
     default:
+        if (COND_EXPR1(cond)->t == TERM_COLREF)
+        {
+            list_append(refs, COND_EXPR1(cond)->ref);
+        }
+        if (COND_EXPR2(cond)->t == TERM_COLREF)
+        {
+            list_append(refs, COND_EXPR2(cond)->ref);
+        }
         break;
     }
+}
+
+// 在conjuncts中找出第column_num列上可以限定查找范围的比较, 有则返回1
+// 同一种比较出现多次时只用第一个, 其余的作为过滤条件
+int chidb_cond_bounds(chidb_stmt *stmt, char *table_name,
+    list_t *conjuncts, int column_num, chidb_cond_bounds_t *bounds)
+{
+    bounds->eq = bounds->lower = bounds->upper = NULL;
+
+    list_iterator_start(conjuncts);
+    while (list_iterator_hasnext(conjuncts))
+    {
+        Condition_t *cond = list_iterator_next(conjuncts);
+        if (!chidb_cond_is_column_value(cond)
+            || chidb_get_order_of_column(&stmt->db->schema, table_name, COND_COLUMN(cond)) != column_num)
+        {
+            continue;
+        }
+
+        if (cond->t == RA_COND_EQ && bounds->eq == NULL)
+        {
+            bounds->eq = cond;
+        }
+        else if ((cond->t == RA_COND_GT || cond->t == RA_COND_GEQ) && bounds->lower == NULL)
+        {
+            bounds->lower = cond;
+        }
+        else if ((cond->t == RA_COND_LT || cond->t == RA_COND_LEQ) && bounds->upper == NULL)
+        {
+            bounds->upper = cond;
+        }
+    }
+    list_iterator_stop(conjuncts);
+
+    // 有等于时范围比较作为过滤条件
+    if (bounds->eq != NULL)
+    {
+        bounds->lower = bounds->upper = NULL;
+    }
+
+    return bounds->eq != NULL || bounds->lower != NULL || bounds->upper != NULL;
+}
+
+// 获取可以用于where条件的索引, 没有则返回NULL, 优先使用有等于比较的索引
+// 只有整数列上的比较可以用索引, 主键则直接用Seek查找
+chidb_schema_index_t *chidb_cond_index(chidb_stmt *stmt, char *table_name,
+    list_t *conjuncts, chidb_cond_bounds_t *bounds)
+{
+    chidb_schema_index_t *found = NULL;
+
+    // chidb_cond_bounds会遍历conjuncts, 所以这里按位置读取, 不使用迭代器
+    int i;
+    for (i = 0; i < list_size(conjuncts); i++)
+    {
+        Condition_t *cond = list_get_at(conjuncts, i);
+        if (!chidb_cond_is_column_value(cond)
+            || chidb_get_type_of_column(&stmt->db->schema, table_name, COND_COLUMN(cond)) != TYPE_INT)
+        {
+            continue;
+        }
+
+        int column_num = chidb_get_order_of_column(&stmt->db->schema, table_name, COND_COLUMN(cond));
+        chidb_schema_index_t *index = chidb_schema_find_index(&stmt->db->schema, table_name, COND_COLUMN(cond));
+        if (column_num == 0 || index == NULL || (found != NULL && bounds->eq != NULL))
+        {
+            continue;
+        }
+
+        chidb_cond_bounds_t b;
+        chidb_cond_bounds(stmt, table_name, conjuncts, column_num, &b);
+        if (found == NULL || b.eq != NULL)
+        {
+            found = index;
+            *bounds = b;
+        }
+    }
+
+    return found;
+}
+
+// 把条件中所有比较的值依次存储在从*reg开始的寄存器上
+// 在循环之前生成, 每一行只需要读取列
+void chidb_cond_values_codegen(chidb_cond_ctx_t *ctx, Condition_t *cond, list_t *ops, int *reg)
+{
+    switch (cond->t)
+    {
+    case RA_COND_AND:
+    case RA_COND_OR:
+        chidb_cond_values_codegen(ctx, cond->cond.binary.cond1, ops, reg);
+        chidb_cond_values_codegen(ctx, cond->cond.binary.cond2, ops, reg);
+        return;
+    case RA_COND_NOT:
+        chidb_cond_values_codegen(ctx, cond->cond.unary.cond, ops, reg);
+        return;
+    default:
+        break;
+    }
+
+    // 值为参数时按另一边的列的类型读取
+    ExprTerm *terms[2] = { COND_EXPR1(cond), COND_EXPR2(cond) };
+    int i, table, column, type;
+    for (i = 0; i < 2; i++)
+    {
+        if (terms[i]->t == TERM_LITERAL)
+        {
+            chidb_cond_resolve(ctx, terms[1 - i]->ref, &table, &column, &type);
+            chidb_value_codegen(ops, terms[i]->val, type, (*reg)++);
+        }
+    }
+}
+
+// 生成判断条件的指令, 条件的结果为jump_if时跳转, 否则顺序执行
+// 跳转指令的p2为占位, 加入jumps中由调用者设置
+// *value_reg为chidb_cond_values_codegen存储比较的值的寄存器, 按相同的顺序使用
+// 与NULL的比较视为不成立
+int chidb_cond_jump_codegen(chidb_cond_ctx_t *ctx, Condition_t *cond, int jump_if,
+    list_t *ops, int *reg, int *value_reg, list_t *jumps)
+{
+    list_t skips;
+
+    switch (cond->t)
+    {
+    // AND成立或OR不成立时跳转: 第一个的结果与之相反时跳过第二个
+    case RA_COND_AND:
+    case RA_COND_OR:
+        if ((cond->t == RA_COND_AND) == jump_if)
+        {
+            list_init(&skips);
+            chidb_cond_jump_codegen(ctx, cond->cond.binary.cond1, !jump_if, ops, reg, value_reg, &skips);
+            chidb_cond_jump_codegen(ctx, cond->cond.binary.cond2, jump_if, ops, reg, value_reg, jumps);
+            list_iterator_start(&skips);
+            while (list_iterator_hasnext(&skips))
+            {
+                chidb_dbm_op_t *op = list_iterator_next(&skips);
+                op->p2 = list_size(ops);
+            }
+            list_iterator_stop(&skips);
+            list_destroy(&skips);
+        }
+        // AND不成立或OR成立时, 任一个满足就跳转
+        else
+        {
+            chidb_cond_jump_codegen(ctx, cond->cond.binary.cond1, jump_if, ops, reg, value_reg, jumps);
+            chidb_cond_jump_codegen(ctx, cond->cond.binary.cond2, jump_if, ops, reg, value_reg, jumps);
+        }
+        return CHIDB_OK;
+    case RA_COND_NOT:
+        return chidb_cond_jump_codegen(ctx, cond->cond.unary.cond, !jump_if, ops, reg, value_reg, jumps);
+    default:
+        break;
+    }
+
+    // 两边的值: 值已经存储在*value_reg上, 列则读取到新的寄存器上
+    ExprTerm *terms[2] = { COND_EXPR1(cond), COND_EXPR2(cond) };
+    int regs[2];
+    int i, table, column, type;
+    for (i = 0; i < 2; i++)
+    {
+        if (terms[i]->t == TERM_LITERAL)
+        {
+            regs[i] = (*value_reg)++;
+        }
+        else
+        {
+            chidb_cond_resolve(ctx, terms[i]->ref, &table, &column, &type);
+            regs[i] = (*reg)++;
+            chidb_cond_column_codegen(ctx, ops, table, column, regs[i]);
+        }
+    }
+
+    // 比较成功时跳转, p3 op p1
+    opcode_t cond_op;
+    switch (cond->t)
+    {
+    case RA_COND_EQ:
+        cond_op = Op_Eq;
+        break;
+    case RA_COND_LT:
+        cond_op = Op_Lt;
+        break;
+    case RA_COND_GT:
+        cond_op = Op_Gt;
+        break;
+    case RA_COND_LEQ:
+        cond_op = Op_Le;
+        break;
+    case RA_COND_GEQ:
+        cond_op = Op_Ge;
+        break;
+    default:
+        return CHIDB_EINVALIDSQL;
+    }
+
+    chidb_dbm_op_t *cmp_op = chidb_make_op(
+        cond_op,
+        regs[1], // 比较右边的值与
+        0, // 占位
+        regs[0], // 左边的值
+        NULL); // not used
+    list_append(ops, cmp_op);
+
+    if (jump_if)
+    {
+        list_append(jumps, cmp_op);
+    }
+    // 不成立时跳转: 成立时跳过Goto, 这样NULL也会跳转
+    else
+    {
+        cmp_op->p2 = list_size(ops) + 1;
+        chidb_dbm_op_t *goto_op = chidb_make_op(
+            Op_Goto,
+            0, // not used
+            0, // 占位
+            0, NULL); // not used
+        list_append(ops, goto_op);
+        list_append(jumps, goto_op);
+    }
+
+    return CHIDB_OK;
+}
+
+// 通过主键查找满足bounds的行
+// 等于时直接Seek; 范围比较时从下界(没有时从头)开始遍历, 主键超过上界时停止
+// 没有更多满足条件的行时跳转到结尾的指令加入ends
+// *next_to为Next指令跳转回的位置, 等于时为-1
+int chidb_pk_cond_codegen(chidb_stmt *stmt, chidb_cond_bounds_t *bounds,
+    list_t *ops, int *reg, int *next_to, list_t *ends)
+{
+    chidb_dbm_op_t *op;
+
+    if (bounds->eq != NULL)
+    {
+        int value_reg = (*reg)++;
+        chidb_value_codegen(ops, COND_VALUE(bounds->eq), TYPE_INT, value_reg);
+
+        op = chidb_make_op(
+            Op_Seek,
+            0, // 在游标0关联的B树上查找
+            0, // 占位, 查找失败时跳转到结尾
+            value_reg,
+            NULL); // not used
+        list_append(ops, op);
+        list_append(ends, op);
+
+        // 如果是Seek则不需要Next
+        *next_to = -1;
+        return CHIDB_OK;
+    }
+
+    if (bounds->lower != NULL)
+    {
+        int value_reg = (*reg)++;
+        chidb_value_codegen(ops, COND_VALUE(bounds->lower), TYPE_INT, value_reg);
+
+        op = chidb_make_op(
+            bounds->lower->t == RA_COND_GT ? Op_SeekGt : Op_SeekGe,
+            0, // 在游标0关联的B树上查找
+            0, // 占位, 查找失败时跳转到结尾
+            value_reg,
+            NULL); // not used
+    }
+    else
+    {
+        op = chidb_make_op(
+            Op_Rewind,
+            0, // 如果游标0关联的表为空, 则
+            0, // 跳转到结尾, 此处占空
+            0, NULL); // not used
+    }
+    list_append(ops, op);
+    list_append(ends, op);
+
+    // 上界的值在循环之前存储
+    int upper_reg = -1;
+    if (bounds->upper != NULL)
+    {
+        upper_reg = (*reg)++;
+        chidb_value_codegen(ops, COND_VALUE(bounds->upper), TYPE_INT, upper_reg);
+    }
+
+    *next_to = list_size(ops);
+
+    // 主键按顺序排列, 超过上界后的行都不满足条件
+    if (upper_reg != -1)
+    {
+        int key_reg = (*reg)++;
+        list_append(ops, chidb_make_op(
+            Op_Key,
+            0, // 读取游标0关联的表的Key
+            key_reg,
+            0, NULL)); // not used
+
+        op = chidb_make_op(
+            bounds->upper->t == RA_COND_LT ? Op_Ge : Op_Gt,
+            upper_reg, // 主键 >= 上界(或 > 上界)时
+            0, // 占位, 跳转到结尾
+            key_reg,
+            NULL); // not used
+        list_append(ops, op);
+        list_append(ends, op);
+    }
+
+    return CHIDB_OK;
+}
+
+// 通过游标1关联的索引查找满足bounds的行, index_only为0时再用其主键在游标0关联的表中Seek,
+// 为1时(要返回的列都在索引中)不读取表
+// 等于时直接在索引中Seek; 范围比较时从下界(没有时从头)开始遍历索引, 超过上界时停止,
+// 把满足条件的 (主键, 索引的列值) 放入row set 0, 再按主键从小到大的顺序(与遍历整个表时相同)逐个读取
+// *end_op为没有更多满足条件的行时跳转到结尾的指令
+// *seek_op为等于时在表中Seek的指令, 表中没有该行时跳过该行, 没有时为NULL
+// *pk_reg为存储当前行主键的寄存器, index_only为1时索引的列值存储在*pk_reg + 1中
+// *loop_to为处理完一行后跳转回的位置, 等于时为-1
+int chidb_index_cond_codegen(chidb_stmt *stmt,
+    chidb_schema_index_t *index, chidb_cond_bounds_t *bounds, int index_only,
+    chidb_dbm_op_t **end_op, chidb_dbm_op_t **seek_op,
+    list_t *ops, int *reg, int *pk_reg, int *loop_to)
+{
+    // 打开索引
+    list_append(ops, chidb_make_op(
+        Op_Integer,
+        index->item->root_page,
+        *reg, // 将索引的root page存储在寄存器上
+        0, NULL)); // not used
+
+    list_append(ops, chidb_make_op(
+        Op_OpenRead,
+        1, // 与游标1关联
+        (*reg)++, // 打开页码为上面的寄存器存储的整数的B树
+        0, // 索引没有列
+        NULL)); // not used
+
+    // 下界(或等于)和上界的值
+    int value_reg = -1;
+    Condition_t *first_cond = bounds->eq != NULL ? bounds->eq : bounds->lower;
+    if (first_cond != NULL)
+    {
+        value_reg = (*reg)++;
+        chidb_value_codegen(ops, COND_VALUE(first_cond), TYPE_INT, value_reg);
+    }
+
+    int upper_reg = -1;
+    if (bounds->upper != NULL)
+    {
+        upper_reg = (*reg)++;
+        chidb_value_codegen(ops, COND_VALUE(bounds->upper), TYPE_INT, upper_reg);
+    }
+
+    // 主键和索引的列值存储在连续的两个寄存器上
+    *pk_reg = *reg;
+    int key_reg = *pk_reg + 1;
+    *reg += 2;
+
+    *seek_op = NULL;
+    *loop_to = -1;
+
+    // 索引中每个key只有一项, 所以等于时只需要查找一次
+    if (bounds->eq != NULL)
+    {
+        *end_op = chidb_make_op(
+            Op_Seek,
+            1, // 在游标1关联的索引上查找
+            0, // 占位, 不存在时跳转到结尾
+            value_reg,
+            NULL); // not used
+        list_append(ops, *end_op);
+
+        list_append(ops, chidb_make_op(
+            Op_IdxPKey,
+            1, // 游标1所指的项的主键
+            *pk_reg, // 存储在寄存器上
+            0, NULL)); // not used
+
+        if (index_only)
+        {
+            list_append(ops, chidb_make_op(
+                Op_Key,
+                1, // 游标1所指的项的key, 即索引的列值
+                key_reg,
+                0, NULL)); // not used
+        }
+        else
+        {
+            *seek_op = chidb_make_op(
+                Op_Seek,
+                0, // 在游标0关联的表上查找
+                0, // 占位, 不存在时跳过该行
+                *pk_reg,
+                NULL); // not used
+            list_append(ops, *seek_op);
+        }
+
+        return CHIDB_OK;
+    }
+
+    // 在索引中定位到第一个满足下界的项, 没有下界时从头开始
+    chidb_dbm_op_t *first_op;
+    if (bounds->lower != NULL)
+    {
+        first_op = chidb_make_op(
+            bounds->lower->t == RA_COND_GT ? Op_SeekGt : Op_SeekGe,
+            1, // 在游标1关联的索引上定位
+            0, // 占位, 没有满足条件的项时跳转到读取row set的地方
+            value_reg,
+            NULL); // not used
+    }
+    else
+    {
+        first_op = chidb_make_op(
+            Op_Rewind,
+            1, // 从游标1关联的索引的第一项开始
+            0, // 占位, 索引为空时跳转到读取row set的地方
+            0, NULL); // not used
+    }
+    list_append(ops, first_op);
+
+    int scan = list_size(ops);
+
+    chidb_dbm_op_t *stop_op = NULL;
+    if (bounds->upper != NULL)
+    {
+        stop_op = chidb_make_op(
+            bounds->upper->t == RA_COND_LT ? Op_IdxGe : Op_IdxGt,
+            1, // 游标1所指的项超出上界时
+            0, // 占位, 跳转到读取row set的地方
+            upper_reg,
+            NULL);
+        list_append(ops, stop_op);
+    }
+
+    // 把主键和索引的列值加入row set 0, 读取表时只需要主键
+    list_append(ops, chidb_make_op(
+        Op_IdxPKey,
+        1, // 游标1所指的项的主键
+        *pk_reg, // 存储在寄存器上
+        0, NULL)); // not used
+
+    if (index_only)
+    {
+        list_append(ops, chidb_make_op(
+            Op_Key,
+            1, // 游标1所指的项的key, 即索引的列值
+            key_reg,
+            0, NULL)); // not used
+    }
+
+    list_append(ops, chidb_make_op(
+        Op_RowSetAdd,
+        0, // 加入row set 0
+        *pk_reg,
+        index_only ? key_reg : *pk_reg,
+        NULL)); // not used
+
+    list_append(ops, chidb_make_op(
+        Op_Next,
+        1, // 对游标1关联的索引进行下一项的比对
+        scan,
+        0, NULL)); // not used
+
+    // 按主键从小到大的顺序读取row set
+    *loop_to = list_size(ops);
+    first_op->p2 = *loop_to;
+    if (stop_op != NULL)
+    {
+        stop_op->p2 = *loop_to;
+    }
+
+    *end_op = chidb_make_op(
+        Op_RowSetRead,
+        0, // 读取row set 0
+        0, // 占位, 读完时跳转到结尾
+        *pk_reg, // 主键和索引的列值存储在pk_reg和key_reg上
+        NULL); // not used
+    list_append(ops, *end_op);
+
+    if (!index_only)
+    {
+        list_append(ops, chidb_make_op(
+            Op_Seek,
+            0, // 在游标0关联的表上查找
+            *loop_to, // 不存在时读取下一个主键
+            *pk_reg,
+            NULL)); // not used
+    }
+
+    return CHIDB_OK;
+}
+
+// 要返回的列是否都在索引中(索引的列或主键), 是则不需要读取表
+int chidb_index_covers(chidb_stmt *stmt, char *table_name,
+    chidb_schema_index_t *index, list_t *select_names)
+{
+    Index_t *def = chidb_schema_index(index);
+    int covers = 1;
+
+    list_iterator_start(select_names);
+    while (list_iterator_hasnext(select_names))
+    {
+        char *name = list_iterator_next(select_names);
+        if (chidb_get_order_of_column(&stmt->db->schema, table_name, name) != 0
+            && strcmp(name, def->column_name))
+        {
+            covers = 0;
+        }
+    }
+    list_iterator_stop(select_names);
+
+    return covers;
+}
+
+// 把表加入连接, 表不存在, 表太多或引用表的名字重复时返回错误
+int chidb_join_add_table(chidb_stmt *stmt, chidb_join_t *join, TableReference_t *ref)
+{
+    char *name = ref->alias != NULL ? ref->alias : ref->table_name;
+    int t, i;
+
+    if (!chidb_check_table_exist(&stmt->db->schema, ref->table_name)
+        || join->ntables == JOIN_MAX_TABLES)
+    {
+        return CHIDB_EINVALIDSQL;
+    }
+    for (t = 0; t < join->ntables; t++)
+    {
+        if (!strcmp(join->tables[t].name, name))
+        {
+            return CHIDB_EINVALIDSQL;
+        }
+    }
+
+    chidb_join_table_t *jt = &join->tables[join->ntables++];
+    memset(jt, 0, sizeof(chidb_join_table_t));
+    jt->name = name;
+    jt->table_name = ref->table_name;
+    jt->key = -1;
+    list_init(&jt->build_conds);
+    list_init(&jt->probe_conds);
+
+    list_t columns;
+    list_init(&columns);
+    chidb_get_columns_of_table(&stmt->db->schema, ref->table_name, &columns);
+    jt->ncols = list_size(&columns);
+    jt->columns = malloc(sizeof(Column_t *) * jt->ncols);
+    jt->merged = calloc(jt->ncols, sizeof(int));
+    jt->fields = malloc(sizeof(int) * jt->ncols);
+    for (i = 0; i < jt->ncols; i++)
+    {
+        jt->columns[i] = list_get_at(&columns, i);
+        jt->fields[i] = -1;
+    }
+    list_destroy(&columns);
+
+    return CHIDB_OK;
+}
+
+// 在第from到to - 1个表中找到第一个未合并的名为name的列, 没有则返回0
+int chidb_join_find_column(chidb_join_t *join, int from, int to, char *name, int *table, int *column)
+{
+    int t, i;
+    for (t = from; t < to; t++)
+    {
+        for (i = 0; i < join->tables[t].ncols; i++)
+        {
+            if (!join->tables[t].merged[i] && !strcmp(join->tables[t].columns[i]->name, name))
+            {
+                *table = t;
+                *column = i;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// USING和自然连接: 生成两个表中同名列相等的条件, 并把右边的列标记为已合并
+void chidb_join_merge(chidb_join_t *join, int t1, int c1, int t2, int c2)
+{
+    chidb_join_table_t *jt1 = &join->tables[t1], *jt2 = &join->tables[t2];
+    Condition_t *cond = Eq(
+        TermColumnReference(ColumnReference_make(jt1->name, jt1->columns[c1]->name)),
+        TermColumnReference(ColumnReference_make(jt2->name, jt2->columns[c2]->name)));
+
+    list_append(&join->made, cond);
+    list_append(&join->conds, cond);
+    jt2->merged[c2] = 1;
+}
+
+// 按从左到右的顺序把SRA中的表加入连接, 所有的条件拆开后加入join->conds
+// 不支持外连接和集合运算
+int chidb_join_flatten(chidb_stmt *stmt, chidb_join_t *join, SRA_t *sra)
+{
+    SRA_t *left, *right;
+    int err, left_end, t1, c1, t2, c2;
+
+    switch (sra->t)
+    {
+    case SRA_TABLE:
+        return chidb_join_add_table(stmt, join, sra->table.ref);
+    case SRA_SELECT:
+        if ((err = chidb_join_flatten(stmt, join, sra->select.sra)))
+        {
+            return err;
+        }
+        chidb_cond_conjuncts(sra->select.cond, &join->conds);
+        return CHIDB_OK;
+    case SRA_JOIN:
+        left = sra->join.sra1;
+        right = sra->join.sra2;
+        break;
+    case SRA_NATURAL_JOIN:
+        left = sra->binary.sra1;
+        right = sra->binary.sra2;
+        break;
+    default:
+        return CHIDB_EINVALIDSQL;
+    }
+
+    if ((err = chidb_join_flatten(stmt, join, left)))
+    {
+        return err;
+    }
+    left_end = join->ntables;
+    if ((err = chidb_join_flatten(stmt, join, right)))
+    {
+        return err;
+    }
+
+    // 自然连接: 右边每个未合并的列与左边第一个同名的列相等
+    if (sra->t == SRA_NATURAL_JOIN)
+    {
+        for (t2 = left_end; t2 < join->ntables; t2++)
+        {
+            for (c2 = 0; c2 < join->tables[t2].ncols; c2++)
+            {
+                if (!join->tables[t2].merged[c2]
+                    && chidb_join_find_column(join, 0, left_end, join->tables[t2].columns[c2]->name, &t1, &c1))
+                {
+                    chidb_join_merge(join, t1, c1, t2, c2);
+                }
+            }
+        }
+    }
+    else if (sra->join.opt_cond != NULL && sra->join.opt_cond->t == JOIN_COND_ON)
+    {
+        chidb_cond_conjuncts(sra->join.opt_cond->on, &join->conds);
+    }
+    // USING中的列在两边都需要存在
+    else if (sra->join.opt_cond != NULL)
+    {
+        StrList_t *col;
+        for (col = sra->join.opt_cond->col_list; col != NULL; col = col->next)
+        {
+            if (!chidb_join_find_column(join, 0, left_end, col->str, &t1, &c1)
+                || !chidb_join_find_column(join, left_end, join->ntables, col->str, &t2, &c2))
+            {
+                return CHIDB_EINVALIDSQL;
+            }
+            chidb_join_merge(join, t1, c1, t2, c2);
+        }
+    }
+
+    return CHIDB_OK;
+}
+
+// 条件中的列所在的表中编号最大的一个, 多个表的列出现时*single为0
+int chidb_join_cond_level(chidb_cond_ctx_t *ctx, Condition_t *cond, int *single)
+{
+    list_t refs;
+    list_init(&refs);
+    chidb_cond_refs(cond, &refs);
+
+    int level = -1, first = -1;
+    int table, column, type;
+    *single = 1;
+    list_iterator_start(&refs);
+    while (list_iterator_hasnext(&refs))
+    {
+        chidb_cond_resolve(ctx, list_iterator_next(&refs), &table, &column, &type);
+        if (first == -1)
+        {
+            first = table;
+        }
+        else if (table != first)
+        {
+            *single = 0;
+        }
+        if (table > level)
+        {
+            level = table;
+        }
+    }
+    list_iterator_stop(&refs);
+    list_destroy(&refs);
+
+    return level;
+}
+
+// 把条件分配到各个表
+// 1. 两个表的整数列相等的第一个条件作为右边的表的hash表的key
+// 2. 只与第一个之后的某一个表有关的条件在放入hash表之前判断
+// 3. 其余的条件在探查到其中编号最大的表时判断
+int chidb_join_plan(chidb_cond_ctx_t *ctx, chidb_join_t *join)
+{
+    list_iterator_start(&join->conds);
+    while (list_iterator_hasnext(&join->conds))
+    {
+        Condition_t *cond = list_iterator_next(&join->conds);
+        if (chidb_cond_check(ctx, cond))
+        {
+            list_iterator_stop(&join->conds);
+            return CHIDB_EINVALIDSQL;
+        }
+
+        int single;
+        int level = chidb_join_cond_level(ctx, cond, &single);
+
+        if (cond->t == RA_COND_EQ && !single
+            && COND_EXPR1(cond)->t == TERM_COLREF && COND_EXPR2(cond)->t == TERM_COLREF)
+        {
+            int t1, c1, t2, c2, type1, type2;
+            chidb_cond_resolve(ctx, COND_EXPR1(cond)->ref, &t1, &c1, &type1);
+            chidb_cond_resolve(ctx, COND_EXPR2(cond)->ref, &t2, &c2, &type2);
+            if (t1 > t2)
+            {
+                int t = t1, c = c1;
+                t1 = t2, c1 = c2;
+                t2 = t, c2 = c;
+            }
+
+            chidb_join_table_t *jt = &join->tables[t2];
+            if (type1 == TYPE_INT && jt->key == -1)
+            {
+                jt->key = c2;
+                jt->probe_table = t1;
+                jt->probe_column = c1;
+                continue;
+            }
+        }
+
+        if (single && level > 0)
+        {
+            list_append(&join->tables[level].build_conds, cond);
+        }
+        else
+        {
+            list_append(&join->tables[level].probe_conds, cond);
+        }
+    }
+    list_iterator_stop(&join->conds);
+
+    return CHIDB_OK;
+}
+
+// 要返回的列, 按顺序把表和列的编号存入tables和columns(为NULL时只计数)
+// 返回列数, 有不存在的列时返回-1
+int chidb_join_select(chidb_cond_ctx_t *ctx, Expression_t *expr_list, int *tables, int *columns)
+{
+    chidb_join_t *join = ctx->join;
+    Expression_t *expr;
+    int n = 0, t, i, type;
+
+    for (expr = expr_list; expr != NULL; expr = expr->next)
+    {
+        ColumnReference_t *ref = expr->expr.term.ref;
+        if (*ref->columnName != '*')
+        {
+            if (chidb_cond_resolve(ctx, ref, &t, &i, &type))
+            {
+                return -1;
+            }
+            if (tables != NULL)
+            {
+                tables[n] = t;
+                columns[n] = i;
+            }
+            n++;
+            continue;
+        }
+
+        // *为所有表中未合并的列, t.*为表t的所有列
+        int found = 0;
+        for (t = 0; t < join->ntables; t++)
+        {
+            chidb_join_table_t *jt = &join->tables[t];
+            if (ref->tableName != NULL && strcmp(ref->tableName, jt->name))
+            {
+                continue;
+            }
+            found = 1;
+            for (i = 0; i < jt->ncols; i++)
+            {
+                if (ref->tableName == NULL && jt->merged[i])
+                {
+                    continue;
+                }
+                if (tables != NULL)
+                {
+                    tables[n] = t;
+                    columns[n] = i;
+                }
+                n++;
+            }
+        }
+        if (!found)
+        {
+            return -1;
+        }
+    }
+
+    return n;
+}
+
+// 标记探查时需要从第table个表读取的列, 这些列会放入hash表的记录中
+void chidb_join_need(chidb_cond_ctx_t *ctx, list_t *conds)
+{
+    int table, column, type;
+    list_t refs;
+    list_init(&refs);
+
+    list_iterator_start(conds);
+    while (list_iterator_hasnext(conds))
+    {
+        chidb_cond_refs(list_iterator_next(conds), &refs);
+    }
+    list_iterator_stop(conds);
+
+    list_iterator_start(&refs);
+    while (list_iterator_hasnext(&refs))
+    {
+        chidb_cond_resolve(ctx, list_iterator_next(&refs), &table, &column, &type);
+        ctx->join->tables[table].fields[column] = 1;
+    }
+    list_iterator_stop(&refs);
+    list_destroy(&refs);
+}
+
+void chidb_join_free(chidb_join_t *join)
+{
+    int t;
+    for (t = 0; t < join->ntables; t++)
+    {
+        free(join->tables[t].columns);
+        free(join->tables[t].merged);
+        free(join->tables[t].fields);
+        list_destroy(&join->tables[t].build_conds);
+        list_destroy(&join->tables[t].probe_conds);
+    }
+
+    // 生成的条件中的列名由这里分配, Condition_free不会释放
+    list_iterator_start(&join->made);
+    while (list_iterator_hasnext(&join->made))
+    {
+        Condition_t *cond = list_iterator_next(&join->made);
+        ColumnReference_t *refs[2] = { COND_EXPR1(cond)->ref, COND_EXPR2(cond)->ref };
+        int i;
+        for (i = 0; i < 2; i++)
+        {
+            free(refs[i]->tableName);
+            free(refs[i]->columnName);
+            free(refs[i]);
+        }
+        Condition_free(cond);
+    }
+    list_iterator_stop(&join->made);
+
+    list_destroy(&join->conds);
+    list_destroy(&join->made);
+}
+
+// 生成判断conds中所有条件的指令, 不成立时跳转的指令加入jumps
+void chidb_join_conds_codegen(chidb_cond_ctx_t *ctx, list_t *conds,
+    list_t *ops, int *reg, int *value_reg, list_t *jumps)
+{
+    list_iterator_start(conds);
+    while (list_iterator_hasnext(conds))
+    {
+        chidb_cond_jump_codegen(ctx, list_iterator_next(conds), 0, ops, reg, value_reg, jumps);
+    }
+    list_iterator_stop(conds);
+}
+
+// 把jumps中跳转指令的目标设为addr
+void chidb_jumps_set(list_t *jumps, int addr)
+{
+    list_iterator_start(jumps);
+    while (list_iterator_hasnext(jumps))
+    {
+        chidb_dbm_op_t *op = list_iterator_next(jumps);
+        op->p2 = addr;
+    }
+    list_iterator_stop(jumps);
+    list_clear(jumps);
+}
+
+// ORDER BY的列, 不需要排序时table为-1
+typedef struct chidb_order
+{
+    int table;
+    int column;
+    int desc;
+} chidb_order_t;
+
+// 找到ORDER BY的列, 只支持按一列排序
+int chidb_order_resolve(chidb_cond_ctx_t *ctx, SRA_Project_t *project, chidb_order_t *order)
+{
+    Expression_t *expr = project->order_by;
+    int type;
+
+    order->table = -1;
+    order->desc = project->asc_desc == ORDER_BY_DESC;
+    if (expr == NULL)
+    {
+        return CHIDB_OK;
+    }
+    if (expr->t != EXPR_TERM || expr->expr.term.t != TERM_COLREF)
+    {
+        return CHIDB_EINVALIDSQL;
+    }
+
+    return chidb_cond_resolve(ctx, expr->expr.term.ref, &order->table, &order->column, &type);
+}
+
+// 打开排序用的sorter 0, 内存预算由chidb_set_sort_memory设置
+void chidb_order_open_codegen(chidb_stmt *stmt, chidb_order_t *order, list_t *ops)
+{
+    if (order->table != -1)
+    {
+        list_append(ops, chidb_make_op(
+            Op_SorterOpen,
+            0,
+            order->desc,
+            stmt->db->sort_memory, // 为0时使用DBM_SORTER_MEMORY
+            NULL)); // not used
+    }
+}
+
+// 返回从startRR开始的nCols个寄存器中的结果行
+// 需要排序时不直接返回, 而是把结果行连同ORDER BY的列一起加入sorter 0
+void chidb_result_row_codegen(chidb_cond_ctx_t *ctx, chidb_order_t *order, list_t *ops,
+    int startRR, int nCols, int *reg)
+{
+    if (order->table == -1)
+    {
+        list_append(ops, chidb_make_op(
+            Op_ResultRow,
+            startRR,
+            nCols,
+            0, NULL)); // not used
+        return;
+    }
+
+    int key_reg = (*reg)++;
+    int record_reg = (*reg)++;
+    chidb_cond_column_codegen(ctx, ops, order->table, order->column, key_reg);
+    list_append(ops, chidb_make_op(
+        Op_MakeRecord,
+        startRR,
+        nCols,
+        record_reg,
+        NULL)); // not used
+    list_append(ops, chidb_make_op(
+        Op_SorterInsert,
+        0,
+        key_reg,
+        record_reg,
+        NULL)); // not used
+}
+
+// 所有的行都加入sorter 0之后, 排序并按顺序把结果行读取到从startRR开始的寄存器中返回
+void chidb_order_output_codegen(chidb_order_t *order, list_t *ops, int startRR, int nCols)
+{
+    if (order->table == -1)
+    {
+        return;
+    }
+
+    chidb_dbm_op_t *sort = chidb_make_op(
+        Op_SorterSort,
+        0,
+        0, // 占位, 没有结果行时跳到最后
+        0, NULL); // not used
+    list_append(ops, sort);
+    int loop = list_size(ops);
+    int i;
+    for (i = 0; i < nCols; i++)
+    {
+        list_append(ops, chidb_make_op(
+            Op_SorterData,
+            0,
+            i,
+            startRR + i,
+            NULL)); // not used
+    }
+    list_append(ops, chidb_make_op(
+        Op_ResultRow,
+        startRR,
+        nCols,
+        0, NULL)); // not used
+    list_append(ops, chidb_make_op(
+        Op_SorterNext,
+        0,
+        loop,
+        0, NULL)); // not used
+    sort->p2 = list_size(ops);
+}
+
+// 第一个表有过滤条件(较小)时, 之后的表中连接的列为主键或有索引的直接查找
+// (index nested-loop join), 把只与该表有关的条件移到查找之后判断, 返回这样的表的个数
+int chidb_join_lookups(chidb_cond_ctx_t *ctx)
+{
+    chidb_join_t *join = ctx->join;
+    int t, i, n = 0;
+
+    if (list_size(&join->tables[0].probe_conds) == 0)
+    {
+        return 0;
+    }
+
+    for (t = 1; t < join->ntables; t++)
+    {
+        chidb_join_table_t *jt = &join->tables[t];
+        if (jt->key == -1
+            || (jt->key != 0
+                && (jt->index = chidb_schema_find_index(&ctx->stmt->db->schema, jt->table_name,
+                                                        jt->columns[jt->key]->name)) == NULL))
+        {
+            continue;
+        }
+
+        jt->lookup = 1;
+        for (i = 0; i < list_size(&jt->build_conds); i++)
+        {
+            list_insert_at(&jt->probe_conds, list_get_at(&jt->build_conds, i), i);
+        }
+        list_clear(&jt->build_conds);
+        n++;
+    }
+
+    return n;
+}
+
+// 生成连接的指令, 返回存储结果的第一个寄存器
+// 逐行遍历第一个表, 之后的每个表依次以整数列相等的条件中该表的列为key放入hash表
+// (没有这样的条件时key都为0), 对第一个表的每一行依次探查各个hash表
+// 直接查找的表则在探查时在表或索引上Seek, 其游标在遍历第一个表之前打开
+// hash表超出内存预算时把记录写入临时文件, 见dbm-hash.c
+int chidb_probe_join_codegen(chidb_cond_ctx_t *ctx, chidb_order_t *order, list_t *ops,
+    int *select_tables, int *select_columns, int nCols)
+{
+    chidb_join_t *join = ctx->join;
+
+    // 探查时读取的列: 要返回的列, ORDER BY的列, 探查时判断的条件中的列和之后的表的key比较的列
+    int t, i;
+    for (i = 0; i < nCols; i++)
+    {
+        join->tables[select_tables[i]].fields[select_columns[i]] = 1;
+    }
+    if (order->table != -1)
+    {
+        join->tables[order->table].fields[order->column] = 1;
+    }
+    for (t = 0; t < join->ntables; t++)
+    {
+        chidb_join_table_t *jt = &join->tables[t];
+        chidb_join_need(ctx, &jt->probe_conds);
+        if (jt->key != -1)
+        {
+            join->tables[jt->probe_table].fields[jt->probe_column] = 1;
+        }
+    }
+    for (t = 1; t < join->ntables; t++)
+    {
+        chidb_join_table_t *jt = &join->tables[t];
+        for (i = 0; i < jt->ncols; i++)
+        {
+            if (jt->fields[i] != -1)
+            {
+                jt->fields[i] = jt->nfields++;
+            }
+        }
+        // 记录至少有一列
+        if (jt->nfields == 0)
+        {
+            jt->fields[0] = jt->nfields++;
+        }
+    }
+
+    // 寄存器0存储root page, 寄存器1为没有key时使用的0
+    int reg = 0;
+    int zero_reg = ++reg;
+    reg++;
+    for (t = 1; t < join->ntables; t++)
+    {
+        if (join->tables[t].key == -1)
+        {
+            list_append(ops, chidb_make_op(
+                Op_Integer,
+                0,
+                zero_reg,
+                0, NULL)); // not used
+            break;
+        }
+    }
+
+    // 条件中的值在循环之前存储, 顺序与生成判断条件的指令的顺序相同
+    int value_reg = reg;
+    for (t = 1; t < join->ntables; t++)
+    {
+        ctx->building = t;
+        list_iterator_start(&join->tables[t].build_conds);
+        while (list_iterator_hasnext(&join->tables[t].build_conds))
+        {
+            chidb_cond_values_codegen(ctx, list_iterator_next(&join->tables[t].build_conds), ops, &reg);
+        }
+        list_iterator_stop(&join->tables[t].build_conds);
+    }
+    ctx->building = -1;
+    for (t = 0; t < join->ntables; t++)
+    {
+        list_iterator_start(&join->tables[t].probe_conds);
+        while (list_iterator_hasnext(&join->tables[t].probe_conds))
+        {
+            chidb_cond_values_codegen(ctx, list_iterator_next(&join->tables[t].probe_conds), ops, &reg);
+        }
+        list_iterator_stop(&join->tables[t].probe_conds);
+    }
+
+    list_t jumps;
+    list_init(&jumps);
+
+    // 把第一个之后的表依次放入同编号的hash表, 使用同编号的游标
+    for (t = 1; t < join->ntables; t++)
+    {
+        chidb_join_table_t *jt = &join->tables[t];
+        if (jt->lookup)
+        {
+            continue;
+        }
+        ctx->building = t;
+
+        list_append(ops, chidb_make_op(
+            Op_Integer,
+            chidb_get_root_page_of_table(&ctx->stmt->db->schema, jt->table_name),
+            0, // 将root page存储在寄存器0上
+            0, NULL)); // not used
+        list_append(ops, chidb_make_op(
+            Op_OpenRead,
+            t,
+            0,
+            jt->ncols,
+            NULL)); // not used
+        chidb_dbm_op_t *rewind = chidb_make_op(
+            Op_Rewind,
+            t, // 表为空时跳转到Close
+            0, // 占位
+            0, NULL); // not used
+        list_append(ops, rewind);
+        int top = list_size(ops);
+
+        // 不满足条件的行不放入hash表
+        chidb_join_conds_codegen(ctx, &jt->build_conds, ops, &reg, &value_reg, &jumps);
+
+        int key_reg = zero_reg;
+        if (jt->key != -1)
+        {
+            key_reg = reg++;
+            chidb_cond_column_codegen(ctx, ops, t, jt->key, key_reg);
+        }
+
+        int start = reg;
+        for (i = 0; i < jt->ncols; i++)
+        {
+            if (jt->fields[i] != -1)
+            {
+                chidb_cond_column_codegen(ctx, ops, t, i, reg++);
+            }
+        }
+        list_append(ops, chidb_make_op(
+            Op_MakeRecord,
+            start,
+            jt->nfields,
+            reg,
+            NULL)); // not used
+        list_append(ops, chidb_make_op(
+            Op_HashAdd,
+            t,
+            key_reg,
+            reg++, // MakeRecord生成的记录
+            NULL)); // not used
+
+        chidb_jumps_set(&jumps, list_size(ops));
+        list_append(ops, chidb_make_op(
+            Op_Next,
+            t,
+            top,
+            0, NULL)); // not used
+        rewind->p2 = list_size(ops);
+        list_append(ops, chidb_make_op(
+            Op_Close,
+            t,
+            0, 0, NULL)); // not used
+    }
+    ctx->building = -1;
+
+    // 打开直接查找的表, 有索引时索引与游标ntables + t关联
+    for (t = 1; t < join->ntables; t++)
+    {
+        chidb_join_table_t *jt = &join->tables[t];
+        if (!jt->lookup)
+        {
+            continue;
+        }
+        list_append(ops, chidb_make_op(
+            Op_Integer,
+            chidb_get_root_page_of_table(&ctx->stmt->db->schema, jt->table_name),
+            0,
+            0, NULL)); // not used
+        list_append(ops, chidb_make_op(
+            Op_OpenRead,
+            t,
+            0,
+            jt->ncols,
+            NULL)); // not used
+        if (jt->index != NULL)
+        {
+            list_append(ops, chidb_make_op(
+                Op_Integer,
+                jt->index->item->root_page,
+                0,
+                0, NULL)); // not used
+            list_append(ops, chidb_make_op(
+                Op_OpenRead,
+                join->ntables + t,
+                0,
+                0, // 索引没有列
+                NULL)); // not used
+        }
+    }
+
+    // 遍历第一个表
+    list_append(ops, chidb_make_op(
+        Op_Integer,
+        chidb_get_root_page_of_table(&ctx->stmt->db->schema, join->tables[0].table_name),
+        0, // 将root page存储在寄存器0上
+        0, NULL)); // not used
+    list_append(ops, chidb_make_op(
+        Op_OpenRead,
+        0,
+        0,
+        join->tables[0].ncols,
+        NULL)); // not used
+    chidb_dbm_op_t *rewind = chidb_make_op(
+        Op_Rewind,
+        0, // 表为空时跳转到结尾
+        0, // 占位
+        0, NULL); // not used
+    list_append(ops, rewind);
+    int loop = list_size(ops);
+
+    // 每个表的条件不成立或探查不到更多的记录时, 跳转到advances[t]处继续下一个记录
+    list_t advances[JOIN_MAX_TABLES];
+    int bodies[JOIN_MAX_TABLES];
+    for (t = 0; t < join->ntables; t++)
+    {
+        list_init(&advances[t]);
+        if (t > 0)
+        {
+            chidb_join_table_t *jt = &join->tables[t];
+            int key_reg = zero_reg;
+            if (jt->key != -1)
+            {
+                key_reg = reg++;
+                chidb_cond_column_codegen(ctx, ops, jt->probe_table, jt->probe_column, key_reg);
+            }
+            // 直接查找时主键和索引中的key都不重复, 最多找到一行
+            if (jt->lookup && jt->index != NULL)
+            {
+                chidb_dbm_op_t *seek = chidb_make_op(
+                    Op_Seek,
+                    join->ntables + t,
+                    0, // 占位, 没有时继续前一个表的下一个记录
+                    key_reg,
+                    NULL); // not used
+                list_append(ops, seek);
+                list_append(&advances[t - 1], seek);
+                key_reg = reg++;
+                list_append(ops, chidb_make_op(
+                    Op_IdxPKey,
+                    join->ntables + t,
+                    key_reg,
+                    0, NULL)); // not used
+            }
+            chidb_dbm_op_t *seek = chidb_make_op(
+                jt->lookup ? Op_Seek : Op_HashSeek,
+                t,
+                0, // 占位, 没有时继续前一个表的下一个记录
+                key_reg,
+                NULL); // not used
+            list_append(ops, seek);
+            list_append(&advances[t - 1], seek);
+            bodies[t] = list_size(ops);
+        }
+        chidb_join_conds_codegen(ctx, &join->tables[t].probe_conds, ops, &reg, &value_reg, &advances[t]);
+    }
+
+    int startRR = reg;
+    for (i = 0; i < nCols; i++)
+    {
+        chidb_cond_column_codegen(ctx, ops, select_tables[i], select_columns[i], reg++);
+    }
+    chidb_result_row_codegen(ctx, order, ops, startRR, nCols, &reg);
+
+    // 从最后一个表开始继续下一个记录
+    for (t = join->ntables - 1; t >= 0; t--)
+    {
+        chidb_jumps_set(&advances[t], list_size(ops));
+        list_destroy(&advances[t]);
+        if (t > 0 && join->tables[t].lookup)
+        {
+            continue;
+        }
+        if (t > 0)
+        {
+            list_append(ops, chidb_make_op(
+                Op_HashNext,
+                t,
+                bodies[t],
+                0, NULL)); // not used
+        }
+        else
+        {
+            list_append(ops, chidb_make_op(
+                Op_Next,
+                0,
+                loop,
+                0, NULL)); // not used
+        }
+    }
+
+    rewind->p2 = list_size(ops);
+    list_append(ops, chidb_make_op(
+        Op_Close,
+        0,
+        0, 0, NULL)); // not used
+    for (t = 1; t < join->ntables; t++)
+    {
+        if (join->tables[t].lookup)
+        {
+            list_append(ops, chidb_make_op(
+                Op_Close,
+                t,
+                0, 0, NULL)); // not used
+        }
+        if (join->tables[t].index != NULL)
+        {
+            list_append(ops, chidb_make_op(
+                Op_Close,
+                join->ntables + t,
+                0, 0, NULL)); // not used
+        }
+    }
+
+    list_destroy(&jumps);
+
+    return startRR;
+}
+
+// 两个表是否都可以按连接的列的顺序读取: 连接的列为主键或有索引, 有索引时存入indexes
+// 两边都不需要hash表, 用merge join
+int chidb_join_ordered(chidb_cond_ctx_t *ctx, chidb_schema_index_t **indexes)
+{
+    chidb_join_t *join = ctx->join;
+    if (join->ntables != 2 || join->tables[1].key == -1)
+    {
+        return 0;
+    }
+
+    int columns[2] = { join->tables[1].probe_column, join->tables[1].key };
+    int t;
+    for (t = 0; t < 2; t++)
+    {
+        chidb_join_table_t *jt = &join->tables[t];
+        indexes[t] = NULL;
+        if (columns[t] != 0
+            && (indexes[t] = chidb_schema_find_index(&ctx->stmt->db->schema, jt->table_name,
+                                                     jt->columns[columns[t]]->name)) == NULL)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// 生成merge join的指令, 返回存储结果的第一个寄存器
+// 两个表分别按主键或索引的顺序读取, 同时移动两个游标, 每次移动key较小的一边
+// 主键和索引中的key都不重复, 所以key相等时两边都移动到下一项
+int chidb_merge_join_codegen(chidb_cond_ctx_t *ctx, chidb_order_t *order, list_t *ops,
+    chidb_schema_index_t **indexes, int *select_tables, int *select_columns, int nCols)
+{
+    chidb_join_t *join = ctx->join;
+    int t, i;
+
+    // 所有的条件都在key相等时判断, 两个表都从游标读取列
+    join->merge = 1;
+    list_t conds;
+    list_init(&conds);
+    for (t = 0; t < 2; t++)
+    {
+        list_t *lists[2] = { &join->tables[t].build_conds, &join->tables[t].probe_conds };
+        for (i = 0; i < 2; i++)
+        {
+            list_iterator_start(lists[i]);
+            while (list_iterator_hasnext(lists[i]))
+            {
+                list_append(&conds, list_iterator_next(lists[i]));
+            }
+            list_iterator_stop(lists[i]);
+        }
+    }
+
+    // 寄存器0存储root page
+    int reg = 1;
+    int value_reg = reg;
+    list_iterator_start(&conds);
+    while (list_iterator_hasnext(&conds))
+    {
+        chidb_cond_values_codegen(ctx, list_iterator_next(&conds), ops, &reg);
+    }
+    list_iterator_stop(&conds);
+
+    // 表t与游标t关联, 按索引的顺序读取时索引与游标ntables(2) + t关联
+    int orders[2];
+    for (t = 0; t < 2; t++)
+    {
+        chidb_join_table_t *jt = &join->tables[t];
+        list_append(ops, chidb_make_op(
+            Op_Integer,
+            chidb_get_root_page_of_table(&ctx->stmt->db->schema, jt->table_name),
+            0, // 将root page存储在寄存器0上
+            0, NULL)); // not used
+        list_append(ops, chidb_make_op(
+            Op_OpenRead,
+            t,
+            0,
+            jt->ncols,
+            NULL)); // not used
+
+        orders[t] = t;
+        if (indexes[t] != NULL)
+        {
+            orders[t] = 2 + t;
+            list_append(ops, chidb_make_op(
+                Op_Integer,
+                indexes[t]->item->root_page,
+                0,
+                0, NULL)); // not used
+            list_append(ops, chidb_make_op(
+                Op_OpenRead,
+                orders[t],
+                0,
+                0, // 索引没有列
+                NULL)); // not used
+        }
+    }
+
+    // 任一边读完时跳转到结尾的指令
+    list_t ends;
+    list_init(&ends);
+    for (t = 0; t < 2; t++)
+    {
+        chidb_dbm_op_t *rewind = chidb_make_op(
+            Op_Rewind,
+            orders[t],
+            0, // 占位
+            0, NULL); // not used
+        list_append(ops, rewind);
+        list_append(&ends, rewind);
+    }
+    int loop = list_size(ops);
+
+    // 表的Key为主键, 索引的Key为索引的列值
+    int key_regs[2];
+    for (t = 0; t < 2; t++)
+    {
+        key_regs[t] = reg++;
+        list_append(ops, chidb_make_op(
+            Op_Key,
+            orders[t],
+            key_regs[t],
+            0, NULL)); // not used
+    }
+
+    // key较小的一边移动到下一项
+    chidb_dbm_op_t *lt = chidb_make_op(
+        Op_Lt,
+        key_regs[1],
+        0, // 占位, 第一个表的key较小时
+        key_regs[0],
+        NULL); // not used
+    list_append(ops, lt);
+    chidb_dbm_op_t *gt = chidb_make_op(
+        Op_Gt,
+        key_regs[1],
+        0, // 占位, 第二个表的key较小时
+        key_regs[0],
+        NULL); // not used
+    list_append(ops, gt);
+
+    // key相等, 按索引的顺序读取时找到表中的行
+    list_t skips;
+    list_init(&skips);
+    for (t = 0; t < 2; t++)
+    {
+        if (indexes[t] == NULL)
+        {
+            continue;
+        }
+        int pk_reg = reg++;
+        list_append(ops, chidb_make_op(
+            Op_IdxPKey,
+            orders[t],
+            pk_reg,
+            0, NULL)); // not used
+        chidb_dbm_op_t *seek = chidb_make_op(
+            Op_Seek,
+            t,
+            0, // 占位, 不存在时跳过
+            pk_reg,
+            NULL); // not used
+        list_append(ops, seek);
+        list_append(&skips, seek);
+    }
+
+    chidb_join_conds_codegen(ctx, &conds, ops, &reg, &value_reg, &skips);
+
+    int startRR = reg;
+    for (i = 0; i < nCols; i++)
+    {
+        chidb_cond_column_codegen(ctx, ops, select_tables[i], select_columns[i], reg++);
+    }
+    chidb_result_row_codegen(ctx, order, ops, startRR, nCols, &reg);
+
+    // 两边都移动到下一项
+    chidb_jumps_set(&skips, list_size(ops));
+    chidb_dbm_op_t *both = chidb_make_op(
+        Op_Next,
+        orders[0],
+        0, // 占位, 再移动第二个表
+        0, NULL); // not used
+    list_append(ops, both);
+    chidb_dbm_op_t *end = chidb_make_op(
+        Op_Goto,
+        0, // not used
+        0, // 占位
+        0, NULL); // not used
+    list_append(ops, end);
+    list_append(&ends, end);
+
+    for (t = 0; t < 2; t++)
+    {
+        (t == 0 ? lt : gt)->p2 = list_size(ops);
+        list_append(ops, chidb_make_op(
+            Op_Next,
+            orders[t],
+            loop,
+            0, NULL)); // not used
+        if (t == 0)
+        {
+            end = chidb_make_op(
+                Op_Goto,
+                0, // not used
+                0, // 占位
+                0, NULL); // not used
+            list_append(ops, end);
+            list_append(&ends, end);
+        }
+    }
 
-    list_t columns;
-    list_init(&columns);
-    chidb_get_columns_of_table(stmt->db->schema, table_name, &columns);
+    both->p2 = gt->p2;
 
-    int column_num = order_of_column(&columns, cond_column_name);
-
-    // 如果可以直接查找主键时, 生成Seek指令
-    if (column_num == 0)
+    chidb_jumps_set(&ends, list_size(ops));
+    for (t = 0; t < 2; t++)
     {
-        opcode_t cond_op;
-        switch (cond->t)
+        list_append(ops, chidb_make_op(
+            Op_Close,
+            t,
+            0, 0, NULL)); // not used
+        if (indexes[t] != NULL)
         {
-        case RA_COND_EQ:
-            cond_op = Op_Seek;
-            break;
-        case RA_COND_LT:
-            cond_op = Op_SeekLt;
-            *prev = 1;
-            break;
-        case RA_COND_GT:
-            cond_op = Op_SeekGt;
-            break;
-        case RA_COND_LEQ:
-            cond_op = Op_SeekLe;
-            *prev = 1;
-            break;
-        case RA_COND_GEQ:
-            cond_op = Op_SeekGe;
-            break;
-        default:
-            return CHIDB_EINVALIDSQL;
+            list_append(ops, chidb_make_op(
+                Op_Close,
+                orders[t],
+                0, 0, NULL)); // not used
         }
+    }
 
-        *cmp_op = chidb_make_op(
-            cond_op,
-            0, // 在游标0关联的B树上查找
-            0, // 占位, 查找失败时跳转到结尾
-            *reg - 1,
-            NULL); // not used
-        list_append(ops, *cmp_op);
+    list_destroy(&conds);
+    list_destroy(&ends);
+    list_destroy(&skips);
 
-        // 如果是Seek则不需要Next
-        if (cond->t == RA_COND_EQ)
-        {
-            *next_to = -1;
-        }
-        // 否则需要next跳转到下一条指令
-        // 同时若查找失败则跳转到next之后
-        else
-        {
-            *next_to = list_size(ops);
-            *after_next = 1;
-        }
+    return startRR;
+}
 
-        list_destroy(&columns);
-        return CHIDB_OK;
+// 连接多个表
+// 没有统计信息, 所以按FROM中的顺序连接
+// 第一个表有过滤条件时, 之后的表尽量直接查找; 否则两个表都按连接的列的顺序读取时用merge join,
+// 其余的情况用hash join
+// 有ORDER BY时结果行先加入sorter, 所有的行都加入后再按顺序返回
+int chidb_join_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t *ops)
+{
+    SRA_Project_t *project = &sql_stmt->stmt.select->project;
+    chidb_join_t join;
+    join.ntables = 0;
+    join.merge = 0;
+    list_init(&join.conds);
+    list_init(&join.made);
+    chidb_cond_ctx_t ctx = { stmt, NULL, 0, -1, &join, -1 };
+
+    int err = chidb_join_flatten(stmt, &join, project->sra);
+    if (!err)
+    {
+        err = chidb_join_plan(&ctx, &join);
+    }
+    int nCols = err ? -1 : chidb_join_select(&ctx, project->expr_list, NULL, NULL);
+    chidb_order_t order;
+    if (nCols < 0 || chidb_order_resolve(&ctx, project, &order))
+    {
+        chidb_join_free(&join);
+        return CHIDB_EINVALIDSQL;
+    }
+    int *select_tables = malloc(sizeof(int) * nCols);
+    int *select_columns = malloc(sizeof(int) * nCols);
+    chidb_join_select(&ctx, project->expr_list, select_tables, select_columns);
+
+    int i, startRR;
+    chidb_schema_index_t *indexes[2];
+    chidb_order_open_codegen(stmt, &order, ops);
+    if (!chidb_join_lookups(&ctx) && chidb_join_ordered(&ctx, indexes))
+    {
+        startRR = chidb_merge_join_codegen(&ctx, &order, ops, indexes, select_tables, select_columns, nCols);
+    }
+    else
+    {
+        startRR = chidb_probe_join_codegen(&ctx, &order, ops, select_tables, select_columns, nCols);
     }
+    chidb_order_output_codegen(&order, ops, startRR, nCols);
 
-    // 不是主键是则通过获取列的操作
-    *next_to = list_size(ops);
     list_append(ops, chidb_make_op(
-        Op_Column,
-        0, // 读取游标0关联的表的列
-        column_num,
-        (*reg)++, // 存储在寄存器2上
-        NULL));
+        Op_Halt, 0, 0, 0, NULL));
 
-    // 因为比较成功时跳转, 所以运算符相反, 所以> -> <=
-    opcode_t cond_op;
-    switch (cond->t)
+    stmt->startRR = startRR;
+    stmt->nRR = nCols;
+    stmt->nCols = nCols;
+    stmt->cols = malloc(sizeof(char *) * nCols);
+    for (i = 0; i < nCols; i++)
     {
-    case RA_COND_EQ:
-        cond_op = Op_Ne;
-        break;
-    case RA_COND_LT:
-        cond_op = Op_Ge;
-        break;
-    case RA_COND_GT:
-        cond_op = Op_Le;
-        break;
-    case RA_COND_LEQ:
-        cond_op = Op_Gt;
-        break;
-    case RA_COND_GEQ:
-        cond_op = Op_Lt;
-        break;
-
-    default:
-        return CHIDB_EINVALIDSQL;
+        stmt->cols[i] = strdup(join.tables[select_tables[i]].columns[select_columns[i]]->name);
     }
-    *cmp_op = chidb_make_op(
-        cond_op,
-        1, // 比较寄存器1存储的值与
-        0, // 占位, 比较成功时跳转
-        2, // 寄存器2存储的值比较,  p3 <= p1
-        NULL);
-    list_append(ops, *cmp_op);
 
-    list_destroy(&columns);
+    free(select_tables);
+    free(select_columns);
+    chidb_join_free(&join);
+
     return CHIDB_OK;
 }
 
@@ -363,6 +2332,12 @@ int chidb_select_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
         select = &project->sra->select;
     }
 
+    // 从多个表中查找时通过连接
+    if ((select == NULL ? project->sra : select->sra)->t != SRA_TABLE)
+    {
+        return chidb_join_codegen(stmt, sql_stmt, ops);
+    }
+
     if (select == NULL)
     {
         table = &project->sra->table;
@@ -376,15 +2351,17 @@ int chidb_select_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
 
     // 1. 要查找的表名不存在返回错误
     char *table_name = table->ref->table_name;
-    if (!chidb_check_table_exist(stmt->db->schema, table_name))
+    if (!chidb_check_table_exist(&stmt->db->schema, table_name))
     {
         return CHIDB_EINVALIDSQL;
     }
 
+    chidb_cond_ctx_t ctx = { stmt, table_name, 0, -1, NULL, -1 };
+
     // 先获取表里所有的列
     list_t columns;
     list_init(&columns);
-    chidb_get_columns_of_table(stmt->db->schema, table_name, &columns);
+    chidb_get_columns_of_table(&stmt->db->schema, table_name, &columns);
 
     // 2. 遍历要返回的列名是否存在, 存在则添加到column_names, 不存在则返回错误
     list_t select_names;
@@ -405,7 +2382,7 @@ int chidb_select_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
             list_iterator_stop(&columns);
         }
         // 不存在则返回错误
-        else if (!chidb_check_column_exist(stmt->db->schema, table_name, column_name))
+        else if (!chidb_check_column_exist(&stmt->db->schema, table_name, column_name))
         {
             return CHIDB_EINVALIDSQL;
         }
@@ -417,49 +2394,186 @@ int chidb_select_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
         expr = expr->next;
     }
 
+    // 3. 检查where条件
+    if (select != NULL && chidb_cond_check(&ctx, select->cond))
+    {
+        list_destroy(&columns);
+        list_destroy(&select_names);
+        return CHIDB_EINVALIDSQL;
+    }
+
+    // 4. 检查ORDER BY的列
+    // 不论用哪种方式查找, 都按主键从小到大的顺序返回行, 所以按主键升序时不需要排序
+    chidb_order_t order;
+    if (chidb_order_resolve(&ctx, project, &order))
+    {
+        list_destroy(&columns);
+        list_destroy(&select_names);
+        return CHIDB_EINVALIDSQL;
+    }
+    if (order.table != -1 && order.column == 0 && !order.desc)
+    {
+        order.table = -1;
+    }
+
+    // 选择查找的方式
+    // 用AND连接的条件中, 主键或有索引的列上的比较用来限定查找的范围, 其余的作为过滤条件
+    // 优先级: 主键等于 > 索引等于 > 主键范围 > 索引范围 > 遍历整个表
+    list_t conjuncts;
+    list_init(&conjuncts);
+    if (select != NULL)
+    {
+        chidb_cond_conjuncts(select->cond, &conjuncts);
+    }
+
+    chidb_cond_bounds_t bounds, index_bounds;
+    int pk_bounded = chidb_cond_bounds(stmt, table_name, &conjuncts, 0, &bounds);
+    chidb_schema_index_t *index = chidb_cond_index(stmt, table_name, &conjuncts, &index_bounds);
+    if (index != NULL && (!pk_bounded || (bounds.eq == NULL && index_bounds.eq != NULL)))
+    {
+        bounds = index_bounds;
+        pk_bounded = 0;
+    }
+    else
+    {
+        index = NULL;
+    }
+
+    // 没有用来限定范围的比较作为过滤条件
+    list_t residuals;
+    list_init(&residuals);
+    list_t residual_refs;
+    list_init(&residual_refs);
+    list_iterator_start(&conjuncts);
+    while (list_iterator_hasnext(&conjuncts))
+    {
+        Condition_t *cond = list_iterator_next(&conjuncts);
+        if ((pk_bounded || index != NULL)
+            && (cond == bounds.eq || cond == bounds.lower || cond == bounds.upper))
+        {
+            continue;
+        }
+        list_append(&residuals, cond);
+        chidb_cond_refs(cond, &residual_refs);
+    }
+    list_iterator_stop(&conjuncts);
+
+    list_t residual_names;
+    list_init(&residual_names);
+    list_iterator_start(&residual_refs);
+    while (list_iterator_hasnext(&residual_refs))
+    {
+        ColumnReference_t *ref = list_iterator_next(&residual_refs);
+        list_append(&residual_names, ref->columnName);
+    }
+    list_iterator_stop(&residual_refs);
+    // 排序时也要读取ORDER BY的列
+    if (order.table != -1)
+    {
+        list_append(&residual_names, project->order_by->expr.term.ref->columnName);
+    }
+
+    int index_only = index != NULL
+                     && chidb_index_covers(stmt, table_name, index, &select_names)
+                     && chidb_index_covers(stmt, table_name, index, &residual_names);
+    ctx.index_only = index_only;
+
     // 具体的代码生成
 
     int reg = 0;
 
-    list_append(ops, chidb_make_op(
-        Op_Integer,
-        chidb_get_root_page_of_table(stmt->db->schema, table_name),
-        reg++, // 将root page存储在寄存器0上
-        0, NULL)); // not used
+    chidb_order_open_codegen(stmt, &order, ops);
 
-    list_append(ops, chidb_make_op(
-        Op_OpenRead, // 以只读模式打开
-        0, // 与游标0关联
-        0, // 打开页码为寄存器0上存储的整数的B树
-        list_size(&columns), // 表内的列数
-        NULL)); // not used
+    // 只读取索引时不需要打开表
+    if (!index_only)
+    {
+        list_append(ops, chidb_make_op(
+            Op_Integer,
+            chidb_get_root_page_of_table(&stmt->db->schema, table_name),
+            reg, // 将root page存储在寄存器0上
+            0, NULL)); // not used
 
-    chidb_dbm_op_t *rewind = chidb_make_op(
-        Op_Rewind,
-        0, // 如果游标0关联的表为空, 则
-        0, // 跳转到p2值表示的指令, 此处占空
-        0, NULL);
-    list_append(ops, rewind);
+        list_append(ops, chidb_make_op(
+            Op_OpenRead, // 以只读模式打开
+            0, // 与游标0关联
+            0, // 打开页码为寄存器0上存储的整数的B树
+            list_size(&columns), // 表内的列数
+            NULL)); // not used
+    }
+    reg++;
 
-    int next_to;
-    int after_next = 0;
-    int prev = 0;
-    chidb_dbm_op_t *cmp_op = NULL;
-    if (select != NULL)
+    // 过滤条件中的值在循环之前存储
+    int value_reg = reg;
+    list_iterator_start(&residuals);
+    while (list_iterator_hasnext(&residuals))
+    {
+        chidb_cond_values_codegen(&ctx, list_iterator_next(&residuals), ops, &reg);
+    }
+    list_iterator_stop(&residuals);
+
+    // 没有更多满足条件的行时跳转到结尾的指令
+    list_t ends;
+    list_init(&ends);
+    // 当前行不满足条件时跳过该行的指令
+    list_t skips;
+    list_init(&skips);
+
+    int next_to = -1;
+    int loop_to = -1;
+    int pk_reg = -1;
+
+    if (index != NULL)
+    {
+        chidb_dbm_op_t *end_op = NULL;
+        chidb_dbm_op_t *seek_op = NULL;
+        int err = chidb_index_cond_codegen(stmt, index, &bounds, index_only, &end_op, &seek_op,
+                                           ops, &reg, &pk_reg, &loop_to);
+        if (err)
+        {
+            return err;
+        }
+        ctx.pk_reg = pk_reg;
+        list_append(&ends, end_op);
+        if (seek_op != NULL)
+        {
+            list_append(&skips, seek_op);
+        }
+    }
+    else if (pk_bounded)
     {
-        int err = chidb_cond_codegen(stmt, select, &cmp_op, ops, &reg, &next_to, &after_next, &prev);
+        int err = chidb_pk_cond_codegen(stmt, &bounds, ops, &reg, &next_to, &ends);
         if (err)
         {
             return err;
         }
     }
-    // 没有where的话next直接跳转到这里
     else
     {
+        chidb_dbm_op_t *rewind = chidb_make_op(
+            Op_Rewind,
+            0, // 如果游标0关联的表为空, 则
+            0, // 跳转到p2值表示的指令, 此处占空
+            0, NULL);
+        list_append(ops, rewind);
+        list_append(&ends, rewind);
+
         // Next 指令会跳转到这里
         next_to = list_size(ops);
     }
 
+    // 过滤条件不成立时跳过该行
+    list_iterator_start(&residuals);
+    while (list_iterator_hasnext(&residuals))
+    {
+        int err = chidb_cond_jump_codegen(&ctx, list_iterator_next(&residuals), 0,
+                                          ops, &reg, &value_reg, &skips);
+        if (err)
+        {
+            return err;
+        }
+    }
+    list_iterator_stop(&residuals);
+
     int startRR = reg;
 
     // 将要获取的列连续生成Column指令
@@ -467,68 +2581,76 @@ int chidb_select_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
     while (list_iterator_hasnext(&select_names))
     {
         char *name = list_iterator_next(&select_names);
-        int column_num = order_of_column(&columns, name);
-        if (column_num == 0)
-        {
-            list_append(ops, chidb_make_op(
-                Op_Key,
-                0, // 读取游标0关联的表的Key
-                reg++,
-                0, NULL));
-        }
-        else
-        {
-            list_append(ops, chidb_make_op(
-                Op_Column,
-                0, // 读取游标0关联的表的列
-                column_num,
-                reg++,
-                NULL));
-        }
+        int column_num = chidb_get_order_of_column(&stmt->db->schema, table_name, name);
+        chidb_column_codegen(ops, column_num, index_only, pk_reg, reg++);
     }
     list_iterator_stop(&select_names);
 
-    list_append(ops, chidb_make_op(
-        Op_ResultRow,
-        startRR, // 从寄存器3开始
-        reg - startRR, // reg - startRR 个值加入结果集中
-        0, NULL)); // not used
+    // reg - startRR 个值加入结果集中, 排序时先加入sorter
+    chidb_result_row_codegen(&ctx, &order, ops, startRR, reg - startRR, &reg);
 
-    // 设置比较或Seek指令的跳转目标
-    if (cmp_op != NULL)
+    // 设置跳过该行的指令的跳转目标
+    list_iterator_start(&skips);
+    while (list_iterator_hasnext(&skips))
     {
-        cmp_op->p2 = list_size(ops);
+        chidb_dbm_op_t *op = list_iterator_next(&skips);
+        op->p2 = list_size(ops);
     }
+    list_iterator_stop(&skips);
 
-    // next_to = -1 时, 不需要prev或next指令
+    // next_to = -1 时, 不需要next指令
     if (next_to != -1)
     {
         list_append(ops, chidb_make_op(
-            prev ? Op_Prev : Op_Next,
+            Op_Next,
             0, // 对游标0关联的表进行下一条记录的比对
             next_to, // 跳转到开始比较的地方继续执行
             0, NULL)); // not used
     }
 
-    // after_next为1时, 比较指令的跳转目标在next或prev之后
-    if (after_next)
+    // 通过索引范围查找时, 继续读取下一个主键
+    if (loop_to != -1)
     {
-        cmp_op->p2 = list_size(ops);
+        list_append(ops, chidb_make_op(
+            Op_Goto,
+            0, // not used
+            loop_to,
+            0, NULL)); // not used
     }
 
-    // 设置表为空时的跳转目标
-    rewind->p2 = list_size(ops);
+    // 设置没有更多满足条件的行时的跳转目标
+    list_iterator_start(&ends);
+    while (list_iterator_hasnext(&ends))
+    {
+        chidb_dbm_op_t *op = list_iterator_next(&ends);
+        op->p2 = list_size(ops);
+    }
+    list_iterator_stop(&ends);
 
-    list_append(ops, chidb_make_op(
-        Op_Close,
-        0, // 关闭游标0关联的B树
-        0, 0, NULL)); // not used
+    if (index != NULL)
+    {
+        list_append(ops, chidb_make_op(
+            Op_Close,
+            1, // 关闭游标1关联的索引
+            0, 0, NULL)); // not used
+    }
 
-    list_append(ops, chidb_make_op(
-        Op_Halt, 0, 0, 0, NULL));
+    if (!index_only)
+    {
+        list_append(ops, chidb_make_op(
+            Op_Close,
+            0, // 关闭游标0关联的B树
+            0, 0, NULL)); // not used
+    }
 
     // 完成对结果集的定义
     int nCols = list_size(&select_names);
+
+    chidb_order_output_codegen(&order, ops, startRR, nCols);
+
+    list_append(ops, chidb_make_op(
+        Op_Halt, 0, 0, 0, NULL));
+
     // 设定结果集的列数和起始寄存器
     stmt->startRR = startRR;
     stmt->nRR = nCols;
@@ -542,10 +2664,31 @@ int chidb_select_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
 
     list_destroy(&columns);
     list_destroy(&select_names);
+    list_destroy(&conjuncts);
+    list_destroy(&residuals);
+    list_destroy(&residual_refs);
+    list_destroy(&residual_names);
+    list_destroy(&ends);
+    list_destroy(&skips);
 
     return CHIDB_OK;
 }
 
+// 返回索引的列在表中的序号, 不能使用的索引返回-1
+int chidb_insert_index_column(chidb_stmt *stmt, char *table_name, list_t *columns,
+    chidb_schema_index_t *index)
+{
+    Index_t *idx = chidb_schema_index(index);
+    int column_num = idx != NULL ? chidb_get_order_of_column(&stmt->db->schema, table_name, idx->column_name) : -1;
+    // 只有整数列可以建立索引
+    if (column_num < 0 || ((Column_t *) list_get_at(columns, column_num))->type != TYPE_INT)
+    {
+        return -1;
+    }
+
+    return column_num;
+}
+
 // Step 3
 // 完成insert语句的代码生成
 int chidb_insert_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t *ops)
@@ -554,7 +2697,7 @@ int chidb_insert_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
 
     // 如果要插入的表不存在返回错误
     char *table_name = sql_stmt->stmt.insert->table_name;
-    if (!chidb_check_table_exist(stmt->db->schema, table_name))
+    if (!chidb_check_table_exist(&stmt->db->schema, table_name))
     {
         return CHIDB_EINVALIDSQL;
     }
@@ -562,7 +2705,7 @@ int chidb_insert_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
     // 获取要插入的表的所有的列
     list_t columns;
     list_init(&columns);
-    chidb_get_columns_of_table(stmt->db->schema, table_name, &columns);
+    chidb_get_columns_of_table(&stmt->db->schema, table_name, &columns);
 
     // 遍历列, 检查每一列与对应的给定值类型是否匹配
     list_iterator_start(&columns);
@@ -576,8 +2719,8 @@ int chidb_insert_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
             list_destroy(&columns);
             return CHIDB_EINVALIDSQL;
         }
-        // 如果当前值与对应列的类型不同, 返回错误
-        if (value->t != column->type)
+        // 如果当前值与对应列的类型不同, 返回错误 (参数的类型在执行时检查)
+        if (value->t != TYPE_PARAM && value->t != column->type)
         {
             list_destroy(&columns);
             return CHIDB_EINVALIDSQL;
@@ -585,10 +2728,16 @@ int chidb_insert_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
         value = value->next;
     }
     list_iterator_stop(&columns);
+    // 给定值多于列数时同样返回错误
+    if (value != NULL)
+    {
+        list_destroy(&columns);
+        return CHIDB_EINVALIDSQL;
+    }
 
     // 错误检查之后开始生成代码
 
-    int root_page = chidb_get_root_page_of_table(stmt->db->schema, table_name);
+    int root_page = chidb_get_root_page_of_table(&stmt->db->schema, table_name);
     list_append(ops, chidb_make_op(
         Op_Integer,
         root_page, // 将要插入表所在的B树页码
@@ -604,34 +2753,13 @@ int chidb_insert_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
 
     // 生成一行记录
     // 遍历值, 不断存储在连续的寄存器上
-    int reg = 1;
+    int reg = 1, col = 0;
     value = insert->values;
     while (value != NULL)
     {
         // 根据不同的值类型生成不同的指令
-        switch (value->t)
-        {
-        case TYPE_INT:
-            list_append(ops, chidb_make_op(
-                Op_Integer,
-                value->val.ival,
-                reg,
-                0, NULL)); // not used
-            break;
-        case TYPE_TEXT:
-            list_append(ops, chidb_make_op(
-                Op_String,
-                strlen(value->val.strval),
-                reg,
-                0, // not used
-                value->val.strval));
-            break;
-
-        // 并没有Op_Double 和 Op_Char
-        case TYPE_DOUBLE:
-        case TYPE_CHAR:
-            break;
-        }
+        Column_t *column = list_get_at(&columns, col++);
+        chidb_value_codegen(ops, value, column->type, reg);
         // 第一个值总为主键, 要在值后标记NULL
         if (reg == 1)
         {
@@ -652,6 +2780,50 @@ int chidb_insert_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
         reg, // 存储在最后一个可用的寄存器上
         NULL)); // not used
 
+    // 先在表的每个索引中查找新行的列值, 已经存在时不写入任何内容就结束,
+    // 这样在事务中失败的INSERT不会留下没有索引项的行
+    chidb_schema_table_t *table = chidb_schema_find_table(&stmt->db->schema, table_name);
+    for (chidb_schema_index_t *index = table->indexes; index != NULL; index = index->next)
+    {
+        int column_num = chidb_insert_index_column(stmt, table_name, &columns, index);
+        if (column_num < 0)
+        {
+            continue;
+        }
+
+        list_append(ops, chidb_make_op(
+            Op_Integer,
+            index->item->root_page,
+            reg + 1, // 将索引的root page存储在记录之后的寄存器上
+            0, NULL)); // not used
+
+        list_append(ops, chidb_make_op(
+            Op_OpenRead,
+            1, // 游标1与索引关联
+            reg + 1,
+            0, // 索引没有列
+            NULL)); // not used
+
+        chidb_dbm_op_t *seek = chidb_make_op(
+            Op_Seek,
+            1,
+            0, // 占位, 不存在时跳过Halt
+            column_num == 0 ? 1 : column_num + 2, // 列值所在的寄存器, NULL不在索引中
+            NULL); // not used
+        list_append(ops, seek);
+
+        list_append(ops, chidb_make_op(
+            Op_Halt,
+            CHIDB_ECONSTRAINT, // 索引的每个key只能有一项
+            0, 0, NULL)); // not used
+
+        seek->p2 = list_size(ops);
+        list_append(ops, chidb_make_op(
+            Op_Close,
+            1, // 关闭游标1关联的索引
+            0, 0, NULL)); // not used
+    }
+
     list_append(ops, chidb_make_op(
         Op_Insert,
         0, // 将reg存储的记录插入到游标0关联的表上
@@ -664,38 +2836,61 @@ int chidb_insert_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t
         0, // 关闭游标0关联的B树
         0, 0, NULL)); // not used
 
+    // 在表的每个索引中加入新行的 (列值, 主键)
+    for (chidb_schema_index_t *index = table->indexes; index != NULL; index = index->next)
+    {
+        int column_num = chidb_insert_index_column(stmt, table_name, &columns, index);
+        if (column_num < 0)
+        {
+            continue;
+        }
+
+        list_append(ops, chidb_make_op(
+            Op_Integer,
+            index->item->root_page,
+            reg + 1, // 将索引的root page存储在记录之后的寄存器上
+            0, NULL)); // not used
+
+        list_append(ops, chidb_make_op(
+            Op_OpenWrite,
+            1, // 游标1与索引关联
+            reg + 1,
+            0, // 索引没有列
+            NULL)); // not used
+
+        list_append(ops, chidb_make_op(
+            Op_IdxInsert,
+            1, // 插入到游标1关联的索引上
+            column_num == 0 ? 1 : column_num + 2, // 列值所在的寄存器, 主键在寄存器1上
+            1, // 主键所在的寄存器
+            NULL)); // not used
+
+        list_append(ops, chidb_make_op(
+            Op_Close,
+            1, // 关闭游标1关联的索引
+            0, 0, NULL)); // not used
+    }
+
     list_destroy(&columns);
     return CHIDB_OK;
 }
 
+// 事务语句只需生成一条AutoCommit指令
+int chidb_transaction_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt, list_t *ops)
+{
+    list_append(ops, chidb_make_op(
+        Op_AutoCommit,
+        sql_stmt->type == STMT_BEGIN ? 0 : 1, // BEGIN关闭自动提交, COMMIT/ROLLBACK恢复自动提交
+        sql_stmt->type == STMT_ROLLBACK, // 是否回滚
+        0, NULL)); // not used
+
+    return CHIDB_OK;
+}
+
 int chidb_stmt_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt)
 {
     sql_stmt->text[strlen(sql_stmt->text) - 1] = '\0'; // 删除结尾的分号
 
-    // 如果之前执行了create table的指令, 则需要重新load schema
-    if (stmt->db->need_refresh == 1)
-    {
-        // 不断获取list中的第一个值并释放其中的指针指向的空间
-        while (!list_empty(&stmt->db->schema))
-        {
-            chidb_schema_item_t *item = (chidb_schema_item_t *)list_fetch(&stmt->db->schema);
-            chisql_statement_free(item->stmt);
-            free(item->type);
-            free(item->name);
-            free(item->assoc);
-            free(item);
-        }
-        // 释放list的空间
-        list_destroy(&stmt->db->schema);
-        // 重新初始化schema
-        list_init(&stmt->db->schema);
-        // 重新load schema
-        int load_schema(chidb *db, npage_t nroot);
-        load_schema(stmt->db, 1);
-        // 更新 need_refresh 为0
-        stmt->db->need_refresh = 0;
-    }
-
     list_t ops;
     list_init(&ops);
 
@@ -705,7 +2900,6 @@ int chidb_stmt_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt)
     {
     case STMT_CREATE:
         err = chidb_create_codegen(stmt, sql_stmt, &ops);
-        stmt->db->need_refresh = 1;
         break;
 
     case STMT_SELECT:
@@ -716,6 +2910,12 @@ int chidb_stmt_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt)
         err = chidb_insert_codegen(stmt, sql_stmt, &ops);
         break;
 
+    case STMT_BEGIN:
+    case STMT_COMMIT:
+    case STMT_ROLLBACK:
+        err = chidb_transaction_codegen(stmt, sql_stmt, &ops);
+        break;
+
     default:
         break;
     }
@@ -732,7 +2932,17 @@ int chidb_stmt_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt)
     }
 
     stmt->sql = sql_stmt;
-    stmt->nOps = list_size(&ops);
+
+    // 为参数准备绑定值的空间, 值在执行前通过chidb_bind_*绑定
+    stmt->nParams = sql_stmt->nparams;
+    stmt->nUserParams = sql_stmt->nparams;
+    stmt->params = calloc(stmt->nParams, sizeof(chidb_dbm_register_t));
+    stmt->paramNames = calloc(stmt->nParams, sizeof(char *));
+    for (int i = 0; i < stmt->nParams; ++i)
+    {
+        if (sql_stmt->params[i] != NULL)
+            stmt->paramNames[i] = strdup(sql_stmt->params[i]);
+    }
 
     // 添加指令到stmt中
     int i = 0;
@@ -752,22 +2962,4 @@ int chidb_stmt_codegen(chidb_stmt *stmt, chisql_statement_t *sql_stmt)
     return CHIDB_OK;
 }
 
-int order_of_column(list_t *columns, char *name)
-{
-    int i = 0;
-    list_iterator_start(columns);
-    while (list_iterator_hasnext(columns))
-    {
-        Column_t *column = list_iterator_next(columns);
-        if (!strcmp(name, column->name))
-        {
-            list_iterator_stop(columns);
-            return i;
-        }
-        ++i;
-    }
-    list_iterator_stop(columns);
-    return -1;
-}
-
 // --------- My Code End ---------
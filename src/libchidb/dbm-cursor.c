@@ -38,892 +38,539 @@
  */
 
 
+
 #include "dbm-cursor.h"
 
-/* Creates a new cursor trail and allocates memory for it
+/* 游标的实现
  *
- * Return
- * - CHIDB_OK: Operation sucessful
- * - CHIDB_ENOMEM: Malloc failed
+ * 游标用一个定长数组trail记录从根到当前结点的路径. 每一层的BTreeNode直接
+ * 嵌在数组里, 其页面在缓冲池中保持固定, 直到游标离开这一层才释放.
+ * 因此顺序扫描时每个页面只会被读取和固定一次, 移动也不需要分配内存.
+ *
+ * 对于trail中除最底层之外的每一层, n_current_cell是游标下降时经过的子结点:
+ * i < n_cells 表示cell i的子页面, i == n_cells 表示right_page.
+ * 对于最底层, n_current_cell是游标当前所指的cell. 在索引树中游标也可以
+ * 停在内部结点的cell上, 此时最底层就是该内部结点.
+ *
+ * fwd/rev在修改trail之前先检查是否还能移动, 不能移动时游标保持原样,
+ * 所以不需要复制trail.
+ *
+ * 表树的叶节点之间如果有链接(见btree.h中的PGFLAG_LEAF_LINKS), 移动到
+ * 相邻的叶节点时直接沿链接走, 并释放所有祖先(detached). 之后如果遇到
+ * 没有链接的叶节点, 再用当前的键重新seek, 恢复完整的trail.
  */
-int chidb_dbm_cursor_trail_new(BTree *bt, chidb_dbm_cursor_trail_t **ct, npage_t npage, uint32_t depth)
-{
-    (*ct) = malloc(sizeof(chidb_dbm_cursor_trail_t));
-    if((*ct)==NULL)
-        return CHIDB_ENOMEM;
 
-    BTreeNode *btn;
-    //通过页号获得Node地址
-    int ret = chidb_Btree_getNodeByPage(bt, npage, &btn);
-    if(ret != CHIDB_OK)
-        return ret;
+//当前结点是否是内部结点
+#define IS_INTERNAL(btn) ((btn)->type == PGTYPE_TABLE_INTERNAL || (btn)->type == PGTYPE_INDEX_INTERNAL)
 
-    // 初始化，设置list中元素的位置，对应的node地址和子页面cell
-    (*ct)->depth = depth;
-    (*ct)->btn = btn;
-    (*ct)->n_current_cell = 0;
+//游标所在的层
+#define TOP(c) (&(c)->trail[(c)->depth - 1])
 
-    return CHIDB_OK;
+//释放从某个深度开始(包括该深度)的所有层
+static void chidb_dbm_cursor_truncate(BTree *bt, chidb_dbm_cursor_t *c, uint32_t depth)
+{
+    while(c->depth > depth)
+    {
+        c->depth--;
+        chidb_Btree_unpinNode(bt, &c->trail[c->depth].btn);
+    }
 }
 
-//销毁链表，释放每个元素所存的页面
-int chidb_dbm_cursor_trail_list_destroy(BTree *bt, list_t *restrict l)
+//将页面npage作为新的一层压入trail
+static int chidb_dbm_cursor_push(BTree *bt, chidb_dbm_cursor_t *c, npage_t npage)
 {
-    // free all of the btn's held within the cursor trail structs and all of the trail structs
-    chidb_dbm_cursor_trail_t *ct;
+    if(c->depth == CURSOR_MAX_DEPTH)
+        return CHIDB_ENOMEM;
 
-    while(!list_empty(l))
-    {
-        ct = (chidb_dbm_cursor_trail_t *)list_fetch(l);
-        chidb_Btree_freeMemNode(bt, ct->btn);
-        free(ct);
-    }
+    chidb_dbm_cursor_trail_t *ct = &c->trail[c->depth];
+    int rc = chidb_Btree_pinNode(bt, npage, &ct->btn);
+    if(rc != CHIDB_OK)
+        return rc;
 
-    list_destroy(l);
+    ct->n_current_cell = 0;
+    c->depth++;
 
     return CHIDB_OK;
 }
 
-//复制某个游标中存的所有trail 元素到新的trail中，得到一个副本
-int chidb_dbm_cursor_trail_cpy(BTree *bt, list_t *restrict l1, list_t *restrict l2)
+//内部结点中第i个子页面, i == n_cells时为right_page
+static npage_t chidb_dbm_cursor_child(chidb_dbm_cursor_trail_t *ct)
 {
-    chidb_dbm_cursor_trail_t *ct_next, *ct_next_cpy;
-    BTreeNode *btncpy;
+    BTreeCell cell;
 
-    //初始化副本链表
-    list_init(l2);
+    if(ct->n_current_cell == ct->btn.n_cells)
+        return ct->btn.right_page;
 
-    list_iterator_start(l1);
-    //用迭代器依次获得节点并复制
-    while(list_iterator_hasnext(l1))
-    {
-        ct_next = (chidb_dbm_cursor_trail_t *)list_iterator_next(l1);
+    chidb_Btree_getCell(&ct->btn, ct->n_current_cell, &cell);
+    return cell.type == PGTYPE_TABLE_INTERNAL ? cell.fields.tableInternal.child_page
+                                              : cell.fields.indexInternal.child_page;
+}
 
-        // make a deep copy of the element
-        ct_next_cpy = malloc(sizeof(chidb_dbm_cursor_t));
-        if(ct_next_cpy == NULL)
-            return CHIDB_ENOMEM;
+//从最底层开始一直下降到叶节点, 沿途每层都选择第一个(leftmost)或最后一个子页面
+static int chidb_dbm_cursor_descend(BTree *bt, chidb_dbm_cursor_t *c, bool leftmost)
+{
+    int rc;
 
-        ct_next_cpy->depth = ct_next->depth;
-        chidb_Btree_getNodeByPage(bt, ct_next->btn->page->npage, &btncpy);
-        ct_next_cpy->btn = btncpy;
-        ct_next_cpy->n_current_cell = ct_next->n_current_cell;
+    while(IS_INTERNAL(&TOP(c)->btn))
+    {
+        if((rc = chidb_dbm_cursor_push(bt, c, chidb_dbm_cursor_child(TOP(c)))) != CHIDB_OK)
+            return rc;
 
-        // append the new element to the new list
-        list_append(l2, ct_next_cpy);
+        chidb_dbm_cursor_trail_t *ct = TOP(c);
+        if(IS_INTERNAL(&ct->btn))
+            ct->n_current_cell = leftmost ? 0 : ct->btn.n_cells;
+        else
+            ct->n_current_cell = leftmost ? 0 : ct->btn.n_cells - 1;
     }
-    list_iterator_stop(l1);
 
     return CHIDB_OK;
 }
-//从某个深度开始清除之后的节点
-int chidb_dbm_cursor_clear_trail_from(BTree *bt, chidb_dbm_cursor_t *c, uint32_t depth)
+
+//让current_cell指向最底层的当前cell
+static int chidb_dbm_cursor_load(chidb_dbm_cursor_t *c)
 {
-    int i;
-    chidb_dbm_cursor_trail_t *ct;
+    chidb_dbm_cursor_trail_t *ct = TOP(c);
+
+    c->record_valid = false;
+    c->positioned = true;
+
+    return chidb_Btree_getCell(&ct->btn, ct->n_current_cell, &c->current_cell);
+}
 
-    for(i = list_size(&(c->trail))-1; i > depth; i--)
+//沿叶节点之间的链接移动到下一个(next为true)或上一个非空叶节点,
+//只剩空叶节点时返回CHIDB_CURSORCANTMOVE, 游标保持原样
+static int chidb_dbm_cursor_follow(BTree *bt, chidb_dbm_cursor_t *c, bool next)
+{
+    BTreeNode btn = TOP(c)->btn;
+    npage_t npage = next ? btn.next_leaf : btn.prev_leaf;
+    int rc;
+
+    while(npage)
     {
-        ct = list_extract_at(&(c->trail), i); // remove element from list
+        if((rc = chidb_Btree_pinNode(bt, npage, &btn)) != CHIDB_OK)
+            return rc;
+
+        if(btn.n_cells > 0)
+        {
+            chidb_dbm_cursor_truncate(bt, c, 0);
+            c->trail[0].btn = btn;
+            c->trail[0].n_current_cell = next ? 0 : btn.n_cells - 1;
+            c->depth = 1;
+            c->detached = true;
 
-        // free resources associated with the trail element
-        chidb_Btree_freeMemNode(bt, ct->btn);
-        free(ct);
+            return chidb_dbm_cursor_load(c);
+        }
+
+        npage = next ? btn.next_leaf : btn.prev_leaf;
+        chidb_Btree_unpinNode(bt, &btn);
     }
-    return CHIDB_OK;
+
+    return CHIDB_CURSORCANTMOVE;
 }
-//移除某个深度处的链表节点
-int chidb_dbm_cursor_trail_remove_at(BTree *bt, chidb_dbm_cursor_t *c, uint32_t depth)
+
+//重新从根开始, trail中只保留根结点
+static int chidb_dbm_cursor_reset(BTree *bt, chidb_dbm_cursor_t *c)
 {
-    chidb_dbm_cursor_trail_t *ct = list_extract_at(&(c->trail), depth);
-    chidb_Btree_freeMemNode(bt, ct->btn);
-    free(ct);
+    chidb_dbm_cursor_truncate(bt, c, 0);
+    c->detached = false;
+    c->positioned = false;
 
-    return CHIDB_OK;
+    return chidb_dbm_cursor_push(bt, c, c->root_page);
 }
-//初始化cursor 记录对应的页，初始化该游标中的trail，并将root_page 对应的trail节点放入trail链表中
+
+//初始化cursor 记录对应的页，并将root_page 对应的结点放入trail中
 int chidb_dbm_cursor_init(BTree *bt, chidb_dbm_cursor_t *c, npage_t root_page, ncol_t n_cols)
 {
     int rc;
-    BTreeNode *btn;
-    chidb_dbm_cursor_trail_t *ct;
 
-    // allocate space for the root btn in the trail
-    ct = malloc(sizeof(chidb_dbm_cursor_trail_t));
-    if(ct == NULL)
-        return CHIDB_ENOMEM;
+    c->depth = 0;
+    c->detached = false;
+    c->positioned = false;
+    c->record_valid = false;
+    c->root_page = root_page;
+    c->n_cols = n_cols;
 
-    if((rc = chidb_Btree_getNodeByPage(bt, root_page, &btn)) != CHIDB_OK)
+    if((rc = chidb_dbm_cursor_push(bt, c, root_page)) != CHIDB_OK)
         return rc;
 
-    ct->depth = 0;
-    ct->btn = btn;
-    ct->n_current_cell = 0;
-
-    list_init(&(c->trail));
-
-    c->root_page = root_page;
-    c->root_type = btn->type;
-    c->n_cols = n_cols;
-    list_insert_at(&(c->trail), ct, ct->depth);
+    c->root_type = c->trail[0].btn.type;
 
     return CHIDB_OK;
 }
 
-//销毁游标
+//销毁游标, 释放trail中固定的所有页面
 int chidb_dbm_cursor_destroy(BTree *bt, chidb_dbm_cursor_t *c)
 {
-    chidb_dbm_cursor_trail_list_destroy(bt, &(c->trail));
+    chidb_dbm_cursor_truncate(bt, c, 0);
 
     return CHIDB_OK;
 }
 
+/* Moves the cursor to the first entry in the B-Tree
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - c: Cursor
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_CURSORCANTMOVE: The B-Tree is empty
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_dbm_cursor_rewind(BTree *bt, chidb_dbm_cursor_t *c)
+{
+    int rc;
+
+    // 重新读取根结点, 这样在游标打开之后插入的数据也能看到
+    if((rc = chidb_dbm_cursor_reset(bt, c)) != CHIDB_OK)
+        return rc;
+
+    if(c->trail[0].btn.n_cells == 0)
+        return CHIDB_CURSORCANTMOVE;
+
+    if((rc = chidb_dbm_cursor_descend(bt, c, true)) != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_cursor_load(c);
+}
+
 //将游标所指的cell向后移动一个，
 /*
-    只有游标对应的页为B树中的叶节点才会移动，当trail 中所指示的cell已经是最后一个cell后要把这个trail移除，
-    再从上一个节点（实际上是这个leaf的父节点）中尝试移动。
-    ----------------------------------------------------------
-    更换到上一个trail节点后，自增当前cell，如果自增后没有超出页中cell个数，则调用chidb_dbm_cursorTable_fwdDwn向前移动
-    在chidb_dbm_cursorTable_fwdDwn中如果节点为PGTYPE_TABLE_INTERNAL，则根据新的trail中的n_current_cell的大小，将这cell所指的子页面或者RIGHT_PAGE
-    加入到trail链表中，再次调用chidb_dbm_cursorTable_fwdDwn
-    如果是叶子节点，就自增，结束移动
-    -------------------------------------------------------------
-    如果所有的trail节点表明自己移动到了最后，则移动失败
-
+    表树中只有叶节点有数据. 叶节点中还有下一个cell时直接自增;
+    否则向上找到第一个还有下一个子页面的祖先, 如果没有则移动失败(游标不变),
+    有则释放它之下的所有层, 自增它的n_current_cell, 再一直沿最左边下降到叶节点
 
     ------------------------------------------------------------
-    移动索引树的游标时根据索引树的特点，在判断cell是否超出页中cell个数有相应的调整
+    索引树的内部结点也有数据, 中序遍历时:
+    叶节点的最后一个cell之后是第一个"从左子树上来"的祖先的cell;
+    内部结点的cell之后是其右边子树中最左边的cell
 */
 int chidb_dbm_cursor_fwd(BTree *bt, chidb_dbm_cursor_t *c)
 {
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
-    uint8_t node_type = ct->btn->type;
-    int ret = CHIDB_OK; // to quiet compiler warnings
-
-    list_t trail_copy;
-    chidb_dbm_cursor_trail_cpy(bt, &(c->trail), &trail_copy);
+    if(c->depth == 0)
+        return CHIDB_CURSORCANTMOVE;
 
-    switch(node_type)
+    switch(TOP(c)->btn.type)
     {
         case PGTYPE_TABLE_INTERNAL:
         case PGTYPE_TABLE_LEAF:
-            ret = chidb_dbm_cursorTable_fwd(bt, c);
-            break;
+            return chidb_dbm_cursorTable_fwd(bt, c);
 
         case PGTYPE_INDEX_INTERNAL:
         case PGTYPE_INDEX_LEAF:
-            ret = chidb_dbm_cursorIndex_fwd(bt, c);
-            break;
+            return chidb_dbm_cursorIndex_fwd(bt, c);
 
         default:
-            ret = CHIDB_ETYPE;
-            break;
-    }
-
-    if(ret == CHIDB_CURSORCANTMOVE)
-    {
-        c->trail = trail_copy;
-    }
-    else
-    {
-        chidb_dbm_cursor_trail_list_destroy(bt, &trail_copy);
+            return CHIDB_ETYPE;
     }
-
-    return ret;
 }
 
 
 int chidb_dbm_cursorTable_fwd(BTree *bt, chidb_dbm_cursor_t *c)
 {
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
+    chidb_dbm_cursor_trail_t *ct = TOP(c);
+    int d, rc;
 
-    if(c->current_cell.type != PGTYPE_TABLE_LEAF)
+    if(ct->btn.type != PGTYPE_TABLE_LEAF)
         return CHIDB_ETYPE;
 
-    if(ct->n_current_cell == ct->btn->n_cells - 1)
-    {
-        chidb_dbm_cursor_trail_remove_at(bt, c, list_loc);
-
-        return chidb_dbm_cursorTable_fwdUp(bt, c);
-    }
-    else
+    if(ct->n_current_cell + 1 < ct->btn.n_cells)
     {
         ct->n_current_cell++;
-        chidb_Btree_getCell(ct->btn, ct->n_current_cell, &(c->current_cell));
-
-        return CHIDB_OK;
-    }
-
-    return CHIDB_OK;
-}
-
-int chidb_dbm_cursorTable_fwdUp(BTree *bt, chidb_dbm_cursor_t *c)
-{
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-
-    if(list_loc == -1)
-    {
-        return CHIDB_CURSORCANTMOVE;
-    }
-
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
-
-    if(ct->btn->type != PGTYPE_TABLE_INTERNAL)
-    {
-        return CHIDB_ETYPE;
+        return chidb_dbm_cursor_load(c);
     }
 
-    ct->n_current_cell++;
+    // 有链接时直接移动到下一个叶节点, 不经过内部结点
+    if(ct->btn.next_leaf && (rc = chidb_dbm_cursor_follow(bt, c, true)) != CHIDB_CURSORCANTMOVE)
+        return rc;
 
-    if(ct->n_current_cell <= ct->btn->n_cells)
-    {
+    // trail中没有祖先, 从当前的键重新定位
+    if(c->detached)
+        return chidb_dbm_cursor_seek(bt, c, c->current_cell.key, SEEKGT);
 
-        return chidb_dbm_cursorTable_fwdDwn(bt,c);
-    }
-    else
-    {
+    // 找到最近的还有下一个子页面的祖先
+    for(d = c->depth - 2; d >= 0; d--)
+        if(c->trail[d].n_current_cell < c->trail[d].btn.n_cells)
+            break;
 
-        chidb_dbm_cursor_trail_remove_at(bt, c, list_loc);
+    if(d < 0)
+        return CHIDB_CURSORCANTMOVE;
 
+    chidb_dbm_cursor_truncate(bt, c, d + 1);
+    c->trail[d].n_current_cell++;
 
-        return chidb_dbm_cursorTable_fwdUp(bt, c);
-    }
+    if((rc = chidb_dbm_cursor_descend(bt, c, true)) != CHIDB_OK)
+        return rc;
 
-    return CHIDB_OK;
+    return chidb_dbm_cursor_load(c);
 }
 
-int chidb_dbm_cursorTable_fwdDwn(BTree *bt, chidb_dbm_cursor_t *c)
-{
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
-    uint8_t node_type = ct->btn->type;
-
-    npage_t pg;
-    switch(node_type)
-    {
-        case PGTYPE_TABLE_INTERNAL:
-            if(ct->n_current_cell < ct->btn->n_cells)
-            {
-                BTreeCell cell;
-                chidb_Btree_getCell(ct->btn, ct->n_current_cell, &cell);
-                pg = cell.fields.tableInternal.child_page;
-            }
-            else if(ct->n_current_cell == ct->btn->n_cells)
-            {
-                pg = ct->btn->right_page;
-            }
-            else
-                return CHIDB_ECELLNO;
-
-            chidb_dbm_cursor_trail_t *ct_new;
-            uint32_t next_depth = list_loc + 1;
-            chidb_dbm_cursor_trail_new(bt, &ct_new, pg, next_depth);
-
-            list_insert_at(&(c->trail), ct_new, next_depth);
-
-            return chidb_dbm_cursorTable_fwdDwn(bt, c);
-
-        case PGTYPE_TABLE_LEAF:
-
-            chidb_Btree_getCell(ct->btn, ct->n_current_cell, &(c->current_cell));
-
-            return CHIDB_OK;
-        default:
-            return CHIDB_ETYPE;
-    }
-
-    return CHIDB_OK;
-}
 
 int chidb_dbm_cursorIndex_fwd(BTree *bt, chidb_dbm_cursor_t *c)
 {
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
-    uint8_t node_type = ct->btn->type;
+    chidb_dbm_cursor_trail_t *ct = TOP(c);
+    int d, rc;
 
-    switch(node_type)
-    {
-        case PGTYPE_INDEX_LEAF:
-            if(ct->n_current_cell == ct->btn->n_cells - 1)
-            {
-
-                chidb_dbm_cursor_trail_remove_at(bt, c, list_loc);
-
-
-                return chidb_dbm_cursorIndex_fwdUp(bt, c);
-            }
-            else
-            {
-                ct->n_current_cell++;
-                chidb_Btree_getCell(ct->btn, ct->n_current_cell, &(c->current_cell));
-
-                return CHIDB_OK;
-            }
-        case PGTYPE_INDEX_INTERNAL:
-
-            ct->n_current_cell++;
-            if(ct->n_current_cell <= ct->btn->n_cells)
-            {
-
-                return chidb_dbm_cursorIndex_fwdDwn(bt,c);
-            }
-            else
-            {
-
-                chidb_dbm_cursor_trail_remove_at(bt, c, list_loc);
-
-
-                return chidb_dbm_cursorIndex_fwdUp(bt, c);
-            }
-    }
-
-    return CHIDB_OK;
-}
-
-int chidb_dbm_cursorIndex_fwdUp(BTree *bt, chidb_dbm_cursor_t *c)
-{
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-
-    if(list_loc == -1)
-    {
-        return CHIDB_CURSORCANTMOVE;
-    }
-
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
-
-    ct->n_current_cell++;
-
-    if(ct->n_current_cell < ct->btn->n_cells)
+    if(ct->btn.type == PGTYPE_INDEX_INTERNAL)
     {
+        // 下一个cell在右边子树的最左边
+        ct->n_current_cell++;
 
-        BTreeCell cell;
-        chidb_Btree_getCell(ct->btn, ct->n_current_cell, &cell);
+        if((rc = chidb_dbm_cursor_descend(bt, c, true)) != CHIDB_OK)
+            return rc;
 
-        return CHIDB_OK;
+        return chidb_dbm_cursor_load(c);
     }
-    else if(ct->n_current_cell == ct->btn->n_cells)
-    {
 
-        return chidb_dbm_cursorIndex_fwdDwn(bt,c);
-    }
-    else
+    if(ct->n_current_cell + 1 < ct->btn.n_cells)
     {
-
-        chidb_dbm_cursor_trail_remove_at(bt, c, list_loc);
-
-
-        return chidb_dbm_cursorIndex_fwdUp(bt, c);
+        ct->n_current_cell++;
+        return chidb_dbm_cursor_load(c);
     }
 
-    return CHIDB_OK;
-}
-
-
-int chidb_dbm_cursorIndex_fwdDwn(BTree *bt, chidb_dbm_cursor_t *c)
-{
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
-    uint8_t node_type = ct->btn->type;
-
-    npage_t pg;
-    switch(node_type)
-    {
-        case PGTYPE_INDEX_INTERNAL:
-            if(ct->n_current_cell < ct->btn->n_cells)
-            {
-                BTreeCell cell;
-                chidb_Btree_getCell(ct->btn, ct->n_current_cell, &cell);
-                pg = cell.fields.indexInternal.child_page;
-            }
-            else if(ct->n_current_cell == ct->btn->n_cells)
-            {
-                pg = ct->btn->right_page;
-            }
-            else
-                return CHIDB_ECELLNO;
-
-            chidb_dbm_cursor_trail_t *ct_new;
-            uint32_t next_depth = list_loc + 1;
-            chidb_dbm_cursor_trail_new(bt, &ct_new, pg, next_depth);
-
-            list_insert_at(&(c->trail), ct_new, next_depth);
-
-            return chidb_dbm_cursorIndex_fwdDwn(bt, c);
+    // 找到最近的从左子树上来的祖先, 它的cell就是下一个
+    for(d = c->depth - 2; d >= 0; d--)
+        if(c->trail[d].n_current_cell < c->trail[d].btn.n_cells)
+            break;
 
-        case PGTYPE_INDEX_LEAF:
-            chidb_Btree_getCell(ct->btn, ct->n_current_cell, &(c->current_cell));
+    if(d < 0)
+        return CHIDB_CURSORCANTMOVE;
 
-            return CHIDB_OK;
-        default:
-            return CHIDB_ETYPE;
-    }
+    chidb_dbm_cursor_truncate(bt, c, d + 1);
 
-    return CHIDB_OK;
+    return chidb_dbm_cursor_load(c);
 }
 
-//将游标所指的cell向前移动一个，
-/*
-    只有游标对应的页为树中的叶节点才会移动，当trail 中所指示的cell已经是第一个cell后要把这个trail移除，
-    再从上一个节点（实际上是这个leaf的父节点）中尝试移动。
-    ----------------------------------------------------------
-    更换到上一个trail节点后，自减当前cell，如果自减后仍然存在节点，则调用chidb_dbm_cursorTable_revDwn向前移动
-    在chidb_dbm_cursorTable_revDwn中如果节点为PGTYPE_TABLE_INTERNAL，则根据新的trail中的n_current_cell的大小，将这cell所指的子页面或者RIGHT_PAGE
-    加入到trail链表中，再次调用chidb_dbm_cursorTable_revDwn
-    如果是叶子节点，就自减，结束移动
-    -------------------------------------------------------------
-    如果所有的trail节点表明自己已经是第一个cell，则移动失败
-
-
-    ------------------------------------------------------------
-    移动索引树的游标时根据索引树的特点，在判断cell是否超出页中cell个数有相应的调整
-*/
+//与fwd对称, 将游标所指的cell向前移动一个
 int chidb_dbm_cursor_rev(BTree *bt, chidb_dbm_cursor_t *c)
 {
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
+    if(c->depth == 0)
+        return CHIDB_CURSORCANTMOVE;
 
-    uint8_t node_type = ct->btn->type;
-    int ret = CHIDB_OK;
-    switch(node_type)
+    switch(TOP(c)->btn.type)
     {
         case PGTYPE_TABLE_INTERNAL:
         case PGTYPE_TABLE_LEAF:
-            ret = chidb_dbm_cursorTable_rev(bt, c);
-            break;
+            return chidb_dbm_cursorTable_rev(bt, c);
 
         case PGTYPE_INDEX_INTERNAL:
         case PGTYPE_INDEX_LEAF:
-            ret = chidb_dbm_cursorIndex_rev(bt, c);
-            break;
+            return chidb_dbm_cursorIndex_rev(bt, c);
 
         default:
-            ret = CHIDB_ETYPE;
-            break;
+            return CHIDB_ETYPE;
     }
-    return ret;
 }
 
+
 int chidb_dbm_cursorTable_rev(BTree *bt, chidb_dbm_cursor_t *c)
 {
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
+    chidb_dbm_cursor_trail_t *ct = TOP(c);
+    int d, rc;
 
-    if(c->current_cell.type != PGTYPE_TABLE_LEAF)
+    if(ct->btn.type != PGTYPE_TABLE_LEAF)
         return CHIDB_ETYPE;
 
-    if(ct->n_current_cell == 0)
-    {
-
-        chidb_dbm_cursor_trail_remove_at(bt, c, list_loc);
-
-        return chidb_dbm_cursorTable_revUp(bt, c);
-    }
-    else
+    if(ct->n_current_cell > 0)
     {
         ct->n_current_cell--;
-        chidb_Btree_getCell(ct->btn, ct->n_current_cell, &(c->current_cell));
-
-        return CHIDB_OK;
+        return chidb_dbm_cursor_load(c);
     }
 
-    return CHIDB_OK;
-}
-
-int chidb_dbm_cursorTable_revUp(BTree *bt, chidb_dbm_cursor_t *c)
-{
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-
-    if(list_loc == -1)
-    {
-        return CHIDB_CURSORCANTMOVE;
-    }
-
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
-
-    if(ct->btn->type != PGTYPE_TABLE_INTERNAL)
-    {
-        return CHIDB_ETYPE;
-    }
-
-    ct->n_current_cell--;
-
-    if(ct->n_current_cell >= 0)
-    {
-        return chidb_dbm_cursorTable_revDwn(bt,c);
-    }
-    else
-    {
-        chidb_dbm_cursor_trail_remove_at(bt, c, list_loc);
-
-        return chidb_dbm_cursorTable_revUp(bt,c);
-    }
-
-    return CHIDB_OK;
-}
-
-int chidb_dbm_cursorTable_revDwn(BTree *bt, chidb_dbm_cursor_t *c)
-{
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
-    uint8_t node_type = ct->btn->type;
-
-    npage_t pg;
-    switch(node_type)
-    {
-        case PGTYPE_TABLE_INTERNAL:
-            if(ct->n_current_cell < ct->btn->n_cells)
-            {
-                BTreeCell cell;
-                chidb_Btree_getCell(ct->btn, ct->n_current_cell, &cell);
-                pg = cell.fields.tableInternal.child_page;
-            }
-            else if(ct->n_current_cell == ct->btn->n_cells)
-            {
-                pg = ct->btn->right_page;
-            }
-            else
-                return CHIDB_ECELLNO;
-
-            chidb_dbm_cursor_trail_t *ct_new;
-            uint32_t next_depth = list_loc + 1;
-            chidb_dbm_cursor_trail_new(bt, &ct_new, pg, next_depth);
-
-            ct_new->n_current_cell = ct_new->btn->n_cells;
-
-
-            if(ct_new->btn->type == PGTYPE_TABLE_LEAF)
-                ct_new->n_current_cell--;
-
-
-            list_insert_at(&(c->trail), ct_new, next_depth);
+    // 有链接时直接移动到上一个叶节点, 不经过内部结点
+    if(ct->btn.prev_leaf && (rc = chidb_dbm_cursor_follow(bt, c, false)) != CHIDB_CURSORCANTMOVE)
+        return rc;
 
+    // trail中没有祖先, 从当前的键重新定位
+    if(c->detached)
+        return chidb_dbm_cursor_seek(bt, c, c->current_cell.key, SEEKLT);
 
-            return chidb_dbm_cursorTable_revDwn(bt, c);
+    // 找到最近的还有上一个子页面的祖先
+    for(d = c->depth - 2; d >= 0; d--)
+        if(c->trail[d].n_current_cell > 0)
+            break;
 
-        case PGTYPE_TABLE_LEAF:
-            chidb_Btree_getCell(ct->btn, ct->n_current_cell, &(c->current_cell));
+    if(d < 0)
+        return CHIDB_CURSORCANTMOVE;
 
-            return CHIDB_OK;
+    chidb_dbm_cursor_truncate(bt, c, d + 1);
+    c->trail[d].n_current_cell--;
 
-        default:
-            return CHIDB_ETYPE;
-    }
+    if((rc = chidb_dbm_cursor_descend(bt, c, false)) != CHIDB_OK)
+        return rc;
 
-    return CHIDB_OK;
+    return chidb_dbm_cursor_load(c);
 }
 
 
 int chidb_dbm_cursorIndex_rev(BTree *bt, chidb_dbm_cursor_t *c)
 {
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
-    uint8_t node_type = ct->btn->type;
+    chidb_dbm_cursor_trail_t *ct = TOP(c);
+    int d, rc;
 
-    switch(node_type)
+    if(ct->btn.type == PGTYPE_INDEX_INTERNAL)
     {
-        case PGTYPE_INDEX_LEAF:
+        // 上一个cell在左子树的最右边
+        if((rc = chidb_dbm_cursor_descend(bt, c, false)) != CHIDB_OK)
+            return rc;
 
-            if(ct->n_current_cell == 0)
-            {
+        return chidb_dbm_cursor_load(c);
+    }
 
-                chidb_dbm_cursor_trail_remove_at(bt, c, list_loc);
+    if(ct->n_current_cell > 0)
+    {
+        ct->n_current_cell--;
+        return chidb_dbm_cursor_load(c);
+    }
 
+    // 找到最近的从右边子树上来的祖先, 它左边的cell就是上一个
+    for(d = c->depth - 2; d >= 0; d--)
+        if(c->trail[d].n_current_cell > 0)
+            break;
 
-                return chidb_dbm_cursorIndex_revUp(bt, c);
-            }
-            else
-            {
-                ct->n_current_cell--;
-                chidb_Btree_getCell(ct->btn, ct->n_current_cell, &(c->current_cell));
+    if(d < 0)
+        return CHIDB_CURSORCANTMOVE;
 
-                return CHIDB_OK;
-            }
-        case PGTYPE_INDEX_INTERNAL:
+    chidb_dbm_cursor_truncate(bt, c, d + 1);
+    c->trail[d].n_current_cell--;
 
-            if(ct->n_current_cell >= 0)
-            {
+    return chidb_dbm_cursor_load(c);
+}
 
-                return chidb_dbm_cursorIndex_revDwn(bt,c);
-            }
-            else
-            {
+/* Moves the cursor to a key
+ *
+ * Descends from the root to the node where the key is (or would be),
+ * using a binary search in each node, and then positions the cursor
+ * according to seek_type.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - c: Cursor
+ * - key: Key to look for
+ * - seek_type: SEEK (exact match), SEEKGT, SEEKGE, SEEKLT or SEEKLE
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: seek_type is SEEK and the key is not in the B-Tree
+ * - CHIDB_CURSORCANTMOVE: There is no entry satisfying seek_type
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_dbm_cursor_seek(BTree *bt, chidb_dbm_cursor_t *c, chidb_key_t key, int seek_type)
+{
+    chidb_dbm_cursor_trail_t *ct;
+    ncell_t i;
+    int found, rc;
 
-                chidb_dbm_cursor_trail_remove_at(bt, c, list_loc);
+    if((rc = chidb_dbm_cursor_reset(bt, c)) != CHIDB_OK)
+        return rc;
 
+    for(;;)
+    {
+        ct = TOP(c);
+        found = chidb_Btree_searchNode(&ct->btn, key, &i) == CHIDB_OK;
+        ct->n_current_cell = i;
 
-                return chidb_dbm_cursorIndex_revUp(bt, c);
-            }
+        // 表树的内部结点只有键, 无论是否相等都继续下降;
+        // 索引树的内部结点中找到键时游标就停在这里
+        if(ct->btn.type == PGTYPE_TABLE_INTERNAL ||
+           (ct->btn.type == PGTYPE_INDEX_INTERNAL && !found))
+        {
+            if((rc = chidb_dbm_cursor_push(bt, c, chidb_dbm_cursor_child(ct))) != CHIDB_OK)
+                return rc;
+            continue;
+        }
+        break;
     }
 
-    return CHIDB_OK;
-}
-
-
-int chidb_dbm_cursorIndex_revUp(BTree *bt, chidb_dbm_cursor_t *c)
-{
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-
-    if(list_loc == -1)
+    if(found)
     {
-        return CHIDB_CURSORCANTMOVE;
+        chidb_dbm_cursor_load(c);
+
+        if(seek_type == SEEKGT)
+            return chidb_dbm_cursor_fwd(bt, c);
+        if(seek_type == SEEKLT)
+            return chidb_dbm_cursor_rev(bt, c);
+        return CHIDB_OK;
     }
 
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
+    // 没找到时, 游标停在叶节点中第一个大于key的cell (i可能等于n_cells)
+    if(seek_type == SEEK)
+        return CHIDB_ENOTFOUND;
 
-    ct->n_current_cell--;
+    if(ct->btn.n_cells == 0)
+        return CHIDB_CURSORCANTMOVE;
 
-    if(ct->n_current_cell >= 0)
+    if(seek_type == SEEKGE || seek_type == SEEKGT)
     {
+        if(i < ct->btn.n_cells)
+            return chidb_dbm_cursor_load(c);
 
-        BTreeCell cell;
-        chidb_Btree_getCell(ct->btn, ct->n_current_cell, &cell);
-
-        return CHIDB_OK;
+        // 叶节点中所有键都小于key, 下一个cell在后面的叶节点中
+        ct->n_current_cell = ct->btn.n_cells - 1;
+        chidb_dbm_cursor_load(c);
+        return chidb_dbm_cursor_fwd(bt, c);
     }
     else
     {
+        if(i > 0)
+        {
+            ct->n_current_cell = i - 1;
+            return chidb_dbm_cursor_load(c);
+        }
 
-        chidb_dbm_cursor_trail_remove_at(bt, c, list_loc);
-
-
-        return chidb_dbm_cursorIndex_fwdUp(bt, c);
+        ct->n_current_cell = 0;
+        chidb_dbm_cursor_load(c);
+        return chidb_dbm_cursor_rev(bt, c);
     }
-
-    return CHIDB_OK;
 }
 
-
-int chidb_dbm_cursorIndex_revDwn(BTree *bt, chidb_dbm_cursor_t *c)
+/* Brings a cursor up to date after its B-Tree has been modified
+ *
+ * The nodes in the trail are loaded when the cursor moves, so they become
+ * stale when the B-Tree is modified through the B-Tree functions (e.g., by
+ * Op_Insert). A cursor that points to a cell is sought again to that cell's
+ * key; otherwise, only the root is reloaded, which does not require any
+ * search.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - c: Cursor
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: The cell the cursor pointed to no longer exists
+ */
+int chidb_dbm_cursor_refresh(BTree *bt, chidb_dbm_cursor_t *c)
 {
-    uint32_t list_loc = list_size(&(c->trail)) - 1;
-    chidb_dbm_cursor_trail_t *ct = list_get_at(&(c->trail), list_loc);
-    uint8_t node_type = ct->btn->type;
-
-    npage_t pg;
-    switch(node_type)
-    {
-        case PGTYPE_INDEX_INTERNAL:
-            if(ct->n_current_cell >= 0)
-            {
-
-                BTreeCell cell;
-                chidb_Btree_getCell(ct->btn, ct->n_current_cell, &cell);
-                pg = cell.fields.indexInternal.child_page;
-            }
-            else if(ct->n_current_cell == ct->btn->n_cells)
-            {
-
-                pg = ct->btn->right_page;
-            }
-            else
-                return CHIDB_ECELLNO;
-
-
-            chidb_dbm_cursor_trail_t *ct_new;
-            uint32_t next_depth = list_loc + 1;
-            chidb_dbm_cursor_trail_new(bt, &ct_new, pg, next_depth);
-
-
-            ct_new->n_current_cell = ct_new->btn->n_cells;
-
-
-            if(ct_new->btn->type == PGTYPE_TABLE_LEAF)
-                ct_new->n_current_cell--;
-
-            list_insert_at(&(c->trail), ct_new, next_depth);
-
-            return chidb_dbm_cursorIndex_fwdDwn(bt, c);
-
-        case PGTYPE_INDEX_LEAF:
-
-            chidb_Btree_getCell(ct->btn, ct->n_current_cell, &(c->current_cell));
-
-            return CHIDB_OK;
-
-        default:
-            return CHIDB_ETYPE;
-    }
+    if(!c->positioned)
+        return chidb_dbm_cursor_reset(bt, c);
 
-    return CHIDB_OK;
+    return chidb_dbm_cursor_seek(bt, c, c->current_cell.key, SEEK);
 }
 
-/*
-
 
-
-*/
-int chidb_dbm_cursor_seek(BTree *bt, chidb_dbm_cursor_t *c, chidb_key_t key, npage_t next, int depth, int seek_type)
+/* Returns a view of the record in the cell the cursor points to
+ *
+ * The record header is only parsed (lazily) the first time a column of
+ * the current cell is requested; moving the cursor invalidates the view.
+ * The view points into the page pinned by the cursor, so it must not be
+ * used after the cursor moves.
+ *
+ * Parameters
+ * - c: Cursor (must point to a table leaf cell)
+ *
+ * Return
+ * - The DBRecordView of the current record
+ */
+DBRecordView *chidb_dbm_cursor_record(chidb_dbm_cursor_t *c)
 {
-    chidb_dbm_cursor_trail_t *trail_entry;
-
-    if (!depth)
-    {
-        chidb_dbm_cursor_clear_trail_from(bt, c, 0);
-        next = c->root_page;
-        trail_entry = list_get_at(&(c->trail), 0);
-    }
-    else
-    {
-        trail_entry = malloc(sizeof(chidb_dbm_cursor_trail_t));
-    }
-
-    BTreeCell cell;
-    BTreeNode *btn;
-
-
-    int status;
-    int i = 0;
-
-    if ((status = chidb_Btree_getNodeByPage(bt, next, &btn)) != CHIDB_OK)
+    if(!c->record_valid)
     {
-        free(btn);
-        return status;
+        chidb_DBRecord_view(&c->record, c->current_cell.fields.tableLeaf.data);
+        c->record_valid = true;
     }
 
-    trail_entry->depth = depth;
-    trail_entry->btn = btn;
-
-    if (btn->type == PGTYPE_TABLE_LEAF)
-    {
-        do
-        {
-            if (chidb_Btree_getCell(btn, i, &cell) != CHIDB_OK)
-                return CHIDB_ECELLNO;
-
-            if (cell.key == key)
-            {
-                trail_entry->n_current_cell = i;
-                c->current_cell = cell;
-                if (depth)
-                    list_append(&c->trail, trail_entry);
-
-                if (seek_type == SEEKLT)
-                    return chidb_dbm_cursor_rev(bt, c);
-
-                else if (seek_type == SEEKGT)
-                    return chidb_dbm_cursor_fwd(bt, c);
-
-                return CHIDB_OK;
-            }
-            else if (cell.key > key)
-            {
-                trail_entry->n_current_cell = i;
-                c->current_cell = cell;
-                if (depth)
-                    list_append(&c->trail, trail_entry);
-
-                if (seek_type == SEEK)
-                    return CHIDB_ENOTFOUND;
-
-                else if (seek_type == SEEKLT || seek_type == SEEKLE)
-                    return chidb_dbm_cursor_rev(bt, c);
-
-                return CHIDB_OK;
-            }
-            else if (cell.key < key)
-            {
-                i++;
-            }
-
-        } while (i < btn->n_cells);
-
-        return CHIDB_CURSORCANTMOVE;
-    }
-
-    else if (btn->type == PGTYPE_TABLE_INTERNAL)
-    {
-        do
-        {
-            if (chidb_Btree_getCell(btn, i, &cell) != CHIDB_OK)
-                return CHIDB_ECELLNO;
-
-            if ((cell.key >= key))
-            {
-                trail_entry->n_current_cell = i;
-                c->current_cell = cell;
-                if (depth)
-                    list_append(&c->trail, trail_entry);
-
-                if ((status = chidb_dbm_cursor_seek(bt, c, key,cell.fields.tableInternal.child_page, depth+1, seek_type)) != CHIDB_OK)
-                    return status;
-                return CHIDB_OK;
-            }
-            else
-            {
-                i++;
-            }
-
-        } while ((cell.key < key) && (i < btn->n_cells));
-
-
-        trail_entry->n_current_cell = btn->n_cells;
-        c->current_cell = cell;
-        if (depth)
-            list_append(&c->trail, trail_entry);
-
-        return chidb_dbm_cursor_seek(bt, c, key, btn->right_page, depth+1, seek_type);
-    }
-
-    else
-    {
-        do
-        {
-            if (chidb_Btree_getCell(btn, i, &cell) != CHIDB_OK)
-                return CHIDB_ECELLNO;
-
-            if (cell.key == key)
-            {
-                trail_entry->n_current_cell = i;
-                c->current_cell = cell;
-                if (depth)
-                    list_append(&c->trail, trail_entry);
-
-                if (seek_type == SEEKLT)
-                    return chidb_dbm_cursor_rev(bt, c);
-                else if (seek_type == SEEKGT)
-                    return chidb_dbm_cursor_fwd(bt, c);
-
-                return CHIDB_OK;
-            }
-            else if (cell.key > key)
-            {
-                trail_entry->n_current_cell = i;
-                c->current_cell = cell;
-                if (depth)
-                    list_append(&c->trail, trail_entry);
-
-                if (btn->type == PGTYPE_INDEX_INTERNAL)
-                    return chidb_dbm_cursor_seek(bt, c, key,cell.fields.indexInternal.child_page, depth+1, seek_type);
-                else
-                {
-                    if (seek_type == SEEK)
-                        return CHIDB_ENOTFOUND;
-
-                    else if (seek_type == SEEKLT || seek_type == SEEKLE)
-                        return chidb_dbm_cursor_rev(bt, c);
-
-                    return CHIDB_OK;
-                }
-            }
-
-            i++;
-        } while (i < btn->n_cells);
-
-        if (btn->type == PGTYPE_INDEX_INTERNAL)
-        {
-            trail_entry->n_current_cell = btn->n_cells;
-            c->current_cell = cell;
-            if (depth)
-                list_append(&c->trail, trail_entry);
-
-            return chidb_dbm_cursor_seek(bt, c, key, btn->right_page, depth+1, seek_type);
-        }
-
-        else if (btn->type == PGTYPE_INDEX_LEAF)
-            return CHIDB_CURSORCANTMOVE;
-    }
-
-    return CHIDB_OK;
+    return &c->record;
 }
@@ -43,7 +43,7 @@
 
 #include "chidbInt.h"
 #include "btree.h"
-#include "../simclist/simclist.h"
+#include "record.h"
 
 typedef uint32_t ncol_t;   // number of columns a table has OR the number of a column
 
@@ -63,14 +63,15 @@ typedef enum chidb_dbm_seek_type
     SEEKGT
 } chidb_dbm_seek_type_t;
 
+/* 游标trail的最大深度. 即使是1024字节的页, 内部结点的扇出也有几十,
+ * 32层足以容纳任何实际的B树 */
+#define CURSOR_MAX_DEPTH (32)
+
 typedef struct chidb_dbm_cursor_trail
 {
-    uint32_t depth; 
-    //表明该节点在链表中的位置
-
-    BTreeNode *btn; //B树节点，储存一页中的cell
+    BTreeNode btn; //B树节点，储存一页中的cell, 其页面在游标离开该层之前一直被固定在缓冲池中
 
-    int n_current_cell; // 子页面对应的cell
+    int n_current_cell; // 子页面对应的cell (在最底层时为游标当前所指的cell)
 } chidb_dbm_cursor_trail_t;
 
 typedef struct chidb_dbm_cursor
@@ -81,44 +82,41 @@ typedef struct chidb_dbm_cursor
     uint8_t root_type;      // 表类型 索引，页表或者Internal类型
 
     ncol_t n_cols;          // 表的列数
-    list_t trail;           // 用于跟踪游标的位置的链表
 
-    chidb_dbm_cursor_type_t type;
+    // 从根到当前结点的路径, trail[0]为根, trail[depth-1]为游标所在的结点
+    chidb_dbm_cursor_trail_t trail[CURSOR_MAX_DEPTH];
+    uint32_t depth;
+    bool detached;          // 沿叶节点之间的链接移动后trail中只剩叶节点, 没有祖先
+    bool positioned;        // current_cell是否指向一个cell
 
-}chidb_dbm_cursor_t;
+    chidb_dbm_cursor_type_t type;
 
-//游标的基本操作
-int chidb_dbm_cursor_trail_new(BTree *bt, chidb_dbm_cursor_trail_t **ct, npage_t npage, uint32_t depth);
-int chidb_dbm_cursor_trail_list_destroy(BTree *bt, list_t *restrict l);
-int chidb_dbm_cursor_trail_cpy(BTree *bt, list_t *restrict l1, list_t *restrict l2);
-int chidb_dbm_cursor_clear_trail_from(BTree *bt, chidb_dbm_cursor_t *c, uint32_t depth); 
-int chidb_dbm_cursor_trail_remove_at(BTree *bt, chidb_dbm_cursor_t *c, uint32_t depth);
+    // 当前cell中记录的视图, 游标移动后失效, 由chidb_dbm_cursor_record重新解析
+    DBRecordView record;
+    bool record_valid;
 
+}chidb_dbm_cursor_t;
 
 //初始化和销毁游标
 int chidb_dbm_cursor_init(BTree *bt, chidb_dbm_cursor_t *c, npage_t root_page, ncol_t n_cols);
 int chidb_dbm_cursor_destroy(BTree *bt, chidb_dbm_cursor_t *c);
 
 //封装好的游标移动和SEEK
+int chidb_dbm_cursor_rewind(BTree *bt, chidb_dbm_cursor_t *c);
 int chidb_dbm_cursor_fwd(BTree *bt, chidb_dbm_cursor_t *c);
 int chidb_dbm_cursor_rev(BTree *bt, chidb_dbm_cursor_t *c);
-int chidb_dbm_cursor_seek(BTree *bt, chidb_dbm_cursor_t *c, chidb_key_t key, npage_t next, int depth, int seek_type);
+int chidb_dbm_cursor_seek(BTree *bt, chidb_dbm_cursor_t *c, chidb_key_t key, int seek_type);
+int chidb_dbm_cursor_refresh(BTree *bt, chidb_dbm_cursor_t *c);
+
+//当前cell中的记录
+DBRecordView *chidb_dbm_cursor_record(chidb_dbm_cursor_t *c);
 
 
 //具体操作
 int chidb_dbm_cursorTable_fwd(BTree *bt, chidb_dbm_cursor_t *c);
-int chidb_dbm_cursorTable_fwdUp(BTree *bt, chidb_dbm_cursor_t *c);
-int chidb_dbm_cursorTable_fwdDwn(BTree *bt, chidb_dbm_cursor_t *c);
 int chidb_dbm_cursorIndex_fwd(BTree *bt, chidb_dbm_cursor_t *c);
-int chidb_dbm_cursorIndex_fwdUp(BTree *bt, chidb_dbm_cursor_t *c);
-int chidb_dbm_cursorIndex_fwdDwn(BTree *bt, chidb_dbm_cursor_t *c);
-
 int chidb_dbm_cursorTable_rev(BTree *bt, chidb_dbm_cursor_t *c);
-int chidb_dbm_cursorTable_revUp(BTree *bt, chidb_dbm_cursor_t *c);
-int chidb_dbm_cursorTable_revDwn(BTree *bt, chidb_dbm_cursor_t *c);
 int chidb_dbm_cursorIndex_rev(BTree *bt, chidb_dbm_cursor_t *c);
-int chidb_dbm_cursorIndex_revUp(BTree *bt, chidb_dbm_cursor_t *c);
-int chidb_dbm_cursorIndex_revDwn(BTree *bt, chidb_dbm_cursor_t *c);
 
 
 
@@ -115,6 +115,16 @@ int __chidb_dbm_is_sql(char* line)
 			strncasecmp("CREATE", s, 6) == 0);
 }
 
+/* Remove a database file, along with its write-ahead log */
+void __chidb_dbm_file_remove_db(const char *dbfile)
+{
+    char walfile[MAX_FILENAME_SIZE + 4];
+
+    snprintf(walfile, sizeof(walfile), "%s-wal", dbfile);
+    remove(dbfile);
+    remove(walfile);
+}
+
 int __chidb_dbm_file_load_db(chidb_dbm_file_t *dbmf, char *line, const char* dbfiledir, const char* genfiledir)
 {
     char *linedup;
@@ -152,7 +162,7 @@ int __chidb_dbm_file_load_db(chidb_dbm_file_t *dbmf, char *line, const char* dbf
         if (rc >= MAX_FILENAME_SIZE)
             return CHIDB_ENOMEM;
 
-        remove(dbmf->dbfile);
+        __chidb_dbm_file_remove_db(dbmf->dbfile);
         dbmf->delete_dbfile = false;
     }
     else if (strcmp(tokens[0], "USE") == 0)
@@ -169,7 +179,7 @@ int __chidb_dbm_file_load_db(chidb_dbm_file_t *dbmf, char *line, const char* dbf
             if (rc >= MAX_FILENAME_SIZE)
                 return CHIDB_ENOMEM;
 
-            remove(dbmf->dbfile);
+            __chidb_dbm_file_remove_db(dbmf->dbfile);
             if(copy(srcfile, dbmf->dbfile) == NULL)
                 return CHIDB_EIO;
 
@@ -193,6 +203,7 @@ int __chidb_dbm_file_load_db(chidb_dbm_file_t *dbmf, char *line, const char* dbf
         // "Could not open chidb file %s", line
         return CHIDB_ENOMEM;
     }
+    dbmf->owns_db = true;
 
     free(linedup);
     return CHIDB_OK;
@@ -374,6 +385,7 @@ int __chidb_dbm_file_load(const char* filename, chidb_dbm_file_t **_dbmf, chidb
     char *base = strrchr(filename, '/');
     dbmf->filename = strdup( base ? base+1 : filename );
     dbmf->db = db;
+    dbmf->owns_db = false;
     dbmf->copyOnUse = copyOnUse;
     list_init(&dbmf->queryResults);
     list_init(&dbmf->registers);
@@ -485,6 +497,9 @@ int __chidb_dbm_file_load(const char* filename, chidb_dbm_file_t **_dbmf, chidb
         }
     }
 
+    if(section > CHIDB_FILE)
+        return chidb_stmt_verify(&dbmf->stmt);
+
     return CHIDB_OK;
 }
 
@@ -529,9 +544,12 @@ int chidb_dbm_file_close(chidb_dbm_file_t *dbmf)
 
     free(dbmf->filename);
 
+    if(dbmf->owns_db)
+        chidb_close(dbmf->db);
+
     if(dbmf->delete_dbfile)
     {
-        remove(dbmf->dbfile);
+        __chidb_dbm_file_remove_db(dbmf->dbfile);
     }
 
     return CHIDB_OK;
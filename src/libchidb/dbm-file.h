@@ -63,6 +63,7 @@ typedef struct chidb_dbm_file
     char dbfile[MAX_FILENAME_SIZE];
     bool delete_dbfile;
     bool copyOnUse;
+    bool owns_db;   /* db was opened by chidb_dbm_file_load2 */
 } chidb_dbm_file_t;
 
 typedef struct chidb_dbm_file_register
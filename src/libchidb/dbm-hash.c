@@ -0,0 +1,359 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ * This module implements the hash tables used by the DBM to join
+ * tables (HashAdd, HashSeek, HashNext and HashColumn). The records
+ * added to a hash table are packed, one after the other, into pages;
+ * only the entries of the table (key, page and offset of each record)
+ * are kept in arrays of their own. Once the pages take more memory than
+ * the budget of the table, the pages that are not being filled are
+ * written to a temporary file and freed, and read back (writing others
+ * out, if needed) when a probe needs one of their records. A page is
+ * written at most once, since it does not change once it is full.
+ *
+ * The buckets are only built when the table is first probed, with the
+ * entries of each bucket in the order in which they were added. Adding
+ * another record afterwards makes the next probe build them again.
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "chidbInt.h"
+#include "dbm-hash.h"
+
+
+/* Initialize a hash table
+ *
+ * Parameters
+ * - h: Hash table
+ * - budget: Bytes of pages that the table can keep in memory
+ */
+void chidb_dbm_hash_init(chidb_dbm_hash_t *h, uint32_t budget)
+{
+    memset(h, 0, sizeof(chidb_dbm_hash_t));
+    h->budget = budget;
+}
+
+
+/* Free the memory and the temporary file of a hash table
+ *
+ * The table is left empty, and can be used again.
+ *
+ * Parameters
+ * - h: Hash table
+ */
+void chidb_dbm_hash_destroy(chidb_dbm_hash_t *h)
+{
+    for(uint32_t i = 0; i < h->npages; i++)
+        free(h->pages[i].data);
+    free(h->pages);
+    free(h->entries);
+    free(h->buckets);
+    if(h->spill != NULL)
+        fclose(h->spill);
+
+    chidb_dbm_hash_init(h, h->budget);
+}
+
+
+static uint32_t chidb_dbm_hash_bucket(chidb_dbm_hash_t *h, int32_t key)
+{
+    uint32_t x = (uint32_t) key * 2654435761u;
+
+    return (x ^ (x >> 15)) & (h->nbuckets - 1);
+}
+
+
+/* Write a page in memory (other than skip and the page being filled)
+ * to the temporary file, if it was not written already, and free it.
+ * Returns CHIDB_ENOTFOUND if there is no such page */
+static int chidb_dbm_hash_evict(chidb_dbm_hash_t *h, uint32_t skip)
+{
+    for(uint32_t n = 0; n < h->npages; n++)
+    {
+        uint32_t i = h->evict;
+        h->evict = (h->evict + 1) % h->npages;
+
+        chidb_dbm_hash_page_t *p = &h->pages[i];
+        if(p->data == NULL || i == skip || i == h->npages - 1)
+            continue;
+
+        if(p->offset == -1)
+        {
+            if(h->spill == NULL && (h->spill = tmpfile()) == NULL)
+                return CHIDB_EIO;
+
+            if(fseek(h->spill, 0, SEEK_END) != 0 ||
+               (p->offset = ftell(h->spill)) == -1 ||
+               fwrite(p->data, 1, p->used, h->spill) != p->used)
+                return CHIDB_EIO;
+
+            h->nspilled++;
+        }
+
+        free(p->data);
+        p->data = NULL;
+        h->resident -= p->size;
+
+        return CHIDB_OK;
+    }
+
+    return CHIDB_ENOTFOUND;
+}
+
+
+/* Frees memory for size more bytes of pages, keeping page skip */
+static int chidb_dbm_hash_make_room(chidb_dbm_hash_t *h, uint32_t size, uint32_t skip)
+{
+    int rc;
+
+    while(h->resident + size > h->budget)
+    {
+        // 剩下的页都不能写出时, 超出预算也继续
+        if((rc = chidb_dbm_hash_evict(h, skip)) == CHIDB_ENOTFOUND)
+            break;
+        if(rc != CHIDB_OK)
+            return rc;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Add a record to a hash table
+ *
+ * Parameters
+ * - h: Hash table
+ * - key: Key of the record
+ * - record: Record (it is copied into the table)
+ * - nbytes: Size of the record
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: Could not write to the temporary file
+ */
+int chidb_dbm_hash_add(chidb_dbm_hash_t *h, int32_t key, uint8_t *record, uint32_t nbytes)
+{
+    chidb_dbm_hash_page_t *p = h->npages > 0 ? &h->pages[h->npages - 1] : NULL;
+    int rc;
+
+    // 最后一页放不下时使用新的一页
+    if(p == NULL || p->data == NULL || p->size - p->used < nbytes)
+    {
+        uint32_t size = nbytes > DBM_HASH_PAGE_SIZE ? nbytes : DBM_HASH_PAGE_SIZE;
+
+        if(h->npages == h->sizePages)
+        {
+            uint32_t sizePages = h->sizePages ? h->sizePages * 2 : 16;
+            chidb_dbm_hash_page_t *pages = realloc(h->pages, sizeof(chidb_dbm_hash_page_t) * sizePages);
+            if(pages == NULL)
+                return CHIDB_ENOMEM;
+
+            h->pages = pages;
+            h->sizePages = sizePages;
+        }
+
+        if((rc = chidb_dbm_hash_make_room(h, size, h->npages)) != CHIDB_OK)
+            return rc;
+
+        p = &h->pages[h->npages];
+        if((p->data = malloc(size)) == NULL)
+            return CHIDB_ENOMEM;
+        p->size = size;
+        p->used = 0;
+        p->offset = -1;
+
+        h->npages++;
+        h->resident += size;
+    }
+
+    if(h->nentries == h->sizeEntries)
+    {
+        uint32_t sizeEntries = h->sizeEntries ? h->sizeEntries * 2 : 64;
+        chidb_dbm_hash_entry_t *entries = realloc(h->entries, sizeof(chidb_dbm_hash_entry_t) * sizeEntries);
+        if(entries == NULL)
+            return CHIDB_ENOMEM;
+
+        h->entries = entries;
+        h->sizeEntries = sizeEntries;
+    }
+
+    chidb_dbm_hash_entry_t *e = &h->entries[h->nentries++];
+    e->key = key;
+    e->next = 0;
+    e->page = h->npages - 1;
+    e->offset = p->used;
+    e->nbytes = nbytes;
+
+    memcpy(p->data + p->used, record, nbytes);
+    p->used += nbytes;
+
+    // 再次查找时重新建立bucket
+    h->nbuckets = 0;
+
+    return CHIDB_OK;
+}
+
+
+/* Builds the buckets, keeping the entries of each one in the order in
+ * which they were added */
+static int chidb_dbm_hash_build(chidb_dbm_hash_t *h)
+{
+    uint32_t nbuckets = 16;
+    while(nbuckets < h->nentries)
+        nbuckets *= 2;
+
+    free(h->buckets);
+    if((h->buckets = calloc(nbuckets, sizeof(uint32_t))) == NULL)
+        return CHIDB_ENOMEM;
+    h->nbuckets = nbuckets;
+
+    for(uint32_t i = h->nentries; i > 0; i--)
+    {
+        chidb_dbm_hash_entry_t *e = &h->entries[i - 1];
+        uint32_t b = chidb_dbm_hash_bucket(h, e->key);
+
+        e->next = h->buckets[b];
+        h->buckets[b] = i;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Moves to the first entry, starting at entry i (plus one), with a key */
+static int chidb_dbm_hash_find(chidb_dbm_hash_t *h, uint32_t i, int32_t key)
+{
+    while(i != 0 && h->entries[i - 1].key != key)
+        i = h->entries[i - 1].next;
+
+    h->current = i;
+
+    return i != 0 ? CHIDB_OK : CHIDB_ENOTFOUND;
+}
+
+
+/* Find the first record with a key
+ *
+ * Parameters
+ * - h: Hash table
+ * - key: Key to look for
+ *
+ * Return
+ * - CHIDB_OK: The record was found, and is now the current record
+ * - CHIDB_ENOTFOUND: There is no record with that key
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_dbm_hash_seek(chidb_dbm_hash_t *h, int32_t key)
+{
+    int rc;
+
+    if(h->nbuckets == 0 && (rc = chidb_dbm_hash_build(h)) != CHIDB_OK)
+        return rc;
+
+    return chidb_dbm_hash_find(h, h->buckets[chidb_dbm_hash_bucket(h, key)], key);
+}
+
+
+/* Find the next record with the same key as the current one
+ *
+ * Parameters
+ * - h: Hash table
+ *
+ * Return
+ * - CHIDB_OK: The record was found, and is now the current record
+ * - CHIDB_ENOTFOUND: There are no more records with that key
+ */
+int chidb_dbm_hash_next(chidb_dbm_hash_t *h)
+{
+    if(h->current == 0 || h->nbuckets == 0)
+        return CHIDB_ENOTFOUND;
+
+    chidb_dbm_hash_entry_t *e = &h->entries[h->current - 1];
+
+    return chidb_dbm_hash_find(h, e->next, e->key);
+}
+
+
+/* Get the current record
+ *
+ * Its page is read back from the temporary file if it was written out.
+ * The record remains valid until the table is probed again.
+ *
+ * Parameters
+ * - h: Hash table
+ * - record: Out parameter. The record.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: There is no current record
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: Could not read from or write to the temporary file
+ */
+int chidb_dbm_hash_record(chidb_dbm_hash_t *h, uint8_t **record)
+{
+    int rc;
+
+    if(h->current == 0)
+        return CHIDB_ENOTFOUND;
+
+    chidb_dbm_hash_entry_t *e = &h->entries[h->current - 1];
+    chidb_dbm_hash_page_t *p = &h->pages[e->page];
+
+    if(p->data == NULL)
+    {
+        if((rc = chidb_dbm_hash_make_room(h, p->size, e->page)) != CHIDB_OK)
+            return rc;
+
+        if((p->data = malloc(p->size)) == NULL)
+            return CHIDB_ENOMEM;
+
+        if(fseek(h->spill, p->offset, SEEK_SET) != 0 ||
+           fread(p->data, 1, p->used, h->spill) != p->used)
+        {
+            free(p->data);
+            p->data = NULL;
+            return CHIDB_EIO;
+        }
+
+        h->resident += p->size;
+    }
+
+    *record = p->data + e->offset;
+
+    return CHIDB_OK;
+}
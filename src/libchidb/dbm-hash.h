@@ -0,0 +1,103 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  DBM hash table header. See dbm-hash.c for more details.
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef DBM_HASH_H_
+#define DBM_HASH_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Records are packed into pages of this size (or into a page of their
+ * own, if they are larger) */
+#define DBM_HASH_PAGE_SIZE (4096)
+
+/* Bytes of pages that a hash table keeps in memory before it starts
+ * writing them to a temporary file */
+#define DBM_HASH_MEMORY (8 * 1024 * 1024)
+
+typedef struct chidb_dbm_hash_entry
+{
+    int32_t key;
+    uint32_t next;      /* Next entry in the same bucket, plus one (0 if none) */
+    uint32_t page;      /* Page holding the record */
+    uint32_t offset;    /* Offset of the record in the page */
+    uint32_t nbytes;    /* Size of the record */
+} chidb_dbm_hash_entry_t;
+
+typedef struct chidb_dbm_hash_page
+{
+    uint8_t *data;      /* NULL while the page is only in the temporary file */
+    uint32_t size;      /* Bytes allocated to the page */
+    uint32_t used;      /* Bytes taken by records */
+    long offset;        /* Position in the temporary file, -1 if never written */
+} chidb_dbm_hash_page_t;
+
+/* A hash table of packed records with integer keys (several records may
+ * have the same key), filled completely before it is probed */
+typedef struct chidb_dbm_hash
+{
+    uint32_t *buckets;      /* First entry of each bucket, plus one */
+    uint32_t nbuckets;      /* A power of two, 0 until the table is probed */
+
+    chidb_dbm_hash_entry_t *entries;
+    uint32_t nentries;
+    uint32_t sizeEntries;
+
+    chidb_dbm_hash_page_t *pages;
+    uint32_t npages;
+    uint32_t sizePages;
+
+    uint32_t budget;        /* Bytes of pages that can be kept in memory */
+    uint32_t resident;      /* Bytes of pages in memory */
+    uint32_t evict;         /* Next page considered for eviction */
+    FILE *spill;            /* Temporary file, created by the first eviction */
+    uint32_t nspilled;      /* Pages written to the temporary file */
+
+    uint32_t current;       /* Entry found by the last seek or next, plus one */
+} chidb_dbm_hash_t;
+
+void chidb_dbm_hash_init(chidb_dbm_hash_t *h, uint32_t budget);
+void chidb_dbm_hash_destroy(chidb_dbm_hash_t *h);
+int chidb_dbm_hash_add(chidb_dbm_hash_t *h, int32_t key, uint8_t *record, uint32_t nbytes);
+int chidb_dbm_hash_seek(chidb_dbm_hash_t *h, int32_t key);
+int chidb_dbm_hash_next(chidb_dbm_hash_t *h);
+int chidb_dbm_hash_record(chidb_dbm_hash_t *h, uint8_t **record);
+
+#endif /* DBM_HASH_H_ */
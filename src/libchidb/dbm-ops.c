@@ -41,24 +41,18 @@
 #include "dbm.h"
 #include "btree.h"
 #include "record.h"
+#include "util.h"
+
+/* Percentage of each page filled when an index is built with
+ * IdxBulkBuild, leaving some room for the rows inserted later */
+#define INDEX_BUILD_FILL (90)
 
 //一些封装好的操作函数，用于写寄存器
 int chidb_dbm_op_WriteReg (chidb_stmt *stmt, int regNo, int reg_type, void *data);
-//防止编译器报warring
-int realloc_cur(chidb_stmt *stmt, uint32_t size);
-int realloc_reg(chidb_stmt *stmt, uint32_t size);
-
-
+int chidb_dbm_op_ReadParam (chidb_stmt *stmt, int param, int regNo, int reg_type);
 
-typedef int (*handler_function)(chidb_stmt *stmt, chidb_dbm_op_t *op);
 
 
-struct handler_entry
-{
-    opcode_t opcode;
-    handler_function func;
-};
-
 /* This generates all the instruction handler prototypes. It expands to:
  *
  * int chidb_dbm_op_OpenRead(chidb_stmt *stmt, chidb_dbm_op_t *op);
@@ -70,17 +64,91 @@ struct handler_entry
 FOREACH_OP(HANDLER_PROTOTYPE)
 
 
-/* Ladies and gentlemen, the dispatch table. */
-#define HANDLER_ENTRY(OP) { Op_ ## OP, chidb_dbm_op_## OP},
+/* Ladies and gentlemen, the interpreter loop.
+ *
+ * Runs instructions from stmt->pc until one of them returns something
+ * other than CHIDB_OK, or the program counter goes past the last
+ * instruction. Handlers are called directly (and can be inlined) from
+ * one dispatch point per opcode, generated with FOREACH_OP. With GCC
+ * and Clang each dispatch point jumps straight to the next handler
+ * through a table of label addresses, so that every opcode gets its own
+ * indirect branch; other compilers, or building with
+ * CHIDB_NO_COMPUTED_GOTO, get a switch in a loop instead.
+ *
+ * The program must have been checked with chidb_stmt_verify, so neither
+ * the opcodes nor the operands are checked here or in the handlers.
+ */
+#if defined(__GNUC__) && !defined(CHIDB_NO_COMPUTED_GOTO)
+#define DBM_COMPUTED_GOTO
+#endif
 
-struct handler_entry dbm_handlers[] =
+int chidb_dbm_run(chidb_stmt *stmt)
+{
+    chidb_dbm_op_t *ops = stmt->ops;
+    chidb_dbm_op_t *op;
+    int rc = CHIDB_OK;
+
+#ifdef DBM_COMPUTED_GOTO
+#define DISPATCH_LABEL(OP) &&do_ ## OP,
+    static void *dispatch[] =
+    {
+        FOREACH_OP(DISPATCH_LABEL)
+    };
+
+#define DISPATCH()                          \
+    do {                                    \
+        if (stmt->pc >= stmt->endOp)        \
+            return CHIDB_OK;                \
+        op = &ops[stmt->pc++];              \
+        goto *dispatch[op->opcode];         \
+    } while (0)
+
+#define DISPATCH_CASE(OP)                   \
+    do_ ## OP:                              \
+        rc = chidb_dbm_op_ ## OP(stmt, op); \
+        if (rc != CHIDB_OK)                 \
+            return rc;                      \
+        DISPATCH();
+
+    DISPATCH();
+    FOREACH_OP(DISPATCH_CASE)
+
+#else
+#define DISPATCH_CASE(OP)                   \
+    case Op_ ## OP:                         \
+        rc = chidb_dbm_op_ ## OP(stmt, op); \
+        break;
+
+    while(stmt->pc < stmt->endOp)
+    {
+        op = &ops[stmt->pc++];
+
+        switch(op->opcode)
         {
-                FOREACH_OP(HANDLER_ENTRY)
-        };
+            FOREACH_OP(DISPATCH_CASE)
+        }
+
+        if (rc != CHIDB_OK)
+            break;
+    }
+#endif
+
+    return rc;
+}
 
-int chidb_dbm_op_handle (chidb_stmt *stmt, chidb_dbm_op_t *op)
+
+// 插入可能改变了B树中游标经过的结点, 语句中所有打开的、在同一棵B树上的游标
+// (不只是插入用的游标)都要更新: 指向某个cell的游标重新seek到它, 否则(如INSERT
+// 语句中只用于插入的游标)只需重新读取根结点
+static void chidb_dbm_refresh_cursors(chidb_stmt *stmt, npage_t root_page)
 {
-    return dbm_handlers[op->opcode].func(stmt, op);
+    for (int i = 0; i < stmt->nCursors; i++)
+    {
+        chidb_dbm_cursor_t *c = &stmt->cursors[i];
+
+        if (c->type != CURSOR_UNSPECIFIED && c->depth > 0 && c->root_page == root_page)
+            chidb_dbm_cursor_refresh(stmt->db->bt, c);
+    }
 }
 
 
@@ -95,94 +163,58 @@ int chidb_dbm_op_Noop (chidb_stmt *stmt, chidb_dbm_op_t *op)
 
 int chidb_dbm_op_OpenRead (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
-    // If cursor doesn't exist, allocate it
-    if (!EXISTS_CURSOR(stmt, op->p1))
-        realloc_cur(stmt, op->p1);
-
     chidb_dbm_cursor_t *c = &((stmt)->cursors[op->p1]);
+
+    // 重新打开一个已经打开的游标时, 先释放它固定的页面
+    if (c->type != CURSOR_UNSPECIFIED)
+        chidb_dbm_cursor_destroy(stmt->db->bt, c);
+
     chidb_dbm_cursor_init(stmt->db->bt, c, stmt->reg[op->p2].value.i, op->p3);
 
     c->type = CURSOR_READ;
 
-    // check that the op worked properly
-    if (!IS_VALID_CURSOR(stmt, op->p1))
-        return CHIDB_PROBLEM;
-
     return CHIDB_OK;
 }
 
 int chidb_dbm_op_OpenWrite (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
-    // If cursor doesn't exist, allocate it
-    if (!EXISTS_CURSOR(stmt, op->p1))
-        realloc_cur(stmt, op->p1);
-
     chidb_dbm_cursor_t *c = &((stmt)->cursors[op->p1]);
+
+    // 重新打开一个已经打开的游标时, 先释放它固定的页面
+    if (c->type != CURSOR_UNSPECIFIED)
+        chidb_dbm_cursor_destroy(stmt->db->bt, c);
+
     chidb_dbm_cursor_init(stmt->db->bt, c, stmt->reg[op->p2].value.i, op->p3);
 
     c->type = CURSOR_WRITE;
 
-    // check that the op worked properly
-    if (!IS_VALID_CURSOR(stmt, op->p1))
-        return CHIDB_PROBLEM;
-
     return CHIDB_OK;
 }
 
 int chidb_dbm_op_Close (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
-    // makes sure we are trying to destroy a valid cursor
-    if (!EXISTS_CURSOR(stmt, op->p1))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_cursor_t *c = &((stmt)->cursors[op->p1]);
     chidb_dbm_cursor_destroy(stmt->db->bt, c);
 
     return CHIDB_OK;
 }
 
-//只保留cursor中trail链表中第一个节点，然后将cursor中的cell指向第一个叶节点的第一个cell
+//将cursor指向B树中的第一个cell, B树为空时跳转到p2
 int chidb_dbm_op_Rewind (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
     uint32_t jmp_addr = op->p2;
-
-    if (!EXISTS_CURSOR(stmt, op->p1))
-        return CHIDB_PROBLEM;
+    int rc;
 
     chidb_dbm_cursor_t *c = &((stmt)->cursors[op->p1]);
 
-    chidb_dbm_cursor_trail_t *ct = (chidb_dbm_cursor_trail_t*) list_get_at(&c->trail, 0);
+    rc = chidb_dbm_cursor_rewind(stmt->db->bt, c);
 
-    if (ct->btn->n_cells == 0) 
+    if (rc == CHIDB_CURSORCANTMOVE)
     {
-        if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-            return CHIDB_PROBLEM;
-
         stmt->pc = jmp_addr;
     }
-    else 
-    {
-        
-        chidb_dbm_cursor_clear_trail_from(stmt->db->bt, c, 0);
-
-        
-        ct->n_current_cell = 0;
-
-        
-        switch(ct->btn->type)
-        {
-            case PGTYPE_TABLE_INTERNAL:
-            case PGTYPE_TABLE_LEAF:
-                chidb_dbm_cursorTable_fwdDwn(stmt->db->bt, c);
-                break;
-            case PGTYPE_INDEX_INTERNAL:
-            case PGTYPE_INDEX_LEAF:
-                chidb_dbm_cursorIndex_fwdDwn(stmt->db->bt, c);
-                break;
-            default:
-                return CHIDB_ETYPE;
-        }
-    }
+    else if (rc != CHIDB_OK)
+        return rc;
 
     return CHIDB_OK;
 }
@@ -193,16 +225,11 @@ int chidb_dbm_op_Next (chidb_stmt *stmt, chidb_dbm_op_t *op)
     uint32_t jmp_addr = op->p2;
     int fwd_ret;
 
-    if (!EXISTS_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
     fwd_ret = chidb_dbm_cursor_fwd(stmt->db->bt,c);
     if(fwd_ret != CHIDB_CURSORCANTMOVE)
     {
-        if (!IS_VALID_ADDRESS(stmt, op->p2))
-            return CHIDB_DONE;
         stmt->pc = jmp_addr;
     }
     return CHIDB_OK;
@@ -214,16 +241,11 @@ int chidb_dbm_op_Prev (chidb_stmt *stmt, chidb_dbm_op_t *op)
     int32_t jmp_addr = op->p2;
     int fwd_ret;
 
-    if (!EXISTS_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
     fwd_ret = chidb_dbm_cursor_rev(stmt->db->bt,c);
     if(fwd_ret != CHIDB_CURSORCANTMOVE)
     {
-        if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-            return CHIDB_DONE;
         stmt->pc = (uint32_t)jmp_addr;
     }
 
@@ -236,34 +258,24 @@ int chidb_dbm_op_Seek (chidb_stmt *stmt, chidb_dbm_op_t *op)
     uint32_t c_index = op->p1;
     uint32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, op->p3))
-    {
-        fprintf(stderr, "%s\n", "an error has occured in seek");
-        return CHIDB_PROBLEM;
-    }
-
     chidb_dbm_register_t *r1 = &((stmt)->reg[op->p3]);
     uint32_t key = r1->value.i;
 
     int seek_ret;
 
-    if (!IS_VALID_CURSOR(stmt, c_index))
+    chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
+
+    // 连接时查找的key可能为NULL, 不与任何key相等
+    if(r1->type != REG_INT32)
     {
-        fprintf(stderr, "%s\n", "a cursor error has occured in seek");
-        return CHIDB_PROBLEM;
+        stmt->pc = (uint32_t)jmp_addr;
+        return CHIDB_OK;
     }
 
-    chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
-
-    seek_ret = chidb_dbm_cursor_seek(stmt->db->bt, c, key, c->root_page, 0, SEEK);
+    seek_ret = chidb_dbm_cursor_seek(stmt->db->bt, c, key, SEEK);
 
     if(seek_ret != CHIDB_OK)
     {
-        if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-        {
-            fprintf(stderr, "%s\n", "error, invalid jump address");
-            return CHIDB_PROBLEM;
-        }
         stmt->pc = (uint32_t)jmp_addr;
     }
 
@@ -275,24 +287,16 @@ int chidb_dbm_op_SeekGt (chidb_stmt *stmt, chidb_dbm_op_t *op)
     uint32_t c_index = op->p1;
     uint32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, op->p3))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *r1 = &((stmt)->reg[op->p3]);
     uint32_t key = r1->value.i;
 
     int seek_ret;
 
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
-    seek_ret = chidb_dbm_cursor_seek(stmt->db->bt, c, key, c->root_page, 0, SEEKGT);
+    seek_ret = chidb_dbm_cursor_seek(stmt->db->bt, c, key, SEEKGT);
     if(seek_ret != CHIDB_OK)
     {
-        if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-            return CHIDB_PROBLEM;
         stmt->pc = (uint32_t)jmp_addr;
     }
 
@@ -304,24 +308,16 @@ int chidb_dbm_op_SeekGe (chidb_stmt *stmt, chidb_dbm_op_t *op)
     uint32_t c_index = op->p1;
     uint32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, op->p3))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *r1 = &((stmt)->reg[op->p3]);
     uint32_t key = r1->value.i;
 
     int seek_ret;
 
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
-    seek_ret = chidb_dbm_cursor_seek(stmt->db->bt, c, key, c->root_page, 0, SEEKGE);
+    seek_ret = chidb_dbm_cursor_seek(stmt->db->bt, c, key, SEEKGE);
     if(seek_ret != CHIDB_OK)
     {
-        if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-            return CHIDB_PROBLEM;
         stmt->pc = (uint32_t)jmp_addr;
     }
 
@@ -333,24 +329,16 @@ int chidb_dbm_op_SeekLt (chidb_stmt *stmt, chidb_dbm_op_t *op)
     uint32_t c_index = op->p1;
     uint32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, op->p3))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *r1 = &((stmt)->reg[op->p3]);
     uint32_t key = r1->value.i;
 
     int seek_ret;
 
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
-    seek_ret = chidb_dbm_cursor_seek(stmt->db->bt, c, key, c->root_page, 0, SEEKLT);
+    seek_ret = chidb_dbm_cursor_seek(stmt->db->bt, c, key, SEEKLT);
     if(seek_ret != CHIDB_OK)
     {
-        if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-            return CHIDB_PROBLEM;
         stmt->pc = (uint32_t)jmp_addr;
     }
 
@@ -362,70 +350,46 @@ int chidb_dbm_op_SeekLe (chidb_stmt *stmt, chidb_dbm_op_t *op)
     uint32_t c_index = op->p1;
     uint32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, op->p3))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *r1 = &((stmt)->reg[op->p3]);
     uint32_t key = r1->value.i;
 
     int seek_ret;
 
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
-    seek_ret = chidb_dbm_cursor_seek(stmt->db->bt, c, key, c->root_page, 0, SEEKLE);
+    seek_ret = chidb_dbm_cursor_seek(stmt->db->bt, c, key, SEEKLE);
     if(seek_ret != CHIDB_OK)
     {
-        if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-            return CHIDB_PROBLEM;
         stmt->pc = (uint32_t)jmp_addr;
     }
 
     return CHIDB_OK;
 }
-//按类型将cursor中对应cell的内容存入寄存器中(p3)
-int chidb_dbm_op_Column (chidb_stmt *stmt, chidb_dbm_op_t *op)
+// 按类型将记录中第col_num列的值存入寄存器reg_index中
+static int chidb_dbm_view_column (chidb_stmt *stmt, DBRecordView *dbrv, int32_t col_num, int32_t reg_index)
 {
-    int32_t c_index = op->p1;
-    int32_t col_num = op->p2;
-    int32_t reg_index = op->p3;
-
     int8_t byte;
     int16_t smallint;
     int32_t integer;
-    char *string;
+    const char *string;
+    int len;
 
-    int ret;
-    int type;
-    DBRecord *dbr;
-
-    // get cursor and entry data
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-    chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
-    uint8_t *entry = c->current_cell.fields.tableLeaf.data;
-
-    if((ret = chidb_DBRecord_unpack(&dbr, entry)) != CHIDB_OK)
-        fprintf(stderr,"CHIDB_DBM_OP_COLUMN: couldn't unpack record\n");
-
-    type = chidb_DBRecord_getType(dbr, (uint8_t)col_num);
-
-    switch(type)
+    switch(chidb_DBRecord_viewGetType(dbrv, (uint8_t)col_num))
     {
         case SQL_INTEGER_1BYTE:
-            ret = chidb_DBRecord_getInt8(dbr, (uint8_t)col_num, &byte);
-            if (chidb_dbm_op_WriteReg(stmt, reg_index, REG_INT32, &byte) != CHIDB_OK)
+            chidb_DBRecord_viewGetInt8(dbrv, (uint8_t)col_num, &byte);
+            integer = byte;
+            if (chidb_dbm_op_WriteReg(stmt, reg_index, REG_INT32, &integer) != CHIDB_OK)
                 return CHIDB_PROBLEM;
             break;
         case SQL_INTEGER_2BYTE:
-            ret = chidb_DBRecord_getInt16(dbr, (uint8_t)col_num, &smallint);
-            if (chidb_dbm_op_WriteReg(stmt, reg_index, REG_INT32, &smallint) != CHIDB_OK)
+            chidb_DBRecord_viewGetInt16(dbrv, (uint8_t)col_num, &smallint);
+            integer = smallint;
+            if (chidb_dbm_op_WriteReg(stmt, reg_index, REG_INT32, &integer) != CHIDB_OK)
                 return CHIDB_PROBLEM;
             break;
         case SQL_INTEGER_4BYTE:
-            ret = chidb_DBRecord_getInt32(dbr,(uint8_t)col_num, &integer);
+            chidb_DBRecord_viewGetInt32(dbrv, (uint8_t)col_num, &integer);
             if (chidb_dbm_op_WriteReg(stmt, reg_index, REG_INT32, &integer) != CHIDB_OK)
                 return CHIDB_PROBLEM;
             break;
@@ -434,8 +398,9 @@ int chidb_dbm_op_Column (chidb_stmt *stmt, chidb_dbm_op_t *op)
                 return CHIDB_PROBLEM;
             break;
         case SQL_TEXT:
-            ret = chidb_DBRecord_getString(dbr, (uint8_t)col_num, &string);
-            if (chidb_dbm_op_WriteReg(stmt, reg_index, REG_STRING, strdup(string)) != CHIDB_OK)
+            // 寄存器中的值在游标移动后仍然有效, 所以字符串需要复制一份
+            chidb_DBRecord_viewGetString(dbrv, (uint8_t)col_num, &string, &len);
+            if (chidb_dbm_op_WriteReg(stmt, reg_index, REG_STRING, strndup(string, len)) != CHIDB_OK)
                 return CHIDB_PROBLEM;
             break;
         case SQL_NOTVALID:
@@ -445,6 +410,22 @@ int chidb_dbm_op_Column (chidb_stmt *stmt, chidb_dbm_op_t *op)
 
     return CHIDB_OK;
 }
+
+//按类型将cursor中对应cell的内容存入寄存器中(p3)
+int chidb_dbm_op_Column (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    int32_t c_index = op->p1;
+    int32_t col_num = op->p2;
+    int32_t reg_index = op->p3;
+
+    // get cursor and entry data
+    chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
+
+    // 记录头在每一行只解析一次, 各列直接从页中读取
+    DBRecordView *dbrv = chidb_dbm_cursor_record(c);
+
+    return chidb_dbm_view_column(stmt, dbrv, col_num, reg_index);
+}
 //将某个cursor中cell对应的key值存到寄存器中
 int chidb_dbm_op_Key (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
@@ -452,9 +433,6 @@ int chidb_dbm_op_Key (chidb_stmt *stmt, chidb_dbm_op_t *op)
     int32_t reg_index = op->p2;
     uint32_t key;
 
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
     key = c->current_cell.key;
@@ -465,8 +443,29 @@ int chidb_dbm_op_Key (chidb_stmt *stmt, chidb_dbm_op_t *op)
     return CHIDB_OK;
 }
 
+// 将第param个参数绑定的值写入寄存器, 没有绑定值的参数为NULL
+int chidb_dbm_op_ReadParam (chidb_stmt *stmt, int param, int regNo, int reg_type)
+{
+    chidb_dbm_register_t *p = &stmt->params[param - 1];
+
+    if (p->type == REG_UNSPECIFIED || p->type == REG_NULL)
+        return chidb_dbm_op_WriteReg(stmt, regNo, REG_NULL, NULL);
+
+    if (p->type != reg_type)
+        return CHIDB_EMISMATCH;
+
+    if (reg_type == REG_INT32)
+        return chidb_dbm_op_WriteReg(stmt, regNo, REG_INT32, &p->value.i);
+    else
+        return chidb_dbm_op_WriteReg(stmt, regNo, REG_STRING, strdup(p->value.s));
+}
+
+// p3不为0时写入第p3个参数的值
 int chidb_dbm_op_Integer (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
+    if (op->p3 > 0)
+        return chidb_dbm_op_ReadParam(stmt, op->p3, op->p2, REG_INT32);
+
     if (chidb_dbm_op_WriteReg(stmt, op->p2, REG_INT32, &(op->p1)) != CHIDB_OK)
         return CHIDB_PROBLEM;
 
@@ -475,6 +474,9 @@ int chidb_dbm_op_Integer (chidb_stmt *stmt, chidb_dbm_op_t *op)
 
 int chidb_dbm_op_String (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
+    if (op->p3 > 0)
+        return chidb_dbm_op_ReadParam(stmt, op->p3, op->p2, REG_STRING);
+
     if (chidb_dbm_op_WriteReg(stmt, op->p2, REG_STRING, strdup(op->p4)) != CHIDB_OK)
         return CHIDB_PROBLEM;
 
@@ -491,11 +493,6 @@ int chidb_dbm_op_Null (chidb_stmt *stmt, chidb_dbm_op_t *op)
 
 int chidb_dbm_op_ResultRow (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
-    if (!IS_VALID_REGISTER(stmt, op->p1))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_REGISTER(stmt, op->p2))
-        return CHIDB_PROBLEM;
-
     stmt->startRR = (uint32_t)op->p1;
     stmt->nRR = (uint32_t)op->p2;
 
@@ -521,17 +518,15 @@ int chidb_dbm_op_MakeRecord (chidb_stmt *stmt, chidb_dbm_op_t *op)
     int i;
     for(i = r1; i <= end_reg; i++)
     {
-        if (!IS_VALID_REGISTER(stmt, i))
-            return CHIDB_PROBLEM;
-
         chidb_dbm_register_t *tmp = &((stmt)->reg[i]);
 
-        if(tmp->type == REG_NULL)
-            chidb_DBRecord_appendNull(&dbrb);
-        else if(tmp->type == REG_INT32)
+        // 没有值的寄存器(如Column读到不存在的列)按NULL处理
+        if(tmp->type == REG_INT32)
             chidb_DBRecord_appendInt32(&dbrb, tmp->value.i);
         else if(tmp->type == REG_STRING)
             chidb_DBRecord_appendString(&dbrb, tmp->value.s);
+        else
+            chidb_DBRecord_appendNull(&dbrb);
     }
 
     chidb_DBRecord_finalize(&dbrb, &dbr);
@@ -556,15 +551,9 @@ int chidb_dbm_op_Insert (chidb_stmt *stmt, chidb_dbm_op_t *op)
     int32_t r1 = op->p2;
     int32_t r2 = op->p3;
 
-    if (!IS_VALID_REGISTER(stmt, r1))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_REGISTER(stmt, r2))
-        return CHIDB_PROBLEM;
     chidb_dbm_register_t *reg1 = &((stmt)->reg[r1]);
     chidb_dbm_register_t *reg2 = &((stmt)->reg[r2]);
 
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
     BTreeCell *cell = malloc(sizeof(BTreeCell));
@@ -573,27 +562,23 @@ int chidb_dbm_op_Insert (chidb_stmt *stmt, chidb_dbm_op_t *op)
 
     cell->fields.tableLeaf.data = reg1->value.bin.bytes; 
     cell->fields.tableLeaf.data_size = reg1->value.bin.nbytes;
-    chidb_Btree_insert(stmt->db->bt, c->root_page, cell);
+    int rc = chidb_Btree_insert(stmt->db->bt, c->root_page, cell);
 
-    chidb_key_t old_key = c->current_cell.key;
-    chidb_dbm_cursor_seek(stmt->db->bt, c, old_key, c->root_page, 0, SEEK);
+    chidb_dbm_refresh_cursors(stmt, c->root_page);
 
     free(cell);
 
-    return CHIDB_OK;
+    // 主键已存在
+    if (rc == CHIDB_EDUPLICATE)
+        return CHIDB_ECONSTRAINT;
+
+    return rc;
 }
 
 int chidb_dbm_op_Eq (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
     uint32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, op->p1))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_REGISTER(stmt, op->p3))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *reg1 = &((stmt)->reg[op->p1]);
     chidb_dbm_register_t *reg2 = &((stmt)->reg[op->p3]);
 
@@ -615,13 +600,6 @@ int chidb_dbm_op_Ne (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
     int32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, op->p1))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_REGISTER(stmt, op->p3))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *reg1 = &((stmt)->reg[op->p1]);
     chidb_dbm_register_t *reg2 = &((stmt)->reg[op->p3]);
 
@@ -643,13 +621,6 @@ int chidb_dbm_op_Lt (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
     uint32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, op->p1))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_REGISTER(stmt, op->p3))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *reg1 = &((stmt)->reg[op->p1]);
     chidb_dbm_register_t *reg2 = &((stmt)->reg[op->p3]);
 
@@ -694,17 +665,9 @@ int chidb_dbm_op_Gt (chidb_stmt *stmt, chidb_dbm_op_t *op)
     int32_t r2 = op->p3;
     int32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, r1))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_REGISTER(stmt, r2))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *reg1 = &((stmt)->reg[r1]);
     chidb_dbm_register_t *reg2 = &((stmt)->reg[r2]);
 
-
     if(reg1->type == REG_INT32 && reg2->type == REG_INT32) {
         if(reg2->value.i > reg1->value.i) {
             stmt->pc = (uint32_t)jmp_addr;
@@ -725,17 +688,9 @@ int chidb_dbm_op_Ge (chidb_stmt *stmt, chidb_dbm_op_t *op)
     int32_t r2 = op->p3;
     int32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, r1))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_REGISTER(stmt, r2))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *reg1 = &((stmt)->reg[r1]);
     chidb_dbm_register_t *reg2 = &((stmt)->reg[r2]);
 
-
     if(reg1->type == REG_INT32 && reg2->type == REG_INT32) {
         if((reg2->value.i >= reg1->value.i))
             stmt->pc = (uint32_t)jmp_addr;
@@ -753,20 +708,14 @@ int chidb_dbm_op_IdxGt (chidb_stmt *stmt, chidb_dbm_op_t *op)
     int32_t c_index = op->p1;
     int32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, op->p3))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *r1 = &((stmt)->reg[op->p3]);
     int32_t key = r1->value.i;
 
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
     // I'm assuming hopefully that current cell points to an index cell
-    if(c->current_cell.key > key) {
+    // 索引的键按有符号整数比较, 与B树中的顺序一致
+    if((int32_t) c->current_cell.key > key) {
         stmt->pc = (uint32_t)jmp_addr;
     }
 
@@ -778,19 +727,12 @@ int chidb_dbm_op_IdxGe (chidb_stmt *stmt, chidb_dbm_op_t *op)
     uint32_t c_index = op->p1;
     uint32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, op->p3))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *r1 = &((stmt)->reg[op->p3]);
     int32_t key = r1->value.i;
 
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
-    if((c->current_cell.key > key) || (c->current_cell.key == key)) {
+    if((int32_t) c->current_cell.key >= key) {
         stmt->pc = (uint32_t)jmp_addr;
     }
 
@@ -802,20 +744,12 @@ int chidb_dbm_op_IdxLt (chidb_stmt *stmt, chidb_dbm_op_t *op)
     int32_t c_index = op->p1;
     int32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, op->p3))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *r1 = &((stmt)->reg[op->p3]);
     int32_t key = r1->value.i;
 
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
-    
-    if(c->current_cell.key < key) {
+    if((int32_t) c->current_cell.key < key) {
         stmt->pc = (uint32_t)jmp_addr;
     }
 
@@ -828,19 +762,12 @@ int chidb_dbm_op_IdxLe (chidb_stmt *stmt, chidb_dbm_op_t *op)
     int32_t c_index = op->p1;
     int32_t jmp_addr = op->p2;
 
-    if (!IS_VALID_REGISTER(stmt, op->p3))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_ADDRESS(stmt, jmp_addr))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *r1 = &((stmt)->reg[op->p3]);
     int32_t key = r1->value.i;
 
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
-    if((c->current_cell.key < key) || (c->current_cell.key == key)) {
+    if((int32_t) c->current_cell.key <= key) {
         stmt->pc = (uint32_t)jmp_addr;
     }
 
@@ -854,9 +781,6 @@ int chidb_dbm_op_IdxPKey (chidb_stmt *stmt, chidb_dbm_op_t *op)
     int32_t reg_index = op->p2;
     uint32_t key;
 
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-
     
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
@@ -880,45 +804,124 @@ int chidb_dbm_op_IdxInsert (chidb_stmt *stmt, chidb_dbm_op_t *op)
     int32_t r1 = op->p2;
     int32_t r2 = op->p3;
 
-    if (!IS_VALID_REGISTER(stmt, r1))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_REGISTER(stmt, r2))
-        return CHIDB_PROBLEM;
-    if (!IS_VALID_CURSOR(stmt, c_index))
-        return CHIDB_PROBLEM;
-
     chidb_dbm_register_t *reg1 = &((stmt)->reg[r1]);
     chidb_dbm_register_t *reg2 = &((stmt)->reg[r2]);
 
     chidb_dbm_cursor_t *c = &((stmt)->cursors[c_index]);
 
+    // NULL不会与任何值相等, 不需要加入索引
+    if (reg1->type == REG_NULL)
+        return CHIDB_OK;
+
     BTreeCell *cell = malloc(sizeof(BTreeCell));
     cell->type = PGTYPE_INDEX_LEAF;
     cell->key = (uint32_t)reg1->value.i; //grab the idx key
 
     cell->fields.indexLeaf.keyPk = (uint32_t)reg2->value.i;
-    chidb_Btree_insert(stmt->db->bt, c->root_page, cell);
+    int rc = chidb_Btree_insert(stmt->db->bt, c->root_page, cell);
+    free(cell);
 
-    //RELOADING THE TREE just in case the insert messed up the tree
-    chidb_key_t old_key = c->current_cell.key;
-    chidb_dbm_cursor_seek(stmt->db->bt, c, old_key, c->root_page, 0, SEEK);
+    chidb_dbm_refresh_cursors(stmt, c->root_page);
 
-    return CHIDB_OK;
+    // 索引的每个key只能有一项, 所以索引的列不能有重复的值
+    if (rc == CHIDB_EDUPLICATE)
+        return CHIDB_ECONSTRAINT;
+
+    return rc;
+}
+
+// 把 (寄存器p1中的key, 寄存器p2中的主键) 加入第p3个sorter, 由IdxBulkBuild建立索引
+int chidb_dbm_op_IdxBulkAdd (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_register_t *key = &stmt->reg[op->p1];
+    chidb_dbm_register_t *pk = &stmt->reg[op->p2];
+    uint8_t entry[8];
+
+    if (op->p3 >= stmt->nSorters)
+        return CHIDB_PROBLEM;
+
+    // 与IdxInsert相同, NULL不加入索引
+    if (key->type == REG_NULL)
+        return CHIDB_OK;
+
+    // sorter按有符号整数排序, 与索引中key的顺序一致; 记录中保存key和主键
+    put4byte(entry, key->value.i);
+    put4byte(entry + 4, pk->value.i);
+
+    return chidb_dbm_sorter_insert(&stmt->sorters[op->p3], DBM_SORTER_INT, key->value.i, NULL,
+                                   entry, sizeof(entry));
+}
+
+// 将IdxBulkAdd加入第p2个sorter的项排序后自下而上建立一个新的索引, 其根结点页码写入寄存器p1.
+// 项多于sorter的内存预算时, 排序使用临时文件
+int chidb_dbm_op_IdxBulkBuild (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    BTreeBuilder bb;
+    BTreeCell cell;
+    npage_t root;
+    uint8_t *entry;
+    int ret, fret, rc;
+
+    if (op->p2 >= stmt->nSorters)
+        return CHIDB_PROBLEM;
+
+    chidb_dbm_sorter_t *s = &stmt->sorters[op->p2];
+
+    rc = chidb_dbm_sorter_sort(s);
+    if (rc != CHIDB_OK && rc != CHIDB_ENOTFOUND)
+        return rc;
+
+    if ((ret = chidb_Btree_bulkInit(stmt->db->bt, &bb, PGTYPE_INDEX_LEAF, INDEX_BUILD_FILL)) != CHIDB_OK)
+        return ret;
+
+    // 表为空(sorter中没有项)时建立一个空的索引
+    cell.type = PGTYPE_INDEX_LEAF;
+    while (rc == CHIDB_OK && ret == CHIDB_OK)
+    {
+        if ((ret = chidb_dbm_sorter_record(s, &entry)) != CHIDB_OK)
+            break;
+        cell.key = get4byte(entry);
+        cell.fields.indexLeaf.keyPk = get4byte(entry + 4);
+        ret = chidb_Btree_bulkAppend(&bb, &cell);
+        if (ret == CHIDB_OK)
+            rc = chidb_dbm_sorter_next(s);
+    }
+    if (ret == CHIDB_OK && rc != CHIDB_ENOTFOUND)
+        ret = rc;
+
+    // 出错时也要结束构建, 释放固定的页面
+    fret = chidb_Btree_bulkFinish(&bb, &root);
+
+    // 索引的每个key只能有一项, 所以列中有重复的值时不能建立索引
+    if (ret == CHIDB_EDUPLICATE)
+        return CHIDB_ECONSTRAINT;
+    if (ret != CHIDB_OK)
+        return ret;
+    if (fret != CHIDB_OK)
+        return fret;
+
+    if ((ret = chidb_Btree_incrSchemaCookie(stmt->db->bt)) != CHIDB_OK)
+        return ret;
+
+    int32_t nroot = root;
+    return chidb_dbm_op_WriteReg(stmt, op->p1, REG_INT32, &nroot);
 }
 
 //创建一个表，申请一个页面，并且将页号写入寄存器中
 int chidb_dbm_op_CreateTable (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
-    npage_t *root = malloc(sizeof(npage_t));
+    npage_t root;
 
-    int ret = chidb_Btree_newNode(stmt->db->bt, root, PGTYPE_TABLE_LEAF);
+    int ret = chidb_Btree_newNode(stmt->db->bt, &root, PGTYPE_TABLE_LEAF);
     if (ret != CHIDB_OK)
         return ret;
 
-    if (chidb_dbm_op_WriteReg(stmt, op->p1, REG_INT32, root) != CHIDB_OK)
-        return CHIDB_PROBLEM;
+    // 结构改变了, 之后准备语句时会发现schema cookie不同, 从而读取新的结构
+    if ((ret = chidb_Btree_incrSchemaCookie(stmt->db->bt)) != CHIDB_OK)
+        return ret;
 
-    free(root);
+    if (chidb_dbm_op_WriteReg(stmt, op->p1, REG_INT32, &root) != CHIDB_OK)
+        return CHIDB_PROBLEM;
 
     return CHIDB_OK;
 }
@@ -926,21 +929,52 @@ int chidb_dbm_op_CreateTable (chidb_stmt *stmt, chidb_dbm_op_t *op)
 
 int chidb_dbm_op_CreateIndex (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
-    npage_t *root = malloc(sizeof(npage_t));
+    npage_t root;
 
-    int ret = chidb_Btree_newNode(stmt->db->bt, root, PGTYPE_INDEX_LEAF);
+    int ret = chidb_Btree_newNode(stmt->db->bt, &root, PGTYPE_INDEX_LEAF);
     if (ret != CHIDB_OK)
         return ret;
 
-    if (chidb_dbm_op_WriteReg(stmt, op->p1, REG_INT32, root) != CHIDB_OK)
+    if ((ret = chidb_Btree_incrSchemaCookie(stmt->db->bt)) != CHIDB_OK)
+        return ret;
+
+    if (chidb_dbm_op_WriteReg(stmt, op->p1, REG_INT32, &root) != CHIDB_OK)
         return CHIDB_PROBLEM;
 
     return CHIDB_OK;
 }
 
 
+// 将寄存器p1的值复制到寄存器p2
 int chidb_dbm_op_Copy (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
+    chidb_dbm_register_t *src = &stmt->reg[op->p1];
+    chidb_dbm_register_t *dst = &stmt->reg[op->p2];
+
+    if (src == dst)
+        return CHIDB_OK;
+
+    if (dst->type == REG_STRING)
+        free(dst->value.s);
+    else if (dst->type == REG_BINARY)
+        free(dst->value.bin.bytes);
+
+    *dst = *src;
+    if (src->type == REG_STRING && (dst->value.s = strdup(src->value.s)) == NULL)
+    {
+        dst->type = REG_NULL;
+        return CHIDB_ENOMEM;
+    }
+    if (src->type == REG_BINARY)
+    {
+        if ((dst->value.bin.bytes = malloc(src->value.bin.nbytes)) == NULL)
+        {
+            dst->type = REG_NULL;
+            return CHIDB_ENOMEM;
+        }
+        memcpy(dst->value.bin.bytes, src->value.bin.bytes, src->value.bin.nbytes);
+    }
+
     return CHIDB_OK;
 }
 
@@ -950,16 +984,283 @@ int chidb_dbm_op_SCopy (chidb_stmt *stmt, chidb_dbm_op_t *op)
     return CHIDB_OK;
 }
 
+// 无条件跳转到p2
+int chidb_dbm_op_Goto (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    stmt->pc = op->p2;
+
+    return CHIDB_OK;
+}
+
+static int rowset_cmp(const void *a, const void *b)
+{
+    uint64_t ea = *(const uint64_t *) a, eb = *(const uint64_t *) b;
+
+    return (ea > eb) - (ea < eb);
+}
+
+// 把寄存器p2中的rowid及寄存器p3中的值加入第p1个row set
+int chidb_dbm_op_RowSetAdd (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    // row set在第一次使用时才分配
+    if (op->p1 >= stmt->nRowSets)
+    {
+        chidb_dbm_rowset_t *rowsets = realloc(stmt->rowsets, sizeof(chidb_dbm_rowset_t) * (op->p1 + 1));
+        if (rowsets == NULL)
+            return CHIDB_ENOMEM;
+
+        memset(&rowsets[stmt->nRowSets], 0, sizeof(chidb_dbm_rowset_t) * (op->p1 + 1 - stmt->nRowSets));
+        stmt->rowsets = rowsets;
+        stmt->nRowSets = op->p1 + 1;
+    }
+
+    chidb_dbm_rowset_t *rs = &stmt->rowsets[op->p1];
+
+    if (rs->nentries == rs->size)
+    {
+        uint32_t size = rs->size ? rs->size * 2 : 64;
+        uint64_t *entries = realloc(rs->entries, sizeof(uint64_t) * size);
+        if (entries == NULL)
+            return CHIDB_ENOMEM;
+
+        rs->entries = entries;
+        rs->size = size;
+    }
+
+    rs->entries[rs->nentries++] = ((uint64_t) (uint32_t) stmt->reg[op->p2].value.i << 32)
+                                | (uint32_t) stmt->reg[op->p3].value.i;
+    rs->sorted = false;
+
+    return CHIDB_OK;
+}
+
+// 按rowid从小到大的顺序取出第p1个row set中的下一项, rowid放入寄存器p3,
+// 其值放入寄存器p3 + 1, 已经取完时跳转到p2
+int chidb_dbm_op_RowSetRead (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_rowset_t *rs = op->p1 < stmt->nRowSets ? &stmt->rowsets[op->p1] : NULL;
+
+    if (rs == NULL || rs->next >= rs->nentries)
+    {
+        stmt->pc = op->p2;
+        return CHIDB_OK;
+    }
+
+    // 第一次读取时排序并去掉重复的项
+    if (!rs->sorted)
+    {
+        qsort(rs->entries, rs->nentries, sizeof(uint64_t), rowset_cmp);
+
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < rs->nentries; i++)
+            if (n == 0 || rs->entries[i] != rs->entries[n - 1])
+                rs->entries[n++] = rs->entries[i];
+        rs->nentries = n;
+        rs->sorted = true;
+    }
+
+    uint64_t entry = rs->entries[rs->next++];
+    int32_t rowid = (int32_t) (entry >> 32), value = (int32_t) entry;
+
+    chidb_dbm_op_WriteReg(stmt, op->p3, REG_INT32, &rowid);
+    return chidb_dbm_op_WriteReg(stmt, op->p3 + 1, REG_INT32, &value);
+}
+
+// 把寄存器p3中的记录(由MakeRecord生成)以寄存器p2中的整数为key加入第p1个hash表,
+// key为NULL的记录不会与任何行相等, 所以不加入
+int chidb_dbm_op_HashAdd (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    // hash表在第一次使用时才分配
+    if (op->p1 >= stmt->nHashes)
+    {
+        chidb_dbm_hash_t *hashes = realloc(stmt->hashes, sizeof(chidb_dbm_hash_t) * (op->p1 + 1));
+        if (hashes == NULL)
+            return CHIDB_ENOMEM;
+
+        for (uint32_t i = stmt->nHashes; i <= op->p1; i++)
+            chidb_dbm_hash_init(&hashes[i], DBM_HASH_MEMORY);
+        stmt->hashes = hashes;
+        stmt->nHashes = op->p1 + 1;
+    }
+
+    chidb_dbm_register_t *key = &stmt->reg[op->p2];
+    chidb_dbm_register_t *record = &stmt->reg[op->p3];
+
+    if (key->type != REG_INT32)
+        return CHIDB_OK;
+
+    if (record->type != REG_BINARY)
+        return CHIDB_EMISMATCH;
+
+    return chidb_dbm_hash_add(&stmt->hashes[op->p1], key->value.i,
+                              record->value.bin.bytes, record->value.bin.nbytes);
+}
+
+// 在第p1个hash表中查找key为寄存器p3中的整数的第一个记录,
+// 没有时(或key为NULL, 或hash表为空)跳转到p2
+int chidb_dbm_op_HashSeek (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_register_t *key = &stmt->reg[op->p3];
+    int rc = CHIDB_ENOTFOUND;
+
+    if (op->p1 < stmt->nHashes && key->type == REG_INT32)
+        rc = chidb_dbm_hash_seek(&stmt->hashes[op->p1], key->value.i);
+
+    if (rc == CHIDB_ENOTFOUND)
+    {
+        stmt->pc = op->p2;
+        return CHIDB_OK;
+    }
+
+    return rc;
+}
+
+// 第p1个hash表中还有与上次查找的key相同的记录时, 移动到该记录并跳转到p2
+int chidb_dbm_op_HashNext (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    if (op->p1 < stmt->nHashes && chidb_dbm_hash_next(&stmt->hashes[op->p1]) == CHIDB_OK)
+        stmt->pc = op->p2;
+
+    return CHIDB_OK;
+}
+
+// 按类型将第p1个hash表的当前记录中第p2列的值存入寄存器p3中
+int chidb_dbm_op_HashColumn (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    uint8_t *record;
+    DBRecordView dbrv;
+    int rc;
+
+    if (op->p1 >= stmt->nHashes)
+        return CHIDB_PROBLEM;
+
+    if ((rc = chidb_dbm_hash_record(&stmt->hashes[op->p1], &record)) != CHIDB_OK)
+        return rc == CHIDB_ENOTFOUND ? CHIDB_PROBLEM : rc;
+
+    chidb_DBRecord_view(&dbrv, record);
+
+    return chidb_dbm_view_column(stmt, &dbrv, op->p2, op->p3);
+}
+
+// 打开第p1个sorter(已有的记录被清空), p2不为0时按降序排序,
+// p3为sorter在内存中保留的字节数(0时使用DBM_SORTER_MEMORY)
+int chidb_dbm_op_SorterOpen (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    if (op->p1 >= stmt->nSorters)
+    {
+        chidb_dbm_sorter_t *sorters = realloc(stmt->sorters, sizeof(chidb_dbm_sorter_t) * (op->p1 + 1));
+        if (sorters == NULL)
+            return CHIDB_ENOMEM;
+
+        for (uint32_t i = stmt->nSorters; i <= op->p1; i++)
+            chidb_dbm_sorter_init(&sorters[i], DBM_SORTER_MEMORY, false);
+        stmt->sorters = sorters;
+        stmt->nSorters = op->p1 + 1;
+    }
+
+    chidb_dbm_sorter_destroy(&stmt->sorters[op->p1]);
+    chidb_dbm_sorter_init(&stmt->sorters[op->p1], op->p3 > 0 ? op->p3 : DBM_SORTER_MEMORY, op->p2 != 0);
+
+    return CHIDB_OK;
+}
+
+// 把寄存器p3中的记录(由MakeRecord生成)以寄存器p2中的值为key加入第p1个sorter
+int chidb_dbm_op_SorterInsert (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    chidb_dbm_register_t *key = &stmt->reg[op->p2];
+    chidb_dbm_register_t *record = &stmt->reg[op->p3];
+
+    if (op->p1 >= stmt->nSorters)
+        return CHIDB_PROBLEM;
+
+    if (record->type != REG_BINARY)
+        return CHIDB_EMISMATCH;
+
+    if (key->type == REG_INT32)
+        return chidb_dbm_sorter_insert(&stmt->sorters[op->p1], DBM_SORTER_INT, key->value.i, NULL,
+                                       record->value.bin.bytes, record->value.bin.nbytes);
+    else if (key->type == REG_STRING)
+        return chidb_dbm_sorter_insert(&stmt->sorters[op->p1], DBM_SORTER_TEXT, 0, key->value.s,
+                                       record->value.bin.bytes, record->value.bin.nbytes);
+    else
+        return chidb_dbm_sorter_insert(&stmt->sorters[op->p1], DBM_SORTER_NULL, 0, NULL,
+                                       record->value.bin.bytes, record->value.bin.nbytes);
+}
+
+// 对第p1个sorter排序并移动到第一个记录, sorter为空时跳转到p2
+int chidb_dbm_op_SorterSort (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    int rc;
+
+    if (op->p1 >= stmt->nSorters)
+        return CHIDB_PROBLEM;
+
+    rc = chidb_dbm_sorter_sort(&stmt->sorters[op->p1]);
+    if (rc == CHIDB_ENOTFOUND)
+        stmt->pc = op->p2;
+    else if (rc != CHIDB_OK)
+        return rc;
+
+    return CHIDB_OK;
+}
+
+// 第p1个sorter中还有记录时, 移动到下一个记录并跳转到p2
+int chidb_dbm_op_SorterNext (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    int rc;
+
+    if (op->p1 >= stmt->nSorters)
+        return CHIDB_PROBLEM;
+
+    rc = chidb_dbm_sorter_next(&stmt->sorters[op->p1]);
+    if (rc == CHIDB_OK)
+        stmt->pc = op->p2;
+    else if (rc != CHIDB_ENOTFOUND)
+        return rc;
+
+    return CHIDB_OK;
+}
+
+// 按类型将第p1个sorter的当前记录中第p2列的值存入寄存器p3中
+int chidb_dbm_op_SorterData (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    uint8_t *record;
+    DBRecordView dbrv;
+    int rc;
+
+    if (op->p1 >= stmt->nSorters)
+        return CHIDB_PROBLEM;
+
+    if ((rc = chidb_dbm_sorter_record(&stmt->sorters[op->p1], &record)) != CHIDB_OK)
+        return rc == CHIDB_ENOTFOUND ? CHIDB_PROBLEM : rc;
+
+    chidb_DBRecord_view(&dbrv, record);
+
+    return chidb_dbm_view_column(stmt, &dbrv, op->p2, op->p3);
+}
+
+// p1为0时开始事务(BEGIN); p1为1时结束事务, p2为0则提交(COMMIT), 否则回滚(ROLLBACK)
+int chidb_dbm_op_AutoCommit (chidb_stmt *stmt, chidb_dbm_op_t *op)
+{
+    if (op->p1 == 0)
+        return chidb_begin(stmt->db);
+    else if (op->p2 == 0)
+        return chidb_commit(stmt->db);
+    else
+        return chidb_rollback(stmt->db);
+}
+
+// 结束程序, p1不为CHIDB_OK时作为错误码返回
 int chidb_dbm_op_Halt (chidb_stmt *stmt, chidb_dbm_op_t *op)
 {
+    if (op->p1 != CHIDB_OK)
+        return op->p1;
+
     return CHIDB_DONE;
 }
 
 int chidb_dbm_op_WriteReg (chidb_stmt *stmt, int regNo, int reg_type, void *data)
 {
-    if (IS_VALID_REGISTER(stmt, regNo) && regNo > stmt->nReg)
-        realloc_reg(stmt, regNo);
-
     chidb_dbm_register_t *reg = &(stmt->reg[regNo]);
     reg->type = reg_type;
 
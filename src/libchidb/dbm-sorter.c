@@ -0,0 +1,644 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ * This module implements the sorters used by the DBM for ORDER BY
+ * (SorterOpen, SorterInsert, SorterSort, SorterNext and SorterData).
+ * Each entry (the sort key followed by a record) is packed into an
+ * arena. When the arena reaches the budget of the sorter, its entries
+ * are sorted and written to a temporary file as a run, and the arena is
+ * reused. Sorting then either sorts the arena, if nothing was written,
+ * or writes the rest as a last run and merges all the runs, reading
+ * each one through a small buffer. When there are more than
+ * DBM_SORTER_FANIN runs, groups of them are merged into longer runs
+ * first, so the memory used to merge does not depend on their number.
+ *
+ * Entries are sorted with a merge sort, and runs are merged in the
+ * order in which they were written, so that entries with the same key
+ * keep the order in which they were added.
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "chidbInt.h"
+#include "dbm-sorter.h"
+
+/* An entry is made up of the size of the record (4 bytes), the type of
+ * the key (1 byte), the integer key or the length of the text key
+ * (4 bytes), the text of the key and the record */
+#define ENTRY_HEADER (9)
+
+
+/* Initialize a sorter
+ *
+ * Parameters
+ * - s: Sorter
+ * - budget: Bytes of entries that the sorter can keep in memory
+ * - desc: Sort in descending order?
+ */
+void chidb_dbm_sorter_init(chidb_dbm_sorter_t *s, uint32_t budget, bool desc)
+{
+    memset(s, 0, sizeof(chidb_dbm_sorter_t));
+    s->budget = budget;
+    s->desc = desc;
+}
+
+
+/* Free the memory and the temporary file of a sorter
+ *
+ * The sorter is left empty, and can be used again.
+ *
+ * Parameters
+ * - s: Sorter
+ */
+void chidb_dbm_sorter_destroy(chidb_dbm_sorter_t *s)
+{
+    for(uint32_t i = 0; i < s->nruns; i++)
+    {
+        free(s->runs[i].block);
+        free(s->runs[i].entry);
+    }
+    free(s->runs);
+    free(s->arena);
+    free(s->entries);
+    free(s->out);
+    free(s->heap);
+    if(s->spill != NULL)
+        fclose(s->spill);
+
+    chidb_dbm_sorter_init(s, s->budget, s->desc);
+}
+
+
+static uint32_t chidb_dbm_sorter_entry_size(uint8_t *e)
+{
+    uint32_t nbytes, n;
+
+    memcpy(&nbytes, e, 4);
+    memcpy(&n, e + 5, 4);
+
+    return ENTRY_HEADER + (e[4] == DBM_SORTER_TEXT ? n : 0) + nbytes;
+}
+
+
+static int chidb_dbm_sorter_compare(chidb_dbm_sorter_t *s, uint8_t *a, uint8_t *b)
+{
+    int c = 0;
+
+    if(a[4] != b[4])
+        c = a[4] < b[4] ? -1 : 1;
+    else if(a[4] == DBM_SORTER_INT)
+    {
+        int32_t x, y;
+        memcpy(&x, a + 5, 4);
+        memcpy(&y, b + 5, 4);
+        c = (x > y) - (x < y);
+    }
+    else if(a[4] == DBM_SORTER_TEXT)
+    {
+        uint32_t n, m;
+        memcpy(&n, a + 5, 4);
+        memcpy(&m, b + 5, 4);
+        c = memcmp(a + ENTRY_HEADER, b + ENTRY_HEADER, n < m ? n : m);
+        if(c == 0)
+            c = (n > m) - (n < m);
+    }
+
+    return s->desc ? -c : c;
+}
+
+
+/* Sorts the entries in the arena (a bottom-up merge sort, so that it is
+ * stable) */
+static int chidb_dbm_sorter_sort_memory(chidb_dbm_sorter_t *s)
+{
+    uint32_t n = s->nentries;
+    uint32_t *src = s->entries, *dst, *tmp;
+
+    if(n < 2)
+        return CHIDB_OK;
+    if((tmp = malloc(sizeof(uint32_t) * n)) == NULL)
+        return CHIDB_ENOMEM;
+    dst = tmp;
+
+    for(uint32_t width = 1; width < n; width *= 2)
+    {
+        for(uint32_t lo = 0; lo < n; lo += 2 * width)
+        {
+            uint32_t mid = lo + width < n ? lo + width : n;
+            uint32_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            uint32_t i = lo, j = mid, k = lo;
+
+            while(i < mid && j < hi)
+            {
+                if(chidb_dbm_sorter_compare(s, s->arena + src[j], s->arena + src[i]) < 0)
+                    dst[k++] = src[j++];
+                else
+                    dst[k++] = src[i++];
+            }
+            while(i < mid)
+                dst[k++] = src[i++];
+            while(j < hi)
+                dst[k++] = src[j++];
+        }
+
+        uint32_t *t = src;
+        src = dst;
+        dst = t;
+    }
+
+    if(src != s->entries)
+        memcpy(s->entries, src, sizeof(uint32_t) * n);
+    free(tmp);
+
+    return CHIDB_OK;
+}
+
+
+/* Appends bytes to the run being written */
+static int chidb_dbm_sorter_write(chidb_dbm_sorter_t *s, uint8_t *data, uint32_t n)
+{
+    if(s->out == NULL && (s->out = malloc(DBM_SORTER_BLOCK)) == NULL)
+        return CHIDB_ENOMEM;
+
+    while(n > 0)
+    {
+        uint32_t chunk = DBM_SORTER_BLOCK - s->nout < n ? DBM_SORTER_BLOCK - s->nout : n;
+        memcpy(s->out + s->nout, data, chunk);
+        s->nout += chunk;
+        data += chunk;
+        n -= chunk;
+
+        if(s->nout == DBM_SORTER_BLOCK)
+        {
+            if(fseek(s->spill, 0, SEEK_END) != 0 ||
+               fwrite(s->out, 1, s->nout, s->spill) != s->nout)
+                return CHIDB_EIO;
+            s->written += s->nout;
+            s->nout = 0;
+        }
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Writes what is left of the run being written */
+static int chidb_dbm_sorter_flush(chidb_dbm_sorter_t *s)
+{
+    if(s->nout > 0)
+    {
+        if(fseek(s->spill, 0, SEEK_END) != 0 ||
+           fwrite(s->out, 1, s->nout, s->spill) != s->nout)
+            return CHIDB_EIO;
+        s->written += s->nout;
+        s->nout = 0;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Adds an empty run, starting at the end of the temporary file, at
+ * position i of the runs */
+static int chidb_dbm_sorter_new_run(chidb_dbm_sorter_t *s, uint32_t i)
+{
+    if(s->spill == NULL && (s->spill = tmpfile()) == NULL)
+        return CHIDB_EIO;
+
+    if(s->nruns == s->sizeRuns)
+    {
+        uint32_t sizeRuns = s->sizeRuns ? s->sizeRuns * 2 : 16;
+        chidb_dbm_sorter_run_t *runs = realloc(s->runs, sizeof(chidb_dbm_sorter_run_t) * sizeRuns);
+        if(runs == NULL)
+            return CHIDB_ENOMEM;
+
+        s->runs = runs;
+        s->sizeRuns = sizeRuns;
+    }
+
+    memmove(&s->runs[i + 1], &s->runs[i], sizeof(chidb_dbm_sorter_run_t) * (s->nruns - i));
+    memset(&s->runs[i], 0, sizeof(chidb_dbm_sorter_run_t));
+    s->runs[i].pos = s->runs[i].end = s->written;
+    s->nruns++;
+
+    return CHIDB_OK;
+}
+
+
+/* Sorts the entries in the arena and writes them as the last run */
+static int chidb_dbm_sorter_spill(chidb_dbm_sorter_t *s)
+{
+    int rc;
+
+    if((rc = chidb_dbm_sorter_sort_memory(s)) != CHIDB_OK ||
+       (rc = chidb_dbm_sorter_new_run(s, s->nruns)) != CHIDB_OK)
+        return rc;
+
+    for(uint32_t i = 0; i < s->nentries; i++)
+    {
+        uint8_t *e = s->arena + s->entries[i];
+        if((rc = chidb_dbm_sorter_write(s, e, chidb_dbm_sorter_entry_size(e))) != CHIDB_OK)
+            return rc;
+    }
+    if((rc = chidb_dbm_sorter_flush(s)) != CHIDB_OK)
+        return rc;
+
+    s->runs[s->nruns - 1].end = s->written;
+    s->used = 0;
+    s->nentries = 0;
+
+    return CHIDB_OK;
+}
+
+
+/* Add a record to a sorter
+ *
+ * Records can only be added before the sorter is sorted.
+ *
+ * Parameters
+ * - s: Sorter
+ * - type: Type of the key (DBM_SORTER_NULL, DBM_SORTER_INT or DBM_SORTER_TEXT)
+ * - value: Integer key
+ * - text: Text key
+ * - record: Record (it is copied into the sorter)
+ * - nbytes: Size of the record
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The sorter was already sorted
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: Could not write to the temporary file
+ */
+int chidb_dbm_sorter_insert(chidb_dbm_sorter_t *s, uint8_t type, int32_t value, const char *text,
+                            uint8_t *record, uint32_t nbytes)
+{
+    uint32_t n = type == DBM_SORTER_TEXT ? strlen(text) : (uint32_t) value;
+    uint32_t size = ENTRY_HEADER + (type == DBM_SORTER_TEXT ? n : 0) + nbytes;
+    int rc;
+
+    if(s->sorted)
+        return CHIDB_EMISUSE;
+
+    // 放不下时把内存中的项作为一个run写出
+    if(s->nentries > 0 && s->used + size > s->budget &&
+       (rc = chidb_dbm_sorter_spill(s)) != CHIDB_OK)
+        return rc;
+
+    if(s->used + size > s->sizeArena)
+    {
+        uint32_t sizeArena = s->sizeArena ? s->sizeArena * 2 : 64 * 1024;
+        while(sizeArena < s->used + size)
+            sizeArena *= 2;
+        if(sizeArena > s->budget && s->used + size <= s->budget)
+            sizeArena = s->budget;
+
+        uint8_t *arena = realloc(s->arena, sizeArena);
+        if(arena == NULL)
+            return CHIDB_ENOMEM;
+
+        s->arena = arena;
+        s->sizeArena = sizeArena;
+    }
+
+    if(s->nentries == s->sizeEntries)
+    {
+        uint32_t sizeEntries = s->sizeEntries ? s->sizeEntries * 2 : 256;
+        uint32_t *entries = realloc(s->entries, sizeof(uint32_t) * sizeEntries);
+        if(entries == NULL)
+            return CHIDB_ENOMEM;
+
+        s->entries = entries;
+        s->sizeEntries = sizeEntries;
+    }
+
+    uint8_t *e = s->arena + s->used;
+    memcpy(e, &nbytes, 4);
+    e[4] = type;
+    memcpy(e + 5, &n, 4);
+    if(type == DBM_SORTER_TEXT)
+        memcpy(e + ENTRY_HEADER, text, n);
+    memcpy(e + size - nbytes, record, nbytes);
+
+    s->entries[s->nentries++] = s->used;
+    s->used += size;
+
+    return CHIDB_OK;
+}
+
+
+/* Reads bytes of a run */
+static int chidb_dbm_sorter_read(chidb_dbm_sorter_t *s, chidb_dbm_sorter_run_t *run,
+                                 uint8_t *dst, uint32_t n)
+{
+    while(n > 0)
+    {
+        if(run->at == run->nblock)
+        {
+            uint32_t len = run->end - run->pos < DBM_SORTER_BLOCK ? run->end - run->pos : DBM_SORTER_BLOCK;
+
+            if(len == 0)
+                return CHIDB_EIO;
+            if(run->block == NULL && (run->block = malloc(DBM_SORTER_BLOCK)) == NULL)
+                return CHIDB_ENOMEM;
+            if(fseek(s->spill, run->pos, SEEK_SET) != 0 ||
+               fread(run->block, 1, len, s->spill) != len)
+                return CHIDB_EIO;
+
+            run->pos += len;
+            run->nblock = len;
+            run->at = 0;
+        }
+
+        uint32_t chunk = run->nblock - run->at < n ? run->nblock - run->at : n;
+        memcpy(dst, run->block + run->at, chunk);
+        run->at += chunk;
+        dst += chunk;
+        n -= chunk;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Reads the next entry of a run. Returns CHIDB_ENOTFOUND at its end */
+static int chidb_dbm_sorter_load(chidb_dbm_sorter_t *s, chidb_dbm_sorter_run_t *run)
+{
+    uint8_t header[ENTRY_HEADER];
+    int rc;
+
+    if(run->at == run->nblock && run->pos == run->end)
+        return CHIDB_ENOTFOUND;
+
+    if((rc = chidb_dbm_sorter_read(s, run, header, ENTRY_HEADER)) != CHIDB_OK)
+        return rc;
+
+    uint32_t size = chidb_dbm_sorter_entry_size(header);
+    if(size > run->sizeEntry)
+    {
+        uint8_t *entry = realloc(run->entry, size);
+        if(entry == NULL)
+            return CHIDB_ENOMEM;
+
+        run->entry = entry;
+        run->sizeEntry = size;
+    }
+
+    memcpy(run->entry, header, ENTRY_HEADER);
+
+    return chidb_dbm_sorter_read(s, run, run->entry + ENTRY_HEADER, size - ENTRY_HEADER);
+}
+
+
+/* Is the current entry of run a before that of run b? Earlier runs go
+ * first when the keys are the same */
+static bool chidb_dbm_sorter_before(chidb_dbm_sorter_t *s, uint32_t a, uint32_t b)
+{
+    int c = chidb_dbm_sorter_compare(s, s->runs[a].entry, s->runs[b].entry);
+
+    return c < 0 || (c == 0 && a < b);
+}
+
+
+static void chidb_dbm_sorter_sift(chidb_dbm_sorter_t *s, uint32_t i)
+{
+    while(2 * i + 1 < s->nheap)
+    {
+        uint32_t child = 2 * i + 1;
+        if(child + 1 < s->nheap && chidb_dbm_sorter_before(s, s->heap[child + 1], s->heap[child]))
+            child++;
+        if(!chidb_dbm_sorter_before(s, s->heap[child], s->heap[i]))
+            break;
+
+        uint32_t t = s->heap[i];
+        s->heap[i] = s->heap[child];
+        s->heap[child] = t;
+        i = child;
+    }
+}
+
+
+/* Starts merging n runs, from run first */
+static int chidb_dbm_sorter_start_merge(chidb_dbm_sorter_t *s, uint32_t first, uint32_t n)
+{
+    int rc;
+
+    free(s->heap);
+    if((s->heap = malloc(sizeof(uint32_t) * n)) == NULL)
+        return CHIDB_ENOMEM;
+    s->nheap = 0;
+
+    for(uint32_t i = first; i < first + n; i++)
+    {
+        if((rc = chidb_dbm_sorter_load(s, &s->runs[i])) == CHIDB_OK)
+            s->heap[s->nheap++] = i;
+        else if(rc != CHIDB_ENOTFOUND)
+            return rc;
+    }
+
+    for(uint32_t i = s->nheap / 2; i > 0; i--)
+        chidb_dbm_sorter_sift(s, i - 1);
+
+    return CHIDB_OK;
+}
+
+
+/* Moves the run with the first entry to its next entry */
+static int chidb_dbm_sorter_advance(chidb_dbm_sorter_t *s)
+{
+    int rc = chidb_dbm_sorter_load(s, &s->runs[s->heap[0]]);
+
+    if(rc == CHIDB_ENOTFOUND)
+        s->heap[0] = s->heap[--s->nheap];
+    else if(rc != CHIDB_OK)
+        return rc;
+
+    chidb_dbm_sorter_sift(s, 0);
+
+    return CHIDB_OK;
+}
+
+
+/* Merges n runs, from run first, into a single run that replaces them */
+static int chidb_dbm_sorter_merge(chidb_dbm_sorter_t *s, uint32_t first, uint32_t n)
+{
+    int rc;
+
+    if((rc = chidb_dbm_sorter_new_run(s, first + n)) != CHIDB_OK ||
+       (rc = chidb_dbm_sorter_start_merge(s, first, n)) != CHIDB_OK)
+        return rc;
+
+    while(s->nheap > 0)
+    {
+        uint8_t *e = s->runs[s->heap[0]].entry;
+        if((rc = chidb_dbm_sorter_write(s, e, chidb_dbm_sorter_entry_size(e))) != CHIDB_OK ||
+           (rc = chidb_dbm_sorter_advance(s)) != CHIDB_OK)
+            return rc;
+    }
+    if((rc = chidb_dbm_sorter_flush(s)) != CHIDB_OK)
+        return rc;
+
+    s->runs[first + n].end = s->written;
+
+    for(uint32_t i = first; i < first + n; i++)
+    {
+        free(s->runs[i].block);
+        free(s->runs[i].entry);
+    }
+    memmove(&s->runs[first], &s->runs[first + n], sizeof(chidb_dbm_sorter_run_t) * (s->nruns - first - n));
+    s->nruns -= n;
+
+    return CHIDB_OK;
+}
+
+
+/* Sort the records of a sorter, and move to the first one
+ *
+ * Parameters
+ * - s: Sorter
+ *
+ * Return
+ * - CHIDB_OK: The first record is now the current record
+ * - CHIDB_ENOTFOUND: The sorter is empty
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: Could not read from or write to the temporary file
+ */
+int chidb_dbm_sorter_sort(chidb_dbm_sorter_t *s)
+{
+    int rc;
+
+    s->sorted = true;
+    s->entry = NULL;
+
+    // 所有的项都在内存中
+    if(s->nruns == 0)
+    {
+        if((rc = chidb_dbm_sorter_sort_memory(s)) != CHIDB_OK)
+            return rc;
+
+        s->current = 0;
+        if(s->nentries == 0)
+            return CHIDB_ENOTFOUND;
+        s->entry = s->arena + s->entries[0];
+
+        return CHIDB_OK;
+    }
+
+    if(s->nentries > 0 && (rc = chidb_dbm_sorter_spill(s)) != CHIDB_OK)
+        return rc;
+
+    // run太多时先合并成较长的run
+    while(s->nruns > DBM_SORTER_FANIN)
+    {
+        for(uint32_t first = 0; first < s->nruns; first++)
+        {
+            uint32_t n = s->nruns - first < DBM_SORTER_FANIN ? s->nruns - first : DBM_SORTER_FANIN;
+            if(n > 1 && (rc = chidb_dbm_sorter_merge(s, first, n)) != CHIDB_OK)
+                return rc;
+        }
+    }
+
+    if((rc = chidb_dbm_sorter_start_merge(s, 0, s->nruns)) != CHIDB_OK)
+        return rc;
+    if(s->nheap == 0)
+        return CHIDB_ENOTFOUND;
+    s->entry = s->runs[s->heap[0]].entry;
+
+    return CHIDB_OK;
+}
+
+
+/* Move to the next record of a sorted sorter
+ *
+ * Parameters
+ * - s: Sorter
+ *
+ * Return
+ * - CHIDB_OK: The next record is now the current record
+ * - CHIDB_ENOTFOUND: There are no more records
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: Could not read from the temporary file
+ */
+int chidb_dbm_sorter_next(chidb_dbm_sorter_t *s)
+{
+    int rc;
+
+    if(s->entry == NULL)
+        return CHIDB_ENOTFOUND;
+    s->entry = NULL;
+
+    if(s->nruns == 0)
+    {
+        if(++s->current >= s->nentries)
+            return CHIDB_ENOTFOUND;
+        s->entry = s->arena + s->entries[s->current];
+
+        return CHIDB_OK;
+    }
+
+    if((rc = chidb_dbm_sorter_advance(s)) != CHIDB_OK)
+        return rc;
+    if(s->nheap == 0)
+        return CHIDB_ENOTFOUND;
+    s->entry = s->runs[s->heap[0]].entry;
+
+    return CHIDB_OK;
+}
+
+
+/* Get the current record
+ *
+ * The record remains valid until the sorter moves to the next one.
+ *
+ * Parameters
+ * - s: Sorter
+ * - record: Out parameter. The record.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: There is no current record
+ */
+int chidb_dbm_sorter_record(chidb_dbm_sorter_t *s, uint8_t **record)
+{
+    uint32_t nbytes;
+
+    if(s->entry == NULL)
+        return CHIDB_ENOTFOUND;
+
+    memcpy(&nbytes, s->entry, 4);
+    *record = s->entry + chidb_dbm_sorter_entry_size(s->entry) - nbytes;
+
+    return CHIDB_OK;
+}
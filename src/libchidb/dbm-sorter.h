@@ -0,0 +1,111 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  DBM sorter header. See dbm-sorter.c for more details.
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef DBM_SORTER_H_
+#define DBM_SORTER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Bytes of entries that a sorter keeps in memory before it writes them,
+ * sorted, to a temporary file as a run */
+#define DBM_SORTER_MEMORY (8 * 1024 * 1024)
+
+/* Size of the buffer used to read (and to write) each run */
+#define DBM_SORTER_BLOCK (32 * 1024)
+
+/* Runs merged at once. When there are more, groups of runs are first
+ * merged into longer runs */
+#define DBM_SORTER_FANIN (16)
+
+/* Types of the sort key */
+#define DBM_SORTER_NULL (0)
+#define DBM_SORTER_INT  (1)
+#define DBM_SORTER_TEXT (2)
+
+typedef struct chidb_dbm_sorter_run
+{
+    long pos;           /* Position of the next byte to read into the block */
+    long end;           /* End of the run in the temporary file */
+    uint8_t *block;
+    uint32_t nblock;    /* Bytes in the block */
+    uint32_t at;        /* Next byte of the block to read */
+    uint8_t *entry;     /* Current entry of the run */
+    uint32_t sizeEntry;
+} chidb_dbm_sorter_run_t;
+
+/* Sorts records by a key (NULL first, then integers, then text). Records
+ * with the same key are returned in the order in which they were added */
+typedef struct chidb_dbm_sorter
+{
+    bool desc;              /* Sort in descending order */
+    uint32_t budget;        /* Bytes of entries that can be kept in memory */
+
+    uint8_t *arena;         /* Entries, packed one after the other */
+    uint32_t used;
+    uint32_t sizeArena;
+    uint32_t *entries;      /* Offset of each entry in the arena */
+    uint32_t nentries;
+    uint32_t sizeEntries;
+
+    FILE *spill;            /* Temporary file, created by the first run */
+    long written;           /* Bytes written to the temporary file */
+    chidb_dbm_sorter_run_t *runs;
+    uint32_t nruns;
+    uint32_t sizeRuns;
+    uint8_t *out;           /* Buffer of the run being written */
+    uint32_t nout;
+
+    bool sorted;
+    uint32_t *heap;         /* Runs being merged, by their current entry */
+    uint32_t nheap;
+    uint32_t current;       /* Next entry, when sorted in memory */
+    uint8_t *entry;         /* Current entry */
+} chidb_dbm_sorter_t;
+
+void chidb_dbm_sorter_init(chidb_dbm_sorter_t *s, uint32_t budget, bool desc);
+void chidb_dbm_sorter_destroy(chidb_dbm_sorter_t *s);
+int chidb_dbm_sorter_insert(chidb_dbm_sorter_t *s, uint8_t type, int32_t value, const char *text,
+                            uint8_t *record, uint32_t nbytes);
+int chidb_dbm_sorter_sort(chidb_dbm_sorter_t *s);
+int chidb_dbm_sorter_next(chidb_dbm_sorter_t *s);
+int chidb_dbm_sorter_record(chidb_dbm_sorter_t *s, uint8_t **record);
+
+#endif /* DBM_SORTER_H_ */
@@ -45,6 +45,8 @@
 #include <chidb/chisql.h>
 #include "chidbInt.h"
 #include "dbm-cursor.h"
+#include "dbm-hash.h"
+#include "dbm-sorter.h"
 
 #define DEFAULT_OPS_SIZE (50)
 #define DEFAULT_REG_SIZE (10)
@@ -93,10 +95,25 @@
         OP(IdxLe)       \
         OP(IdxPKey)     \
         OP(IdxInsert)   \
+        OP(IdxBulkAdd)  \
+        OP(IdxBulkBuild) \
         OP(CreateTable) \
         OP(CreateIndex) \
         OP(Copy)        \
         OP(SCopy)       \
+        OP(Goto)        \
+        OP(RowSetAdd)   \
+        OP(RowSetRead)  \
+        OP(HashAdd)     \
+        OP(HashSeek)    \
+        OP(HashNext)    \
+        OP(HashColumn)  \
+        OP(SorterOpen)  \
+        OP(SorterInsert) \
+        OP(SorterSort)  \
+        OP(SorterNext)  \
+        OP(SorterData)  \
+        OP(AutoCommit)  \
         OP(Halt)
 
 /* The following generates an enum type for the opcode. It expands to:
@@ -212,6 +229,19 @@ typedef struct chidb_dbm_register
 
 } chidb_dbm_register_t;
 
+/* A set of rowids, each with an integer value attached, filled with
+ * RowSetAdd and read back in increasing rowid order (and without
+ * duplicates) with RowSetRead. Each entry holds the rowid in its upper
+ * 32 bits and the value in the lower ones */
+typedef struct chidb_dbm_rowset
+{
+    uint64_t *entries;
+    uint32_t nentries;  /* Number of entries in the set */
+    uint32_t size;      /* Size of the entries array */
+    uint32_t next;      /* Next entry read by RowSetRead */
+    bool sorted;        /* Has the set been sorted (i.e. read)? */
+} chidb_dbm_rowset_t;
+
 /*  This is the struct that represents a single DBM program.
  *
  *  Notice how a single DBM program has its own registers and cursors;
@@ -264,6 +294,34 @@ struct chidb_stmt
      * per operation */
     bool explain;
 
+    /* Parameters (? and :name): the values bound with chidb_bind_*,
+     * which Integer and String instructions read when their p3 is not 0,
+     * and the names of the parameters (NULL for a ?). Only the first
+     * nUserParams are written in the SQL statement and can be bound by
+     * the API client; the rest are the literals that the statement
+     * cache turned into parameters */
+    chidb_dbm_register_t *params;
+    char **paramNames;
+    uint32_t nParams;
+    uint32_t nUserParams;
+
+    /* Row sets used by RowSetAdd and RowSetRead. They are allocated
+     * the first time a rowid is added to them */
+    chidb_dbm_rowset_t *rowsets;
+    uint32_t nRowSets;
+
+    /* Hash tables used by HashAdd, HashSeek, HashNext and HashColumn
+     * (hash joins). Same as row sets, they are allocated the first time
+     * a record is added to them */
+    chidb_dbm_hash_t *hashes;
+    uint32_t nHashes;
+
+    /* Sorters used by SorterOpen, SorterInsert, SorterSort, SorterNext
+     * and SorterData (ORDER BY), and by IdxBulkAdd and IdxBulkBuild
+     * (CREATE INDEX). They are allocated by SorterOpen */
+    chidb_dbm_sorter_t *sorters;
+    uint32_t nSorters;
+
     /* Additional fields go here */
 };
 
@@ -110,6 +110,20 @@ int chidb_stmt_init(chidb_stmt *stmt, chidb *db)
     stmt->cols = NULL;
     stmt->nCols = 0;
 
+    /* There are no parameters until the program is generated */
+    stmt->params = NULL;
+    stmt->paramNames = NULL;
+    stmt->nParams = 0;
+    stmt->nUserParams = 0;
+
+    /* Row sets, hash tables and sorters are only allocated when they are used */
+    stmt->rowsets = NULL;
+    stmt->nRowSets = 0;
+    stmt->hashes = NULL;
+    stmt->nHashes = 0;
+    stmt->sorters = NULL;
+    stmt->nSorters = 0;
+
     return CHIDB_OK;
 }
 
@@ -125,6 +139,30 @@ int chidb_stmt_init(chidb_stmt *stmt, chidb *db)
  */
 int chidb_stmt_free(chidb_stmt *stmt)
 {
+	// 释放仍然打开的游标所固定的页面
+	for(int i = 0; i < stmt->nCursors; i++)
+		if(stmt->cursors[i].type != CURSOR_UNSPECIFIED)
+			chidb_dbm_cursor_destroy(stmt->db->bt, &stmt->cursors[i]);
+
+	for(int i = 0; i < stmt->nParams; i++)
+	{
+		if(stmt->params[i].type == REG_STRING)
+			free(stmt->params[i].value.s);
+		free(stmt->paramNames[i]);
+	}
+	free(stmt->params);
+	free(stmt->paramNames);
+
+	for(int i = 0; i < stmt->nRowSets; i++)
+		free(stmt->rowsets[i].entries);
+	free(stmt->rowsets);
+	for(int i = 0; i < stmt->nHashes; i++)
+		chidb_dbm_hash_destroy(&stmt->hashes[i]);
+	free(stmt->hashes);
+	for(int i = 0; i < stmt->nSorters; i++)
+		chidb_dbm_sorter_destroy(&stmt->sorters[i]);
+	free(stmt->sorters);
+
 	free(stmt->ops);
 	free(stmt->reg);
 	free(stmt->cursors);
@@ -132,6 +170,115 @@ int chidb_stmt_free(chidb_stmt *stmt)
 }
 
 
+/* Copy a DBM
+ *
+ * Creates a new DBM with the same program, result columns, and
+ * parameters (without their values) as an existing one, ready to run.
+ *
+ * Parameters
+ * - src: DBM to copy. It must have been verified.
+ * - stmt: Out parameter. The new DBM (to be freed with chidb_stmt_free
+ *         and free)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_stmt_clone(chidb_stmt *src, chidb_stmt **stmt)
+{
+    chidb_stmt *s;
+    int rc;
+
+    if((s = malloc(sizeof(chidb_stmt))) == NULL)
+        return CHIDB_ENOMEM;
+    if((rc = chidb_stmt_init(s, src->db)) != CHIDB_OK)
+    {
+        free(s);
+        return rc;
+    }
+
+    for(int i = 0; i < src->endOp && rc == CHIDB_OK; i++)
+        rc = chidb_stmt_set_op(s, &src->ops[i], i);
+    if(rc == CHIDB_OK && src->nReg > s->nReg)
+        rc = realloc_reg(s, src->nReg);
+    if(rc == CHIDB_OK && src->nCursors > s->nCursors)
+        rc = realloc_cur(s, src->nCursors);
+    if(rc != CHIDB_OK)
+    {
+        chidb_stmt_free(s);
+        free(s);
+        return rc;
+    }
+
+    s->explain = src->explain;
+    s->startRR = src->startRR;
+    s->nRR = src->nRR;
+    s->nCols = src->nCols;
+    s->cols = malloc(sizeof(char *) * src->nCols);
+    for(int i = 0; i < src->nCols; i++)
+        s->cols[i] = strdup(src->cols[i]);
+
+    s->nParams = src->nParams;
+    s->nUserParams = src->nUserParams;
+    s->params = calloc(src->nParams, sizeof(chidb_dbm_register_t));
+    s->paramNames = calloc(src->nParams, sizeof(char *));
+    for(int i = 0; i < src->nParams; i++)
+        if(src->paramNames[i] != NULL)
+            s->paramNames[i] = strdup(src->paramNames[i]);
+
+    *stmt = s;
+
+    return CHIDB_OK;
+}
+
+/* Reset a DBM
+ *
+ * Rewinds the program so that it can be run again from the first
+ * instruction: the cursors are closed, and the registers, row sets,
+ * hash tables and sorters are emptied. The values bound to the
+ * parameters are kept.
+ *
+ * Parameters
+ * - stmt: DBM to reset
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_stmt_reset(chidb_stmt *stmt)
+{
+	for(int i = 0; i < stmt->nCursors; i++)
+		if(stmt->cursors[i].type != CURSOR_UNSPECIFIED)
+		{
+			chidb_dbm_cursor_destroy(stmt->db->bt, &stmt->cursors[i]);
+			stmt->cursors[i].type = CURSOR_UNSPECIFIED;
+		}
+
+	for(int i = 0; i < stmt->nReg; i++)
+	{
+		if(stmt->reg[i].type == REG_STRING)
+			free(stmt->reg[i].value.s);
+		else if(stmt->reg[i].type == REG_BINARY)
+			free(stmt->reg[i].value.bin.bytes);
+		stmt->reg[i].type = REG_UNSPECIFIED;
+	}
+
+	for(int i = 0; i < stmt->nRowSets; i++)
+	{
+		stmt->rowsets[i].nentries = 0;
+		stmt->rowsets[i].next = 0;
+		stmt->rowsets[i].sorted = false;
+	}
+	for(int i = 0; i < stmt->nHashes; i++)
+		chidb_dbm_hash_destroy(&stmt->hashes[i]);
+	for(int i = 0; i < stmt->nSorters; i++)
+		chidb_dbm_sorter_destroy(&stmt->sorters[i]);
+
+	stmt->pc = 0;
+
+	return CHIDB_OK;
+}
+
+
 /* Set the value of a specific instruction
  *
  * Given an instruction (of type chidb_dbm_op_t, which includes
@@ -170,8 +317,241 @@ int chidb_stmt_set_op(chidb_stmt *stmt, chidb_dbm_op_t *op, uint32_t pos)
     return CHIDB_OK;
 }
 
-/* Forward declaration of instruction handler. See dbm-ops.c for details */
-int chidb_dbm_op_handle (chidb_stmt *stmt, chidb_dbm_op_t *op);
+/* Operand kinds of each instruction, used by chidb_stmt_verify */
+typedef enum operand_kind
+{
+    OPND_NONE = 0,
+    OPND_REG_IN,    /* Register read by the instruction */
+    OPND_REG_OUT,   /* Register written by the instruction */
+    OPND_REG2_OUT,  /* Registers p and p+1 written by the instruction */
+    OPND_REGS_IN,   /* Registers p1 .. p1+p2-1 read by the instruction */
+    OPND_CURSOR,    /* Cursor */
+    OPND_ADDR,      /* Jump address */
+    OPND_PARAM,     /* Parameter (1..nParams), or 0 for none */
+    OPND_ROWSET,    /* Row set */
+    OPND_HASH,      /* Hash table */
+    OPND_SORTER     /* Sorter */
+} operand_kind_t;
+
+typedef struct operand_kinds
+{
+    operand_kind_t p1, p2, p3;
+    bool p4;        /* Is p4 required (unless a parameter is read)? */
+} operand_kinds_t;
+
+/* Operand kinds of each opcode. The table is generated from FOREACH_OP,
+ * so an opcode added there without its OPERANDS_ entry does not compile */
+#define OPERANDS_Noop         { OPND_NONE,    OPND_NONE,    OPND_NONE }
+#define OPERANDS_OpenRead     { OPND_CURSOR,  OPND_REG_IN,  OPND_NONE }
+#define OPERANDS_OpenWrite    { OPND_CURSOR,  OPND_REG_IN,  OPND_NONE }
+#define OPERANDS_Close        { OPND_CURSOR,  OPND_NONE,    OPND_NONE }
+#define OPERANDS_Rewind       { OPND_CURSOR,  OPND_ADDR,    OPND_NONE }
+#define OPERANDS_Next         { OPND_CURSOR,  OPND_ADDR,    OPND_NONE }
+#define OPERANDS_Prev         { OPND_CURSOR,  OPND_ADDR,    OPND_NONE }
+#define OPERANDS_Seek         { OPND_CURSOR,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_SeekGt       { OPND_CURSOR,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_SeekGe       { OPND_CURSOR,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_SeekLt       { OPND_CURSOR,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_SeekLe       { OPND_CURSOR,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_Column       { OPND_CURSOR,  OPND_NONE,    OPND_REG_OUT }
+#define OPERANDS_Key          { OPND_CURSOR,  OPND_REG_OUT, OPND_NONE }
+#define OPERANDS_Integer      { OPND_NONE,    OPND_REG_OUT, OPND_PARAM }
+#define OPERANDS_String       { OPND_NONE,    OPND_REG_OUT, OPND_PARAM,   true }
+#define OPERANDS_Null         { OPND_NONE,    OPND_REG_OUT, OPND_NONE }
+#define OPERANDS_ResultRow    { OPND_REGS_IN, OPND_NONE,    OPND_NONE }
+#define OPERANDS_MakeRecord   { OPND_REGS_IN, OPND_NONE,    OPND_REG_OUT }
+#define OPERANDS_Insert       { OPND_CURSOR,  OPND_REG_IN,  OPND_REG_IN }
+#define OPERANDS_Eq           { OPND_REG_IN,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_Ne           { OPND_REG_IN,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_Lt           { OPND_REG_IN,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_Le           { OPND_REG_IN,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_Gt           { OPND_REG_IN,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_Ge           { OPND_REG_IN,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_IdxGt        { OPND_CURSOR,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_IdxGe        { OPND_CURSOR,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_IdxLt        { OPND_CURSOR,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_IdxLe        { OPND_CURSOR,  OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_IdxPKey      { OPND_CURSOR,  OPND_REG_OUT, OPND_NONE }
+#define OPERANDS_IdxInsert    { OPND_CURSOR,  OPND_REG_IN,  OPND_REG_IN }
+#define OPERANDS_IdxBulkAdd   { OPND_REG_IN,  OPND_REG_IN,  OPND_SORTER }
+#define OPERANDS_IdxBulkBuild { OPND_REG_OUT, OPND_SORTER,  OPND_NONE }
+#define OPERANDS_CreateTable  { OPND_REG_OUT, OPND_NONE,    OPND_NONE }
+#define OPERANDS_CreateIndex  { OPND_REG_OUT, OPND_NONE,    OPND_NONE }
+#define OPERANDS_Copy         { OPND_REG_IN,  OPND_REG_OUT, OPND_NONE }
+#define OPERANDS_SCopy        { OPND_REG_IN,  OPND_REG_OUT, OPND_NONE }
+#define OPERANDS_Goto         { OPND_NONE,    OPND_ADDR,    OPND_NONE }
+#define OPERANDS_RowSetAdd    { OPND_ROWSET,  OPND_REG_IN,  OPND_REG_IN }
+#define OPERANDS_RowSetRead   { OPND_ROWSET,  OPND_ADDR,    OPND_REG2_OUT }
+#define OPERANDS_HashAdd      { OPND_HASH,    OPND_REG_IN,  OPND_REG_IN }
+#define OPERANDS_HashSeek     { OPND_HASH,    OPND_ADDR,    OPND_REG_IN }
+#define OPERANDS_HashNext     { OPND_HASH,    OPND_ADDR,    OPND_NONE }
+#define OPERANDS_HashColumn   { OPND_HASH,    OPND_NONE,    OPND_REG_OUT }
+#define OPERANDS_SorterOpen   { OPND_SORTER,  OPND_NONE,    OPND_NONE }
+#define OPERANDS_SorterInsert { OPND_SORTER,  OPND_REG_IN,  OPND_REG_IN }
+#define OPERANDS_SorterSort   { OPND_SORTER,  OPND_ADDR,    OPND_NONE }
+#define OPERANDS_SorterNext   { OPND_SORTER,  OPND_ADDR,    OPND_NONE }
+#define OPERANDS_SorterData   { OPND_SORTER,  OPND_NONE,    OPND_REG_OUT }
+#define OPERANDS_AutoCommit   { OPND_NONE,    OPND_NONE,    OPND_NONE }
+#define OPERANDS_Halt         { OPND_NONE,    OPND_NONE,    OPND_NONE }
+
+#define GENERATE_OPERANDS(ENUM) [Op_ ## ENUM] = OPERANDS_ ## ENUM,
+static const operand_kinds_t op_operands[] =
+{
+    FOREACH_OP(GENERATE_OPERANDS)
+};
+
+/* Checks a single operand, and records the registers and cursors it uses */
+static int verify_operand(chidb_stmt *stmt, operand_kind_t kind, int32_t p, int32_t n,
+                          int32_t *maxReg, int32_t *maxCur)
+{
+    switch(kind)
+    {
+    case OPND_NONE:
+        break;
+    case OPND_REG_IN:
+    case OPND_REG_OUT:
+        n = 1;
+        /* fall through */
+    case OPND_REG2_OUT:
+        if (kind == OPND_REG2_OUT)
+            n = 2;
+        /* fall through */
+    case OPND_REGS_IN:
+        if (p < 0 || n < 0)
+            return CHIDB_PROBLEM;
+        if (p + n - 1 > *maxReg)
+            *maxReg = p + n - 1;
+        break;
+    case OPND_CURSOR:
+        if (p < 0)
+            return CHIDB_PROBLEM;
+        if (p > *maxCur)
+            *maxCur = p;
+        break;
+    case OPND_ADDR:
+        /* Jumping to endOp simply ends the program */
+        if (p < 0 || p > stmt->endOp)
+            return CHIDB_PROBLEM;
+        break;
+    case OPND_PARAM:
+        if (p < 0 || p > stmt->nParams)
+            return CHIDB_PROBLEM;
+        break;
+    case OPND_ROWSET:
+    case OPND_HASH:
+    case OPND_SORTER:
+        if (p < 0)
+            return CHIDB_PROBLEM;
+        break;
+    }
+
+    return CHIDB_OK;
+}
+
+/* Verify a DBM program
+ *
+ * Checks every instruction of the program once, before it is run, so
+ * that the instruction handlers do not have to check their operands
+ * each time they are executed: opcodes must be valid, jump addresses
+ * must be inside the program, registers, cursors, row sets, hash
+ * tables and sorters cannot be negative, every register that is read
+ * must be written by some instruction, every cursor that is used must
+ * be opened by some instruction, and parameters must exist. The
+ * register and cursor arrays are then made large enough for all the
+ * registers and cursors the program uses.
+ *
+ * Parameters
+ * - stmt: DBM to verify
+ *
+ * Return
+ * - CHIDB_OK: The program is valid
+ * - CHIDB_PROBLEM: The program is not valid
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_stmt_verify(chidb_stmt *stmt)
+{
+    int32_t maxReg = -1, maxCur = -1;
+    int rc;
+
+    for(int i=0; i < stmt->endOp; i++)
+    {
+        chidb_dbm_op_t *op = &stmt->ops[i];
+
+        if (op->opcode < 0 || op->opcode > Op_Halt)
+            return CHIDB_PROBLEM;
+
+        const operand_kinds_t *k = &op_operands[op->opcode];
+
+        if ((rc = verify_operand(stmt, k->p1, op->p1, op->p2, &maxReg, &maxCur)) != CHIDB_OK ||
+            (rc = verify_operand(stmt, k->p2, op->p2, 0, &maxReg, &maxCur)) != CHIDB_OK ||
+            (rc = verify_operand(stmt, k->p3, op->p3, 0, &maxReg, &maxCur)) != CHIDB_OK)
+            return rc;
+
+        if (k->p4 && op->p4 == NULL && !(k->p3 == OPND_PARAM && op->p3 > 0))
+            return CHIDB_PROBLEM;
+    }
+
+    // 记录被写入的寄存器和被打开的游标
+    bool *written = calloc(maxReg + 1, sizeof(bool));
+    bool *opened = calloc(maxCur + 1, sizeof(bool));
+    if ((maxReg >= 0 && written == NULL) || (maxCur >= 0 && opened == NULL))
+    {
+        free(written);
+        free(opened);
+        return CHIDB_ENOMEM;
+    }
+
+    for(int i=0; i < stmt->endOp; i++)
+    {
+        chidb_dbm_op_t *op = &stmt->ops[i];
+        const operand_kinds_t *k = &op_operands[op->opcode];
+
+        if (k->p1 == OPND_REG_OUT)
+            written[op->p1] = true;
+        if (k->p2 == OPND_REG_OUT)
+            written[op->p2] = true;
+        if (k->p3 == OPND_REG_OUT)
+            written[op->p3] = true;
+        if (k->p3 == OPND_REG2_OUT)
+            written[op->p3] = written[op->p3 + 1] = true;
+        if (op->opcode == Op_OpenRead || op->opcode == Op_OpenWrite)
+            opened[op->p1] = true;
+    }
+
+    rc = CHIDB_OK;
+    for(int i=0; i < stmt->endOp && rc == CHIDB_OK; i++)
+    {
+        chidb_dbm_op_t *op = &stmt->ops[i];
+        const operand_kinds_t *k = &op_operands[op->opcode];
+
+        if ((k->p1 == OPND_REG_IN && !written[op->p1]) ||
+            (k->p2 == OPND_REG_IN && !written[op->p2]) ||
+            (k->p3 == OPND_REG_IN && !written[op->p3]) ||
+            (k->p1 == OPND_CURSOR && !opened[op->p1]))
+            rc = CHIDB_PROBLEM;
+
+        if (k->p1 == OPND_REGS_IN)
+            for(int r = op->p1; r < op->p1 + op->p2; r++)
+                if (!written[r])
+                    rc = CHIDB_PROBLEM;
+    }
+
+    free(written);
+    free(opened);
+
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (maxReg >= (int32_t) stmt->nReg && (rc = realloc_reg(stmt, maxReg + 1)) != CHIDB_OK)
+        return rc;
+    if (maxCur >= (int32_t) stmt->nCursors && (rc = realloc_cur(stmt, maxCur + 1)) != CHIDB_OK)
+        return rc;
+
+    return CHIDB_OK;
+}
+
+/* The interpreter loop. See dbm-ops.c for details */
+int chidb_dbm_run(chidb_stmt *stmt);
 
 
 /* Run the DBM
@@ -180,13 +560,16 @@ int chidb_dbm_op_handle (chidb_stmt *stmt, chidb_dbm_op_t *op);
  *
  *  - A ResultRow instruction is encountered. startRR and nRR are set
  *    to the appropriate values, and the function returns CHIDB_ROW
- *  - A Halt instruction is encountered, and CHIDB_DONE is returned.
+ *  - A Halt instruction is encountered, and CHIDB_DONE (or the error
+ *    code in its p1) is returned.
  *  - The end of the program is reached (the program counter goes
  *    beyond endOp), and CHIDB_DONE is returned.
  *  - Any of the instructions returns anything other than CHIDB_OK
  *    or CHIDB_ROW. The program stops executing and and the return
  *    value of the instruction handler is returned.
  *
+ * The program must have been checked with chidb_stmt_verify first.
+ *
  * Parameters
  * - stmt: DBM to run.
  *
@@ -197,21 +580,25 @@ int chidb_dbm_op_handle (chidb_stmt *stmt, chidb_dbm_op_t *op);
  */
 int chidb_stmt_exec(chidb_stmt *stmt)
 {
-    int rc = CHIDB_OK;
-
-    while(stmt->pc < stmt->endOp)
-    {
-        chidb_dbm_op_t *op = &stmt->ops[stmt->pc++];
-        rc = chidb_dbm_op_handle(stmt, op);
-
-        if (rc != CHIDB_OK)
-            break;
-    }
+    int rc = chidb_dbm_run(stmt);
 
     assert(stmt->nRR == stmt->nCols);
 
     if (rc == CHIDB_OK || rc == CHIDB_DONE)
-        rc = CHIDB_DONE;
+    {
+        /* Outside of a transaction, each statement is committed when it
+         * finishes */
+        if (!stmt->db->in_transaction)
+            rc = chidb_Btree_commit(stmt->db->bt);
+        if (rc == CHIDB_OK)
+            rc = CHIDB_DONE;
+    }
+    else if (rc != CHIDB_ROW && !stmt->db->in_transaction)
+    {
+        /* ... and a statement that fails leaves no changes behind */
+        chidb_Btree_rollback(stmt->db->bt);
+        stmt->db->need_refresh = 1;
+    }
 
     return rc;
 }
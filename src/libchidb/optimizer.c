@@ -84,6 +84,11 @@ int chidb_stmt_optimize(chidb *db, chisql_statement_t *sql_stmt, chisql_statemen
     // 设置为select类型
     chisql_statement_t *stmt_opt = *sql_stmt_opt;
     stmt_opt->type = STMT_SELECT;
+    stmt_opt->explain = sql_stmt->explain;
+    stmt_opt->text = sql_stmt->text;
+    // 参数仍属于原来的sql
+    stmt_opt->nparams = sql_stmt->nparams;
+    stmt_opt->params = sql_stmt->params;
     // 复制project的expr_list部分
     stmt_opt->stmt.select = malloc(sizeof(SRA_t));
     // 设置select类型为SRA_PROJECT
@@ -91,6 +96,11 @@ int chidb_stmt_optimize(chidb *db, chisql_statement_t *sql_stmt, chisql_statemen
     SRA_Project_t *project_opt = &stmt_opt->stmt.select->project;
     project_opt->expr_list = malloc(sizeof(Expression_t));
     memcpy(project_opt->expr_list, project->expr_list, sizeof(Expression_t));
+    // ORDER BY等选项与原来的相同
+    project_opt->order_by = project->order_by;
+    project_opt->asc_desc = project->asc_desc;
+    project_opt->distinct = project->distinct;
+    project_opt->group_by = project->group_by;
 
     // 为优化后的stmt生成narutaljoin
     project_opt->sra = malloc(sizeof(SRA_t));
@@ -136,9 +146,24 @@ int check_optionmizable(chisql_statement_t *sql_stmt)
     {
         SRA_Select_t *select = &project->sra->select;
 
-        if (select->sra->t == SRA_NATURAL_JOIN)
+        // 条件需要是单个比较, 且比较的列指明了属于连接左边的表,
+        // 这样把条件移到左边后连接的顺序(以及*返回的列的顺序)不变
+        if (select->sra->t == SRA_NATURAL_JOIN
+            && select->cond->t != RA_COND_AND
+            && select->cond->t != RA_COND_OR
+            && select->cond->t != RA_COND_NOT
+            && select->cond->t != RA_COND_IN)
         {
-            return 1;
+            SRA_t *left = select->sra->binary.sra1;
+            Expression_t *expr1 = select->cond->cond.comp.expr1;
+            ColumnReference_t *ref = expr1->expr.term.ref;
+
+            return left->t == SRA_TABLE
+                   && left->table.ref->alias == NULL
+                   && expr1->t == EXPR_TERM
+                   && expr1->expr.term.t == TERM_COLREF
+                   && ref->tableName != NULL
+                   && strcmp(ref->tableName, left->table.ref->table_name) == 0;
         }
     }
 
@@ -9,12 +9,15 @@
  * modify the page returned by the pager and instruct the pager to
  * write it back to disk.
  *
- * The default pager is very simple and always creates an in-memory copy
- * of any page that is read (even if that page has already been read before).
- * More specifically, pages are read into a MemPage structure, which must
- * be freed (using the releaseMemPage function) once they are not needed.
- * In a real database, the pager component typically does some caching
- * of pages to reduce the number of disk accesses.
+ * Pages are kept in a buffer pool of MemPage frames, replaced with the
+ * CLOCK algorithm. Reading a page pins its frame (reading the same page
+ * twice returns the same MemPage), and releaseMemPage unpins it once it
+ * is not needed; only unpinned frames are evicted. A page that is not
+ * cached is read from the write-ahead log if the log holds a copy of it,
+ * otherwise from the database file: in memory-mapped mode, the frame
+ * points into the mapping of the file instead of a private buffer.
+ * Modified pages go to the write-ahead log, never directly to the file.
+ * See "Buffer pool" below for the details.
  *
  */
 
@@ -55,6 +58,9 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -64,9 +70,321 @@
 
 #include "pager.h"
 
+/* Buffer pool
+ *
+ * The pager keeps an in-memory pool of pages (MemPage frames) so that
+ * repeatedly accessed pages (e.g. the upper levels of a B-Tree) are not
+ * read from disk every time. Frames are located through a hash table
+ * keyed on the page number, and are replaced using the CLOCK algorithm.
+ *
+ * readPage pins a frame, and releaseMemPage unpins it. A pinned frame is
+ * never evicted, so the data pointer of a MemPage stays valid until it is
+ * released. writePage only marks the frame as dirty; dirty frames are
+ * written to the write-ahead log when they are evicted, when
+ * chidb_Pager_flush is called, or when the pager is closed.
+ *
+ * Write-ahead log
+ *
+ * Pages are never written over the database file directly. They are
+ * appended to the write-ahead log (see wal.c), and chidb_Pager_flush
+ * commits every page written since the previous flush with a single
+ * fdatasync. Until then, the changes can be undone with
+ * chidb_Pager_rollback. A page that is in the log is read from the log, since the
+ * copy in the database file is out of date. Pages are copied back into
+ * the database file by a checkpoint, which runs after a flush once the
+ * log holds WAL_CHECKPOINT_FRAMES frames, and when the pager is closed.
+ *
+ * cache_size is a soft limit: if every frame is pinned, a new frame is
+ * allocated anyway instead of failing the read.
+ *
+ * In memory-mapped mode, the file is mapped privately (MAP_PRIVATE) and
+ * the data of a frame points directly into the mapping, so reading a page
+ * does not copy it. Modifying the page in place makes the kernel copy it
+ * into private memory; the file itself is only changed when the page is
+ * checkpointed, exactly as with private buffers. Pages that are in the
+ * write-ahead log use private buffers. Since a checkpoint writes to the
+ * file behind the mapping, the mapping is refreshed after it, so that
+ * its private copies of pages give way to the file again. The mapping is
+ * larger than the file, and allocatePage extends the file so that new
+ * pages are covered by it. When the file outgrows the mapping, the
+ * mapping grows in place, into address space reserved after it, so that
+ * frames pointing into it stay valid and nothing has to be committed.
+ * Pages beyond the reserved space use private buffers. A rollback
+ * truncates the file back to its committed size.
+ */
+
+/* Minimum length of the mapping, in bytes */
+#define MMAP_MIN_SIZE (64 * 1024 * 1024)
+
+/* Minimum address space reserved for the mapping to grow into, in bytes */
+#define MMAP_RESERVE_SIZE ((size_t) 1024 * 1024 * 1024)
+
+/* Alignment of private buffers. Direct I/O (see chidb_Pager_setDirectIO)
+ * requires buffers, offsets and lengths aligned to the logical block
+ * size of the device; buffers are always aligned so that it can be
+ * turned on at any time. */
+#define PAGE_BUF_ALIGN (4096)
+
+/* pread the whole buffer, unless the end of file is reached */
+static ssize_t chidb_Pager_pread(Pager *pager, void *buf, size_t len, off_t offset)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len)
+    {
+        n = pread(pager->fd, (uint8_t *) buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        done += n;
+    }
+
+    return done;
+}
+
+static int chidb_Pager_writeFrame(Pager *pager, MemPage *page);
+static int chidb_Pager_dropCache(Pager *pager);
+
+#define PAGE_HASH(pager, npage) ((npage) & ((pager)->n_buckets - 1))
+
+static MemPage *chidb_Pager_lookup(Pager *pager, npage_t npage)
+{
+    MemPage *page;
+
+    if (pager->buckets == NULL)
+        return NULL;
+
+    for (page = pager->buckets[PAGE_HASH(pager, npage)]; page != NULL; page = page->next)
+        if (page->npage == npage)
+            return page;
+
+    return NULL;
+}
+
+static void chidb_Pager_unlink(Pager *pager, MemPage *page)
+{
+    MemPage **p;
+
+    for (p = &pager->buckets[PAGE_HASH(pager, page->npage)]; *p != NULL; p = &(*p)->next)
+        if (*p == page)
+        {
+            *p = page->next;
+            break;
+        }
+    page->next = NULL;
+}
+
+/* Get a frame that can hold a new page: either a newly allocated one
+ * (if we are below cache_size, or all frames are pinned) or a victim
+ * chosen by the CLOCK algorithm. The frame is not in the hash table. */
+static int chidb_Pager_getFrame(Pager *pager, MemPage **frame)
+{
+    MemPage *page;
+    uint32_t i;
+    int rc;
+
+    if (pager->n_frames >= pager->cache_size)
+    {
+        /* Two sweeps: the first one may only clear reference bits */
+        for (i = 0; i < 2 * pager->n_frames; i++)
+        {
+            page = pager->frames[pager->clock_hand];
+            pager->clock_hand = (pager->clock_hand + 1) % pager->n_frames;
+
+            if (page->pins > 0)
+                continue;
+            if (page->referenced)
+            {
+                page->referenced = false;
+                continue;
+            }
+
+            if (page->dirty && (rc = chidb_Pager_writeFrame(pager, page)) != CHIDB_OK)
+                return rc;
+            chidb_Pager_unlink(pager, page);
+            *frame = page;
+            return CHIDB_OK;
+        }
+    }
+
+    if (pager->buckets == NULL)
+    {
+        pager->n_buckets = 16;
+        while (pager->n_buckets < pager->cache_size)
+            pager->n_buckets <<= 1;
+        pager->buckets = calloc(pager->n_buckets, sizeof(MemPage *));
+        if (pager->buckets == NULL)
+            return CHIDB_ENOMEM;
+    }
+
+    MemPage **frames = realloc(pager->frames, (pager->n_frames + 1) * sizeof(MemPage *));
+    if (frames == NULL)
+        return CHIDB_ENOMEM;
+    pager->frames = frames;
+
+    page = calloc(1, sizeof(MemPage));
+    if (page == NULL)
+        return CHIDB_ENOMEM;
+
+    pager->frames[pager->n_frames++] = page;
+    *frame = page;
+    return CHIDB_OK;
+}
+
+/* Write the contents of a frame to the log */
+static int chidb_Pager_writeFrame(Pager *pager, MemPage *page)
+{
+    int rc = chidb_Wal_writePage(pager->wal, page->npage, page->data, pager->page_size);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    page->dirty = false;
+    return CHIDB_OK;
+}
+
+/* Write back and free every frame. Pinned frames are freed too, so this
+ * must only be called when no MemPage is in use any more. */
+static int chidb_Pager_dropCache(Pager *pager)
+{
+    int rc = chidb_Pager_flush(pager);
+
+    for (uint32_t i = 0; i < pager->n_frames; i++)
+    {
+        free(pager->frames[i]->buf);
+        free(pager->frames[i]);
+    }
+    free(pager->frames);
+    free(pager->buckets);
+
+    pager->frames = NULL;
+    pager->n_frames = 0;
+    pager->clock_hand = 0;
+    pager->buckets = NULL;
+    pager->n_buckets = 0;
+
+    return rc;
+}
+
+/* Number of pages covered by the mapping */
+static npage_t chidb_Pager_mappedPages(Pager *pager)
+{
+    return pager->map == NULL ? 0 : pager->map_size / pager->page_size;
+}
+
+/* Map the file, with room for it to grow to twice its size. The mapping
+ * is placed at the start of a larger range of reserved address space,
+ * into which chidb_Pager_growMap extends it */
+static int chidb_Pager_map(Pager *pager)
+{
+    size_t size = MMAP_MIN_SIZE, reserved;
+    struct stat buf;
+    void *map;
+
+    /* Sizes are kept multiples of MMAP_MIN_SIZE, so that the mapping can
+     * be extended at an offset aligned to the system's page size */
+    while (size < (size_t) pager->n_pages * pager->page_size * 2)
+        size *= 2;
+    reserved = size * 2 > MMAP_RESERVE_SIZE ? size * 2 : MMAP_RESERVE_SIZE;
+
+    /* Every page up to n_pages must be backed by the file */
+    if (fstat(pager->fd, &buf) != 0)
+        return CHIDB_EIO;
+    if (buf.st_size < (off_t) pager->n_pages * pager->page_size
+        && ftruncate(pager->fd, (off_t) pager->n_pages * pager->page_size) != 0)
+        return CHIDB_EIO;
+
+    map = mmap(NULL, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+    {
+        /* Not enough address space: the mapping will not grow */
+        reserved = size;
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, pager->fd, 0);
+    }
+    else if (mmap(map, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, pager->fd, 0) == MAP_FAILED)
+    {
+        munmap(map, reserved);
+        map = MAP_FAILED;
+    }
+    if (map == MAP_FAILED)
+        return CHIDB_EIO;
+
+    pager->map = map;
+    pager->map_size = size;
+    pager->map_reserved = reserved;
+    return CHIDB_OK;
+}
+
+static void chidb_Pager_unmap(Pager *pager)
+{
+    if (pager->map != NULL)
+        munmap(pager->map, pager->map_reserved);
+    pager->map = NULL;
+    pager->map_size = 0;
+    pager->map_reserved = 0;
+}
+
+/* Extend the mapping in place until it covers every page, or the
+ * reserved address space is used up. The pages that are already mapped
+ * stay where they are, so frames that point into the mapping remain
+ * valid */
+static int chidb_Pager_growMap(Pager *pager)
+{
+    size_t size = pager->map_size;
+
+    while (size < (size_t) pager->n_pages * pager->page_size && size < pager->map_reserved)
+        size *= 2;
+    if (size > pager->map_reserved)
+        size = pager->map_reserved;
+    if (size == pager->map_size)
+        return CHIDB_OK;
+
+    if (mmap(pager->map + pager->map_size, size - pager->map_size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, pager->fd, pager->map_size) == MAP_FAILED)
+        return CHIDB_EIO;
+
+    pager->map_size = size;
+    return CHIDB_OK;
+}
+
+/* Map the file again at the same address, discarding the private copies
+ * of the pages that were modified in place. Frames that point into the
+ * mapping remain valid, but now hold the contents of the file */
+static int chidb_Pager_remap(Pager *pager)
+{
+    if (pager->map == NULL)
+        return CHIDB_OK;
+
+    if (mmap(pager->map, pager->map_size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, pager->fd, 0) == MAP_FAILED)
+    {
+        chidb_Pager_unmap(pager);
+        return CHIDB_EIO;
+    }
+
+    return CHIDB_OK;
+}
+
+/* Copy the write-ahead log into the file. Every page in the log has
+ * been committed, so the frames pointing into the mapping hold what the
+ * checkpoint writes, and the mapping can be refreshed under them */
+static int chidb_Pager_walCheckpoint(Pager *pager)
+{
+    int rc = chidb_Wal_checkpoint(pager->wal, pager->fd);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_Pager_remap(pager);
+}
+
+
 /* Open a file
  *
- * This function opens a file for paged access.
+ * This function opens a file for paged access. If the file has a
+ * write-ahead log, the pages committed to it are read from the log.
  *
  * Parameters
  * - pager: An out parameter. Used to return a pointer to the
@@ -77,21 +395,20 @@
  * - CHIDB_OK: Operation successful
  * - CHIDB_ENOMEM: Could not allocate memory
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ *              or its write-ahead log
  */
 int chidb_Pager_open(Pager **pager, const char *filename)
 {
-    *pager = malloc(sizeof(Pager));
-    if (pager == NULL)
+    *pager = calloc(1, sizeof(Pager));
+    if (*pager == NULL)
         return CHIDB_ENOMEM;
-    (*pager)->f = fopen(filename, "r+");
-
-    if ((*pager)->f == NULL)
-        (*pager)->f = fopen(filename, "w+");
+    (*pager)->cache_size = DEFAULT_CACHE_SIZE;
+    (*pager)->fd = open(filename, O_RDWR | O_CREAT, 0644);
 
-    if ((*pager)->f == NULL)
+    if ((*pager)->fd < 0)
         return CHIDB_EIO;
-    else
-        return CHIDB_OK;
+
+    return chidb_Wal_open(&(*pager)->wal, filename);
 }
 
 
@@ -101,6 +418,8 @@ int chidb_Pager_open(Pager **pager, const char *filename)
  * This function must be called before operating on pages.
  * It will not verify if the page size makes size. If an incorrect
  * page size is provided, this will result in unexpected behaviour.
+ * Any cached page is written back and discarded. If the write-ahead
+ * log holds pages of a different size, it is checkpointed.
  *
  * Parameters
  * - pager: A Pager.
@@ -111,10 +430,99 @@ int chidb_Pager_open(Pager **pager, const char *filename)
  */
 int chidb_Pager_setPageSize(Pager *pager, uint16_t pagesize)
 {
+    chidb_Pager_dropCache(pager);
+    chidb_Pager_unmap(pager);
+
+    /* The log can only hold pages of one size */
+    if (pager->wal->page_size != pagesize)
+        chidb_Pager_walCheckpoint(pager);
+
     pager->page_size = pagesize;
     chidb_Pager_getRealDBSize(pager, &pager->n_pages);
+    pager->db_size = pager->n_pages;
+
+    return CHIDB_OK;
+}
+
+
+/* Set the size of the buffer pool
+ *
+ * Unpinned pages in excess of the new size are evicted lazily, as
+ * new pages are read in.
+ *
+ * Parameters
+ * - pager: A Pager.
+ * - npages: Number of pages to keep in memory (at least 1)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_Pager_setCacheSize(Pager *pager, uint32_t npages)
+{
+    pager->cache_size = npages > 0 ? npages : 1;
+
+    return CHIDB_OK;
+}
+
+
+/* Enable or disable memory-mapped mode
+ *
+ * Any cached page is written back and discarded, so this function
+ * must not be called while a MemPage is in use. The page size must
+ * have been set.
+ *
+ * Parameters
+ * - pager: A Pager.
+ * - enable: true to map the file, false to use private buffers.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EIO: The file could not be mapped
+ */
+int chidb_Pager_setMmap(Pager *pager, bool enable)
+{
+    int rc = chidb_Pager_dropCache(pager);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    chidb_Pager_unmap(pager);
+
+    return enable ? chidb_Pager_map(pager) : CHIDB_OK;
+}
+
+
+/* Enable or disable direct I/O
+ *
+ * With direct I/O (O_DIRECT), pages read into and written from private
+ * buffers bypass the operating system's page cache, which is useful when
+ * the buffer pool is the only cache that should hold database pages.
+ * The page size must be a multiple of the device's logical block size.
+ * Pages served from a memory mapping (see chidb_Pager_setMmap) are not
+ * affected.
+ *
+ * Parameters
+ * - pager: A Pager.
+ * - enable: true to enable direct I/O, false to disable it.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EIO: Direct I/O is not supported for this file
+ */
+int chidb_Pager_setDirectIO(Pager *pager, bool enable)
+{
+#ifdef O_DIRECT
+    int flags = fcntl(pager->fd, F_GETFL);
+
+    if (flags < 0)
+        return CHIDB_EIO;
+    flags = enable ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    if (fcntl(pager->fd, F_SETFL, flags) != 0)
+        return CHIDB_EIO;
 
     return CHIDB_OK;
+#else
+    return enable ? CHIDB_EIO : CHIDB_OK;
+#endif
 }
 
 
@@ -135,10 +543,44 @@ int chidb_Pager_setPageSize(Pager *pager, uint16_t pagesize)
  */
 int chidb_Pager_readHeader(Pager *pager, uint8_t *header)
 {
-    int count;
-    count = fseek(pager->f, 0, SEEK_SET);
-    count = fread(header, 1, 100, pager->f);
-    if (count != 100)
+    ssize_t count;
+    void *buf;
+    MemPage *page = chidb_Pager_lookup(pager, 1);
+
+    uint32_t frame;
+
+    /* The cached copy of page 1 is more recent than the file */
+    if (page != NULL)
+    {
+        memcpy(header, page->data, 100);
+        return CHIDB_OK;
+    }
+
+    /* ... and so is the copy in the log */
+    if (chidb_Wal_find(pager->wal, 1, &frame) == CHIDB_OK)
+    {
+        uint8_t *data = malloc(pager->wal->page_size);
+        if (data == NULL)
+            return CHIDB_ENOMEM;
+        if (chidb_Wal_readFrame(pager->wal, frame, data) != CHIDB_OK)
+        {
+            free(data);
+            return CHIDB_EIO;
+        }
+        memcpy(header, data, 100);
+        free(data);
+        return CHIDB_OK;
+    }
+
+    /* Read a whole aligned block, in case direct I/O is enabled */
+    if (posix_memalign(&buf, PAGE_BUF_ALIGN, PAGE_BUF_ALIGN) != 0)
+        return CHIDB_ENOMEM;
+    count = chidb_Pager_pread(pager, buf, PAGE_BUF_ALIGN, 0);
+    if (count >= 100)
+        memcpy(header, buf, 100);
+    free(buf);
+
+    if (count < 100)
         return CHIDB_NOHEADER;
     else
         return CHIDB_OK;
@@ -161,23 +603,38 @@ int chidb_Pager_allocatePage(Pager *pager, npage_t *npage)
      * and writePage take care of the rest. */
     *npage = ++pager->n_pages;
 
+    if (pager->map == NULL)
+        return CHIDB_OK;
+
+    /* In memory-mapped mode, the file has to grow so that the new
+     * page is backed by the mapping */
+    if (ftruncate(pager->fd, (off_t) pager->n_pages * pager->page_size) != 0)
+        return CHIDB_EIO;
+
+    /* The file outgrew the mapping. The mapping is extended in place,
+     * since mapping the file again would drop the frames, and so commit
+     * the pages that are not committed yet */
+    if (pager->n_pages > chidb_Pager_mappedPages(pager))
+        return chidb_Pager_growMap(pager);
+
     return CHIDB_OK;
 }
 
 
 /* Read a page from file
  *
- * This page reads a page from the file, and creates an in-memory copy
- * in a MemPage struct (see header file for more details on this struct).
- * Always use chidb_Pager_releaseMemPage to free the memory allocated for
- * a MemPage created by this function.
- * Any changes done to a MemPage will not be effective until you call
+ * This function returns the buffer pool frame holding the page, reading
+ * it from the file if it is not already cached, and pins it.
+ * Always use chidb_Pager_releaseMemPage to unpin a MemPage returned by
+ * this function. Reading the same page twice returns the same MemPage,
+ * so changes done to it are visible to every user of the page, but
+ * they will not be effective on disk until you call
  * chidb_Pager_writePage with that MemPage.
  *
  * Parameters
  * - pager: A Pager.
  * - npage: Page number of page to read.
- * - page: Out parameter. Used to return a pointer to newly created MemPage
+ * - page: Out parameter. Used to return a pointer to the MemPage
  *
  * Return
  * - CHIDB_OK: Operation successful
@@ -188,18 +645,64 @@ int	chidb_Pager_readPage(Pager *pager, npage_t npage, MemPage **page)
 {
     if (npage > pager->n_pages || npage <= 0)
         return CHIDB_EPAGENO;
-    int n;
+    ssize_t n;
+    uint32_t frame;
+    int rc;
+
+    *page = chidb_Pager_lookup(pager, npage);
+    if (*page != NULL)
+    {
+        (*page)->pins++;
+        (*page)->referenced = true;
+        return CHIDB_OK;
+    }
+
+    if ((rc = chidb_Pager_getFrame(pager, page)) != CHIDB_OK)
+        return rc;
+
+    /* The copy of a page in the log is more recent than the one in the
+     * file (and in the mapping) */
+    bool logged = chidb_Wal_find(pager->wal, npage, &frame) == CHIDB_OK;
+
+    if (!logged && npage <= chidb_Pager_mappedPages(pager))
+    {
+        (*page)->data = pager->map + (size_t) (npage - 1) * pager->page_size;
+        n = pager->page_size;
+    }
+    else
+    {
+        if ((*page)->buf == NULL
+            && posix_memalign((void **) &(*page)->buf, PAGE_BUF_ALIGN, pager->page_size) != 0)
+        {
+            (*page)->buf = NULL;
+            return CHIDB_ENOMEM;
+        }
+        (*page)->data = (*page)->buf;
+
+        if (logged)
+        {
+            if ((rc = chidb_Wal_readFrame(pager->wal, frame, (*page)->data)) != CHIDB_OK)
+                return rc;
+            n = pager->page_size;
+        }
+        else
+        {
+            /* Pages past the end of the file (allocated, but not yet written)
+             * read as zeroes */
+            n = chidb_Pager_pread(pager, (*page)->data, pager->page_size, (off_t) (npage - 1) * pager->page_size);
+            if (n < 0)
+                return CHIDB_EIO;
+            memset((*page)->data + n, 0, pager->page_size - n);
+        }
+    }
+    chilog(TRACE, "Read %i bytes from page %i into memory [%x data: %x]", (int) n, npage, *page, (*page)->data);
 
-    *page = malloc(sizeof(MemPage));
-    if (page == NULL)
-        return CHIDB_ENOMEM;
     (*page)->npage = npage;
-    (*page)->data = calloc(pager->page_size, 1);
-    if ((*page)->data == NULL)
-        return CHIDB_ENOMEM;
-    fseek(pager->f, (npage - 1) * pager->page_size, SEEK_SET);
-    n = fread((*page)->data, 1, pager->page_size, pager->f);
-    chilog(TRACE, "Read %i bytes from page %i into memory [%x data: %x]", n, npage, *page, (*page)->data);
+    (*page)->pins = 1;
+    (*page)->dirty = false;
+    (*page)->referenced = true;
+    (*page)->next = pager->buckets[PAGE_HASH(pager, npage)];
+    pager->buckets[PAGE_HASH(pager, npage)] = *page;
 
     return CHIDB_OK;
 }
@@ -207,8 +710,10 @@ int	chidb_Pager_readPage(Pager *pager, npage_t npage, MemPage **page)
 
 /* Write a page to file
  *
- * This page writes the in-memory copy of a page (stored in a MemPage
- * struct) back to disk.
+ * This function marks the in-memory copy of a page (stored in a MemPage
+ * struct) as modified. It will be written to the write-ahead log when
+ * it is evicted from the buffer pool, or when the pager is flushed or
+ * closed, and will only be durable once the pager has been flushed.
  *
  * Parameters
  * - pager: A Pager.
@@ -223,15 +728,222 @@ int	chidb_Pager_writePage(Pager *pager, MemPage *page)
 {
     if (page->npage > pager->n_pages)
         return CHIDB_EPAGENO;
-    int n;
-    fseek(pager->f, (page->npage - 1) * pager->page_size, SEEK_SET);
-    n = fwrite(page->data, 1, pager->page_size, pager->f);
-    chilog(TRACE, "Wrote %i bytes to page %i", n, page->npage);
+
+    page->dirty = true;
+    return CHIDB_OK;
+}
+
+
+static int cmp_pages(const void *a, const void *b)
+{
+    npage_t pa = (*(MemPage * const *) a)->npage, pb = (*(MemPage * const *) b)->npage;
+
+    return (pa > pb) - (pa < pb);
+}
+
+/* Write every modified page to the log, in page order, and commit them */
+static int chidb_Pager_commit(Pager *pager)
+{
+    MemPage **dirty;
+    uint32_t n = 0;
+    int rc = CHIDB_OK;
+
+    for (uint32_t i = 0; i < pager->n_frames; i++)
+        if (pager->frames[i]->dirty)
+            n++;
+
+    if (n > 0)
+    {
+        dirty = malloc(n * sizeof(MemPage *));
+        if (dirty == NULL)
+            return CHIDB_ENOMEM;
+        n = 0;
+        for (uint32_t i = 0; i < pager->n_frames; i++)
+            if (pager->frames[i]->dirty)
+                dirty[n++] = pager->frames[i];
+        qsort(dirty, n, sizeof(MemPage *), cmp_pages);
+
+        for (uint32_t i = 0; i < n && rc == CHIDB_OK; i++)
+            rc = chidb_Pager_writeFrame(pager, dirty[i]);
+        free(dirty);
+        if (rc != CHIDB_OK)
+            return rc;
+    }
+
+    if ((rc = chidb_Wal_commit(pager->wal, pager->n_pages)) != CHIDB_OK)
+        return rc;
+
+    pager->db_size = pager->n_pages;
+    return CHIDB_OK;
+}
+
+
+/* Commit all modified pages
+ *
+ * Every modified page is written to the write-ahead log, in page order,
+ * and the log is synced once for all of them (group commit). When this
+ * returns, every page written since the previous flush is durable. If
+ * the log has grown large enough, it is then checkpointed.
+ *
+ * Parameters
+ * - pager: A Pager.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Pager_flush(Pager *pager)
+{
+    int rc = chidb_Pager_commit(pager);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    if (pager->wal->n_frames >= WAL_CHECKPOINT_FRAMES)
+        return chidb_Pager_walCheckpoint(pager);
+
     return CHIDB_OK;
 }
 
 
+/* Copy the write-ahead log into the database file
+ *
+ * Modified pages are committed first (see chidb_Pager_flush).
+ *
+ * Parameters
+ * - pager: A Pager.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Pager_checkpoint(Pager *pager)
+{
+    int rc = chidb_Pager_commit(pager);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    return chidb_Pager_walCheckpoint(pager);
+}
+
+
+/* Undo all changes since the last commit
+ *
+ * Every page modified since the last chidb_Pager_flush (or since the
+ * file was opened) is restored to its committed contents, including
+ * modified pages that were evicted to the write-ahead log, and pages
+ * allocated since then are discarded. Frames are restored in place, so
+ * MemPages that are still pinned remain valid. In memory-mapped mode,
+ * the mapping is refreshed (see chidb_Pager_remap), so that evicted
+ * changes do not linger in it, and the file is truncated back to its
+ * committed size.
+ *
+ * Parameters
+ * - pager: A Pager.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Pager_rollback(Pager *pager)
+{
+    MemPage *page;
+    uint32_t frame;
+    void *buf;
+    ssize_t n;
+    int rc;
+
+    /* A clean frame is out of date too if it was read back from a
+     * frame of the log that is about to be discarded */
+    for (uint32_t i = 0; i < pager->n_frames; i++)
+    {
+        page = pager->frames[i];
+        if (chidb_Pager_lookup(pager, page->npage) == page
+            && chidb_Wal_find(pager->wal, page->npage, &frame) == CHIDB_OK
+            && frame > pager->wal->n_committed)
+            page->dirty = true;
+    }
+
+    if ((rc = chidb_Wal_rollback(pager->wal)) != CHIDB_OK)
+        return rc;
+    pager->n_pages = pager->db_size;
+
+    /* Modified pages that were evicted leave their changes in the
+     * private copies of the mapping, so these are discarded too. The
+     * frames that point into the mapping are restored like modified
+     * frames, since some of them held pages committed to the log */
+    if (pager->map != NULL)
+    {
+        if ((rc = chidb_Pager_remap(pager)) != CHIDB_OK)
+            return rc;
+        for (uint32_t i = 0; i < pager->n_frames; i++)
+        {
+            page = pager->frames[i];
+            if (chidb_Pager_lookup(pager, page->npage) == page && page->data != page->buf)
+                page->dirty = true;
+        }
+    }
+
+    /* Read through an aligned buffer, in case direct I/O is enabled */
+    if (posix_memalign(&buf, PAGE_BUF_ALIGN, pager->page_size) != 0)
+        return CHIDB_ENOMEM;
+
+    for (uint32_t i = 0; i < pager->n_frames && rc == CHIDB_OK; i++)
+    {
+        page = pager->frames[i];
+        if (!page->dirty)
+            continue;
+
+        if (page->npage > pager->db_size)
+            memset(page->data, 0, pager->page_size);
+        else if (chidb_Wal_find(pager->wal, page->npage, &frame) == CHIDB_OK)
+            rc = chidb_Wal_readFrame(pager->wal, frame, page->data);
+        else
+        {
+            n = chidb_Pager_pread(pager, buf, pager->page_size, (off_t) (page->npage - 1) * pager->page_size);
+            if (n < 0)
+                rc = CHIDB_EIO;
+            else
+            {
+                memset((uint8_t *) buf + n, 0, pager->page_size - n);
+                memcpy(page->data, buf, pager->page_size);
+            }
+        }
+        page->dirty = false;
+    }
+    free(buf);
+
+    /* allocatePage extended the file for the discarded pages. Their
+     * frames point past the end of the file once it is truncated, so
+     * they are taken out of the buffer pool */
+    if (pager->map != NULL && rc == CHIDB_OK)
+    {
+        struct stat st;
+
+        for (uint32_t i = 0; i < pager->n_frames; i++)
+        {
+            page = pager->frames[i];
+            if (page->npage > pager->db_size && chidb_Pager_lookup(pager, page->npage) == page)
+                chidb_Pager_unlink(pager, page);
+        }
+
+        if (fstat(pager->fd, &st) != 0)
+            return CHIDB_EIO;
+        if (st.st_size > (off_t) pager->db_size * pager->page_size
+            && ftruncate(pager->fd, (off_t) pager->db_size * pager->page_size) != 0)
+            return CHIDB_EIO;
+    }
+
+    return rc;
+}
+
+
 /* Release an in-memory copy of a page
+ *
+ * This unpins the page. The page stays in the buffer pool, and
+ * can be evicted once it is no longer pinned.
  *
  * Parameters
  * - pager: A Pager.
@@ -247,14 +959,15 @@ int	chidb_Pager_releaseMemPage(Pager *pager, MemPage *page)
         return CHIDB_EPAGENO;
 
     chilog(TRACE, "Releasing page %i from memory [%x data: %x]", page->npage, page, page->data);
-    free(page->data);
-    free(page);
+    if (page->pins > 0)
+        page->pins--;
 
     return CHIDB_OK;
 }
 
 
-/* Computes the number of pages in a file.
+/* Computes the number of pages in a file, including the pages
+ * committed to its write-ahead log.
  *
  * Parameters
  * - pager: A Pager.
@@ -266,14 +979,20 @@ int	chidb_Pager_releaseMemPage(Pager *pager, MemPage *page)
 int chidb_Pager_getRealDBSize(Pager *pager, npage_t *npages)
 {
     struct stat buf;
-    fstat(fileno(pager->f), &buf);
+    fstat(pager->fd, &buf);
     *npages = buf.st_size / pager->page_size;
 
+    /* The database may have grown since the last checkpoint */
+    if (pager->wal->db_size > *npages)
+        *npages = pager->wal->db_size;
+
     return CHIDB_OK;
 }
 
 
 /* Closes a pager and frees up all resources used by the pager.
+ * Modified pages are committed, and the write-ahead log is checkpointed
+ * and removed, before closing the file.
  *
  * Parameters
  * - pager: A Pager.
@@ -284,8 +1003,18 @@ int chidb_Pager_getRealDBSize(Pager *pager, npage_t *npages)
  */
 int chidb_Pager_close(Pager *pager)
 {
-    fclose(pager->f);
+    int rc = chidb_Pager_dropCache(pager);
+
+    chidb_Pager_unmap(pager);
+
+    if (rc == CHIDB_OK)
+        rc = chidb_Wal_close(pager->wal, pager->fd);
+    else
+        chidb_Wal_close(pager->wal, pager->fd);
+
+    if (close(pager->fd) != 0)
+        rc = CHIDB_EIO;
     free(pager);
 
-    return CHIDB_OK;
+    return rc;
 }
@@ -42,19 +42,45 @@
 
 #include <stdio.h>
 #include "chidbInt.h"
+#include "wal.h"
 
+/* A MemPage is a frame in the pager's buffer pool. The frame is owned
+ * by the pager; readPage pins it and releaseMemPage unpins it. */
 struct MemPage
 {
     npage_t npage;
-    uint8_t *data;
+    uint8_t *data;          /* Points to buf, or into the pager's mapping */
+
+    uint8_t *buf;           /* Private buffer, used when the page is not mapped */
+    uint32_t pins;          /* Number of readPage's not yet released */
+    bool dirty;             /* Modified since it was last written to disk */
+    bool referenced;        /* CLOCK reference bit */
+    struct MemPage *next;   /* Next frame in the same hash bucket */
 };
 typedef struct MemPage MemPage;
 
 struct Pager
 {
-    FILE *f;
+    int fd;
     npage_t n_pages;
+    npage_t db_size;        /* n_pages at the last commit */
     uint16_t page_size;
+
+    /* Buffer pool */
+    MemPage **frames;       /* All allocated frames */
+    uint32_t n_frames;
+    uint32_t cache_size;    /* Number of frames we try not to exceed */
+    uint32_t clock_hand;
+    MemPage **buckets;      /* Hash table on page number */
+    uint32_t n_buckets;
+
+    /* Memory-mapped mode (see chidb_Pager_setMmap) */
+    uint8_t *map;
+    size_t map_size;
+    size_t map_reserved;    /* Address space reserved for the mapping to grow into */
+
+    /* Write-ahead log (see wal.c) */
+    Wal *wal;
 };
 typedef struct Pager Pager;
 
@@ -66,6 +92,12 @@ int chidb_Pager_releaseMemPage(Pager *pager, MemPage *page);
 int	chidb_Pager_readPage(Pager *pager, npage_t page_num, MemPage **page);
 int chidb_Pager_writePage(Pager *pager, MemPage *page);
 int chidb_Pager_getRealDBSize(Pager *pager, npage_t *npages);
+int chidb_Pager_setCacheSize(Pager *pager, uint32_t npages);
+int chidb_Pager_flush(Pager *pager);
+int chidb_Pager_checkpoint(Pager *pager);
+int chidb_Pager_rollback(Pager *pager);
+int chidb_Pager_setMmap(Pager *pager, bool enable);
+int chidb_Pager_setDirectIO(Pager *pager, bool enable);
 int chidb_Pager_close(Pager *pager);
 
 #endif /*PAGER_H_*/
@@ -547,6 +547,219 @@ int chidb_DBRecord_print(DBRecord *dbr)
 }
 
 
+/* Creates a read-only view of a raw binary database record
+ *
+ * Only the header size is read here. The types and offsets of the fields
+ * are parsed on demand by the chidb_DBRecord_view* functions.
+ *
+ * Parameters
+ * - dbrv: DBRecordView to initialize
+ * - raw: Pointer to first byte of raw binary database record. It is
+ *        not copied, and must remain valid while the view is used.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_DBRecord_view(DBRecordView *dbrv, uint8_t *raw)
+{
+    dbrv->raw = raw;
+    dbrv->header_size = raw[0];
+    dbrv->header_pos = 1;
+    dbrv->nparsed = 0;
+    dbrv->next_offset = 0;
+
+    return CHIDB_OK;
+}
+
+
+/* Number of bytes taken by a value of a given header type */
+static uint32_t chidb_DBRecord_typeLength(uint32_t type)
+{
+    if (type == SQL_INTEGER_1BYTE)
+        return 1;
+    else if (type == SQL_INTEGER_2BYTE)
+        return 2;
+    else if (type == SQL_INTEGER_4BYTE)
+        return 4;
+    else if (type >= SQL_TEXT && (type - SQL_TEXT) % 2 == 0)
+        return (type - SQL_TEXT) / 2;
+    else
+        return 0;
+}
+
+
+/* Parses the header of a view up to (and including) a given field
+ *
+ * Return
+ * - CHIDB_OK: The field has been parsed
+ * - CHIDB_ENOTFOUND: The record has fewer fields
+ */
+static int chidb_DBRecord_viewParse(DBRecordView *dbrv, uint8_t field)
+{
+    uint8_t *raw = dbrv->raw;
+
+    while (dbrv->nparsed <= field && dbrv->header_pos < dbrv->header_size)
+    {
+        uint32_t type;
+
+        if (raw[dbrv->header_pos] & 0x80)
+        {
+            getVarint32(&raw[dbrv->header_pos], &type);
+            dbrv->header_pos += 4;
+        }
+        else
+        {
+            type = raw[dbrv->header_pos];
+            dbrv->header_pos += 1;
+        }
+
+        dbrv->types[dbrv->nparsed] = type;
+        dbrv->offsets[dbrv->nparsed] = dbrv->next_offset;
+        dbrv->next_offset += chidb_DBRecord_typeLength(type);
+        dbrv->nparsed++;
+    }
+
+    return field < dbrv->nparsed ? CHIDB_OK : CHIDB_ENOTFOUND;
+}
+
+
+/* Returns the number of fields in a viewed record
+ *
+ * Parameters
+ * - dbrv: The DBRecordView
+ *
+ * Return
+ * - Number of fields
+ */
+int chidb_DBRecord_viewNFields(DBRecordView *dbrv)
+{
+    chidb_DBRecord_viewParse(dbrv, DBRECORD_MAX_FIELDS - 1);
+
+    return dbrv->nparsed;
+}
+
+
+/* Returns the type of a field of a viewed record
+ *
+ * Parameters
+ * - dbrv: The DBRecordView
+ * - field: Index of the field
+ *
+ * Return
+ * - SQL_NULL, SQL_INTEGER_1BYTE, SQL_INTEGER_2BYTE, SQL_INTEGER_4BYTE,
+ *   or SQL_TEXT depending on the field type.
+ * - SQL_NOTVALID if the field has an invalid field type, or the record
+ *   does not have that many fields.
+ */
+int chidb_DBRecord_viewGetType(DBRecordView *dbrv, uint8_t field)
+{
+    if (chidb_DBRecord_viewParse(dbrv, field) != CHIDB_OK)
+        return SQL_NOTVALID;
+
+    uint32_t type = dbrv->types[field];
+    if(type == SQL_NULL || type == SQL_INTEGER_1BYTE ||
+            type == SQL_INTEGER_2BYTE || type == SQL_INTEGER_4BYTE)
+        return type;
+    else if (type >= SQL_TEXT && (type - SQL_TEXT) % 2 == 0)
+        return SQL_TEXT;
+    else
+        return SQL_NOTVALID;
+}
+
+
+/* Returns the value of a 1-byte integer field of a viewed record
+ *
+ * Parameters
+ * - dbrv: The DBRecordView
+ * - field: Index of the field
+ * - v: Out parameter used to return the value
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: The record does not have that many fields
+ */
+int chidb_DBRecord_viewGetInt8(DBRecordView *dbrv, uint8_t field, int8_t *v)
+{
+    if (chidb_DBRecord_viewParse(dbrv, field) != CHIDB_OK)
+        return CHIDB_ENOTFOUND;
+
+    *v = dbrv->raw[dbrv->header_size + dbrv->offsets[field]];
+
+    return CHIDB_OK;
+}
+
+
+/* Returns the value of a 2-byte integer field of a viewed record
+ *
+ * Parameters
+ * - dbrv: The DBRecordView
+ * - field: Index of the field
+ * - v: Out parameter used to return the value
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: The record does not have that many fields
+ */
+int chidb_DBRecord_viewGetInt16(DBRecordView *dbrv, uint8_t field, int16_t *v)
+{
+    if (chidb_DBRecord_viewParse(dbrv, field) != CHIDB_OK)
+        return CHIDB_ENOTFOUND;
+
+    *v = get2byte(&dbrv->raw[dbrv->header_size + dbrv->offsets[field]]);
+
+    return CHIDB_OK;
+}
+
+
+/* Returns the value of a 4-byte integer field of a viewed record
+ *
+ * Parameters
+ * - dbrv: The DBRecordView
+ * - field: Index of the field
+ * - v: Out parameter used to return the value
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: The record does not have that many fields
+ */
+int chidb_DBRecord_viewGetInt32(DBRecordView *dbrv, uint8_t field, int32_t *v)
+{
+    if (chidb_DBRecord_viewParse(dbrv, field) != CHIDB_OK)
+        return CHIDB_ENOTFOUND;
+
+    *v = get4byte(&dbrv->raw[dbrv->header_size + dbrv->offsets[field]]);
+
+    return CHIDB_OK;
+}
+
+
+/* Returns the value of a string field of a viewed record
+ *
+ * The returned pointer points into the raw record, and the string is
+ * *not* NULL-terminated.
+ *
+ * Parameters
+ * - dbrv: The DBRecordView
+ * - field: Index of the field
+ * - v: Out parameter used to return a pointer to the first character
+ * - len: Out parameter used to return the length of the string
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: The record does not have that many fields
+ */
+int chidb_DBRecord_viewGetString(DBRecordView *dbrv, uint8_t field, const char **v, int *len)
+{
+    if (chidb_DBRecord_viewParse(dbrv, field) != CHIDB_OK)
+        return CHIDB_ENOTFOUND;
+
+    *v = (const char *) &dbrv->raw[dbrv->header_size + dbrv->offsets[field]];
+    *len = chidb_DBRecord_typeLength(dbrv->types[field]);
+
+    return CHIDB_OK;
+}
+
+
 /* Creates a DBRecord based on a specification string and all the values
  * in the record.
  *
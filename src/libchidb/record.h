@@ -63,6 +63,27 @@ struct DBRecordBuffer
 };
 typedef struct DBRecordBuffer DBRecordBuffer;
 
+/* Maximum number of fields in a record (the header size is a single byte,
+ * and every field takes at least one byte of the header) */
+#define DBRECORD_MAX_FIELDS (255)
+
+/* A DBRecordView is a read-only view of a raw database record stored
+ * elsewhere (typically, in a page of the buffer pool). The header is
+ * parsed lazily, only up to the highest field requested so far, and
+ * field values are read straight from the raw record. Nothing is ever
+ * allocated or copied, so the raw record must outlive the view. */
+struct DBRecordView
+{
+    uint8_t *raw;
+    uint8_t header_size;
+    uint8_t header_pos;
+    uint8_t nparsed;
+    uint32_t next_offset;
+    uint32_t types[DBRECORD_MAX_FIELDS];
+    uint32_t offsets[DBRECORD_MAX_FIELDS];
+};
+typedef struct DBRecordView DBRecordView;
+
 int chidb_DBRecord_create(DBRecord **dbr, const char *, ...);
 
 int chidb_DBRecord_create_empty(DBRecordBuffer *dbrb, uint8_t nfields);
@@ -86,6 +107,14 @@ int chidb_DBRecord_getStringLength(DBRecord *dbr, uint8_t field, int *len);
 
 int chidb_DBRecord_print(DBRecord *dbr);
 
+int chidb_DBRecord_view(DBRecordView *dbrv, uint8_t *raw);
+int chidb_DBRecord_viewNFields(DBRecordView *dbrv);
+int chidb_DBRecord_viewGetType(DBRecordView *dbrv, uint8_t field);
+int chidb_DBRecord_viewGetInt8(DBRecordView *dbrv, uint8_t field, int8_t *v);
+int chidb_DBRecord_viewGetInt16(DBRecordView *dbrv, uint8_t field, int16_t *v);
+int chidb_DBRecord_viewGetInt32(DBRecordView *dbrv, uint8_t field, int32_t *v);
+int chidb_DBRecord_viewGetString(DBRecordView *dbrv, uint8_t field, const char **v, int *len);
+
 
 int chidb_DBRecord_destroy(DBRecord *dbr);
 
@@ -0,0 +1,431 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ * This module implements the in-memory catalog of a database. The schema
+ * table is read into a list of chidb_schema_item_t, in the order of its
+ * rows. So that preparing a statement does not have to walk that list
+ * (and the column lists of the CREATE TABLE statements) once for every
+ * name it looks up, each table and each column is also entered into a
+ * hash table: tables by name, columns by table and column name.
+ *
+ * The CREATE statements stored in the schema table are only parsed when
+ * their table is first looked up, so opening a database with many tables
+ * does not require parsing all of them. Indexes are kept in a list in
+ * the entry of their table, and are parsed when they are first looked
+ * at too.
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "chidbInt.h"
+#include "schema.h"
+#include "util.h"
+
+
+static uint32_t chidb_schema_hash_name(uint32_t h, const char *name)
+{
+    for (; *name; name++)
+        h = (h ^ (uint8_t) *name) * 16777619u;
+
+    return h;
+}
+
+static uint32_t chidb_schema_hash_table(const char *table)
+{
+    return chidb_schema_hash_name(2166136261u, table);
+}
+
+static uint32_t chidb_schema_hash_column(const char *table, const char *column)
+{
+    // 表名和列名之间以'.'分隔
+    return chidb_schema_hash_name(chidb_schema_hash_name(chidb_schema_hash_table(table), "."), column);
+}
+
+
+static int chidb_schema_hash_init(chidb_schema_hash_t *h)
+{
+    h->buckets = calloc(SCHEMA_BUCKETS, sizeof(chidb_schema_entry_t *));
+    if (h->buckets == NULL)
+        return CHIDB_ENOMEM;
+    h->nbuckets = SCHEMA_BUCKETS;
+    h->n = 0;
+
+    return CHIDB_OK;
+}
+
+static int chidb_schema_hash_insert(chidb_schema_hash_t *h, chidb_schema_entry_t *e)
+{
+    // 平均每个桶多于一项时, 桶的数量加倍
+    if (h->n >= h->nbuckets)
+    {
+        uint32_t nbuckets = h->nbuckets * 2;
+        chidb_schema_entry_t **buckets = calloc(nbuckets, sizeof(chidb_schema_entry_t *));
+        if (buckets == NULL)
+            return CHIDB_ENOMEM;
+
+        for (uint32_t i = 0; i < h->nbuckets; i++)
+        {
+            chidb_schema_entry_t *cur = h->buckets[i], *next;
+            for (; cur != NULL; cur = next)
+            {
+                next = cur->next;
+                cur->next = buckets[cur->hash % nbuckets];
+                buckets[cur->hash % nbuckets] = cur;
+            }
+        }
+
+        free(h->buckets);
+        h->buckets = buckets;
+        h->nbuckets = nbuckets;
+    }
+
+    e->next = h->buckets[e->hash % h->nbuckets];
+    h->buckets[e->hash % h->nbuckets] = e;
+    h->n++;
+
+    return CHIDB_OK;
+}
+
+static void chidb_schema_hash_destroy(chidb_schema_hash_t *h)
+{
+    for (uint32_t i = 0; i < h->nbuckets; i++)
+    {
+        chidb_schema_entry_t *cur = h->buckets[i], *next;
+        for (; cur != NULL; cur = next)
+        {
+            next = cur->next;
+            free(cur);
+        }
+    }
+
+    free(h->buckets);
+    h->buckets = NULL;
+    h->nbuckets = h->n = 0;
+}
+
+
+// 按名字查找表, 不解析其CREATE语句
+static chidb_schema_table_t *chidb_schema_lookup_table(chidb_schema_t *schema, const char *table)
+{
+    uint32_t hash = chidb_schema_hash_table(table);
+    chidb_schema_entry_t *e = schema->tables.buckets[hash % schema->tables.nbuckets];
+
+    for (; e != NULL; e = e->next)
+    {
+        chidb_schema_table_t *t = (chidb_schema_table_t *) e;
+        if (e->hash == hash && !strcmp(t->item->name, table))
+            return t;
+    }
+
+    return NULL;
+}
+
+
+/* Initialize an empty schema
+ *
+ * Parameters
+ * - schema: Schema to initialize
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_schema_init(chidb_schema_t *schema)
+{
+    int rc;
+
+    list_init(&schema->items);
+    schema->last_key = 0;
+    if ((rc = chidb_schema_hash_init(&schema->tables)) != CHIDB_OK)
+        return rc;
+    if ((rc = chidb_schema_hash_init(&schema->columns)) != CHIDB_OK)
+    {
+        free(schema->tables.buckets);
+        return rc;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Free a schema
+ *
+ * Frees every row of the schema and the hash tables built from them.
+ * The schema must be initialized again before it is used.
+ *
+ * Parameters
+ * - schema: Schema to free
+ */
+void chidb_schema_destroy(chidb_schema_t *schema)
+{
+    // 不断获取list中的第一个值并释放其中的指针指向的空间
+    while (!list_empty(&schema->items))
+    {
+        chidb_schema_item_t *item = (chidb_schema_item_t *)list_fetch(&schema->items);
+        if (item->stmt != NULL)
+            chisql_statement_free(item->stmt);
+        free(item->sql);
+        free(item->type);
+        free(item->name);
+        free(item->assoc);
+        free(item);
+    }
+    // 释放list的空间
+    list_destroy(&schema->items);
+
+    // 释放每个表的索引列表
+    for (uint32_t i = 0; i < schema->tables.nbuckets; i++)
+    {
+        chidb_schema_entry_t *e = schema->tables.buckets[i];
+        for (; e != NULL; e = e->next)
+        {
+            chidb_schema_index_t *index = ((chidb_schema_table_t *) e)->indexes, *next;
+            for (; index != NULL; index = next)
+            {
+                next = index->next;
+                free(index);
+            }
+        }
+    }
+
+    chidb_schema_hash_destroy(&schema->tables);
+    chidb_schema_hash_destroy(&schema->columns);
+}
+
+
+/* Add a row to a schema
+ *
+ * The row is appended to the schema. If it describes a table, the table
+ * is also entered into the hash table of tables; if it describes an
+ * index, the index is added to its table. The schema takes ownership of
+ * the row.
+ *
+ * Parameters
+ * - schema: Schema
+ * - item: Row of the schema table. Its SQL is not parsed yet
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_schema_add(chidb_schema_t *schema, chidb_schema_item_t *item)
+{
+    int rc;
+
+    list_append(&schema->items, item);
+
+    // 索引加入到其关联的表中 (索引总在表之后创建)
+    if (!strcmp(item->type, "index"))
+    {
+        chidb_schema_table_t *table = chidb_schema_lookup_table(schema, item->assoc);
+        if (table == NULL)
+            return CHIDB_OK;
+
+        chidb_schema_index_t *index = malloc(sizeof(chidb_schema_index_t));
+        if (index == NULL)
+            return CHIDB_ENOMEM;
+        index->item = item;
+        index->next = table->indexes;
+        table->indexes = index;
+        return CHIDB_OK;
+    }
+
+    // 只有表需要按名字查找
+    if (strcmp(item->type, "table"))
+        return CHIDB_OK;
+
+    chidb_schema_table_t *table = malloc(sizeof(chidb_schema_table_t));
+    if (table == NULL)
+        return CHIDB_ENOMEM;
+    table->entry.hash = chidb_schema_hash_table(item->name);
+    table->item = item;
+    table->ncols = -1;
+    table->indexes = NULL;
+    if ((rc = chidb_schema_hash_insert(&schema->tables, &table->entry)) != CHIDB_OK)
+    {
+        free(table);
+        return rc;
+    }
+
+    return CHIDB_OK;
+}
+
+
+// 解析表的CREATE语句, 并将其中的列加入到列的哈希表中
+static int chidb_schema_load_columns(chidb_schema_t *schema, chidb_schema_table_t *table)
+{
+    chidb_schema_item_t *item = table->item;
+    int rc;
+
+    if (item->stmt == NULL && chisql_parser(item->sql, &item->stmt) != CHIDB_OK)
+    {
+        item->stmt = NULL;
+        return CHIDB_EINVALIDSQL;
+    }
+    if (item->stmt->type != STMT_CREATE || item->stmt->stmt.create->t != CREATE_TABLE)
+        return CHIDB_EINVALIDSQL;
+
+    // 遍历表中的列, 依次加入
+    table->ncols = 0;
+    Column_t *cur_column = item->stmt->stmt.create->table->columns;
+    for (; cur_column != NULL; cur_column = cur_column->next)
+    {
+        chidb_schema_column_t *column = malloc(sizeof(chidb_schema_column_t));
+        if (column == NULL)
+            return CHIDB_ENOMEM;
+        column->entry.hash = chidb_schema_hash_column(item->name, cur_column->name);
+        column->table = table;
+        column->column = cur_column;
+        column->ordinal = table->ncols++;
+        if ((rc = chidb_schema_hash_insert(&schema->columns, &column->entry)) != CHIDB_OK)
+        {
+            free(column);
+            return rc;
+        }
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Find a table of a schema
+ *
+ * The CREATE statement of the table is parsed the first time the table
+ * is found.
+ *
+ * Parameters
+ * - schema: Schema
+ * - table: Name of the table
+ *
+ * Return
+ * - The table, or NULL if the schema has no such table (or its CREATE
+ *   statement cannot be parsed)
+ */
+chidb_schema_table_t *chidb_schema_find_table(chidb_schema_t *schema, const char *table)
+{
+    chidb_schema_table_t *t = chidb_schema_lookup_table(schema, table);
+
+    if (t != NULL && t->ncols < 0 && chidb_schema_load_columns(schema, t) != CHIDB_OK)
+        return NULL;
+
+    return t;
+}
+
+
+/* Find a column of a table of a schema
+ *
+ * Parameters
+ * - schema: Schema
+ * - table: Name of the table
+ * - column: Name of the column
+ *
+ * Return
+ * - The column, or NULL if the table does not exist or has no such column
+ */
+chidb_schema_column_t *chidb_schema_find_column(chidb_schema_t *schema, const char *table, const char *column)
+{
+    uint32_t hash = chidb_schema_hash_column(table, column);
+    chidb_schema_entry_t *e;
+
+    // 表的列在第一次查找表时才加入
+    if (chidb_schema_find_table(schema, table) == NULL)
+        return NULL;
+
+    e = schema->columns.buckets[hash % schema->columns.nbuckets];
+
+    for (; e != NULL; e = e->next)
+    {
+        chidb_schema_column_t *c = (chidb_schema_column_t *) e;
+        if (e->hash == hash && !strcmp(c->column->name, column) && !strcmp(c->table->item->name, table))
+            return c;
+    }
+
+    return NULL;
+}
+
+
+/* Get the definition of an index
+ *
+ * The CREATE INDEX statement of the index is parsed the first time this
+ * is called.
+ *
+ * Parameters
+ * - index: Index of a table of the catalog
+ *
+ * Return
+ * - The definition of the index, or NULL if its statement cannot be parsed
+ */
+Index_t *chidb_schema_index(chidb_schema_index_t *index)
+{
+    chidb_schema_item_t *item = index->item;
+
+    if (item->stmt == NULL && chisql_parser(item->sql, &item->stmt) != CHIDB_OK)
+    {
+        item->stmt = NULL;
+        return NULL;
+    }
+    if (item->stmt->type != STMT_CREATE || item->stmt->stmt.create->t != CREATE_INDEX)
+        return NULL;
+
+    return item->stmt->stmt.create->index;
+}
+
+
+/* Find an index on a column
+ *
+ * Parameters
+ * - schema: Schema
+ * - table: Name of the table
+ * - column: Name of the column
+ *
+ * Return
+ * - An index on the column, or NULL if the column is not indexed
+ */
+chidb_schema_index_t *chidb_schema_find_index(chidb_schema_t *schema, const char *table, const char *column)
+{
+    chidb_schema_table_t *t = chidb_schema_find_table(schema, table);
+    chidb_schema_index_t *index;
+
+    if (t == NULL)
+        return NULL;
+
+    for (index = t->indexes; index != NULL; index = index->next)
+    {
+        Index_t *def = chidb_schema_index(index);
+        if (def != NULL && !strcmp(def->column_name, column))
+            return index;
+    }
+
+    return NULL;
+}
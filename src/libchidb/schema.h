@@ -0,0 +1,119 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Schema catalog header. See schema.c for more details.
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef SCHEMA_H_
+#define SCHEMA_H_
+
+#include <stdint.h>
+#include <chidb/chidb.h>
+#include "../simclist/simclist.h"
+
+/* Initial number of buckets of each hash table (doubled as it fills) */
+#define SCHEMA_BUCKETS (64)
+
+// 定义Schema结构
+typedef struct
+{
+    char *type;
+    char *name;
+    char *assoc;
+    int root_page;
+    char *sql;
+    chisql_statement_t *stmt; // 第一次用到时才解析sql
+} chidb_schema_item_t;
+
+/* Link of an entry in one of the hash tables of the catalog. It is the
+ * first member of the entries, so that they can share the hash table code */
+typedef struct chidb_schema_entry
+{
+    uint32_t hash;
+    struct chidb_schema_entry *next;
+} chidb_schema_entry_t;
+
+typedef struct chidb_schema_hash
+{
+    chidb_schema_entry_t **buckets;
+    uint32_t nbuckets;
+    uint32_t n;
+} chidb_schema_hash_t;
+
+/* An index on a table of the catalog */
+typedef struct chidb_schema_index
+{
+    chidb_schema_item_t *item;
+    struct chidb_schema_index *next;
+} chidb_schema_index_t;
+
+/* A table of the catalog, found by its name. Its columns are entered into
+ * the catalog the first time the table is looked up */
+typedef struct chidb_schema_table
+{
+    chidb_schema_entry_t entry;
+    chidb_schema_item_t *item;
+    int ncols;          /* -1 until the CREATE statement is parsed */
+    chidb_schema_index_t *indexes;
+} chidb_schema_table_t;
+
+/* A column of the catalog, found by the name of its table and its own */
+typedef struct chidb_schema_column
+{
+    chidb_schema_entry_t entry;
+    chidb_schema_table_t *table;
+    Column_t *column;
+    int ordinal;        /* Position of the column in its table, from 0 */
+} chidb_schema_column_t;
+
+typedef struct chidb_schema
+{
+    list_t items;                   /* Rows of the schema table, in order */
+    uint32_t last_key;              /* Key of the last row read */
+    chidb_schema_hash_t tables;     /* Table name -> chidb_schema_table_t */
+    chidb_schema_hash_t columns;    /* (table, column) -> chidb_schema_column_t */
+} chidb_schema_t;
+
+int chidb_schema_init(chidb_schema_t *schema);
+void chidb_schema_destroy(chidb_schema_t *schema);
+int chidb_schema_add(chidb_schema_t *schema, chidb_schema_item_t *item);
+chidb_schema_table_t *chidb_schema_find_table(chidb_schema_t *schema, const char *table);
+chidb_schema_column_t *chidb_schema_find_column(chidb_schema_t *schema, const char *table, const char *column);
+Index_t *chidb_schema_index(chidb_schema_index_t *index);
+chidb_schema_index_t *chidb_schema_find_index(chidb_schema_t *schema, const char *table, const char *column);
+
+#endif /* SCHEMA_H_ */
@@ -0,0 +1,367 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ * This module implements the cache of prepared statements kept by each
+ * connection. A SQL statement that is prepared again, maybe with
+ * different literal values, is not parsed and compiled again: its
+ * literals are taken out to form a cache key (so "SELECT * FROM t WHERE
+ * a = 1" and "SELECT * FROM t WHERE a = 2" have the same key, "SELECT *
+ * FROM t WHERE a = ?"), the key is compiled once into a program that
+ * reads the literals from parameters, and chidb_prepare hands out
+ * copies of that program with the literals bound to its parameters.
+ * The least recently used program is evicted when the cache is full.
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <ctype.h>
+#include <strings.h>
+#include "chidbInt.h"
+#include "dbm.h"
+#include "stmt-cache.h"
+
+
+/* Initialize a statement cache
+ *
+ * Parameters
+ * - cache: Statement cache
+ */
+void chidb_stmt_cache_init(chidb_stmt_cache_t *cache)
+{
+    memset(cache, 0, sizeof(chidb_stmt_cache_t));
+}
+
+
+static void chidb_stmt_cache_free_entry(chidb_stmt_cache_entry_t *e)
+{
+    chidb_stmt_free(e->stmt);
+    free(e->stmt);
+    free(e->key);
+    free(e);
+}
+
+
+/* Empty a statement cache
+ *
+ * Called whenever the schema may have changed, since the cached
+ * programs have the root pages and columns of tables built into them.
+ *
+ * Parameters
+ * - cache: Statement cache
+ */
+void chidb_stmt_cache_clear(chidb_stmt_cache_t *cache)
+{
+    chidb_stmt_cache_entry_t *e = cache->head, *next;
+
+    for (; e != NULL; e = next)
+    {
+        next = e->next;
+        chidb_stmt_cache_free_entry(e);
+    }
+
+    chidb_stmt_cache_init(cache);
+}
+
+
+// 只缓存SELECT和INSERT语句(可以加上EXPLAIN)
+static bool chidb_stmt_cacheable(const char *sql)
+{
+    while (isspace((unsigned char) *sql))
+        sql++;
+
+    if (!strncasecmp(sql, "explain", 7) && isspace((unsigned char) sql[7]))
+        for (sql += 7; isspace((unsigned char) *sql); sql++)
+            ;
+
+    return (!strncasecmp(sql, "select", 6) || !strncasecmp(sql, "insert", 6))
+        && !isalnum((unsigned char) sql[6]) && sql[6] != '_';
+}
+
+
+/* Compute the cache key of a SQL statement
+ *
+ * Whitespace is collapsed, the final semicolon is removed and, unless
+ * the statement has parameters of its own, integer literals and string
+ * literals are replaced by "?". Literals are recognized in the same way
+ * as the SQL lexer does. One-character strings and decimal numbers are
+ * kept in the key, since they are not values of any column type that
+ * the code generator supports.
+ *
+ * Parameters
+ * - sql: SQL statement
+ * - key: Out parameter. The cache key (to be freed by the caller)
+ * - lits: Out parameter. The literals taken out of the statement, in
+ *         order, which are parameters 1, 2, ... of the key (to be freed
+ *         with chidb_stmt_cache_free_literals)
+ * - nlits: Out parameter. Number of literals
+ *
+ * Return
+ * - true: The statement can be cached
+ * - false: The statement cannot be cached (it is not a SELECT or an
+ *          INSERT, or it has comments or unterminated strings)
+ */
+bool chidb_stmt_cache_key(const char *sql, char **key, chidb_stmt_literal_t **lits, int *nlits)
+{
+    int len = strlen(sql);
+    bool normalize = true;
+    const char *p;
+    char quote = 0;
+
+    if (!chidb_stmt_cacheable(sql))
+        return false;
+
+    // 语句本身有参数时, 字面值不再变为参数, 以免打乱参数的编号
+    for (p = sql; *p; p++)
+    {
+        if (quote)
+        {
+            if (*p == quote)
+                quote = 0;
+        }
+        else if (*p == '\'' || *p == '"')
+            quote = *p;
+        else if (*p == '?' || *p == ':')
+            normalize = false;
+        else if ((p[0] == '-' && p[1] == '-') || (p[0] == '/' && p[1] == '*'))
+            return false;
+    }
+    if (quote)
+        return false;
+
+    char *k = malloc(len + 1);
+    int klen = 0, n = 0;
+    chidb_stmt_literal_t *l = NULL;
+
+    for (p = sql; *p; )
+    {
+        if (isspace((unsigned char) *p))
+        {
+            while (isspace((unsigned char) *p))
+                p++;
+            if (klen > 0 && *p)
+                k[klen++] = ' ';
+        }
+        else if (*p == '\'' || *p == '"')
+        {
+            const char *end = strchr(p + 1, *p);
+            if (normalize && end - p - 1 != 1)
+            {
+                l = realloc(l, sizeof(chidb_stmt_literal_t) * (n + 1));
+                l[n].is_int = false;
+                l[n++].s = strndup(p + 1, end - p - 1);
+                k[klen++] = '?';
+            }
+            else
+            {
+                memcpy(k + klen, p, end - p + 1);
+                klen += end - p + 1;
+            }
+            p = end + 1;
+        }
+        else if (isalpha((unsigned char) *p))
+        {
+            while (isalnum((unsigned char) *p) || *p == '_')
+                k[klen++] = *p++;
+        }
+        else if (isdigit((unsigned char) *p) || (*p == '.' && isdigit((unsigned char) p[1]))
+                 || ((*p == '+' || *p == '-') && isdigit((unsigned char) p[1])))
+        {
+            const char *start = p;
+            if (*p == '+' || *p == '-')
+                p++;
+            while (isdigit((unsigned char) *p))
+                p++;
+
+            if (*p == '.' || *start == '.')
+            {
+                // 小数保留在键中
+                for (p = start + 1; isdigit((unsigned char) *p) || *p == '.'; p++)
+                    ;
+                if ((*p == 'e' || *p == 'E') && (isdigit((unsigned char) p[1])
+                    || ((p[1] == '+' || p[1] == '-') && isdigit((unsigned char) p[2]))))
+                    for (p += 2; isdigit((unsigned char) *p); p++)
+                        ;
+                memcpy(k + klen, start, p - start);
+                klen += p - start;
+            }
+            else if (normalize)
+            {
+                l = realloc(l, sizeof(chidb_stmt_literal_t) * (n + 1));
+                l[n].is_int = true;
+                l[n++].i = atoi(start);
+                k[klen++] = '?';
+            }
+            else
+            {
+                memcpy(k + klen, start, p - start);
+                klen += p - start;
+            }
+        }
+        else
+            k[klen++] = *p++;
+    }
+
+    // 删除结尾的分号
+    while (klen > 0 && (k[klen - 1] == ';' || k[klen - 1] == ' '))
+        klen--;
+    k[klen] = '\0';
+
+    *key = k;
+    *lits = l;
+    *nlits = n;
+
+    return true;
+}
+
+
+/* Free the literals returned by chidb_stmt_cache_key */
+void chidb_stmt_cache_free_literals(chidb_stmt_literal_t *lits, int nlits)
+{
+    for (int i = 0; i < nlits; i++)
+        if (!lits[i].is_int)
+            free(lits[i].s);
+    free(lits);
+}
+
+
+static uint32_t chidb_stmt_cache_hash(const char *key)
+{
+    uint32_t h = 2166136261u;
+
+    for (; *key; key++)
+        h = (h ^ (uint8_t) *key) * 16777619u;
+
+    return h;
+}
+
+
+static void chidb_stmt_cache_unlink(chidb_stmt_cache_t *cache, chidb_stmt_cache_entry_t *e)
+{
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        cache->head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        cache->tail = e->prev;
+}
+
+
+static void chidb_stmt_cache_push(chidb_stmt_cache_t *cache, chidb_stmt_cache_entry_t *e)
+{
+    e->prev = NULL;
+    e->next = cache->head;
+    if (cache->head)
+        cache->head->prev = e;
+    cache->head = e;
+    if (cache->tail == NULL)
+        cache->tail = e;
+}
+
+
+/* Look up a compiled statement
+ *
+ * Parameters
+ * - cache: Statement cache
+ * - key: Cache key (see chidb_stmt_cache_key)
+ *
+ * Return
+ * - The compiled statement, which must not be run or freed (use
+ *   chidb_stmt_clone to get a copy that can be run), or NULL if
+ *   there is no statement with that key
+ */
+chidb_stmt *chidb_stmt_cache_get(chidb_stmt_cache_t *cache, const char *key)
+{
+    uint32_t hash = chidb_stmt_cache_hash(key);
+    chidb_stmt_cache_entry_t *e = cache->buckets[hash % STMT_CACHE_BUCKETS];
+
+    for (; e != NULL; e = e->next_hash)
+        if (e->hash == hash && !strcmp(e->key, key))
+        {
+            // 移到最近使用的一端
+            chidb_stmt_cache_unlink(cache, e);
+            chidb_stmt_cache_push(cache, e);
+            return e->stmt;
+        }
+
+    return NULL;
+}
+
+
+/* Add a compiled statement to the cache
+ *
+ * If the cache is full, the least recently used statement is evicted.
+ *
+ * Parameters
+ * - cache: Statement cache
+ * - key: Cache key (see chidb_stmt_cache_key). It is copied.
+ * - stmt: Compiled statement. The cache takes ownership of it.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_stmt_cache_put(chidb_stmt_cache_t *cache, const char *key, chidb_stmt *stmt)
+{
+    chidb_stmt_cache_entry_t *e, **pe;
+
+    if (cache->n == STMT_CACHE_SIZE)
+    {
+        e = cache->tail;
+        for (pe = &cache->buckets[e->hash % STMT_CACHE_BUCKETS]; *pe != e; pe = &(*pe)->next_hash)
+            ;
+        *pe = e->next_hash;
+        chidb_stmt_cache_unlink(cache, e);
+        chidb_stmt_cache_free_entry(e);
+        cache->n--;
+    }
+
+    if ((e = malloc(sizeof(chidb_stmt_cache_entry_t))) == NULL)
+        return CHIDB_ENOMEM;
+    if ((e->key = strdup(key)) == NULL)
+    {
+        free(e);
+        return CHIDB_ENOMEM;
+    }
+    e->hash = chidb_stmt_cache_hash(key);
+    e->stmt = stmt;
+
+    e->next_hash = cache->buckets[e->hash % STMT_CACHE_BUCKETS];
+    cache->buckets[e->hash % STMT_CACHE_BUCKETS] = e;
+    chidb_stmt_cache_push(cache, e);
+    cache->n++;
+
+    return CHIDB_OK;
+}
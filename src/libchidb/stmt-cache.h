@@ -0,0 +1,83 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Prepared statement cache header. See stmt-cache.c for more details.
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef STMT_CACHE_H_
+#define STMT_CACHE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <chidb/chidb.h>
+
+/* Number of compiled statements kept by each connection */
+#define STMT_CACHE_SIZE (64)
+#define STMT_CACHE_BUCKETS (128)
+
+/* A literal taken out of a SQL statement when computing its cache key */
+typedef struct chidb_stmt_literal
+{
+    bool is_int;
+    int32_t i;
+    char *s;
+} chidb_stmt_literal_t;
+
+typedef struct chidb_stmt_cache_entry
+{
+    char *key;
+    uint32_t hash;
+    chidb_stmt *stmt;                           /* Compiled program, never run */
+    struct chidb_stmt_cache_entry *next_hash;   /* Next entry in the same bucket */
+    struct chidb_stmt_cache_entry *prev, *next; /* Recency list */
+} chidb_stmt_cache_entry_t;
+
+typedef struct chidb_stmt_cache
+{
+    chidb_stmt_cache_entry_t *buckets[STMT_CACHE_BUCKETS];
+    chidb_stmt_cache_entry_t *head;     /* Most recently used */
+    chidb_stmt_cache_entry_t *tail;     /* Least recently used */
+    uint32_t n;
+} chidb_stmt_cache_t;
+
+void chidb_stmt_cache_init(chidb_stmt_cache_t *cache);
+void chidb_stmt_cache_clear(chidb_stmt_cache_t *cache);
+bool chidb_stmt_cache_key(const char *sql, char **key, chidb_stmt_literal_t **lits, int *nlits);
+void chidb_stmt_cache_free_literals(chidb_stmt_literal_t *lits, int nlits);
+chidb_stmt *chidb_stmt_cache_get(chidb_stmt_cache_t *cache, const char *key);
+int chidb_stmt_cache_put(chidb_stmt_cache_t *cache, const char *key, chidb_stmt *stmt);
+
+#endif /* STMT_CACHE_H_ */
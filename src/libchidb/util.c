@@ -284,160 +284,76 @@ int chidb_tokenize(char *str, char ***tokens)
 
 // --------- My Code Begin ---------
 
-int chidb_check_table_exist(chidb_schema_t schema, char *table)
+int chidb_check_table_exist(chidb_schema_t *schema, char *table)
 {
-    // 初始化迭代器
-    list_iterator_start(&schema);
+    // 存在返回1, 不存在返回0
+    return chidb_schema_find_table(schema, table) != NULL;
+}
 
-    // 遍历schema每一项
-    while (list_iterator_hasnext(&schema))
+int chidb_check_index_exist(chidb_schema_t *schema, char *index)
+{
+    // 索引只在建立索引时按名字查找, 遍历schema即可
+    int exist = 0;
+    list_iterator_start(&schema->items);
+    while (list_iterator_hasnext(&schema->items))
     {
-        // 获取当前项的指针
-        chidb_schema_item_t *item = list_iterator_next(&schema);
-        // name 与 table相等则返回1
-        if (!strcmp(item->name, table) && !strcmp(item->type, "table"))
-        {
-            list_iterator_stop(&schema);
-            return 1;
-        }
+        chidb_schema_item_t *item = list_iterator_next(&schema->items);
+        if (!strcmp(item->type, "index") && !strcmp(item->name, index))
+            exist = 1;
     }
+    list_iterator_stop(&schema->items);
 
-    // 结束迭代器
-    list_iterator_stop(&schema);
-
-    // 不存在返回0
-    return 0;
+    // 存在返回1, 不存在返回0
+    return exist;
 }
 
-int chidb_get_root_page_of_table(chidb_schema_t schema, char *table)
+int chidb_get_root_page_of_table(chidb_schema_t *schema, char *table)
 {
-    // 初始化迭代器
-    list_iterator_start(&schema);
-
-    // 遍历schema每一项
-    while (list_iterator_hasnext(&schema))
-    {
-        // 获取当前项的指针
-        chidb_schema_item_t *item = list_iterator_next(&schema);
-        // name 与 table相等则返回对应的root page
-        if (!strcmp(item->name, table) && !strcmp(item->type, "table"))
-        {
-            list_iterator_stop(&schema);
-            return item->root_page;
-        }
-    }
-
-    // 结束迭代器
-    list_iterator_stop(&schema);
+    chidb_schema_table_t *t = chidb_schema_find_table(schema, table);
 
     // 不存在返回0
-    return 0;
+    return t == NULL ? 0 : t->item->root_page;
 }
 
-int chidb_check_column_exist(chidb_schema_t schema, char *table, char *column)
+int chidb_check_column_exist(chidb_schema_t *schema, char *table, char *column)
 {
-    // 初始化迭代器
-    list_iterator_start(&schema);
+    // 存在返回1, 不存在返回0
+    return chidb_schema_find_column(schema, table, column) != NULL;
+}
 
-    // 遍历schema每一项
-    while (list_iterator_hasnext(&schema))
-    {
-        // 获取当前项的指针
-        chidb_schema_item_t *item = list_iterator_next(&schema);
-        // name 与 table相等则在其中查找
-        if (!strcmp(item->name, table) && !strcmp(item->type, "table"))
-        {
-            // 遍历给定表中的列
-            Column_t *cur_column = item->stmt->stmt.create->table->columns;
-            while (cur_column != NULL)
-            {
-                // 若当前列名与给定列名相同, 返回1
-                if (!strcmp(cur_column->name, column))
-                {
-                    list_iterator_stop(&schema);
-                    return 1;
-                }
-                // 若不同则更新当前列指针指向下一列
-                cur_column = cur_column->next;
-            }
-            // 不存在返回0
-            list_iterator_stop(&schema);
-            return 0;
-        }
-    }
+int chidb_get_type_of_column(chidb_schema_t *schema, char *table, char *column)
+{
+    chidb_schema_column_t *c = chidb_schema_find_column(schema, table, column);
 
-    list_iterator_stop(&schema);
-    // 不存在返回0
-    return 0;
+    // 不存在返回-1
+    return c == NULL ? -1 : c->column->type;
 }
 
-int chidb_get_type_of_column(chidb_schema_t schema, char *table, char *column)
+int chidb_get_order_of_column(chidb_schema_t *schema, char *table, char *column)
 {
-    // 初始化迭代器
-    list_iterator_start(&schema);
+    chidb_schema_column_t *c = chidb_schema_find_column(schema, table, column);
 
-    // 遍历schema每一项
-    while (list_iterator_hasnext(&schema))
-    {
-        // 获取当前项的指针
-        chidb_schema_item_t *item = (chidb_schema_item_t *)(list_iterator_next(&schema));
-        // name 与 table相等则在其中查找
-        if (!strcmp(item->name, table) && !strcmp(item->type, "table"))
-        {
-            // 遍历给定表中的列
-            Column_t *cur_column = item->stmt->stmt.create->table->columns;
-            while (cur_column != NULL)
-            {
-                // 若当前列名与给定列名相同, 返回类型
-                if (!strcmp(cur_column->name, column))
-                {
-                    list_iterator_stop(&schema);
-                    return cur_column->type;
-                }
-                // 若不同则更新当前列指针指向下一列
-                cur_column = cur_column->next;
-            }
-            // 不存在返回-1
-            list_iterator_stop(&schema);
-            return -1;
-        }
-    }
-
-    list_iterator_stop(&schema);
     // 不存在返回-1
-    return -1;
+    return c == NULL ? -1 : c->ordinal;
 }
 
-int chidb_get_columns_of_table(chidb_schema_t schema, char *table, list_t *columns)
+int chidb_get_columns_of_table(chidb_schema_t *schema, char *table, list_t *columns)
 {
-    // 初始化迭代器
-    list_iterator_start(&schema);
+    chidb_schema_table_t *t = chidb_schema_find_table(schema, table);
+
+    // 不存在返回错误
+    if (t == NULL)
+        return CHIDB_EINVALIDSQL;
 
-    // 遍历schema每一项
-    while (list_iterator_hasnext(&schema))
+    // 遍历列, 添加到列名列表中
+    Column_t *column = t->item->stmt->stmt.create->table->columns;
+    while (column != NULL)
     {
-        // 获取当前项的指针
-        chidb_schema_item_t *item = list_iterator_next(&schema);
-        // name 与 table相等则获取其中的列后返回
-        if (!strcmp(item->name, table) && !strcmp(item->type, "table"))
-        {
-            // 遍历列, 添加到列名列表中
-            Column_t *column = item->stmt->stmt.create->table->columns;
-            while (column != NULL)
-            {
-                list_append(columns, column);
-                column = column->next;
-            }
-
-            list_iterator_stop(&schema);
-            return CHIDB_OK;
-        }
+        list_append(columns, column);
+        column = column->next;
     }
 
-    // 结束迭代器
-    list_iterator_stop(&schema);
-    // 不存在返回错误
-    return CHIDB_EINVALIDSQL;
+    return CHIDB_OK;
 }
 
 void chisql_statement_free(chisql_statement_t *sql_stmt)
@@ -465,6 +381,9 @@ void chisql_statement_free(chisql_statement_t *sql_stmt)
         } break;
     }
 
+    for (int i = 0; i < sql_stmt->nparams; i++)
+        free(sql_stmt->params[i]);
+    free(sql_stmt->params);
     free(sql_stmt->text);
     free(sql_stmt);
 }
@@ -77,16 +77,20 @@ FILE *copy(const char *from, const char *to);
  * 4. Given a table name and a column name, obtain the type of the column.
  */
 // 检查是否已存在给定table, 存在则返回1, 不存在则返回0
-int chidb_check_table_exist(chidb_schema_t schema, char *table);
+int chidb_check_table_exist(chidb_schema_t *schema, char *table);
+// 检查是否已存在给定名字的索引, 存在则返回1, 不存在则返回0
+int chidb_check_index_exist(chidb_schema_t *schema, char *index);
 // 获取给定table所在的根页码, 不存在则返回0
-int chidb_get_root_page_of_table(chidb_schema_t schema, char *table);
+int chidb_get_root_page_of_table(chidb_schema_t *schema, char *table);
 // 检查在给定table中是否存在给定列, 存在返回1, 否则返回0
-int chidb_check_column_exist(chidb_schema_t schema, char *table, char *column);
+int chidb_check_column_exist(chidb_schema_t *schema, char *table, char *column);
 // 获取给定table中给定column的类型, 不存在则返回-1
-int chidb_get_type_of_column(chidb_schema_t schema, char *table, char *column);
+int chidb_get_type_of_column(chidb_schema_t *schema, char *table, char *column);
+// 获取给定column在table中所有列的位置, 从0开始, 不存在则返回-1
+int chidb_get_order_of_column(chidb_schema_t *schema, char *table, char *column);
 
 // 根据给定的表名获取其所有的列
-int chidb_get_columns_of_table(chidb_schema_t schema, char *table, list_t *columns);
+int chidb_get_columns_of_table(chidb_schema_t *schema, char *table, list_t *columns);
 
 void chisql_statement_free(chisql_statement_t *sql_stmt);
 // --------- My Code End ---------
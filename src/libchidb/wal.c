@@ -0,0 +1,748 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ * This module implements the write-ahead log (WAL) used by the pager.
+ * Modified pages are not written over the database file; instead, their
+ * images are appended to a log file (the database file name followed by
+ * "-wal"), and a batch of pages becomes durable with a single fdatasync
+ * of the log. Pages are copied back into the database file by a
+ * checkpoint, after which the log starts over.
+ *
+ */
+
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <chidb/log.h>
+
+#include "chidbInt.h"
+#include "util.h"
+#include "wal.h"
+
+/* Log format
+ *
+ * The log starts with a 32-byte header:
+ *
+ *   0: WAL_MAGIC
+ *   4: Page size
+ *   8: Checkpoint sequence number
+ *  12: Salt (two 32-bit values)
+ *  20: Unused (zero)
+ *  24: Checksum of bytes 0-23 (two 32-bit values)
+ *
+ * It is followed by frames, each of them a 24-byte header and the image
+ * of a page:
+ *
+ *   0: Page number
+ *   4: For a commit frame, the size of the database (in pages) after
+ *      the commit. Zero for every other frame.
+ *   8: Salt, copied from the log header
+ *  16: Checksum of bytes 0-15 and of the page image
+ *
+ * The checksum of a frame starts from the checksum of the previous frame
+ * (or of the log header, for the first frame), so a frame is only valid
+ * if every frame before it is the one it was written after. A rollback
+ * leaves the frames of the discarded batch in the log, with valid
+ * checksums, and the next batch overwrites them. If the system crashes
+ * once the commit frame of that batch is on disk but some of its earlier
+ * frames are not, the first new frame that follows a stale one does not
+ * match, and the batch is not recovered.
+ *
+ * All values are big-endian. A commit frame is always the last frame of
+ * its batch: it is written after every other page of the batch, and is
+ * followed by the only fdatasync of the batch (group commit). When the
+ * log is opened, frames are read until one is torn (bad checksum) or
+ * belongs to an older log (bad salt), and only the frames up to the last
+ * commit frame are kept; the rest is truncated away.
+ *
+ * Frames that are not committed yet are overwritten in place when the
+ * same page is written again, so a batch holds at most one frame per
+ * page. The frames after an overwritten frame are checksummed again
+ * when the batch is committed.
+ *
+ * The WAL index maps each page number to the most recent frame holding
+ * the page, so that the pager can find the latest version of a page
+ * without scanning the log. It lives in memory, and is rebuilt from the
+ * frame headers when the log is opened.
+ *
+ * After a commit that leaves WAL_CHECKPOINT_FRAMES or more frames in the
+ * log, the pager runs a checkpoint: the latest version of every page is
+ * written to the database file (in page order), the database file is
+ * synced, and the log is truncated.
+ */
+
+#define WAL_MAGIC (0x57414c31)
+
+#define WAL_FRAME_SIZE(wal) (WAL_FRAME_HEADER_SIZE + (wal)->page_size)
+#define WAL_FRAME_OFFSET(wal, frame) (WAL_HEADER_SIZE + (off_t) ((frame) - 1) * WAL_FRAME_SIZE(wal))
+
+/* Alignment of the buffer used to copy pages into the database file,
+ * which may have been opened with O_DIRECT */
+#define WAL_BUF_ALIGN (4096)
+
+/* pread/pwrite the whole buffer, unless the end of file is reached */
+static ssize_t chidb_Wal_pread(int fd, void *buf, size_t len, off_t offset)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len)
+    {
+        n = pread(fd, (uint8_t *) buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        done += n;
+    }
+
+    return done;
+}
+
+static ssize_t chidb_Wal_pwrite(int fd, const void *buf, size_t len, off_t offset)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len)
+    {
+        n = pwrite(fd, (const uint8_t *) buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        done += n;
+    }
+
+    return done;
+}
+
+/* Fletcher-like checksum over big-endian 32-bit words. len must be a
+ * multiple of 8. The checksum is accumulated into s. */
+static void chidb_Wal_checksum(const uint8_t *p, size_t len, uint32_t *s)
+{
+    for (size_t i = 0; i < len; i += 8)
+    {
+        s[0] += get4byte(p + i) + s[1];
+        s[1] += get4byte(p + i + 4) + s[0];
+    }
+}
+
+/* Checksum of a frame held in wal->buf, which starts from the checksum
+ * of the previous frame. It is recorded as the checksum of the frame. */
+static void chidb_Wal_frameChecksum(Wal *wal, uint32_t frame, uint32_t *s)
+{
+    const uint32_t *prev = frame == 1 ? wal->hdr_cksum : &wal->frame_cksums[2 * (frame - 2)];
+
+    s[0] = prev[0];
+    s[1] = prev[1];
+    chidb_Wal_checksum(wal->buf, 16, s);
+    chidb_Wal_checksum(wal->buf + WAL_FRAME_HEADER_SIZE, wal->page_size, s);
+    wal->frame_cksums[2 * (frame - 1)] = s[0];
+    wal->frame_cksums[2 * (frame - 1) + 1] = s[1];
+}
+
+/* Make room for the information kept on each frame, up to frame */
+static int chidb_Wal_growFrames(Wal *wal, uint32_t frame)
+{
+    npage_t *pages;
+    uint32_t *cksums;
+
+    if (frame <= wal->frames_alloc)
+        return CHIDB_OK;
+
+    pages = realloc(wal->frame_pages, 2 * frame * sizeof(npage_t));
+    if (pages == NULL)
+        return CHIDB_ENOMEM;
+    wal->frame_pages = pages;
+    cksums = realloc(wal->frame_cksums, 2 * frame * 2 * sizeof(uint32_t));
+    if (cksums == NULL)
+        return CHIDB_ENOMEM;
+    wal->frame_cksums = cksums;
+    wal->frames_alloc = 2 * frame;
+
+    return CHIDB_OK;
+}
+
+#define WAL_HASH(wal, npage) (((npage) * 2654435761u) & ((wal)->index_size - 1))
+
+static WalIndexEntry *chidb_Wal_slot(Wal *wal, npage_t npage)
+{
+    uint32_t i;
+
+    for (i = WAL_HASH(wal, npage); wal->index[i].npage != 0; i = (i + 1) & (wal->index_size - 1))
+        if (wal->index[i].npage == npage)
+            break;
+
+    return &wal->index[i];
+}
+
+/* Record that frame is the most recent frame holding npage */
+static int chidb_Wal_indexSet(Wal *wal, npage_t npage, uint32_t frame)
+{
+    WalIndexEntry *slot;
+
+    /* Keep the table at most half full */
+    if (2 * (wal->index_used + 1) > wal->index_size)
+    {
+        WalIndexEntry *old = wal->index;
+        uint32_t old_size = wal->index_size;
+
+        wal->index_size = old_size == 0 ? 64 : 2 * old_size;
+        wal->index = calloc(wal->index_size, sizeof(WalIndexEntry));
+        if (wal->index == NULL)
+        {
+            wal->index = old;
+            wal->index_size = old_size;
+            return CHIDB_ENOMEM;
+        }
+        for (uint32_t i = 0; i < old_size; i++)
+            if (old[i].npage != 0)
+                *chidb_Wal_slot(wal, old[i].npage) = old[i];
+        free(old);
+    }
+
+    slot = chidb_Wal_slot(wal, npage);
+    if (slot->npage == 0)
+        wal->index_used++;
+    slot->npage = npage;
+    slot->frame = frame;
+
+    return CHIDB_OK;
+}
+
+/* Forget every frame after the first n_frames ones */
+static int chidb_Wal_rebuildIndex(Wal *wal, uint32_t n_frames)
+{
+    int rc;
+
+    if (wal->index != NULL)
+        memset(wal->index, 0, wal->index_size * sizeof(WalIndexEntry));
+    wal->index_used = 0;
+
+    for (uint32_t i = 1; i <= n_frames; i++)
+        if ((rc = chidb_Wal_indexSet(wal, wal->frame_pages[i - 1], i)) != CHIDB_OK)
+            return rc;
+    wal->n_frames = n_frames;
+
+    return CHIDB_OK;
+}
+
+static int chidb_Wal_allocBuf(Wal *wal)
+{
+    free(wal->buf);
+    wal->buf = malloc(WAL_FRAME_SIZE(wal));
+
+    return wal->buf == NULL ? CHIDB_ENOMEM : CHIDB_OK;
+}
+
+/* Write the log header. This starts a new log: the file is truncated. */
+static int chidb_Wal_writeHeader(Wal *wal)
+{
+    uint8_t header[WAL_HEADER_SIZE];
+    uint32_t s[2] = {0, 0};
+
+    if (wal->fd < 0)
+    {
+        wal->fd = open(wal->filename, O_RDWR | O_CREAT, 0644);
+        if (wal->fd < 0)
+            return CHIDB_EIO;
+    }
+
+    memset(header, 0, WAL_HEADER_SIZE);
+    put4byte(header, WAL_MAGIC);
+    put4byte(header + 4, wal->page_size);
+    put4byte(header + 8, wal->ckpt_seq);
+    put4byte(header + 12, wal->salt[0]);
+    put4byte(header + 16, wal->salt[1]);
+    chidb_Wal_checksum(header, 24, s);
+    put4byte(header + 24, s[0]);
+    put4byte(header + 28, s[1]);
+    wal->hdr_cksum[0] = s[0];
+    wal->hdr_cksum[1] = s[1];
+
+    if (ftruncate(wal->fd, 0) != 0
+        || chidb_Wal_pwrite(wal->fd, header, WAL_HEADER_SIZE, 0) != WAL_HEADER_SIZE)
+        return CHIDB_EIO;
+
+    return CHIDB_OK;
+}
+
+/* Read the log and rebuild the WAL index from its committed frames */
+static int chidb_Wal_recover(Wal *wal)
+{
+    uint8_t header[WAL_HEADER_SIZE];
+    uint32_t s[2] = {0, 0};
+    uint32_t frame, n_frames = 0;
+    struct stat st;
+    int rc;
+
+    if (fstat(wal->fd, &st) != 0)
+        return CHIDB_EIO;
+    if (chidb_Wal_pread(wal->fd, header, WAL_HEADER_SIZE, 0) != WAL_HEADER_SIZE)
+        return ftruncate(wal->fd, 0) == 0 ? CHIDB_OK : CHIDB_EIO;
+
+    chidb_Wal_checksum(header, 24, s);
+    if (get4byte(header) != WAL_MAGIC || get4byte(header + 24) != s[0] || get4byte(header + 28) != s[1]
+        || get4byte(header + 4) < 512 || get4byte(header + 4) > 65536 || get4byte(header + 4) % 8 != 0)
+        return ftruncate(wal->fd, 0) == 0 ? CHIDB_OK : CHIDB_EIO;
+
+    wal->page_size = get4byte(header + 4);
+    wal->ckpt_seq = get4byte(header + 8);
+    wal->salt[0] = get4byte(header + 12);
+    wal->salt[1] = get4byte(header + 16);
+    wal->hdr_cksum[0] = s[0];
+    wal->hdr_cksum[1] = s[1];
+    if ((rc = chidb_Wal_allocBuf(wal)) != CHIDB_OK)
+        return rc;
+
+    for (frame = 1; WAL_FRAME_OFFSET(wal, frame + 1) <= st.st_size; frame++)
+    {
+        if (chidb_Wal_pread(wal->fd, wal->buf, WAL_FRAME_SIZE(wal), WAL_FRAME_OFFSET(wal, frame)) != WAL_FRAME_SIZE(wal))
+            break;
+
+        if ((rc = chidb_Wal_growFrames(wal, frame)) != CHIDB_OK)
+            return rc;
+
+        chidb_Wal_frameChecksum(wal, frame, s);
+        if (get4byte(wal->buf + 8) != wal->salt[0] || get4byte(wal->buf + 12) != wal->salt[1]
+            || get4byte(wal->buf + 16) != s[0] || get4byte(wal->buf + 20) != s[1]
+            || get4byte(wal->buf) == 0)
+            break;
+
+        wal->frame_pages[frame - 1] = get4byte(wal->buf);
+
+        if (get4byte(wal->buf + 4) != 0)
+        {
+            n_frames = frame;
+            wal->db_size = get4byte(wal->buf + 4);
+        }
+    }
+
+    /* Frames after the last commit frame were never committed. They are
+     * removed, so that they cannot be mistaken for frames of a later batch. */
+    if ((rc = chidb_Wal_rebuildIndex(wal, n_frames)) != CHIDB_OK)
+        return rc;
+    wal->n_committed = n_frames;
+    if (ftruncate(wal->fd, n_frames == 0 ? 0 : WAL_FRAME_OFFSET(wal, n_frames + 1)) != 0)
+        return CHIDB_EIO;
+
+    chilog(TRACE, "Recovered %i frames from %s", n_frames, wal->filename);
+
+    return CHIDB_OK;
+}
+
+
+/* Open the write-ahead log of a database
+ *
+ * If the log exists, its committed frames are indexed, and the pager
+ * will read the pages they hold from the log. The log file is only
+ * created when a page is first written to it.
+ *
+ * Parameters
+ * - wal: An out parameter. Used to return a pointer to the new Wal.
+ * - dbfile: Name of the database file.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the log
+ */
+int chidb_Wal_open(Wal **wal, const char *dbfile)
+{
+    int rc;
+
+    *wal = calloc(1, sizeof(Wal));
+    if (*wal == NULL)
+        return CHIDB_ENOMEM;
+
+    (*wal)->filename = malloc(strlen(dbfile) + 5);
+    if ((*wal)->filename == NULL)
+        return CHIDB_ENOMEM;
+    sprintf((*wal)->filename, "%s-wal", dbfile);
+
+    (*wal)->salt[0] = (uint32_t) time(NULL);
+    (*wal)->salt[1] = (uint32_t) getpid();
+
+    (*wal)->fd = open((*wal)->filename, O_RDWR);
+    if ((*wal)->fd < 0)
+        return errno == ENOENT ? CHIDB_OK : CHIDB_EIO;
+
+    if ((rc = chidb_Wal_recover(*wal)) != CHIDB_OK)
+        return rc;
+
+    /* If the log has to start over, it must not share the salt of the
+     * one it replaces */
+    if ((*wal)->n_frames == 0)
+    {
+        (*wal)->salt[0]++;
+        (*wal)->salt[1] = (*wal)->salt[1] * 1103515245 + 12345;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Find the most recent frame holding a page
+ *
+ * Frames that are not committed yet are returned too: they hold the
+ * latest version of the page.
+ *
+ * Parameters
+ * - wal: A Wal.
+ * - npage: Page number.
+ * - frame: Out parameter. Frame number.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: The page is not in the log
+ */
+int chidb_Wal_find(Wal *wal, npage_t npage, uint32_t *frame)
+{
+    WalIndexEntry *slot;
+
+    if (wal->index_used == 0)
+        return CHIDB_ENOTFOUND;
+
+    slot = chidb_Wal_slot(wal, npage);
+    if (slot->npage == 0)
+        return CHIDB_ENOTFOUND;
+
+    *frame = slot->frame;
+    return CHIDB_OK;
+}
+
+
+/* Read the page image held by a frame
+ *
+ * Parameters
+ * - wal: A Wal.
+ * - frame: Frame number (see chidb_Wal_find)
+ * - data: Buffer with room for a page.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EIO: An I/O error has occurred when accessing the log
+ */
+int chidb_Wal_readFrame(Wal *wal, uint32_t frame, uint8_t *data)
+{
+    if (chidb_Wal_pread(wal->fd, data, wal->page_size, WAL_FRAME_OFFSET(wal, frame) + WAL_FRAME_HEADER_SIZE) != wal->page_size)
+        return CHIDB_EIO;
+
+    return CHIDB_OK;
+}
+
+
+/* Write a page to the log
+ *
+ * The page is not durable (nor visible after a crash) until the next
+ * chidb_Wal_commit.
+ *
+ * Parameters
+ * - wal: A Wal.
+ * - npage: Page number.
+ * - data: Page image.
+ * - page_size: Size of the page. It must be the page size of the log,
+ *              unless the log is empty.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The page size does not match the log
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the log
+ */
+int chidb_Wal_writePage(Wal *wal, npage_t npage, const uint8_t *data, uint16_t page_size)
+{
+    uint32_t frame;
+    uint32_t s[2];
+    int rc;
+
+    if (wal->n_frames == 0)
+    {
+        if (wal->page_size != page_size || wal->buf == NULL)
+        {
+            wal->page_size = page_size;
+            if ((rc = chidb_Wal_allocBuf(wal)) != CHIDB_OK)
+                return rc;
+        }
+        if ((rc = chidb_Wal_writeHeader(wal)) != CHIDB_OK)
+            return rc;
+    }
+    else if (wal->page_size != page_size)
+        return CHIDB_EMISUSE;
+
+    /* A frame that is not committed yet can be overwritten. The
+     * checksums of the frames after it must then be computed again. */
+    if (chidb_Wal_find(wal, npage, &frame) != CHIDB_OK || frame <= wal->n_committed)
+    {
+        frame = wal->n_frames + 1;
+        if ((rc = chidb_Wal_growFrames(wal, frame)) != CHIDB_OK)
+            return rc;
+        if ((rc = chidb_Wal_indexSet(wal, npage, frame)) != CHIDB_OK)
+            return rc;
+        wal->frame_pages[frame - 1] = npage;
+        wal->n_frames = frame;
+    }
+    else if (frame < wal->n_frames && (wal->recksum == 0 || frame + 1 < wal->recksum))
+        wal->recksum = frame + 1;
+
+    put4byte(wal->buf, npage);
+    put4byte(wal->buf + 4, 0);
+    put4byte(wal->buf + 8, wal->salt[0]);
+    put4byte(wal->buf + 12, wal->salt[1]);
+    memcpy(wal->buf + WAL_FRAME_HEADER_SIZE, data, wal->page_size);
+    chidb_Wal_frameChecksum(wal, frame, s);
+    put4byte(wal->buf + 16, s[0]);
+    put4byte(wal->buf + 20, s[1]);
+
+    if (chidb_Wal_pwrite(wal->fd, wal->buf, WAL_FRAME_SIZE(wal), WAL_FRAME_OFFSET(wal, frame)) != WAL_FRAME_SIZE(wal))
+        return CHIDB_EIO;
+    chilog(TRACE, "Wrote page %i to frame %i of the log", npage, frame);
+
+    return CHIDB_OK;
+}
+
+
+/* Commit the pages written to the log
+ *
+ * The last frame written becomes a commit frame, and the log is synced
+ * once. After this, every page written since the previous commit is
+ * durable. If a frame of the batch was overwritten, the frames after
+ * it are checksummed again first.
+ *
+ * Parameters
+ * - wal: A Wal.
+ * - db_size: Size of the database, in pages.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EIO: An I/O error has occurred when accessing the log
+ */
+int chidb_Wal_commit(Wal *wal, npage_t db_size)
+{
+    uint32_t s[2];
+
+    if (wal->n_frames == wal->n_committed)
+        return CHIDB_OK;
+
+    /* The last frame is checksummed below, as the commit frame */
+    for (uint32_t frame = wal->recksum; frame != 0 && frame < wal->n_frames; frame++)
+    {
+        if (chidb_Wal_pread(wal->fd, wal->buf, WAL_FRAME_SIZE(wal), WAL_FRAME_OFFSET(wal, frame)) != WAL_FRAME_SIZE(wal))
+            return CHIDB_EIO;
+        chidb_Wal_frameChecksum(wal, frame, s);
+        put4byte(wal->buf + 16, s[0]);
+        put4byte(wal->buf + 20, s[1]);
+        if (chidb_Wal_pwrite(wal->fd, wal->buf, WAL_FRAME_HEADER_SIZE, WAL_FRAME_OFFSET(wal, frame)) != WAL_FRAME_HEADER_SIZE)
+            return CHIDB_EIO;
+    }
+    wal->recksum = 0;
+
+    /* The buffer still holds the last frame, unless an earlier frame of
+     * the batch was written after it */
+    if (get4byte(wal->buf) != wal->frame_pages[wal->n_frames - 1]
+        && chidb_Wal_pread(wal->fd, wal->buf, WAL_FRAME_SIZE(wal), WAL_FRAME_OFFSET(wal, wal->n_frames)) != WAL_FRAME_SIZE(wal))
+        return CHIDB_EIO;
+
+    put4byte(wal->buf + 4, db_size);
+    chidb_Wal_frameChecksum(wal, wal->n_frames, s);
+    put4byte(wal->buf + 16, s[0]);
+    put4byte(wal->buf + 20, s[1]);
+
+    if (chidb_Wal_pwrite(wal->fd, wal->buf, WAL_FRAME_HEADER_SIZE, WAL_FRAME_OFFSET(wal, wal->n_frames)) != WAL_FRAME_HEADER_SIZE
+        || fdatasync(wal->fd) != 0)
+        return CHIDB_EIO;
+
+    wal->n_committed = wal->n_frames;
+    wal->db_size = db_size;
+
+    return CHIDB_OK;
+}
+
+
+/* Discard the pages written to the log since the last commit
+ *
+ * Parameters
+ * - wal: A Wal.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_Wal_rollback(Wal *wal)
+{
+    if (wal->n_frames == wal->n_committed)
+        return CHIDB_OK;
+
+    /* Frames after the last commit frame are ignored when the log is
+     * read, and are overwritten by later batches. Since checksums are
+     * chained, a crash cannot mix them with the frames of the next batch
+     * (see "Log format") */
+    wal->recksum = 0;
+    return chidb_Wal_rebuildIndex(wal, wal->n_committed);
+}
+
+static int cmp_entries(const void *a, const void *b)
+{
+    npage_t pa = ((const WalIndexEntry *) a)->npage, pb = ((const WalIndexEntry *) b)->npage;
+
+    return (pa > pb) - (pa < pb);
+}
+
+/* Copy the log into the database file
+ *
+ * The latest version of every page in the log is written to the
+ * database file, the database file is synced, and the log is emptied.
+ * Every frame in the log must be committed.
+ *
+ * Parameters
+ * - wal: A Wal.
+ * - dbfd: File descriptor of the database file.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The log has frames that are not committed
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred
+ */
+int chidb_Wal_checkpoint(Wal *wal, int dbfd)
+{
+    WalIndexEntry *entries;
+    uint32_t n = 0;
+    void *page;
+    struct stat st;
+    int rc = CHIDB_OK;
+
+    if (wal->n_frames != wal->n_committed)
+        return CHIDB_EMISUSE;
+    if (wal->n_frames == 0)
+        return CHIDB_OK;
+
+    /* Write the pages in order, so the database file is written sequentially */
+    entries = malloc(wal->index_used * sizeof(WalIndexEntry));
+    if (entries == NULL)
+        return CHIDB_ENOMEM;
+    for (uint32_t i = 0; i < wal->index_size; i++)
+        if (wal->index[i].npage != 0)
+            entries[n++] = wal->index[i];
+    qsort(entries, n, sizeof(WalIndexEntry), cmp_entries);
+
+    if (posix_memalign(&page, WAL_BUF_ALIGN, wal->page_size) != 0)
+    {
+        free(entries);
+        return CHIDB_ENOMEM;
+    }
+
+    for (uint32_t i = 0; i < n && rc == CHIDB_OK; i++)
+    {
+        if ((rc = chidb_Wal_readFrame(wal, entries[i].frame, page)) != CHIDB_OK)
+            break;
+        if (chidb_Wal_pwrite(dbfd, page, wal->page_size, (off_t) (entries[i].npage - 1) * wal->page_size) != wal->page_size)
+            rc = CHIDB_EIO;
+    }
+    free(page);
+    free(entries);
+    if (rc != CHIDB_OK)
+        return rc;
+
+    /* Pages that were allocated but never written read as zeroes */
+    if (fstat(dbfd, &st) != 0)
+        return CHIDB_EIO;
+    if (st.st_size < (off_t) wal->db_size * wal->page_size
+        && ftruncate(dbfd, (off_t) wal->db_size * wal->page_size) != 0)
+        return CHIDB_EIO;
+
+    /* The log can only be emptied once the pages are safe in the database
+     * file. If we crash before that, the log is simply copied again. */
+    if (fdatasync(dbfd) != 0 || ftruncate(wal->fd, 0) != 0)
+        return CHIDB_EIO;
+    chilog(TRACE, "Checkpointed %i frames (%i pages)", wal->n_frames, n);
+
+    wal->ckpt_seq++;
+    wal->salt[0]++;
+    wal->salt[1] = wal->salt[1] * 1103515245 + 12345;
+    wal->n_committed = 0;
+    wal->db_size = 0;
+
+    return chidb_Wal_rebuildIndex(wal, 0);
+}
+
+
+/* Close the log
+ *
+ * The log is checkpointed and removed. If it cannot be checkpointed
+ * (because of an I/O error, or because some frames are not committed),
+ * it is left on disk, and its committed frames will be recovered the
+ * next time the database is opened.
+ *
+ * Parameters
+ * - wal: A Wal.
+ * - dbfd: File descriptor of the database file.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EIO: An I/O error has occurred
+ */
+int chidb_Wal_close(Wal *wal, int dbfd)
+{
+    int rc = chidb_Wal_checkpoint(wal, dbfd);
+
+    if (wal->fd >= 0)
+    {
+        if (rc == CHIDB_OK)
+            unlink(wal->filename);
+        close(wal->fd);
+    }
+
+    free(wal->filename);
+    free(wal->frame_pages);
+    free(wal->frame_cksums);
+    free(wal->index);
+    free(wal->buf);
+    free(wal);
+
+    return rc == CHIDB_EMISUSE ? CHIDB_OK : rc;
+}
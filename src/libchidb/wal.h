@@ -0,0 +1,95 @@
+/*
+ *  chidb - a didactic relational database management system
+ *
+ *  Write-ahead log header. See wal.c for more details.
+ *
+ */
+
+/*
+ *  Copyright (c) 2009-2015, The University of Chicago
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or withsend
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  - Neither the name of The University of Chicago nor the names of its
+ *    contributors may be used to endorse or promote products derived from this
+ *    software withsend specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY send OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WAL_H_
+#define WAL_H_
+
+#include "chidbInt.h"
+
+/* Size of the log header and of the header of each frame */
+#define WAL_HEADER_SIZE (32)
+#define WAL_FRAME_HEADER_SIZE (24)
+
+/* A commit that leaves at least this many frames in the log is followed
+ * by a checkpoint */
+#define WAL_CHECKPOINT_FRAMES (1000)
+
+/* Entry of the WAL index: the most recent frame holding a page */
+typedef struct WalIndexEntry
+{
+    npage_t npage;          /* 0 if the slot is empty */
+    uint32_t frame;
+} WalIndexEntry;
+
+struct Wal
+{
+    int fd;                 /* -1 until the log is first written to */
+    char *filename;
+    uint16_t page_size;
+    uint32_t salt[2];       /* Frames carry the salt of the log they belong to */
+    uint32_t hdr_cksum[2];  /* Checksum of the log header, which seeds the first frame's */
+    uint32_t ckpt_seq;      /* Number of checkpoints so far */
+
+    uint32_t n_frames;      /* Frames in the log, committed or not */
+    uint32_t n_committed;   /* Frames up to (and including) the last commit frame */
+    npage_t db_size;        /* Size of the database, in pages, at the last commit */
+    npage_t *frame_pages;   /* Page held by each frame (frame i is frame_pages[i-1]) */
+    uint32_t *frame_cksums; /* Checksum of each frame (two values per frame) */
+    uint32_t frames_alloc;
+    uint32_t recksum;       /* First frame whose checksum is out of date, or 0 */
+
+    /* WAL index: open addressing on the page number */
+    WalIndexEntry *index;
+    uint32_t index_size;    /* Power of two */
+    uint32_t index_used;
+
+    uint8_t *buf;           /* Frame being written or read */
+};
+typedef struct Wal Wal;
+
+int chidb_Wal_open(Wal **wal, const char *dbfile);
+int chidb_Wal_find(Wal *wal, npage_t npage, uint32_t *frame);
+int chidb_Wal_readFrame(Wal *wal, uint32_t frame, uint8_t *data);
+int chidb_Wal_writePage(Wal *wal, npage_t npage, const uint8_t *data, uint16_t page_size);
+int chidb_Wal_commit(Wal *wal, npage_t db_size);
+int chidb_Wal_rollback(Wal *wal);
+int chidb_Wal_checkpoint(Wal *wal, int dbfd);
+int chidb_Wal_close(Wal *wal, int dbfd);
+
+#endif /*WAL_H_*/
@@ -16,6 +16,9 @@ char *typeToString(enum data_type type, char *buf)
     case TYPE_TEXT:
         sprintf(buf, "text");
         break;
+    case TYPE_PARAM:
+        sprintf(buf, "param");
+        break;
     }
     return buf;
 }
@@ -33,6 +33,14 @@ Literal_t *litText(char *str)
     return lval;
 }
 
+Literal_t *litParam(int param)
+{
+    Literal_t *lval = (Literal_t *)calloc(1, sizeof(Literal_t));
+    lval->t = TYPE_PARAM;
+    lval->val.ival = param;
+    return lval;
+}
+
 void Literal_print(Literal_t *val)
 {
     char buf[100];
@@ -51,6 +59,9 @@ void Literal_print(Literal_t *val)
     case TYPE_TEXT:
         printf("\"%s\"", val->val.strval);
         break;
+    case TYPE_PARAM:
+        printf("?%d", val->val.ival);
+        break;
     default:
         printf("(unknown type)");
     }
@@ -18,6 +18,8 @@ int num_stmts = 0;
 
 chisql_statement_t *__stmt;
 
+int __stmt_param(char *name);
+
 %}
 
 %union {
@@ -53,10 +55,12 @@ chisql_statement_t *__stmt;
 %token COUNT SUM AVG MIN MAX INTERSECT EXCEPT DISTINCT
 %token CONCAT TRUE FALSE CASE WHEN DECLARE BIT GROUP
 %token INDEX EXPLAIN
+%token TOKEN_BEGIN COMMIT ROLLBACK TRANSACTION
 %token <strval> IDENTIFIER
 %token <strval> STRING_LITERAL
 %token <dval> DOUBLE_LITERAL
 %token <ival> INT_LITERAL
+%token <strval> PARAMETER
 
 %type <ival> column_type bool_op comp_op select_combo
 %type <ival> function_name opt_distinct join opt_unique
@@ -100,6 +104,14 @@ sql_line
 	| select 		{ __stmt->stmt.select = $1; __stmt->type = STMT_SELECT; }
 	| insert_into 	{ __stmt->stmt.insert = $1; __stmt->type = STMT_INSERT; }
 	| delete_from 	{ __stmt->stmt.delete = $1; __stmt->type = STMT_DELETE; }
+	| TOKEN_BEGIN opt_transaction 	{ __stmt->type = STMT_BEGIN; }
+	| COMMIT opt_transaction 		{ __stmt->type = STMT_COMMIT; }
+	| ROLLBACK opt_transaction 		{ __stmt->type = STMT_ROLLBACK; }
+	| /* empty */
+	;
+
+opt_transaction
+	: TRANSACTION
 	| /* empty */
 	;
 
@@ -475,6 +487,7 @@ literal_value
 			else
 				$$ = litText($1);
 		}
+	| PARAMETER { $$ = litParam(__stmt_param($1)); }
 	;
 
 delete_from
@@ -506,12 +519,38 @@ int chisql_stmt_print(chisql_statement_t *stmt)
     case STMT_DELETE:
         Delete_print(stmt->stmt.delete);
         break;
+    case STMT_BEGIN:
+        printf("Begin\n");
+        break;
+    case STMT_COMMIT:
+        printf("Commit\n");
+        break;
+    case STMT_ROLLBACK:
+        printf("Rollback\n");
+        break;
     }
 
     return 0;
 }
 
 
+/* Returns the number of a parameter (starting at 1). Every ? is a new
+ * parameter, while every appearance of the same :name is the same one. */
+int __stmt_param(char *name)
+{
+  if (name != NULL)
+    for (int i = 0; i < __stmt->nparams; i++)
+      if (__stmt->params[i] != NULL && !strcmp(__stmt->params[i], name))
+      {
+        free(name);
+        return i + 1;
+      }
+
+  __stmt->params = realloc(__stmt->params, sizeof(char *) * (__stmt->nparams + 1));
+  __stmt->params[__stmt->nparams++] = name;
+  return __stmt->nparams;
+}
+
 char *__sql_semicolon(const char *sql)
 {
   int len = strlen(sql);
@@ -529,6 +568,8 @@ int chisql_parser(const char *sql, chisql_statement_t **stmt)
   int rc;
 
   __stmt = malloc(sizeof(chisql_statement_t));
+  __stmt->nparams = 0;
+  __stmt->params = NULL;
   char *tsql = __sql_semicolon(sql);
 
   YY_BUFFER_STATE my_string_buffer = yy_scan_string (tsql);
@@ -541,6 +582,9 @@ int chisql_parser(const char *sql, chisql_statement_t **stmt)
     return CHIDB_OK;
   } else {
     fprintf(stderr,"invalid sql: \"%s\"\n", tsql);
+    for (int i = 0; i < __stmt->nparams; i++)
+      free(__stmt->params[i]);
+    free(__stmt->params);
     free(__stmt);
     return CHIDB_EINVALIDSQL;
   }
@@ -27,6 +27,8 @@ TCase* make_btree_5_tc(void);
 TCase* make_btree_6_tc(void);
 TCase* make_btree_7_tc(void);
 TCase* make_btree_8_tc(void);
+TCase* make_btree_9_tc(void);
+TCase* make_btree_10_tc(void);
 
 
 
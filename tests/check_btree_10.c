@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <check.h>
+#include "check_btree.h"
+
+static chidb_key_t *sort_keys;
+
+static int cmp_bigfile(const void *a, const void *b)
+{
+    chidb_key_t ka = sort_keys[*(const int *) a], kb = sort_keys[*(const int *) b];
+
+    return (ka > kb) - (ka < kb);
+}
+
+/* Returns the positions of the bigfile entries, sorted by keys[i] */
+int *sorted_bigfile(chidb_key_t *keys)
+{
+    int *order = malloc(bigfile_nvalues * sizeof(int));
+
+    for(int i=0; i<bigfile_nvalues; i++)
+        order[i] = i;
+    sort_keys = keys;
+    qsort(order, bigfile_nvalues, sizeof(int), cmp_bigfile);
+
+    return order;
+}
+
+START_TEST (test_10_1)
+{
+    chidb *db;
+    int rc;
+    int *order;
+    npage_t nroot;
+    BTreeBuilder bb;
+    BTreeCell btc;
+    uint8_t data[192];
+
+    char *fname = create_tmp_file();
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(fname, db, &db->bt);
+    ck_assert(rc == CHIDB_OK);
+
+    order = sorted_bigfile(bigfile_pkeys);
+
+    rc = chidb_Btree_bulkInit(db->bt, &bb, PGTYPE_TABLE_LEAF, 100);
+    ck_assert(rc == CHIDB_OK);
+    for(int j=0; j<bigfile_nvalues; j++)
+    {
+        int i = order[j];
+
+        for(int k=0; k<48; k++)
+            put4byte(data + (4*k), bigfile_ikeys[i]);
+
+        btc.type = PGTYPE_TABLE_LEAF;
+        btc.key = bigfile_pkeys[i];
+        btc.fields.tableLeaf.data = data;
+        btc.fields.tableLeaf.data_size = ((bigfile_pkeys[i] % 3) + 1) * 64;
+        rc = chidb_Btree_bulkAppend(&bb, &btc);
+        ck_assert(rc == CHIDB_OK);
+    }
+
+    /* Keys must be increasing */
+    rc = chidb_Btree_bulkAppend(&bb, &btc);
+    ck_assert(rc == CHIDB_EDUPLICATE);
+    btc.key = bigfile_pkeys[order[0]];
+    rc = chidb_Btree_bulkAppend(&bb, &btc);
+    ck_assert(rc == CHIDB_EMISUSE);
+
+    rc = chidb_Btree_bulkFinish(&bb, &nroot);
+    ck_assert(rc == CHIDB_OK);
+
+    for(int i=0; i<bigfile_nvalues; i++)
+    {
+        uint8_t* buf;
+        uint16_t size;
+        int datalen = ((bigfile_pkeys[i] % 3) + 1) * 64;
+
+        for(int k=0; k<48; k++)
+            put4byte(data + (4*k), bigfile_ikeys[i]);
+
+        rc = chidb_Btree_find(db->bt, nroot, bigfile_pkeys[i], &buf, &size);
+        ck_assert(rc == CHIDB_OK);
+        ck_assert(size == datalen);
+        ck_assert(!memcmp(buf, data, datalen));
+        free(buf);
+    }
+
+    free(order);
+    chidb_Btree_close(db->bt);
+    delete_tmp_file(fname);
+    free(db);
+}
+END_TEST
+
+
+START_TEST (test_10_2)
+{
+    chidb *db;
+    int rc;
+    int *order;
+    npage_t nroot;
+    BTreeBuilder bb;
+    BTreeCell btc;
+
+    char *fname = create_tmp_file();
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(fname, db, &db->bt);
+    ck_assert(rc == CHIDB_OK);
+
+    for(int i=0; i<bigfile_nvalues; i++)
+        insert_bigfile(db, i);
+
+    order = sorted_bigfile(bigfile_ikeys);
+
+    rc = chidb_Btree_bulkInit(db->bt, &bb, PGTYPE_INDEX_LEAF, 75);
+    ck_assert(rc == CHIDB_OK);
+    for(int j=0; j<bigfile_nvalues; j++)
+    {
+        btc.type = PGTYPE_INDEX_LEAF;
+        btc.key = bigfile_ikeys[order[j]];
+        btc.fields.indexLeaf.keyPk = bigfile_pkeys[order[j]];
+        rc = chidb_Btree_bulkAppend(&bb, &btc);
+        ck_assert(rc == CHIDB_OK);
+    }
+    rc = chidb_Btree_bulkFinish(&bb, &nroot);
+    ck_assert(rc == CHIDB_OK);
+
+    test_index_bigfile(db, nroot);
+
+    free(order);
+    chidb_Btree_close(db->bt);
+    delete_tmp_file(fname);
+    free(db);
+}
+END_TEST
+
+
+START_TEST (test_10_3)
+{
+    chidb *db;
+    int rc;
+    int *order;
+    npage_t sorted_pages, reverse_pages;
+
+    /* Appending increasing keys leaves the leaves full, so it takes
+     * fewer pages than inserting the same keys in decreasing order */
+    order = sorted_bigfile(bigfile_pkeys);
+
+    char *fname = create_tmp_file();
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(fname, db, &db->bt);
+    ck_assert(rc == CHIDB_OK);
+    for(int j=0; j<bigfile_nvalues; j++)
+        insert_bigfile(db, order[j]);
+    test_bigfile(db);
+    sorted_pages = db->bt->pager->n_pages;
+    chidb_Btree_close(db->bt);
+    delete_tmp_file(fname);
+
+    fname = create_tmp_file();
+    rc = chidb_Btree_open(fname, db, &db->bt);
+    ck_assert(rc == CHIDB_OK);
+    for(int j=bigfile_nvalues-1; j>=0; j--)
+        insert_bigfile(db, order[j]);
+    test_bigfile(db);
+    reverse_pages = db->bt->pager->n_pages;
+    chidb_Btree_close(db->bt);
+    delete_tmp_file(fname);
+
+    ck_assert(sorted_pages < reverse_pages);
+
+    free(order);
+    free(db);
+}
+END_TEST
+
+
+TCase* make_btree_10_tc(void)
+{
+    TCase *tc = tcase_create ("Step 10: Bulk loading");
+    tcase_add_test (tc, test_10_1);
+    tcase_add_test (tc, test_10_2);
+    tcase_add_test (tc, test_10_3);
+
+    return tc;
+}
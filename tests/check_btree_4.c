@@ -140,6 +140,52 @@ START_TEST (test_4_4)
 END_TEST
 
 
+START_TEST (test_4_5)
+{
+    chidb *db;
+    BTreeNode *btn;
+    BTreeCell btc, prev;
+    ncell_t ncell;
+
+    char *fname = create_copy(TESTFILE_STRINGS1, "btree-test-4-5.dat");
+    db = malloc(sizeof(chidb));
+    chidb_Btree_open(fname, db, &db->bt);
+
+    for(npage_t npage = 1; npage <= db->bt->pager->n_pages; npage++)
+    {
+        chidb_Btree_getNodeByPage(db->bt, npage, &btn);
+
+        for(ncell_t i = 0; i < btn->n_cells; i++)
+        {
+            chidb_Btree_getCell(btn, i, &btc);
+            ck_assert(chidb_Btree_searchNode(btn, btc.key, &ncell) == CHIDB_OK);
+            ck_assert_int_eq(ncell, i);
+
+            /* A missing key is positioned before the next larger key */
+            if(i == 0 || btc.key - 1 > prev.key)
+            {
+                ck_assert(chidb_Btree_searchNode(btn, btc.key - 1, &ncell) == CHIDB_ENOTFOUND);
+                ck_assert_int_eq(ncell, i);
+            }
+            prev = btc;
+        }
+
+        if(btn->n_cells > 0)
+        {
+            ck_assert(chidb_Btree_searchNode(btn, prev.key + 1, &ncell) == CHIDB_ENOTFOUND);
+            ck_assert_int_eq(ncell, btn->n_cells);
+        }
+
+        chidb_Btree_freeMemNode(db->bt, btn);
+    }
+
+    chidb_Btree_close(db->bt);
+    delete_copy(fname);
+    free(db);
+}
+END_TEST
+
+
 TCase* make_btree_4_tc(void)
 {
     TCase *tc = tcase_create ("Step 4: Manipulating B-Tree cells");
@@ -147,6 +193,7 @@ TCase* make_btree_4_tc(void)
     tcase_add_test (tc, test_4_2);
     tcase_add_test (tc, test_4_3);
     tcase_add_test (tc, test_4_4);
+    tcase_add_test (tc, test_4_5);
 
     return tc;
 }
@@ -40,11 +40,46 @@ START_TEST (test_5_2)
 END_TEST
 
 
+START_TEST (test_5_3)
+{
+    chidb *db;
+    uint16_t size;
+    uint8_t *data;
+    MemPage *page;
+    int rc;
+
+    db = malloc(sizeof(chidb));
+    char *fname = create_copy(TESTFILE_STRINGS1, "btree-test-5-3.dat");
+    chidb_Btree_open(fname, db, &db->bt);
+    for(int i = 0; i<file1_nvalues; i++)
+    {
+        rc = chidb_Btree_findRef(db->bt, 1, file1_keys[i], &data, &size, &page);
+        ck_assert(rc == CHIDB_OK);
+        ck_assert(size == 128);
+        ck_assert(!strcmp((char *) data, file1_values[i]));
+
+        /* The data points into the pinned leaf page */
+        ck_assert(data > page->data && data < page->data + db->bt->pager->page_size);
+        ck_assert(page->pins > 0);
+        chidb_Btree_releaseRef(db->bt, page);
+    }
+
+    rc = chidb_Btree_findRef(db->bt, 1, 4, &data, &size, &page);
+    ck_assert(rc == CHIDB_ENOTFOUND);
+
+    chidb_Btree_close(db->bt);
+    delete_copy(fname);
+    free(db);
+}
+END_TEST
+
+
 TCase* make_btree_5_tc(void)
 {
     TCase *tc = tcase_create ("Step 5: Finding a value in a B-Tree");
     tcase_add_test (tc, test_5_1);
     tcase_add_test (tc, test_5_2);
+    tcase_add_test (tc, test_5_3);
 
     return tc;
 }
@@ -70,12 +70,74 @@ START_TEST (test_7_3)
 END_TEST
 
 
+START_TEST (test_7_4)
+{
+    chidb *db;
+    int rc;
+    BTreeNode *btn;
+    BTreeCell cell;
+    npage_t npage = 1, prev = 0;
+    int n = 0;
+
+    char *fname = create_tmp_file();
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(fname, db, &db->bt);
+    ck_assert(rc == CHIDB_OK);
+
+    for(int i=bigfile_nvalues-1; i>=0; i--)
+        insert_bigfile(db, i);
+
+    /* Find the leftmost leaf */
+    for(;;)
+    {
+        rc = chidb_Btree_getNodeByPage(db->bt, npage, &btn);
+        ck_assert(rc == CHIDB_OK);
+        if(btn->type == PGTYPE_TABLE_LEAF)
+            break;
+        chidb_Btree_getCell(btn, 0, &cell);
+        npage = cell.fields.tableInternal.child_page;
+        chidb_Btree_freeMemNode(db->bt, btn);
+    }
+
+    /* Follow the sibling links, which must visit every key in order */
+    for(;;)
+    {
+        ck_assert(btn->linked);
+        ck_assert(btn->prev_leaf == prev);
+        btn_sanity_check(db->bt, btn, false);
+        ck_assert(btn->cells_offset <= db->bt->pager->page_size - LEAFPG_LINKS_SIZE);
+
+        for(int i=0; i<btn->n_cells; i++)
+        {
+            chidb_Btree_getCell(btn, i, &cell);
+            ck_assert(cell.key == bigfile_pkeys[n++]);
+        }
+
+        prev = npage;
+        npage = btn->next_leaf;
+        chidb_Btree_freeMemNode(db->bt, btn);
+        if(npage == 0)
+            break;
+
+        rc = chidb_Btree_getNodeByPage(db->bt, npage, &btn);
+        ck_assert(rc == CHIDB_OK);
+    }
+    ck_assert(n == bigfile_nvalues);
+
+    chidb_Btree_close(db->bt);
+    delete_tmp_file(fname);
+    free(db);
+}
+END_TEST
+
+
 TCase* make_btree_7_tc(void)
 {
     TCase *tc = tcase_create ("Step 7: Insertion with splitting");
     tcase_add_test (tc, test_7_1);
     tcase_add_test (tc, test_7_2);
     tcase_add_test (tc, test_7_3);
+    tcase_add_test (tc, test_7_4);
 
     return tc;
 }
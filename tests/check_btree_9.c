@@ -0,0 +1,272 @@
+#include <stdlib.h>
+#include <check.h>
+#include "check_btree.h"
+
+void test_bigfile_deleted(chidb *db, char *deleted)
+{
+    int rc;
+
+    for(int i=0; i<bigfile_nvalues; i++)
+    {
+        uint8_t* buf;
+        uint16_t size;
+
+        rc = chidb_Btree_find(db->bt, 1, bigfile_pkeys[i], &buf, &size);
+        if(deleted[i])
+            ck_assert(rc == CHIDB_ENOTFOUND);
+        else
+        {
+            ck_assert(rc == CHIDB_OK);
+            ck_assert(size == ((bigfile_pkeys[i] % 3) + 1) * 64);
+            free(buf);
+        }
+    }
+}
+
+uint32_t get_free_pages(chidb *db)
+{
+    MemPage *page;
+    uint32_t n;
+
+    chidb_Pager_readPage(db->bt->pager, 1, &page);
+    n = get4byte(page->data + HEADER_FREECOUNT_OFFSET);
+    chidb_Pager_releaseMemPage(db->bt->pager, page);
+
+    return n;
+}
+
+START_TEST (test_9_1)
+{
+    chidb *db;
+    int rc;
+    char *deleted;
+
+    char *fname = create_tmp_file();
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(fname, db, &db->bt);
+    ck_assert(rc == CHIDB_OK);
+
+    for(int i=0; i<bigfile_nvalues; i++)
+        insert_bigfile(db, i);
+
+    deleted = calloc(bigfile_nvalues, 1);
+
+    for(int i=0; i<bigfile_nvalues; i+=2)
+    {
+        rc = chidb_Btree_delete(db->bt, 1, bigfile_pkeys[i]);
+        ck_assert(rc == CHIDB_OK);
+        deleted[i] = 1;
+    }
+    test_bigfile_deleted(db, deleted);
+
+    rc = chidb_Btree_delete(db->bt, 1, bigfile_pkeys[0]);
+    ck_assert(rc == CHIDB_ENOTFOUND);
+
+    for(int i=1; i<bigfile_nvalues; i+=2)
+    {
+        rc = chidb_Btree_delete(db->bt, 1, bigfile_pkeys[i]);
+        ck_assert(rc == CHIDB_OK);
+        deleted[i] = 1;
+    }
+    test_bigfile_deleted(db, deleted);
+
+    /* Every page but the (now empty) root is free */
+    ck_assert_int_eq(get_free_pages(db), db->bt->pager->n_pages - 1);
+
+    free(deleted);
+    chidb_Btree_close(db->bt);
+    delete_tmp_file(fname);
+    free(db);
+}
+END_TEST
+
+
+START_TEST (test_9_2)
+{
+    chidb *db;
+    int rc;
+    npage_t npage, n_pages;
+
+    char *fname = create_tmp_file();
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(fname, db, &db->bt);
+    ck_assert(rc == CHIDB_OK);
+
+    for(int i=0; i<bigfile_nvalues; i++)
+        insert_bigfile(db, i);
+
+    n_pages = db->bt->pager->n_pages;
+    for(int i=bigfile_nvalues-1; i>=0; i--)
+    {
+        rc = chidb_Btree_delete(db->bt, 1, bigfile_pkeys[i]);
+        ck_assert(rc == CHIDB_OK);
+    }
+
+    /* The free-page list survives reopening the file */
+    chidb_Btree_close(db->bt);
+    rc = chidb_Btree_open(fname, db, &db->bt);
+    ck_assert(rc == CHIDB_OK);
+    ck_assert_int_eq(get_free_pages(db), n_pages - 1);
+
+    /* Freed pages are reused before the file grows */
+    chidb_Btree_newNode(db->bt, &npage, PGTYPE_INDEX_LEAF);
+    ck_assert(npage <= n_pages);
+    ck_assert_int_eq(get_free_pages(db), n_pages - 2);
+    rc = chidb_Btree_freePage(db->bt, npage);
+    ck_assert(rc == CHIDB_OK);
+
+    for(int i=0; i<bigfile_nvalues; i++)
+        insert_bigfile(db, i);
+    test_bigfile(db);
+    ck_assert_int_eq(db->bt->pager->n_pages, n_pages);
+
+    chidb_Btree_close(db->bt);
+    delete_tmp_file(fname);
+    free(db);
+}
+END_TEST
+
+
+START_TEST (test_9_3)
+{
+    chidb *db;
+    int rc;
+    npage_t npage;
+    chidb_key_t pkey;
+
+    char *fname = create_tmp_file();
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(fname, db, &db->bt);
+    ck_assert(rc == CHIDB_OK);
+
+    for(int i=0; i<bigfile_nvalues; i++)
+        insert_bigfile(db, i);
+
+    chidb_Btree_newNode(db->bt, &npage, PGTYPE_INDEX_LEAF);
+    for(int i=0; i<bigfile_nvalues; i++)
+        chidb_Btree_insertInIndex(db->bt, npage, bigfile_ikeys[i], bigfile_pkeys[i]);
+
+    /* Entries in internal index nodes are replaced by their predecessor */
+    for(int i=0; i<bigfile_nvalues; i+=3)
+    {
+        rc = chidb_Btree_delete(db->bt, npage, bigfile_ikeys[i]);
+        ck_assert(rc == CHIDB_OK);
+    }
+
+    for(int i=0; i<bigfile_nvalues; i++)
+    {
+        rc = chidb_Btree_findInIndex(db->bt, npage, bigfile_ikeys[i], &pkey);
+        if(i % 3 == 0)
+            ck_assert(rc == CHIDB_ENOTFOUND);
+        else
+        {
+            ck_assert(rc == CHIDB_OK);
+            ck_assert(pkey == bigfile_pkeys[i]);
+        }
+    }
+
+    chidb_Btree_close(db->bt);
+    delete_tmp_file(fname);
+    free(db);
+}
+END_TEST
+
+
+/* Depth of the leaves below npage, or -1 if they are not all at the same depth */
+int leaf_depth(BTree *bt, npage_t npage)
+{
+    BTreeNode *btn;
+    BTreeCell cell;
+    int depth = -2, d;
+
+    chidb_Btree_getNodeByPage(bt, npage, &btn);
+    if(btn->type == PGTYPE_TABLE_LEAF || btn->type == PGTYPE_INDEX_LEAF)
+    {
+        chidb_Btree_freeMemNode(bt, btn);
+        return 0;
+    }
+
+    for(int i=0; i<=btn->n_cells; i++)
+    {
+        if(i < btn->n_cells)
+        {
+            chidb_Btree_getCell(btn, i, &cell);
+            d = leaf_depth(bt, cell.fields.tableInternal.child_page);
+        }
+        else
+            d = leaf_depth(bt, btn->right_page);
+
+        if(d < 0 || (depth != -2 && d != depth))
+            depth = -1;
+        else if(depth == -2)
+            depth = d;
+    }
+    chidb_Btree_freeMemNode(bt, btn);
+
+    return depth < 0 ? -1 : depth + 1;
+}
+
+START_TEST (test_9_4)
+{
+    chidb *db;
+    int rc;
+    uint8_t data[900], *buf;
+    uint16_t size;
+    chidb_key_t nkeys = 3001;
+
+    char *fname = create_tmp_file();
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(fname, db, &db->bt);
+    ck_assert(rc == CHIDB_OK);
+
+    /* Large records among small ones take several splits of the same
+     * leaf, which fill up the internal nodes above it; those are split
+     * in turn, and the leaves stay at the same depth */
+    for(chidb_key_t i=0; i<nkeys; i++)
+    {
+        chidb_key_t key = (i * 7919) % nkeys + 1;
+
+        memset(data, key, sizeof(data));
+        rc = chidb_Btree_insertInTable(db->bt, 1, key, data, key % 4 ? 40 : 900);
+        ck_assert(rc == CHIDB_OK);
+    }
+    ck_assert(leaf_depth(db->bt, 1) > 1);
+
+    for(chidb_key_t key=1; key<=nkeys; key++)
+    {
+        memset(data, key, sizeof(data));
+        rc = chidb_Btree_find(db->bt, 1, key, &buf, &size);
+        ck_assert(rc == CHIDB_OK);
+        ck_assert_int_eq(size, key % 4 ? 40 : 900);
+        ck_assert(!memcmp(buf, data, size));
+        free(buf);
+    }
+
+    for(chidb_key_t i=0; i<nkeys; i++)
+    {
+        rc = chidb_Btree_delete(db->bt, 1, (i * 7919) % nkeys + 1);
+        ck_assert(rc == CHIDB_OK);
+        if(i % 500 == 0)
+            ck_assert(leaf_depth(db->bt, 1) >= 0);
+    }
+
+    /* Every page but the (now empty) root is free */
+    ck_assert_int_eq(get_free_pages(db), db->bt->pager->n_pages - 1);
+
+    chidb_Btree_close(db->bt);
+    delete_tmp_file(fname);
+    free(db);
+}
+END_TEST
+
+
+TCase* make_btree_9_tc(void)
+{
+    TCase *tc = tcase_create ("Step 9: Deleting entries");
+    tcase_add_test (tc, test_9_1);
+    tcase_add_test (tc, test_9_2);
+    tcase_add_test (tc, test_9_3);
+    tcase_add_test (tc, test_9_4);
+
+    return tc;
+}
@@ -89,6 +89,1037 @@ START_TEST (test_dbm)
 END_TEST
 
 
+/* Builds a DBM program from an array of instructions and verifies it */
+int verify_program(chidb_stmt *stmt, chidb_dbm_op_t *ops, int nops)
+{
+    static chidb db;
+
+    chidb_stmt_init(stmt, &db);
+    for(int i=0; i < nops; i++)
+        chidb_stmt_set_op(stmt, &ops[i], i);
+
+    return chidb_stmt_verify(stmt);
+}
+
+START_TEST (test_verify)
+{
+    chidb_stmt stmt;
+
+    /* A valid program gets as many registers and cursors as it uses */
+    chidb_dbm_op_t valid[] = {
+        {Op_Integer, 2, 40, 0, NULL},
+        {Op_OpenRead, 12, 40, 0, NULL},
+        {Op_Rewind, 12, 4, 0, NULL},
+        {Op_Next, 12, 3, 0, NULL},
+        {Op_Close, 12, 0, 0, NULL},
+    };
+    ck_assert_int_eq(verify_program(&stmt, valid, 5), CHIDB_OK);
+    ck_assert(stmt.nReg > 40);
+    ck_assert(stmt.nCursors > 12);
+    chidb_stmt_free(&stmt);
+
+    /* Jump past the end of the program */
+    chidb_dbm_op_t badjump[] = {
+        {Op_Integer, 1, 0, 0, NULL},
+        {Op_Eq, 0, 3, 0, NULL},
+    };
+    ck_assert_int_eq(verify_program(&stmt, badjump, 2), CHIDB_PROBLEM);
+    chidb_stmt_free(&stmt);
+
+    /* Negative register */
+    chidb_dbm_op_t badreg[] = {
+        {Op_Integer, 1, -1, 0, NULL},
+    };
+    ck_assert_int_eq(verify_program(&stmt, badreg, 1), CHIDB_PROBLEM);
+    chidb_stmt_free(&stmt);
+
+    /* Register that is never written */
+    chidb_dbm_op_t unwritten[] = {
+        {Op_Integer, 1, 0, 0, NULL},
+        {Op_ResultRow, 0, 2, 0, NULL},
+    };
+    ck_assert_int_eq(verify_program(&stmt, unwritten, 2), CHIDB_PROBLEM);
+    chidb_stmt_free(&stmt);
+
+    /* Cursor that is never opened */
+    chidb_dbm_op_t unopened[] = {
+        {Op_Rewind, 0, 1, 0, NULL},
+    };
+    ck_assert_int_eq(verify_program(&stmt, unopened, 1), CHIDB_PROBLEM);
+    chidb_stmt_free(&stmt);
+
+    /* String without a value */
+    chidb_dbm_op_t nostring[] = {
+        {Op_String, 0, 0, 0, NULL},
+    };
+    ck_assert_int_eq(verify_program(&stmt, nostring, 1), CHIDB_PROBLEM);
+    chidb_stmt_free(&stmt);
+}
+END_TEST
+
+START_TEST (test_bind)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    char s[20];
+
+    char *fname = create_tmp_file();
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    ck_assert(chidb_prepare(db, "CREATE TABLE t(id INTEGER PRIMARY KEY, v INTEGER, s TEXT);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    /* The same INSERT is run several times, with different values */
+    ck_assert(chidb_prepare(db, "INSERT INTO t VALUES(?, :v, :s);", &stmt) == CHIDB_OK);
+    ck_assert_int_eq(chidb_bind_parameter_count(stmt), 3);
+    ck_assert_int_eq(chidb_bind_parameter_index(stmt, ":s"), 3);
+    ck_assert_int_eq(chidb_bind_parameter_index(stmt, ":x"), 0);
+    ck_assert_int_eq(chidb_bind_int(stmt, 4, 0), CHIDB_EMISUSE);
+    for(int i = 1; i <= 5; i++)
+    {
+        sprintf(s, "row%i", i);
+        ck_assert(chidb_bind_int(stmt, 1, i) == CHIDB_OK);
+        ck_assert(chidb_bind_int(stmt, 2, i * 10) == CHIDB_OK);
+        ck_assert(chidb_bind_text(stmt, 3, s) == CHIDB_OK);
+        ck_assert(chidb_step(stmt) == CHIDB_DONE);
+        ck_assert(chidb_reset(stmt) == CHIDB_OK);
+    }
+
+    /* A value of the wrong type */
+    chidb_bind_int(stmt, 1, 6);
+    chidb_bind_text(stmt, 2, "60");
+    ck_assert_int_eq(chidb_step(stmt), CHIDB_EMISMATCH);
+    chidb_finalize(stmt);
+
+    /* The same SELECT is run several times, with different values */
+    ck_assert(chidb_prepare(db, "SELECT s FROM t WHERE v > :v;", &stmt) == CHIDB_OK);
+    for(int v = 0; v <= 50; v += 10)
+    {
+        int n = 0;
+
+        chidb_bind_int(stmt, 1, v);
+        while(chidb_step(stmt) == CHIDB_ROW)
+        {
+            sprintf(s, "row%i", v / 10 + n + 1);
+            ck_assert_str_eq(chidb_column_text(stmt, 0), s);
+            n++;
+        }
+        ck_assert_int_eq(n, 5 - v / 10);
+        chidb_reset(stmt);
+    }
+    chidb_finalize(stmt);
+
+    chidb_close(db);
+    delete_tmp_file(fname);
+}
+END_TEST
+
+START_TEST (test_stmt_cache)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    char sql[100], s[20];
+    int n;
+
+    char *fname = create_tmp_file();
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    ck_assert(chidb_prepare(db, "CREATE TABLE t(id INTEGER PRIMARY KEY, v INTEGER, s TEXT);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    /* Statements that only differ in their literals */
+    for(int i = 1; i <= 100; i++)
+    {
+        sprintf(sql, "INSERT INTO t VALUES(%i, %i, 'row%i');", i, i * 10, i);
+        ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+        ck_assert_int_eq(chidb_bind_parameter_count(stmt), 0);
+        ck_assert(chidb_step(stmt) == CHIDB_DONE);
+        chidb_finalize(stmt);
+    }
+    for(int i = 1; i <= 100; i += 33)
+    {
+        sprintf(sql, "SELECT s FROM t WHERE id = %i;", i);
+        ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+        /* The literal is not a parameter that can be bound again */
+        ck_assert_int_eq(chidb_bind_parameter_count(stmt), 0);
+        ck_assert_int_eq(chidb_bind_int(stmt, 1, 0), CHIDB_EMISUSE);
+        ck_assert(chidb_step(stmt) == CHIDB_ROW);
+        sprintf(s, "row%i", i);
+        ck_assert_str_eq(chidb_column_text(stmt, 0), s);
+        ck_assert(chidb_step(stmt) == CHIDB_DONE);
+        chidb_finalize(stmt);
+    }
+
+    /* A literal of the wrong type is still rejected */
+    ck_assert(chidb_prepare(db, "INSERT INTO t VALUES(101, 'abc', 'row101');", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "INSERT INTO t VALUES(101, 1010, 1);", &stmt) == CHIDB_EINVALIDSQL);
+
+    /* More statements than the cache can hold */
+    const char *cols[] = {"id", "v", "s"};
+    for(int k = 0; k < 2; k++)
+        for(int c = 0; c < 81; c++)
+        {
+            int id = c + 1;
+
+            sprintf(sql, "SELECT %s, %s, %s, %s FROM t WHERE id = %i;",
+                    cols[c % 3], cols[c / 3 % 3], cols[c / 9 % 3], cols[c / 27], id);
+            ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+            ck_assert(chidb_step(stmt) == CHIDB_ROW);
+            for(int col = 0, d = c; col < 4; col++, d /= 3)
+            {
+                if(d % 3 == 0)
+                    ck_assert_int_eq(chidb_column_int(stmt, col), id);
+                else if(d % 3 == 1)
+                    ck_assert_int_eq(chidb_column_int(stmt, col), id * 10);
+                else
+                {
+                    sprintf(s, "row%i", id);
+                    ck_assert_str_eq(chidb_column_text(stmt, col), s);
+                }
+            }
+            ck_assert(chidb_step(stmt) == CHIDB_DONE);
+            chidb_finalize(stmt);
+        }
+
+    /* Changing the schema empties the cache */
+    ck_assert(chidb_prepare(db, "SELECT * FROM u;", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "CREATE TABLE u(id INTEGER PRIMARY KEY, w INTEGER);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+    ck_assert(chidb_prepare(db, "INSERT INTO u VALUES(1, 2);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+    ck_assert(chidb_prepare(db, "SELECT * FROM u;", &stmt) == CHIDB_OK);
+    for(n = 0; chidb_step(stmt) == CHIDB_ROW; n++)
+        ;
+    ck_assert_int_eq(n, 1);
+    chidb_finalize(stmt);
+
+    chidb_close(db);
+    delete_tmp_file(fname);
+}
+END_TEST
+
+
+START_TEST (test_catalog)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    char sql[200];
+
+    char *fname = create_tmp_file();
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* Enough tables and columns for the catalog to grow */
+    for(int i = 0; i < 150; i++)
+    {
+        sprintf(sql, "CREATE TABLE t%i(id INTEGER PRIMARY KEY, a%i INTEGER, b%i TEXT);", i, i, i);
+        ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+        ck_assert(chidb_step(stmt) == CHIDB_DONE);
+        chidb_finalize(stmt);
+    }
+
+    for(int k = 0; k < 2; k++)
+    {
+        for(int i = 0; i < 150; i += 7)
+        {
+            if(k == 0)
+            {
+                sprintf(sql, "INSERT INTO t%i VALUES(1, %i, 'x%i');", i, i, i);
+                ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+                ck_assert(chidb_step(stmt) == CHIDB_DONE);
+                chidb_finalize(stmt);
+            }
+
+            sprintf(sql, "SELECT b%i, a%i FROM t%i WHERE a%i = %i;", i, i, i, i, i);
+            ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+            ck_assert(chidb_step(stmt) == CHIDB_ROW);
+            ck_assert_int_eq(chidb_column_int(stmt, 1), i);
+            chidb_finalize(stmt);
+
+            /* Columns only exist in their own table */
+            sprintf(sql, "SELECT a%i FROM t%i;", i + 1, i);
+            ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_EINVALIDSQL);
+        }
+
+        /* The catalog is built again when the file is opened */
+        chidb_close(db);
+        ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+    }
+
+    ck_assert(chidb_prepare(db, "CREATE TABLE t10(id INTEGER PRIMARY KEY);", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "SELECT * FROM t150;", &stmt) == CHIDB_EINVALIDSQL);
+
+    /* A table created and rolled back is forgotten, even if another
+       table is created afterwards */
+    ck_assert(chidb_begin(db) == CHIDB_OK);
+    ck_assert(chidb_prepare(db, "CREATE TABLE u(id INTEGER PRIMARY KEY);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+    ck_assert(chidb_prepare(db, "SELECT * FROM u;", &stmt) == CHIDB_OK);
+    chidb_finalize(stmt);
+    ck_assert(chidb_rollback(db) == CHIDB_OK);
+    ck_assert(chidb_prepare(db, "CREATE TABLE v(id INTEGER PRIMARY KEY);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+    ck_assert(chidb_prepare(db, "SELECT * FROM u;", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "SELECT * FROM v;", &stmt) == CHIDB_OK);
+    chidb_finalize(stmt);
+
+    chidb_close(db);
+    delete_tmp_file(fname);
+}
+END_TEST
+
+
+START_TEST (test_index)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int n, rc;
+    uint32_t prev;
+
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-index.cdb");
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* Equality goes through the index on altcode */
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers WHERE altcode = 9992;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert_int_eq(chidb_column_int(stmt, 0), 7912);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    /* Ranges return the same rows, in the same (rowid) order, as a scan */
+    ck_assert(chidb_prepare(db, "SELECT code, altcode FROM numbers WHERE altcode < 100;", &stmt) == CHIDB_OK);
+    for(n = 0, prev = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; n++)
+    {
+        ck_assert(chidb_column_int(stmt, 1) < 100);
+        ck_assert((uint32_t) chidb_column_int(stmt, 0) > prev);
+        prev = chidb_column_int(stmt, 0);
+    }
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert(n > 0);
+    chidb_finalize(stmt);
+
+    /* Queries that only need the indexed column and the primary key
+       do not read the table */
+    ck_assert(chidb_prepare(db, "EXPLAIN SELECT code, altcode FROM numbers WHERE altcode > 9980;", &stmt) == CHIDB_OK);
+    while((rc = chidb_step(stmt)) == CHIDB_ROW)
+        ck_assert(strcmp(chidb_column_text(stmt, 1), "OpenRead") || chidb_column_int(stmt, 2) != 0);
+    ck_assert(rc == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    int covered[][2] = { {597, 9990}, {6853, 9988}, {7912, 9992}, {9861, 9987} };
+    ck_assert(chidb_prepare(db, "SELECT code, altcode FROM numbers WHERE altcode > 9980;", &stmt) == CHIDB_OK);
+    for(n = 0; n < 4; n++)
+    {
+        ck_assert(chidb_step(stmt) == CHIDB_ROW);
+        ck_assert_int_eq(chidb_column_int(stmt, 0), covered[n][0]);
+        ck_assert_int_eq(chidb_column_int(stmt, 1), covered[n][1]);
+    }
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    ck_assert(chidb_prepare(db, "SELECT altcode, code FROM numbers WHERE altcode = 9992;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert_int_eq(chidb_column_int(stmt, 0), 9992);
+    ck_assert_int_eq(chidb_column_int(stmt, 1), 7912);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    /* New rows are added to the index, which does not allow duplicates */
+    ck_assert(chidb_prepare(db, "INSERT INTO numbers VALUES(100000, 'xx', 100000);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+    ck_assert(chidb_prepare(db, "INSERT INTO numbers VALUES(100001, 'yy', 100000);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ECONSTRAINT);
+    chidb_finalize(stmt);
+
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers WHERE altcode = ?;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_bind_int(stmt, 1, 100000) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert_int_eq(chidb_column_int(stmt, 0), 100000);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers WHERE altcode >= 9992;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert_int_eq(chidb_column_int(stmt, 0), 7912);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert_int_eq(chidb_column_int(stmt, 0), 100000);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    /* The failed insert was rolled back */
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers WHERE code = 100001;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    chidb_close(db);
+    delete_copy(fname);
+}
+END_TEST
+
+
+START_TEST (test_create_index)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int n, rc;
+
+    char *fname = create_tmp_file();
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    ck_assert(chidb_prepare(db, "CREATE TABLE t(id INTEGER PRIMARY KEY, a INTEGER, b INTEGER, c TEXT);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    /* a is a permutation of the ids, b has duplicates */
+    ck_assert(chidb_begin(db) == CHIDB_OK);
+    ck_assert(chidb_prepare(db, "INSERT INTO t VALUES(?, ?, ?, 'row');", &stmt) == CHIDB_OK);
+    for(int i = 1; i <= 5000; i++)
+    {
+        ck_assert(chidb_bind_int(stmt, 1, i) == CHIDB_OK);
+        ck_assert(chidb_bind_int(stmt, 2, (i * 7919) % 5003) == CHIDB_OK);
+        ck_assert(chidb_bind_int(stmt, 3, i % 10) == CHIDB_OK);
+        ck_assert(chidb_step(stmt) == CHIDB_DONE);
+        ck_assert(chidb_reset(stmt) == CHIDB_OK);
+    }
+    chidb_finalize(stmt);
+    ck_assert(chidb_commit(db) == CHIDB_OK);
+
+    /* The entries are sorted within the sort memory budget, in runs
+       written to a temporary file */
+    ck_assert(chidb_set_sort_memory(db, 4096) == CHIDB_OK);
+    ck_assert(chidb_prepare(db, "CREATE INDEX ta ON t(a);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    ck_assert(stmt->nSorters == 1 && stmt->sorters[0].nruns > 1);
+    chidb_finalize(stmt);
+
+    /* Only new, integer columns can be indexed, and only once by name */
+    ck_assert(chidb_prepare(db, "CREATE INDEX ta ON t(b);", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "CREATE INDEX tc ON t(c);", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "CREATE INDEX tx ON t(x);", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "CREATE INDEX tx ON u(a);", &stmt) == CHIDB_EINVALIDSQL);
+
+    /* An index is a single entry per key */
+    ck_assert(chidb_prepare(db, "CREATE INDEX tb ON t(b);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ECONSTRAINT);
+    chidb_finalize(stmt);
+
+    for(int k = 0; k < 2; k++)
+    {
+        /* Every row can be found through the index */
+        ck_assert(chidb_prepare(db, "SELECT id FROM t WHERE a = ?;", &stmt) == CHIDB_OK);
+        for(int i = 1; i <= 5000; i += 13)
+        {
+            ck_assert(chidb_bind_int(stmt, 1, (i * 7919) % 5003) == CHIDB_OK);
+            ck_assert(chidb_step(stmt) == CHIDB_ROW);
+            ck_assert_int_eq(chidb_column_int(stmt, 0), i);
+            ck_assert(chidb_step(stmt) == CHIDB_DONE);
+            ck_assert(chidb_reset(stmt) == CHIDB_OK);
+        }
+        chidb_finalize(stmt);
+
+        ck_assert(chidb_prepare(db, "SELECT id FROM t WHERE a >= 0;", &stmt) == CHIDB_OK);
+        for(n = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; n++)
+            ck_assert_int_eq(chidb_column_int(stmt, 0), n + 1);
+        ck_assert(rc == CHIDB_DONE);
+        ck_assert_int_eq(n, 5000);
+        chidb_finalize(stmt);
+
+        chidb_close(db);
+        ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+    }
+
+    /* The index is kept up to date */
+    ck_assert(chidb_prepare(db, "INSERT INTO t VALUES(5001, 6000, 1, 'row');", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+    ck_assert(chidb_prepare(db, "INSERT INTO t VALUES(5002, 6000, 2, 'row');", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ECONSTRAINT);
+    chidb_finalize(stmt);
+    ck_assert(chidb_prepare(db, "SELECT id FROM t WHERE a = 6000;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert_int_eq(chidb_column_int(stmt, 0), 5001);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    chidb_close(db);
+    delete_tmp_file(fname);
+}
+END_TEST
+
+
+/* Runs a query and stores the first column of each row in codes */
+int select_codes(chidb *db, const char *sql, int *codes, int max)
+{
+    chidb_stmt *stmt;
+    int n = 0, rc;
+
+    ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+    while((rc = chidb_step(stmt)) == CHIDB_ROW)
+    {
+        ck_assert(n < max);
+        codes[n++] = chidb_column_int(stmt, 0);
+    }
+    ck_assert(rc == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    return n;
+}
+
+/* Number of instructions with the given opcode in the program of sql,
+   which must start with EXPLAIN */
+int count_ops(chidb *db, const char *sql, const char *opcode)
+{
+    chidb_stmt *stmt;
+    int n = 0, rc;
+
+    ck_assert(chidb_prepare(db, sql, &stmt) == CHIDB_OK);
+    while((rc = chidb_step(stmt)) == CHIDB_ROW)
+        n += !strcmp(chidb_column_text(stmt, 1), opcode);
+    ck_assert(rc == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    return n;
+}
+
+START_TEST (test_index_negative)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int ids[200], n;
+
+    char *fname = create_tmp_file();
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    ck_assert(chidb_prepare(db, "CREATE TABLE t(id INTEGER PRIMARY KEY, a INTEGER);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    /* Half of the rows are in the table when the index is built,
+       the other half are added to the index one by one */
+    for(int k = 0; k < 2; k++)
+    {
+        ck_assert(chidb_prepare(db, "INSERT INTO t VALUES(?, ?);", &stmt) == CHIDB_OK);
+        for(int i = 1 + k * 50; i <= 50 + k * 50; i++)
+        {
+            ck_assert(chidb_bind_int(stmt, 1, i) == CHIDB_OK);
+            ck_assert(chidb_bind_int(stmt, 2, (i % 2 ? 1 : -1) * i) == CHIDB_OK);
+            ck_assert(chidb_step(stmt) == CHIDB_DONE);
+            ck_assert(chidb_reset(stmt) == CHIDB_OK);
+        }
+        chidb_finalize(stmt);
+
+        if(k == 0)
+        {
+            ck_assert(chidb_prepare(db, "CREATE INDEX ta ON t(a);", &stmt) == CHIDB_OK);
+            ck_assert(chidb_step(stmt) == CHIDB_DONE);
+            chidb_finalize(stmt);
+        }
+    }
+
+    /* Negative keys sort before the positive ones */
+    n = select_codes(db, "SELECT id FROM t WHERE a < 10;", ids, 200);
+    ck_assert_int_eq(n, 55);
+    for(int i = 0; i < n; i++)
+        ck_assert(ids[i] % 2 == 0 || ids[i] < 10);
+
+    n = select_codes(db, "SELECT id FROM t WHERE a >= -5;", ids, 200);
+    ck_assert_int_eq(n, 52);
+    for(int i = 0; i < n; i++)
+        ck_assert(ids[i] % 2 == 1 || ids[i] <= 5);
+
+    n = select_codes(db, "SELECT id FROM t WHERE a > -30 AND a <= -20;", ids, 200);
+    ck_assert_int_eq(n, 5);
+    for(int i = 0; i < n; i++)
+        ck_assert_int_eq(ids[i], 20 + 2 * i);
+
+    ck_assert(chidb_prepare(db, "SELECT id FROM t WHERE a = ?;", &stmt) == CHIDB_OK);
+    for(int i = 1; i <= 100; i++)
+    {
+        ck_assert(chidb_bind_int(stmt, 1, (i % 2 ? 1 : -1) * i) == CHIDB_OK);
+        ck_assert(chidb_step(stmt) == CHIDB_ROW);
+        ck_assert_int_eq(chidb_column_int(stmt, 0), i);
+        ck_assert(chidb_step(stmt) == CHIDB_DONE);
+        ck_assert(chidb_reset(stmt) == CHIDB_OK);
+    }
+    chidb_finalize(stmt);
+
+    chidb_close(db);
+    delete_tmp_file(fname);
+}
+END_TEST
+
+
+START_TEST (test_index_transaction)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int ids[16], n;
+
+    char *fname = create_tmp_file();
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    ck_assert(chidb_prepare(db, "CREATE TABLE t(id INTEGER PRIMARY KEY, a INTEGER, b INTEGER);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+    ck_assert(chidb_prepare(db, "CREATE INDEX ta ON t(a);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+    ck_assert(chidb_prepare(db, "CREATE INDEX tb ON t(b);", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    /* A duplicate key in either index fails the INSERT without changing
+       the table or the other index, and the transaction goes on */
+    ck_assert(chidb_begin(db) == CHIDB_OK);
+    ck_assert(chidb_prepare(db, "INSERT INTO t VALUES(?, ?, ?);", &stmt) == CHIDB_OK);
+    int rows[][4] = { {1, 10, 100, CHIDB_DONE}, {2, 10, 200, CHIDB_ECONSTRAINT},
+                      {3, 30, 100, CHIDB_ECONSTRAINT}, {4, 40, 400, CHIDB_DONE} };
+    for(int i = 0; i < 4; i++)
+    {
+        for(int j = 0; j < 3; j++)
+            ck_assert(chidb_bind_int(stmt, j + 1, rows[i][j]) == CHIDB_OK);
+        ck_assert(chidb_step(stmt) == rows[i][3]);
+        ck_assert(chidb_reset(stmt) == CHIDB_OK);
+    }
+    chidb_finalize(stmt);
+    ck_assert(chidb_commit(db) == CHIDB_OK);
+
+    n = select_codes(db, "SELECT id FROM t;", ids, 16);
+    ck_assert_int_eq(n, 2);
+    ck_assert_int_eq(ids[0], 1);
+    ck_assert_int_eq(ids[1], 4);
+    ck_assert_int_eq(select_codes(db, "SELECT id FROM t WHERE a >= 0;", ids, 16), 2);
+    ck_assert_int_eq(select_codes(db, "SELECT id FROM t WHERE b >= 0;", ids, 16), 2);
+    ck_assert_int_eq(select_codes(db, "SELECT id FROM t WHERE a = 30;", ids, 16), 0);
+    ck_assert_int_eq(select_codes(db, "SELECT id FROM t WHERE b = 200;", ids, 16), 0);
+
+    chidb_close(db);
+    delete_tmp_file(fname);
+}
+END_TEST
+
+
+START_TEST (test_conditions)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int codes[2][1000];
+    int n, i, rc, stops;
+
+    /* Each query is paired with one that has no usable bounds,
+       so it is answered by scanning the whole table */
+    const char *queries[][2] = {
+        { "SELECT code FROM numbers WHERE code > 100 AND code <= 2000;",
+          "SELECT code FROM numbers WHERE NOT (code <= 100 OR code > 2000);" },
+        { "SELECT code FROM numbers WHERE code < 500 AND altcode > 5000;",
+          "SELECT code FROM numbers WHERE NOT (code >= 500 OR altcode <= 5000);" },
+        { "SELECT code FROM numbers WHERE altcode >= 9000 AND altcode < 9500 AND code > 3000;",
+          "SELECT code FROM numbers WHERE NOT (altcode < 9000 OR altcode >= 9500) AND NOT code <= 3000;" },
+        { "SELECT code FROM numbers WHERE altcode > 9900 AND (code < 1000 OR code > 9000);",
+          "SELECT code FROM numbers WHERE NOT (altcode <= 9900) AND NOT (code >= 1000 AND code <= 9000);" },
+        { "SELECT code FROM numbers WHERE code >= 9000 AND code != 9001 AND textcode != 'abc';",
+          "SELECT code FROM numbers WHERE NOT (code < 9000 OR code = 9001);" },
+    };
+
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-conditions.cdb");
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    for(i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+    {
+        n = select_codes(db, queries[i][0], codes[0], 1000);
+        ck_assert(n > 0);
+        ck_assert_int_eq(select_codes(db, queries[i][1], codes[1], 1000), n);
+        ck_assert(!memcmp(codes[0], codes[1], n * sizeof(int)));
+    }
+
+    /* Rows come back in rowid order, whatever the access path */
+    n = select_codes(db, "SELECT code FROM numbers WHERE code < 3000 AND code > 1000;", codes[0], 1000);
+    for(i = 1; i < n; i++)
+        ck_assert(codes[0][i - 1] < codes[0][i]);
+
+    /* A range on the primary key stops at its upper bound instead of
+       running to the end of the table */
+    ck_assert(chidb_prepare(db, "EXPLAIN SELECT code FROM numbers WHERE code > 100 AND code < 200;", &stmt) == CHIDB_OK);
+    for(stops = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; )
+    {
+        ck_assert(strcmp(chidb_column_text(stmt, 1), "Rewind"));
+        stops += !strcmp(chidb_column_text(stmt, 1), "Ge");
+    }
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert_int_eq(stops, 1);
+    chidb_finalize(stmt);
+
+    /* Comparisons on an indexed column seek into the index: an equality
+       is a single Seek, and a range starts at its lower bound and stops
+       at its upper bound instead of walking the whole index */
+    ck_assert_int_eq(count_ops(db, "EXPLAIN SELECT code FROM numbers WHERE altcode = 20;", "Seek"), 1);
+    ck_assert_int_eq(count_ops(db, "EXPLAIN SELECT code FROM numbers WHERE altcode = 20;", "Rewind"), 0);
+    ck_assert_int_eq(count_ops(db, "EXPLAIN SELECT code FROM numbers WHERE altcode > 1050;", "SeekGt"), 1);
+    ck_assert_int_eq(count_ops(db, "EXPLAIN SELECT code FROM numbers WHERE altcode > 1050;", "Rewind"), 0);
+    ck_assert_int_eq(count_ops(db, "EXPLAIN SELECT code FROM numbers WHERE altcode >= 1050 AND altcode < 1100;", "SeekGe"), 1);
+    ck_assert_int_eq(count_ops(db, "EXPLAIN SELECT code FROM numbers WHERE altcode >= 1050 AND altcode < 1100;", "IdxGe"), 1);
+    ck_assert_int_eq(count_ops(db, "EXPLAIN SELECT code FROM numbers WHERE altcode > 1050 AND altcode <= 1100;", "IdxGt"), 1);
+
+    /* A second lower bound on the same column is only a filter */
+    n = select_codes(db, "SELECT code FROM numbers WHERE altcode > 1000 AND altcode < 3000 AND altcode > 2000;", codes[0], 1000);
+    ck_assert(n > 0);
+    ck_assert_int_eq(select_codes(db, "SELECT code FROM numbers WHERE NOT (altcode <= 2000 OR altcode >= 3000);", codes[1], 1000), n);
+    ck_assert(!memcmp(codes[0], codes[1], n * sizeof(int)));
+
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers WHERE code > 1 AND (altcode = 'ab' OR code < 5);", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers WHERE NOT nosuchcolumn = 1;", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers WHERE code IN (1, 2);", &stmt) == CHIDB_EINVALIDSQL);
+
+    chidb_close(db);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_joins)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int codes[2048], altcodes[2048];
+    int n, i, j, rc, rows, expected;
+
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-joins.cdb");
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    n = select_codes(db, "SELECT code FROM numbers;", codes, 2048);
+    ck_assert_int_eq(select_codes(db, "SELECT altcode FROM numbers;", altcodes, 2048), n);
+
+    /* Every row matches itself on the primary key */
+    ck_assert(chidb_prepare(db, "SELECT x.code, y.code, y.altcode FROM numbers x JOIN numbers y ON x.code = y.code;", &stmt) == CHIDB_OK);
+    for(rows = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; rows++)
+        ck_assert_int_eq(chidb_column_int(stmt, 0), chidb_column_int(stmt, 1));
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert_int_eq(rows, n);
+    chidb_finalize(stmt);
+
+    /* No equality to build on: filters on each side, the rest per pair */
+    for(expected = 0, i = 0; i < n; i++)
+        for(j = 0; j < n; j++)
+            expected += altcodes[i] < 100 && codes[j] < 200 && codes[i] > codes[j];
+
+    ck_assert(chidb_prepare(db, "SELECT x.code, y.code FROM numbers x, numbers y WHERE x.altcode < 100 AND y.code < 200 AND x.code > y.code;", &stmt) == CHIDB_OK);
+    for(rows = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; rows++)
+        ck_assert(chidb_column_int(stmt, 0) > chidb_column_int(stmt, 1));
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert_int_eq(rows, expected);
+    chidb_finalize(stmt);
+
+    /* The column of USING is only returned once by * */
+    ck_assert(chidb_prepare(db, "SELECT * FROM numbers x JOIN numbers y USING (code);", &stmt) == CHIDB_OK);
+    ck_assert_int_eq(chidb_column_count(stmt), 5);
+    chidb_finalize(stmt);
+
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers x, numbers y;", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "SELECT * FROM numbers, numbers;", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "SELECT * FROM numbers x JOIN numbers y ON x.code = y.textcode;", &stmt) == CHIDB_EINVALIDSQL);
+
+    chidb_close(db);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_merge_join)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int codes[2][2048];
+    int n, i, rc, hashes;
+
+    const char *ordered[] = {
+        "EXPLAIN SELECT x.code FROM numbers x JOIN numbers y ON x.code = y.code;",
+        "EXPLAIN SELECT x.code FROM numbers x JOIN numbers y ON x.altcode = y.code;",
+        "EXPLAIN SELECT x.code FROM numbers x JOIN numbers y ON x.code = y.altcode;",
+    };
+
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-merge-join.cdb");
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* Joins on the primary key or an indexed column need no hash table */
+    for(i = 0; i < sizeof(ordered) / sizeof(ordered[0]); i++)
+    {
+        ck_assert(chidb_prepare(db, ordered[i], &stmt) == CHIDB_OK);
+        for(hashes = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; )
+            hashes += !strcmp(chidb_column_text(stmt, 1), "HashAdd");
+        ck_assert(rc == CHIDB_DONE);
+        ck_assert_int_eq(hashes, 0);
+        chidb_finalize(stmt);
+    }
+
+    /* The merge join returns the rows in key order, and a third table
+       (joined through a hash table) does not change them */
+    n = select_codes(db, "SELECT code FROM numbers;", codes[0], 2048);
+    ck_assert_int_eq(select_codes(db, "SELECT x.code FROM numbers x JOIN numbers y ON x.code = y.code;", codes[1], 2048), n);
+    ck_assert(!memcmp(codes[0], codes[1], n * sizeof(int)));
+    ck_assert_int_eq(select_codes(db, "SELECT x.code FROM numbers x JOIN numbers y ON x.code = y.code JOIN numbers z ON z.code = y.code;", codes[1], 2048), n);
+
+    /* Index order on one side, primary key order on the other */
+    const char *inserts[] = {
+        "INSERT INTO numbers VALUES(20000, 'aa', 13);",
+        "INSERT INTO numbers VALUES(20001, 'bb', 8);",
+        "INSERT INTO numbers VALUES(20002, 'cc', 9);",
+    };
+    for(i = 0; i < sizeof(inserts) / sizeof(inserts[0]); i++)
+    {
+        ck_assert(chidb_prepare(db, inserts[i], &stmt) == CHIDB_OK);
+        ck_assert(chidb_step(stmt) == CHIDB_DONE);
+        chidb_finalize(stmt);
+    }
+
+    ck_assert(chidb_prepare(db, "SELECT x.code, y.code FROM numbers x JOIN numbers y ON x.altcode = y.code WHERE y.code > 8;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert_int_eq(chidb_column_int(stmt, 0), 20002);
+    ck_assert_int_eq(chidb_column_int(stmt, 1), 9);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert_int_eq(chidb_column_int(stmt, 0), 20000);
+    ck_assert_int_eq(chidb_column_int(stmt, 1), 13);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    chidb_close(db);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_index_join)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int codes[2048], altcodes[2048];
+    int n, i, rc, rows, expected, scans;
+
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-index-join.cdb");
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    /* With a filter on the outer table, the inner one is only sought */
+    ck_assert(chidb_prepare(db, "EXPLAIN SELECT x.code FROM numbers x JOIN numbers y ON x.code = y.altcode WHERE x.code < 12;", &stmt) == CHIDB_OK);
+    for(scans = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; )
+        scans += !strcmp(chidb_column_text(stmt, 1), "Rewind") || !strcmp(chidb_column_text(stmt, 1), "HashAdd");
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert_int_eq(scans, 1);
+    chidb_finalize(stmt);
+
+    n = select_codes(db, "SELECT code FROM numbers;", codes, 2048);
+    ck_assert_int_eq(select_codes(db, "SELECT altcode FROM numbers;", altcodes, 2048), n);
+    for(expected = 0, i = 0; i < n; i++)
+        expected += altcodes[i] < 3000;
+
+    ck_assert(chidb_prepare(db, "SELECT x.code, y.code FROM numbers x JOIN numbers y ON x.code = y.code WHERE x.altcode < 3000;", &stmt) == CHIDB_OK);
+    for(rows = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; rows++)
+        ck_assert_int_eq(chidb_column_int(stmt, 0), chidb_column_int(stmt, 1));
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert_int_eq(rows, expected);
+    chidb_finalize(stmt);
+
+    /* Lookups through the index on altcode */
+    const char *inserts[] = {
+        "INSERT INTO numbers VALUES(20000, 'aa', 13);",
+        "INSERT INTO numbers VALUES(20001, 'bb', 8);",
+        "INSERT INTO numbers VALUES(20002, 'cc', 9);",
+    };
+    for(i = 0; i < sizeof(inserts) / sizeof(inserts[0]); i++)
+    {
+        ck_assert(chidb_prepare(db, inserts[i], &stmt) == CHIDB_OK);
+        ck_assert(chidb_step(stmt) == CHIDB_DONE);
+        chidb_finalize(stmt);
+    }
+
+    ck_assert(chidb_prepare(db, "SELECT x.code, y.code, y.textcode FROM numbers x JOIN numbers y ON x.code = y.altcode WHERE x.code < 12;", &stmt) == CHIDB_OK);
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert_int_eq(chidb_column_int(stmt, 0), 8);
+    ck_assert_int_eq(chidb_column_int(stmt, 1), 20001);
+    ck_assert_str_eq(chidb_column_text(stmt, 2), "bb");
+    ck_assert(chidb_step(stmt) == CHIDB_ROW);
+    ck_assert_int_eq(chidb_column_int(stmt, 0), 9);
+    ck_assert_int_eq(chidb_column_int(stmt, 1), 20002);
+    ck_assert(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    chidb_close(db);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_hash_spill)
+{
+    chidb_dbm_hash_t h;
+    uint8_t record[64], *found;
+    int i, n;
+
+    /* A budget of two pages makes the table write most of them out */
+    chidb_dbm_hash_init(&h, 2 * DBM_HASH_PAGE_SIZE);
+    for(i = 0; i < 10000; i++)
+    {
+        memset(record, i & 0xff, sizeof(record));
+        ck_assert(chidb_dbm_hash_add(&h, i % 1000, record, sizeof(record)) == CHIDB_OK);
+    }
+    ck_assert(h.nspilled > 0);
+    ck_assert(h.resident <= 2 * DBM_HASH_PAGE_SIZE);
+
+    /* Records with the same key come back in the order they were added */
+    ck_assert(chidb_dbm_hash_seek(&h, 1000) == CHIDB_ENOTFOUND);
+    ck_assert(chidb_dbm_hash_seek(&h, 123) == CHIDB_OK);
+    for(n = 0, i = 123; ; n++, i += 1000)
+    {
+        ck_assert(chidb_dbm_hash_record(&h, &found) == CHIDB_OK);
+        ck_assert_int_eq(found[0], i & 0xff);
+        ck_assert_int_eq(found[sizeof(record) - 1], i & 0xff);
+        if(chidb_dbm_hash_next(&h) != CHIDB_OK)
+            break;
+    }
+    ck_assert_int_eq(n, 9);
+
+    chidb_dbm_hash_destroy(&h);
+}
+END_TEST
+
+START_TEST (test_order_by)
+{
+    chidb *db;
+    chidb_stmt *stmt;
+    int codes[2][2048];
+    int n, i, rc, rows, sorters;
+    char last[64];
+
+    char *fname = create_copy("1table-largebtree.cdb", "dbm-order-by.cdb");
+    ck_assert(chidb_open(fname, &db) == CHIDB_OK);
+
+    n = select_codes(db, "SELECT code FROM numbers;", codes[0], 2048);
+
+    /* Rows already come back in primary key order */
+    ck_assert(chidb_prepare(db, "EXPLAIN SELECT code FROM numbers ORDER BY code;", &stmt) == CHIDB_OK);
+    for(sorters = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; )
+        sorters += !strcmp(chidb_column_text(stmt, 1), "SorterOpen");
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert_int_eq(sorters, 0);
+    chidb_finalize(stmt);
+
+    ck_assert_int_eq(select_codes(db, "SELECT code FROM numbers ORDER BY code DESC;", codes[1], 2048), n);
+    for(i = 0; i < n; i++)
+        ck_assert_int_eq(codes[1][i], codes[0][n - 1 - i]);
+
+    /* Rows with the same key keep their primary key order */
+    ck_assert(chidb_prepare(db, "SELECT code, altcode FROM numbers WHERE altcode < 5000 ORDER BY altcode;", &stmt) == CHIDB_OK);
+    for(rows = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; rows++)
+    {
+        codes[1][rows] = chidb_column_int(stmt, 1);
+        if(rows > 0)
+            ck_assert(codes[1][rows - 1] < codes[1][rows] ||
+                      (codes[1][rows - 1] == codes[1][rows] && codes[0][rows - 1] < chidb_column_int(stmt, 0)));
+        codes[0][rows] = chidb_column_int(stmt, 0);
+    }
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert(rows > 0);
+    chidb_finalize(stmt);
+
+    ck_assert(chidb_prepare(db, "SELECT textcode FROM numbers ORDER BY textcode DESC;", &stmt) == CHIDB_OK);
+    for(rows = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; rows++)
+    {
+        if(rows > 0)
+            ck_assert(strcmp(last, chidb_column_text(stmt, 0)) >= 0);
+        snprintf(last, sizeof(last), "%s", chidb_column_text(stmt, 0));
+    }
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert_int_eq(rows, n);
+    chidb_finalize(stmt);
+
+    /* Joins sort on a column of any of their tables */
+    ck_assert(chidb_prepare(db, "SELECT x.code, y.altcode FROM numbers x JOIN numbers y ON x.code = y.code ORDER BY y.altcode DESC;", &stmt) == CHIDB_OK);
+    for(rows = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; rows++)
+    {
+        if(rows > 0)
+            ck_assert(codes[1][0] >= chidb_column_int(stmt, 1));
+        codes[1][0] = chidb_column_int(stmt, 1);
+    }
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert_int_eq(rows, n);
+    chidb_finalize(stmt);
+
+    /* With a small budget the rows are sorted in runs written to a
+       temporary file, and still come back in order */
+    ck_assert(chidb_set_sort_memory(db, 4096) == CHIDB_OK);
+    ck_assert(chidb_prepare(db, "SELECT code, altcode FROM numbers ORDER BY altcode DESC;", &stmt) == CHIDB_OK);
+    for(rows = 0; (rc = chidb_step(stmt)) == CHIDB_ROW; rows++)
+    {
+        if(rows > 0)
+            ck_assert(codes[1][0] >= chidb_column_int(stmt, 1));
+        codes[1][0] = chidb_column_int(stmt, 1);
+    }
+    ck_assert(rc == CHIDB_DONE);
+    ck_assert_int_eq(rows, n);
+    ck_assert(stmt->nSorters == 1 && stmt->sorters[0].nruns > 0);
+    chidb_finalize(stmt);
+    ck_assert(chidb_set_sort_memory(db, 0) == CHIDB_OK);
+
+    ck_assert(chidb_prepare(db, "SELECT code FROM numbers ORDER BY nosuchcolumn;", &stmt) == CHIDB_EINVALIDSQL);
+    ck_assert(chidb_prepare(db, "SELECT x.code FROM numbers x, numbers y WHERE x.code = y.code ORDER BY code;", &stmt) == CHIDB_EINVALIDSQL);
+
+    chidb_close(db);
+    delete_copy(fname);
+}
+END_TEST
+
+START_TEST (test_sorter_spill)
+{
+    chidb_dbm_sorter_t s;
+    uint8_t *found;
+    int32_t i, prev, cur, n;
+
+    /* A tiny budget makes the sorter write more runs than it merges at
+       once, so they are first merged into longer runs */
+    chidb_dbm_sorter_init(&s, 4096, false);
+    for(i = 0; i < 20000; i++)
+        ck_assert(chidb_dbm_sorter_insert(&s, DBM_SORTER_INT, (i * 7919) % 1000, NULL,
+                                          (uint8_t *) &i, sizeof(i)) == CHIDB_OK);
+    ck_assert(s.nruns > DBM_SORTER_FANIN);
+
+    /* Sorted by key, and in the order they were added for the same key */
+    ck_assert(chidb_dbm_sorter_sort(&s) == CHIDB_OK);
+    ck_assert(chidb_dbm_sorter_insert(&s, DBM_SORTER_NULL, 0, NULL, (uint8_t *) &i, sizeof(i)) == CHIDB_EMISUSE);
+    for(n = 0, prev = -1; ; n++)
+    {
+        ck_assert(chidb_dbm_sorter_record(&s, &found) == CHIDB_OK);
+        memcpy(&cur, found, sizeof(cur));
+        if(n > 0)
+            ck_assert((prev * 7919) % 1000 < (cur * 7919) % 1000 ||
+                      ((prev * 7919) % 1000 == (cur * 7919) % 1000 && prev < cur));
+        prev = cur;
+        if(chidb_dbm_sorter_next(&s) != CHIDB_OK)
+            break;
+    }
+    ck_assert_int_eq(n + 1, 20000);
+    chidb_dbm_sorter_destroy(&s);
+
+    /* Descending, in memory: text, then integers, then NULLs */
+    chidb_dbm_sorter_init(&s, DBM_SORTER_MEMORY, true);
+    ck_assert(chidb_dbm_sorter_sort(&s) == CHIDB_ENOTFOUND);
+    chidb_dbm_sorter_destroy(&s);
+    for(i = 0; i < 4; i++)
+        ck_assert(chidb_dbm_sorter_insert(&s, i % 3, i, i % 3 == DBM_SORTER_TEXT ? "ab" : NULL,
+                                          (uint8_t *) &i, sizeof(i)) == CHIDB_OK);
+    ck_assert(chidb_dbm_sorter_sort(&s) == CHIDB_OK);
+    int32_t expected[] = { 2, 1, 0, 3 };
+    for(n = 0; n < 4; n++)
+    {
+        ck_assert(chidb_dbm_sorter_record(&s, &found) == CHIDB_OK);
+        memcpy(&cur, found, sizeof(cur));
+        ck_assert_int_eq(cur, expected[n]);
+        ck_assert(chidb_dbm_sorter_next(&s) == (n < 3 ? CHIDB_OK : CHIDB_ENOTFOUND));
+    }
+    ck_assert(s.nruns == 0);
+    chidb_dbm_sorter_destroy(&s);
+}
+END_TEST
+
 
 int main (void)
 {
@@ -152,6 +1183,40 @@ int main (void)
         exit(1);
     }
 
+    s = suite_create ("dbm-prepare");
+    TCase *tc_verify = tcase_create ("Verifier");
+    tcase_add_test (tc_verify, test_verify);
+    suite_add_tcase (s, tc_verify);
+    TCase *tc_bind = tcase_create ("Parameters");
+    tcase_add_test (tc_bind, test_bind);
+    suite_add_tcase (s, tc_bind);
+    TCase *tc_cache = tcase_create ("Statement cache");
+    tcase_add_test (tc_cache, test_stmt_cache);
+    suite_add_tcase (s, tc_cache);
+    TCase *tc_catalog = tcase_create ("Catalog");
+    tcase_add_test (tc_catalog, test_catalog);
+    suite_add_tcase (s, tc_catalog);
+    TCase *tc_index = tcase_create ("Indexes");
+    tcase_add_test (tc_index, test_index);
+    tcase_add_test (tc_index, test_create_index);
+    tcase_add_test (tc_index, test_index_negative);
+    tcase_add_test (tc_index, test_index_transaction);
+    suite_add_tcase (s, tc_index);
+    TCase *tc_conditions = tcase_create ("Conditions");
+    tcase_add_test (tc_conditions, test_conditions);
+    suite_add_tcase (s, tc_conditions);
+    TCase *tc_joins = tcase_create ("Joins");
+    tcase_add_test (tc_joins, test_joins);
+    tcase_add_test (tc_joins, test_merge_join);
+    tcase_add_test (tc_joins, test_index_join);
+    tcase_add_test (tc_joins, test_hash_spill);
+    suite_add_tcase (s, tc_joins);
+    TCase *tc_order = tcase_create ("Order by");
+    tcase_add_test (tc_order, test_order_by);
+    tcase_add_test (tc_order, test_sorter_spill);
+    suite_add_tcase (s, tc_order);
+    srunner_add_suite(sr, s);
+
     srunner_run_all (sr, CK_NORMAL);
     number_failed = srunner_ntests_failed (sr);
     srunner_free (sr);
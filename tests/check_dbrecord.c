@@ -177,6 +177,54 @@ START_TEST (test_packunpack)
 END_TEST
 
 
+START_TEST (test_view)
+{
+    DBRecord *dbr;
+    DBRecordView dbrv;
+    const char *s;
+    int8_t i8;
+    int16_t i16;
+    int32_t i32;
+    uint8_t *buf;
+    int len;
+
+    for(int i=0; i<NVALUES; i++)
+    {
+        chidb_DBRecord_create(&dbr, "|s|0|i1|i2|i4|", str_values[i], int8_values[i], int16_values[i], int32_values[i]);
+        chidb_DBRecord_pack(dbr, &buf);
+
+        chidb_DBRecord_view(&dbrv, buf);
+
+        /* Fields are accessed out of order to exercise lazy header parsing */
+        ck_assert_int_eq(chidb_DBRecord_viewGetType(&dbrv, 4), SQL_INTEGER_4BYTE);
+        chidb_DBRecord_viewGetInt32(&dbrv, 4, &i32);
+        ck_assert_int_eq(int32_values[i], i32);
+
+        ck_assert_int_eq(chidb_DBRecord_viewGetType(&dbrv, 0), SQL_TEXT);
+        chidb_DBRecord_viewGetString(&dbrv, 0, &s, &len);
+        ck_assert_int_eq(len, strlen(str_values[i]));
+        ck_assert(!strncmp(s, str_values[i], len));
+
+        ck_assert_int_eq(chidb_DBRecord_viewGetType(&dbrv, 1), SQL_NULL);
+
+        ck_assert_int_eq(chidb_DBRecord_viewGetType(&dbrv, 2), SQL_INTEGER_1BYTE);
+        chidb_DBRecord_viewGetInt8(&dbrv, 2, &i8);
+        ck_assert_int_eq(int8_values[i], i8);
+
+        ck_assert_int_eq(chidb_DBRecord_viewGetType(&dbrv, 3), SQL_INTEGER_2BYTE);
+        chidb_DBRecord_viewGetInt16(&dbrv, 3, &i16);
+        ck_assert_int_eq(int16_values[i], i16);
+
+        ck_assert_int_eq(chidb_DBRecord_viewNFields(&dbrv), 5);
+        ck_assert_int_eq(chidb_DBRecord_viewGetType(&dbrv, 5), SQL_NOTVALID);
+
+        chidb_DBRecord_destroy(dbr);
+        free(buf);
+    }
+}
+END_TEST
+
+
 Suite* make_dbrecord_suite (void)
 {
     Suite *s = suite_create ("DB Record");
@@ -195,6 +243,7 @@ Suite* make_dbrecord_suite (void)
 
     TCase *tc_packunpack = tcase_create ("Packing/unpacking a record");
     tcase_add_test (tc_packunpack, test_packunpack);
+    tcase_add_test (tc_packunpack, test_view);
     suite_add_tcase (s, tc_packunpack);
 
     return s;
@@ -1,4 +1,7 @@
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <check.h>
 #include "check_common.h"
 #include "libchidb/pager.h"
@@ -146,6 +149,711 @@ START_TEST (test_readwrite)
 END_TEST
 
 
+START_TEST (test_cache_pin)
+{
+    int rc;
+    npage_t npage;
+    Pager *pg;
+    MemPage *page1, *page2;
+
+    char *fname = create_tmp_file();
+
+    rc = chidb_Pager_open(&pg, fname);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setPageSize(pg, PAGE_SIZE);
+    chidb_Pager_allocatePage(pg, &npage);
+
+    /* Reading a cached page twice returns the same frame, pinned twice */
+    chidb_Pager_readPage(pg, npage, &page1);
+    chidb_Pager_readPage(pg, npage, &page2);
+    ck_assert(page1 == page2);
+    ck_assert_int_eq(page1->pins, 2);
+
+    chidb_Pager_releaseMemPage(pg, page2);
+    ck_assert_int_eq(page1->pins, 1);
+    chidb_Pager_releaseMemPage(pg, page1);
+    ck_assert_int_eq(page1->pins, 0);
+
+    chidb_Pager_close(pg);
+    delete_tmp_file(fname);
+}
+END_TEST
+
+
+START_TEST (test_cache_evict)
+{
+    int rc;
+    npage_t npage;
+    Pager *pg;
+    MemPage *page, *pinned;
+
+    char *fname = create_tmp_file();
+
+    rc = chidb_Pager_open(&pg, fname);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setPageSize(pg, PAGE_SIZE);
+    chidb_Pager_setCacheSize(pg, 2);
+
+    for(int j=1; j<=MAXPAGES; j++)
+        chidb_Pager_allocatePage(pg, &npage);
+
+    /* Keep page 1 pinned: it must survive every eviction */
+    chidb_Pager_readPage(pg, 1, &pinned);
+    pinned->data[pagepos[0]] = values[0];
+    chidb_Pager_writePage(pg, pinned);
+
+    /* Dirty pages are written back when they are evicted */
+    for(int j=2; j<=MAXPAGES; j++)
+    {
+        chidb_Pager_readPage(pg, j, &page);
+        for(int k=0; k<NVALUES; k++)
+            page->data[pagepos[k]] = values[(k + j) % NVALUES];
+        chidb_Pager_writePage(pg, page);
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+    ck_assert(pg->n_frames <= 2);
+    ck_assert_int_eq(pinned->npage, 1);
+    ck_assert_int_eq(pinned->data[pagepos[0]], values[0]);
+    chidb_Pager_releaseMemPage(pg, pinned);
+
+    for(int j=2; j<=MAXPAGES; j++)
+    {
+        chidb_Pager_readPage(pg, j, &page);
+        for(int k=0; k<NVALUES; k++)
+            if(page->data[pagepos[k]] != values[(k + j) % NVALUES])
+            {
+                ck_abort_msg("Incorrect value read from evicted page");
+                break;
+            }
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+
+    /* ... and on close */
+    chidb_Pager_close(pg);
+
+    rc = chidb_Pager_open(&pg, fname);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setPageSize(pg, PAGE_SIZE);
+    ck_assert_int_eq(pg->n_pages, MAXPAGES);
+    chidb_Pager_readPage(pg, 1, &page);
+    ck_assert_int_eq(page->data[pagepos[0]], values[0]);
+    chidb_Pager_releaseMemPage(pg, page);
+    chidb_Pager_close(pg);
+
+    delete_tmp_file(fname);
+}
+END_TEST
+
+
+START_TEST (test_mmap)
+{
+    int rc;
+    npage_t npage;
+    Pager *pg;
+    MemPage *page;
+
+    for(int i=0; i<NMULT; i++)
+    {
+        char *fname = create_tmp_file();
+
+        rc = chidb_Pager_open(&pg, fname);
+        ck_assert(rc == CHIDB_OK);
+        chidb_Pager_setPageSize(pg, PAGE_SIZE * pagemult[i]);
+        rc = chidb_Pager_setMmap(pg, true);
+        ck_assert(rc == CHIDB_OK);
+
+        for(int j=1; j<=MAXPAGES; j++)
+        {
+            chidb_Pager_allocatePage(pg, &npage);
+            ck_assert(npage == j);
+        }
+
+        for(int j=1; j<=MAXPAGES; j++)
+        {
+            chidb_Pager_readPage(pg, j, &page);
+            ck_assert(page->data == pg->map + (j - 1) * pg->page_size);
+            for(int k=0; k<NVALUES; k++)
+                page->data[pagepos[k]*(i+1)] = values[k];
+            chidb_Pager_writePage(pg, page);
+            chidb_Pager_releaseMemPage(pg, page);
+        }
+
+        chidb_Pager_close(pg);
+
+        /* The pages must have been written to the file */
+        rc = chidb_Pager_open(&pg, fname);
+        ck_assert(rc == CHIDB_OK);
+        chidb_Pager_setPageSize(pg, PAGE_SIZE * pagemult[i]);
+        ck_assert_int_eq(pg->n_pages, MAXPAGES);
+
+        for(int j=1; j<=MAXPAGES; j++)
+        {
+            chidb_Pager_readPage(pg, j, &page);
+            for(int k=0; k<NVALUES; k++)
+                if(page->data[pagepos[k]*(i+1)] != values[k])
+                {
+                    ck_abort_msg("Incorrect value read from page");
+                    break;
+                }
+            chidb_Pager_releaseMemPage(pg, page);
+        }
+
+        chidb_Pager_close(pg);
+        delete_tmp_file(fname);
+    }
+}
+END_TEST
+
+
+START_TEST (test_mmap_checkpoint)
+{
+    int rc;
+    npage_t npage;
+    Pager *pg;
+    MemPage *page;
+
+    char *fname = create_tmp_file();
+
+    rc = chidb_Pager_open(&pg, fname);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setPageSize(pg, PAGE_SIZE);
+    rc = chidb_Pager_setMmap(pg, true);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setCacheSize(pg, 1);
+    chidb_Pager_allocatePage(pg, &npage);
+    chidb_Pager_allocatePage(pg, &npage);
+
+    /* The first change is made in place, in the mapping */
+    chidb_Pager_readPage(pg, 1, &page);
+    ck_assert(page->data == pg->map);
+    page->data[0] = 1;
+    chidb_Pager_writePage(pg, page);
+    chidb_Pager_releaseMemPage(pg, page);
+    rc = chidb_Pager_flush(pg);
+    ck_assert(rc == CHIDB_OK);
+
+    /* Once evicted, the page is read back from the log, and the second
+     * change only reaches the file with the checkpoint */
+    chidb_Pager_readPage(pg, 2, &page);
+    chidb_Pager_releaseMemPage(pg, page);
+    chidb_Pager_readPage(pg, 1, &page);
+    page->data[0] = 2;
+    chidb_Pager_writePage(pg, page);
+    chidb_Pager_releaseMemPage(pg, page);
+    rc = chidb_Pager_checkpoint(pg);
+    ck_assert(rc == CHIDB_OK);
+    ck_assert_int_eq(pg->wal->n_frames, 0);
+
+    /* The page is now read from the mapping again */
+    chidb_Pager_readPage(pg, 2, &page);
+    chidb_Pager_releaseMemPage(pg, page);
+    chidb_Pager_readPage(pg, 1, &page);
+    ck_assert(page->data == pg->map);
+    ck_assert_int_eq(page->data[0], 2);
+    chidb_Pager_releaseMemPage(pg, page);
+
+    chidb_Pager_close(pg);
+    delete_tmp_file(fname);
+}
+END_TEST
+
+
+START_TEST (test_mmap_rollback)
+{
+    int rc;
+    npage_t npage;
+    Pager *pg;
+    MemPage *page;
+
+    char *fname = create_tmp_file();
+
+    rc = chidb_Pager_open(&pg, fname);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setPageSize(pg, PAGE_SIZE);
+    rc = chidb_Pager_setMmap(pg, true);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setCacheSize(pg, 2);
+
+    for(int j=1; j<=MAXPAGES; j++)
+    {
+        chidb_Pager_allocatePage(pg, &npage);
+        chidb_Pager_readPage(pg, npage, &page);
+        for(int k=0; k<NVALUES; k++)
+            page->data[pagepos[k]] = values[k];
+        chidb_Pager_writePage(pg, page);
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+    rc = chidb_Pager_checkpoint(pg);
+    ck_assert(rc == CHIDB_OK);
+
+    /* Change every page in place, with a cache smaller than the
+     * transaction, so that most changes are evicted to the log */
+    for(int j=1; j<=MAXPAGES; j++)
+    {
+        chidb_Pager_readPage(pg, j, &page);
+        ck_assert(page->data == pg->map + (j - 1) * pg->page_size);
+        for(int k=0; k<NVALUES; k++)
+            page->data[pagepos[k]] = values[(k + 1) % NVALUES];
+        chidb_Pager_writePage(pg, page);
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+    ck_assert(pg->wal->n_frames > pg->wal->n_committed);
+
+    rc = chidb_Pager_rollback(pg);
+    ck_assert(rc == CHIDB_OK);
+
+    /* Evicted pages are read from the mapping again, without the changes */
+    for(int j=1; j<=MAXPAGES; j++)
+    {
+        chidb_Pager_readPage(pg, j, &page);
+        for(int k=0; k<NVALUES; k++)
+            if(page->data[pagepos[k]] != values[k])
+            {
+                ck_abort_msg("Incorrect value read from page");
+                break;
+            }
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+
+    chidb_Pager_close(pg);
+    delete_tmp_file(fname);
+}
+END_TEST
+
+
+START_TEST (test_mmap_grow)
+{
+    int rc;
+    npage_t npage, npages;
+    Pager *pg;
+    MemPage *page, *pinned;
+    struct stat st;
+    uint16_t pagesize = PAGE_SIZE * 32;
+    uint32_t committed;
+
+    char *fname = create_tmp_file();
+
+    rc = chidb_Pager_open(&pg, fname);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setPageSize(pg, pagesize);
+    rc = chidb_Pager_setMmap(pg, true);
+    ck_assert(rc == CHIDB_OK);
+
+    for(int j=1; j<=MAXPAGES; j++)
+    {
+        chidb_Pager_allocatePage(pg, &npage);
+        chidb_Pager_readPage(pg, npage, &page);
+        for(int k=0; k<NVALUES; k++)
+            page->data[pagepos[k]] = values[k];
+        chidb_Pager_writePage(pg, page);
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+    rc = chidb_Pager_flush(pg);
+    ck_assert(rc == CHIDB_OK);
+    committed = pg->wal->n_committed;
+
+    /* A transaction changes a page, and then allocates pages past the
+     * end of the mapping while another page is pinned */
+    chidb_Pager_readPage(pg, 1, &page);
+    for(int k=0; k<NVALUES; k++)
+        page->data[pagepos[k]] = values[(k + 1) % NVALUES];
+    chidb_Pager_writePage(pg, page);
+    chidb_Pager_releaseMemPage(pg, page);
+
+    chidb_Pager_readPage(pg, 2, &pinned);
+    npages = pg->map_size / pagesize + 1;
+    while(pg->n_pages < npages)
+        chidb_Pager_allocatePage(pg, &npage);
+
+    /* The mapping grew in place, without committing anything */
+    ck_assert(pg->map_size >= (size_t) npages * pagesize);
+    ck_assert(pinned->data == pg->map + pagesize);
+    ck_assert_int_eq(pinned->data[pagepos[0]], values[0]);
+    chidb_Pager_releaseMemPage(pg, pinned);
+    ck_assert_int_eq(pg->wal->n_committed, committed);
+
+    chidb_Pager_readPage(pg, npages, &page);
+    ck_assert(page->data == pg->map + (size_t) (npages - 1) * pagesize);
+    page->data[0] = 1;
+    chidb_Pager_writePage(pg, page);
+    chidb_Pager_releaseMemPage(pg, page);
+
+    rc = chidb_Pager_rollback(pg);
+    ck_assert(rc == CHIDB_OK);
+
+    /* The file is back to its committed size and contents */
+    ck_assert_int_eq(pg->n_pages, MAXPAGES);
+    ck_assert(fstat(pg->fd, &st) == 0);
+    ck_assert_int_eq(st.st_size, MAXPAGES * pagesize);
+    chidb_Pager_readPage(pg, 1, &page);
+    for(int k=0; k<NVALUES; k++)
+        if(page->data[pagepos[k]] != values[k])
+        {
+            ck_abort_msg("Incorrect value read from page");
+            break;
+        }
+    chidb_Pager_releaseMemPage(pg, page);
+
+    /* Pages allocated again read as zeroes */
+    chidb_Pager_allocatePage(pg, &npage);
+    ck_assert_int_eq(npage, MAXPAGES + 1);
+    chidb_Pager_readPage(pg, npage, &page);
+    ck_assert_int_eq(page->data[pagepos[0]], 0);
+    chidb_Pager_releaseMemPage(pg, page);
+
+    chidb_Pager_close(pg);
+    delete_tmp_file(fname);
+}
+END_TEST
+
+
+START_TEST (test_directio)
+{
+    int rc;
+    npage_t npage;
+    Pager *pg;
+    MemPage *page;
+
+    char *fname = create_tmp_file();
+
+    rc = chidb_Pager_open(&pg, fname);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setPageSize(pg, PAGE_SIZE * 4);
+
+    /* Not every file system supports O_DIRECT */
+    if(chidb_Pager_setDirectIO(pg, true) == CHIDB_OK)
+    {
+        for(int j=1; j<=MAXPAGES; j++)
+        {
+            chidb_Pager_allocatePage(pg, &npage);
+            chidb_Pager_readPage(pg, npage, &page);
+            for(int k=0; k<NVALUES; k++)
+                page->data[pagepos[k]*4] = values[(k + j) % NVALUES];
+            chidb_Pager_writePage(pg, page);
+            chidb_Pager_releaseMemPage(pg, page);
+        }
+        rc = chidb_Pager_flush(pg);
+        ck_assert(rc == CHIDB_OK);
+        chidb_Pager_close(pg);
+
+        rc = chidb_Pager_open(&pg, fname);
+        ck_assert(rc == CHIDB_OK);
+        chidb_Pager_setPageSize(pg, PAGE_SIZE * 4);
+        rc = chidb_Pager_setDirectIO(pg, true);
+        ck_assert(rc == CHIDB_OK);
+        ck_assert_int_eq(pg->n_pages, MAXPAGES);
+
+        for(int j=1; j<=MAXPAGES; j++)
+        {
+            rc = chidb_Pager_readPage(pg, j, &page);
+            ck_assert(rc == CHIDB_OK);
+            for(int k=0; k<NVALUES; k++)
+                if(page->data[pagepos[k]*4] != values[(k + j) % NVALUES])
+                {
+                    ck_abort_msg("Incorrect value read from page");
+                    break;
+                }
+            chidb_Pager_releaseMemPage(pg, page);
+        }
+    }
+
+    chidb_Pager_close(pg);
+    delete_tmp_file(fname);
+}
+END_TEST
+
+
+/* Copy a file as it is on disk, as if we had crashed */
+static void copy_file(const char *from, const char *to)
+{
+    FILE *fromf, *tof;
+    char buf[1024];
+    size_t n;
+
+    fromf = fopen(from, "rb");
+    tof = fopen(to, "wb");
+    ck_assert(fromf != NULL && tof != NULL);
+    while((n = fread(buf, 1, sizeof(buf), fromf)) > 0)
+        fwrite(buf, 1, n, tof);
+    fclose(fromf);
+    fclose(tof);
+}
+
+static char *wal_file(const char *fname)
+{
+    char *f = malloc(strlen(fname) + 5);
+    sprintf(f, "%s-wal", fname);
+
+    return f;
+}
+
+static void check_wal_pages(const char *fname, int nnew)
+{
+    int rc;
+    Pager *pg;
+    MemPage *page;
+
+    rc = chidb_Pager_open(&pg, fname);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setPageSize(pg, PAGE_SIZE);
+    ck_assert_int_eq(pg->n_pages, MAXPAGES);
+
+    for(int j=1; j<=MAXPAGES; j++)
+    {
+        int shift = j <= nnew ? 1 : 0;
+
+        chidb_Pager_readPage(pg, j, &page);
+        for(int k=0; k<NVALUES; k++)
+            if(page->data[pagepos[k]] != values[(k + shift) % NVALUES])
+            {
+                ck_abort_msg("Incorrect value read from page");
+                break;
+            }
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+
+    chidb_Pager_close(pg);
+}
+
+START_TEST (test_wal)
+{
+    int rc;
+    npage_t npage;
+    Pager *pg;
+    MemPage *page;
+    struct stat st;
+
+    char *fname = create_tmp_file();
+    char *wname = wal_file(fname);
+    char *copy1 = create_tmp_file(), *copy1_wal = wal_file(copy1);
+    char *copy2 = create_tmp_file(), *copy2_wal = wal_file(copy2);
+
+    rc = chidb_Pager_open(&pg, fname);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setPageSize(pg, PAGE_SIZE);
+
+    for(int j=1; j<=MAXPAGES; j++)
+    {
+        chidb_Pager_allocatePage(pg, &npage);
+        chidb_Pager_readPage(pg, npage, &page);
+        for(int k=0; k<NVALUES; k++)
+            page->data[pagepos[k]] = values[k];
+        chidb_Pager_writePage(pg, page);
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+    rc = chidb_Pager_flush(pg);
+    ck_assert(rc == CHIDB_OK);
+
+    /* Committed pages are in the log, not in the database file */
+    ck_assert_int_eq(pg->wal->n_committed, MAXPAGES);
+    stat(fname, &st);
+    ck_assert_int_eq(st.st_size, 0);
+
+    /* A second batch, which only changes the first pages */
+    for(int j=1; j<=3; j++)
+    {
+        chidb_Pager_readPage(pg, j, &page);
+        for(int k=0; k<NVALUES; k++)
+            page->data[pagepos[k]] = values[(k + 1) % NVALUES];
+        chidb_Pager_writePage(pg, page);
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+    rc = chidb_Pager_flush(pg);
+    ck_assert(rc == CHIDB_OK);
+    ck_assert_int_eq(pg->wal->n_committed, MAXPAGES + 3);
+
+    /* Crash now. In the second copy, the commit frame of the second batch
+     * is torn, so only the first batch survives. */
+    copy_file(fname, copy1);
+    copy_file(wname, copy1_wal);
+    copy_file(fname, copy2);
+    copy_file(wname, copy2_wal);
+    stat(copy2_wal, &st);
+    truncate(copy2_wal, st.st_size - 1);
+
+    check_wal_pages(copy1, 3);
+    check_wal_pages(copy2, 0);
+
+    /* Closing checkpoints the log into the database file and removes it */
+    ck_assert(access(copy1_wal, F_OK) != 0);
+    stat(copy1, &st);
+    ck_assert_int_eq(st.st_size, MAXPAGES * PAGE_SIZE);
+
+    chidb_Pager_close(pg);
+    ck_assert(access(wname, F_OK) != 0);
+    check_wal_pages(fname, 3);
+
+    delete_tmp_file(copy1);
+    delete_tmp_file(copy2);
+    delete_tmp_file(fname);
+    free(copy1_wal);
+    free(copy2_wal);
+    free(wname);
+}
+END_TEST
+
+START_TEST (test_wal_stale_frames)
+{
+    int rc;
+    npage_t npage;
+    Pager *pg;
+    MemPage *page;
+    int fd;
+    size_t frame_size = WAL_FRAME_HEADER_SIZE + PAGE_SIZE;
+    off_t stale_offset = WAL_HEADER_SIZE + MAXPAGES * frame_size;
+    uint8_t *stale = malloc(2 * frame_size);
+
+    char *fname = create_tmp_file();
+    char *wname = wal_file(fname);
+    char *copy1 = create_tmp_file(), *copy1_wal = wal_file(copy1);
+    char *copy2 = create_tmp_file(), *copy2_wal = wal_file(copy2);
+
+    rc = chidb_Pager_open(&pg, fname);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setPageSize(pg, PAGE_SIZE);
+    chidb_Pager_setCacheSize(pg, 1);
+
+    for(int j=1; j<=MAXPAGES; j++)
+    {
+        chidb_Pager_allocatePage(pg, &npage);
+        chidb_Pager_readPage(pg, npage, &page);
+        for(int k=0; k<NVALUES; k++)
+            page->data[pagepos[k]] = values[k];
+        chidb_Pager_writePage(pg, page);
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+    rc = chidb_Pager_flush(pg);
+    ck_assert(rc == CHIDB_OK);
+
+    /* A batch that changes pages 1 and 2, evicted to the log, and is
+     * rolled back. Its frames stay in the log. */
+    for(int j=1; j<=3; j++)
+    {
+        chidb_Pager_readPage(pg, j, &page);
+        for(int k=0; k<NVALUES; k++)
+            page->data[pagepos[k]] = values[(k + 2) % NVALUES];
+        if(j < 3)
+            chidb_Pager_writePage(pg, page);
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+    ck_assert_int_eq(pg->wal->n_frames, MAXPAGES + 2);
+    rc = chidb_Pager_rollback(pg);
+    ck_assert(rc == CHIDB_OK);
+
+    fd = open(wname, O_RDONLY);
+    ck_assert(pread(fd, stale, 2 * frame_size, stale_offset) == 2 * frame_size);
+    close(fd);
+
+    /* The next batch changes pages 1 to 3, and overwrites its first
+     * frame before it is committed */
+    for(int j=1; j<=4; j++)
+    {
+        chidb_Pager_readPage(pg, j == 3 ? 1 : j == 4 ? 3 : j, &page);
+        for(int k=0; k<NVALUES; k++)
+            page->data[pagepos[k]] = values[(k + (j == 1 ? 3 : 1)) % NVALUES];
+        chidb_Pager_writePage(pg, page);
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+    rc = chidb_Pager_flush(pg);
+    ck_assert(rc == CHIDB_OK);
+    ck_assert_int_eq(pg->wal->n_committed, MAXPAGES + 3);
+
+    /* Crash now. In the second copy, the commit frame of the batch made
+     * it to disk, but its first two frames did not: the log still holds
+     * the frames of the batch that was rolled back. */
+    copy_file(fname, copy1);
+    copy_file(wname, copy1_wal);
+    copy_file(fname, copy2);
+    copy_file(wname, copy2_wal);
+    fd = open(copy2_wal, O_WRONLY);
+    ck_assert(pwrite(fd, stale, 2 * frame_size, stale_offset) == 2 * frame_size);
+    close(fd);
+
+    check_wal_pages(copy1, 3);
+    check_wal_pages(copy2, 0);
+
+    chidb_Pager_close(pg);
+
+    delete_tmp_file(copy1);
+    delete_tmp_file(copy2);
+    delete_tmp_file(fname);
+    free(copy1_wal);
+    free(copy2_wal);
+    free(wname);
+    free(stale);
+}
+END_TEST
+
+
+START_TEST (test_rollback)
+{
+    int rc;
+    npage_t npage;
+    Pager *pg;
+    MemPage *page, *pinned;
+
+    char *fname = create_tmp_file();
+
+    rc = chidb_Pager_open(&pg, fname);
+    ck_assert(rc == CHIDB_OK);
+    chidb_Pager_setPageSize(pg, PAGE_SIZE);
+
+    for(int j=1; j<=MAXPAGES; j++)
+    {
+        chidb_Pager_allocatePage(pg, &npage);
+        chidb_Pager_readPage(pg, npage, &page);
+        for(int k=0; k<NVALUES; k++)
+            page->data[pagepos[k]] = values[k];
+        chidb_Pager_writePage(pg, page);
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+    rc = chidb_Pager_flush(pg);
+    ck_assert(rc == CHIDB_OK);
+
+    /* Change every page, with a cache small enough that the changes
+     * are evicted to the log, and allocate a few more pages */
+    chidb_Pager_setCacheSize(pg, 2);
+    chidb_Pager_readPage(pg, 1, &pinned);
+    for(int j=1; j<=MAXPAGES + 2; j++)
+    {
+        if(j > MAXPAGES)
+            chidb_Pager_allocatePage(pg, &npage);
+        chidb_Pager_readPage(pg, j, &page);
+        for(int k=0; k<NVALUES; k++)
+            page->data[pagepos[k]] = values[(k + 1) % NVALUES];
+        chidb_Pager_writePage(pg, page);
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+    ck_assert(pg->wal->n_frames > pg->wal->n_committed);
+
+    rc = chidb_Pager_rollback(pg);
+    ck_assert(rc == CHIDB_OK);
+    ck_assert_int_eq(pg->n_pages, MAXPAGES);
+    ck_assert_int_eq(pg->wal->n_frames, pg->wal->n_committed);
+
+    /* Pinned pages are restored in place */
+    ck_assert_int_eq(pinned->data[pagepos[0]], values[0]);
+    chidb_Pager_releaseMemPage(pg, pinned);
+
+    for(int j=1; j<=MAXPAGES; j++)
+    {
+        chidb_Pager_readPage(pg, j, &page);
+        for(int k=0; k<NVALUES; k++)
+            if(page->data[pagepos[k]] != values[k])
+            {
+                ck_abort_msg("Incorrect value read from page");
+                break;
+            }
+        chidb_Pager_releaseMemPage(pg, page);
+    }
+
+    chidb_Pager_close(pg);
+    check_wal_pages(fname, 0);
+
+    delete_tmp_file(fname);
+}
+END_TEST
+
 Suite* make_pager_suite (void)
 {
     Suite *s = suite_create ("Pager");
@@ -162,6 +870,28 @@ Suite* make_pager_suite (void)
     tcase_add_test (tc_readwrite, test_readwrite);
     suite_add_tcase (s, tc_readwrite);
 
+    TCase *tc_cache = tcase_create ("Buffer pool");
+    tcase_add_test (tc_cache, test_cache_pin);
+    tcase_add_test (tc_cache, test_cache_evict);
+    suite_add_tcase (s, tc_cache);
+
+    TCase *tc_mmap = tcase_create ("Memory-mapped file");
+    tcase_add_test (tc_mmap, test_mmap);
+    tcase_add_test (tc_mmap, test_mmap_checkpoint);
+    tcase_add_test (tc_mmap, test_mmap_rollback);
+    tcase_add_test (tc_mmap, test_mmap_grow);
+    suite_add_tcase (s, tc_mmap);
+
+    TCase *tc_directio = tcase_create ("Direct I/O");
+    tcase_add_test (tc_directio, test_directio);
+    suite_add_tcase (s, tc_directio);
+
+    TCase *tc_wal = tcase_create ("Write-ahead log");
+    tcase_add_test (tc_wal, test_wal);
+    tcase_add_test (tc_wal, test_rollback);
+    tcase_add_test (tc_wal, test_wal_stale_frames);
+    suite_add_tcase (s, tc_wal);
+
     return s;
 }
 